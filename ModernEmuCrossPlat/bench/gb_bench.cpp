@@ -0,0 +1,784 @@
+// gb_bench.cpp : Performance benchmarks for the emulator core. Every workload
+// is assembled here from source, so nothing copyrighted is needed to run it.
+//
+// usage: gb_bench [--quick] [--out results.json] [--filter text]
+//
+// Progress goes to stderr, the results are written as JSON to stdout or to
+// the --out file for trend tracking.
+
+#include "pch.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+#include "assembler.h"
+#include "disassembler.h"
+#include "fuzz_harness.h"
+#include "gameboy.h"
+#include "replay.h"
+#include "rewind.h"
+#include "rollback.h"
+#include "run_ahead.h"
+
+namespace
+{
+    // Workloads, assembled at startup. Each one parks the CPU in its loop
+    // forever, the benchmarks decide how long to run.
+
+    const char* const alu_source = R"(
+        TITLE "BENCH ALU"
+        ORG $150
+loop:   add a, b
+        adc a, c
+        sub d
+        xor e
+        and h
+        or l
+        inc b
+        dec c
+        rlca
+        cp $5A
+        add hl, de
+        inc de
+        swap a
+        cpl
+        inc a
+        jr loop
+)";
+
+    const char* const branch_source = R"(
+        TITLE "BENCH BRANCH"
+        ORG $150
+loop:   dec b
+        jr nz, .skip
+        inc c
+        inc c
+.skip:  bit 0, c
+        jr z, .even
+        nop
+.even:  call sub
+        jp loop
+
+sub:    ld a, c
+        and 3
+        ret z
+        dec c
+        ret
+)";
+
+    // 4KB ROM to WRAM copies, over and over
+    const char* const copy_source = R"(
+        TITLE "BENCH COPY"
+        ORG $150
+loop:   ld hl, $0000
+        ld de, $C000
+        ld bc, $1000
+.copy:  ld a, [hl+]
+        ld [de], a
+        inc de
+        dec bc
+        ld a, b
+        or c
+        jr nz, .copy
+        jr loop
+)";
+
+    // MBC1 bank switching in a loop, reading a byte from each bank
+    const char* const bank_switch_source = R"(
+        TITLE "BENCH BANKS"
+        CART $01
+        ORG $150
+loop:   ld b, 1
+.bank:  ld a, b
+        ld [$2000], a
+        ld a, [$4000]
+        add a, c
+        ld c, a
+        inc b
+        ld a, b
+        cp 8
+        jr nz, .bank
+        jr loop
+
+        BANK 7
+        db 7
+)";
+
+    // 2KB copies from ROM into VRAM with the LCD running
+    const char* const vram_copy_source = R"(
+        TITLE "BENCH VRAM"
+        ORG $150
+loop:   ld hl, $0000
+        ld de, $8000
+        ld bc, $0800
+.copy:  ld a, [hl+]
+        ld [de], a
+        inc de
+        dec bc
+        ld a, b
+        or c
+        jr nz, .copy
+        jr loop
+)";
+
+    // LCD on with background, window and sprites, from noise tiles the ROM
+    // generates itself. The CPU scrolls with LY and does arithmetic between.
+    const char* const render_source = R"(
+        TITLE "BENCH RENDER"
+LCDC    EQU $FF40
+SCX     EQU $FF43
+LY      EQU $FF44
+WY      EQU $FF4A
+WX      EQU $FF4B
+
+        ORG $150
+        di
+        xor a
+        ldh [LCDC], a
+
+        ; tiles and both maps, e = 5e + 1 is noise enough
+        ld hl, $8000
+        ld bc, $2000
+        ld e, 1
+.noise: ld a, e
+        add a, a
+        add a, a
+        add a, e
+        inc a
+        ld e, a
+        ld [hl+], a
+        dec bc
+        ld a, b
+        or c
+        jr nz, .noise
+
+        ; 40 sprites spread over the screen
+        ld hl, $FE00
+        ld bc, $1000
+        ld d, 40
+.oam:   ld a, b
+        add a, 23
+        ld b, a
+        and $7F
+        add a, 16
+        ld [hl+], a
+        ld a, c
+        add a, 17
+        ld c, a
+        ld [hl+], a
+        ld a, d
+        ld [hl+], a
+        and 3
+        swap a
+        ld [hl+], a
+        dec d
+        jr nz, .oam
+
+        ld a, $50
+        ldh [WY], a
+        ld a, $57
+        ldh [WX], a
+        ld a, $F3
+        ldh [LCDC], a
+
+loop:   ldh a, [LY]
+        ldh [SCX], a
+        add a, b
+        adc a, c
+        sub d
+        xor e
+        and h
+        or l
+        inc b
+        dec c
+        rlca
+        swap a
+        jr loop
+)";
+
+    // a frame of game logic then a spin on a flag the VBlank handler sets,
+    // the way most games wait for the next frame
+    const char* const vblank_wait_source = R"(
+        TITLE "BENCH IDLE"
+FLAG    EQU $FF80
+        ORG $40
+vblank: push af
+        ld a, 1
+        ldh [FLAG], a
+        pop af
+        reti
+
+        ORG $150
+        ld a, $01
+        ld [$FFFF], a
+        ei
+loop:   ld hl, $C000
+        ld b, 0
+.logic: ld a, [hl]
+        add a, b
+        ld [hl+], a
+        dec b
+        jr nz, .logic
+        xor a
+        ldh [FLAG], a
+.wait:  ldh a, [FLAG]
+        and a
+        jr z, .wait
+        jr loop
+)";
+
+    const std::vector<uint8_t> build(const char* const source)
+    {
+        const auto assembled = assemble(source);
+        for (const auto& error : assembled.errors)
+            std::cerr << "workload line " << error.line << ": " << error.message << std::endl;
+        if (!assembled.ok())
+            std::exit(1);
+        return assembled.rom;
+    }
+
+    struct Result
+    {
+        std::string name;
+        std::string unit;
+        double value;
+        uint64_t iterations;
+        double seconds;
+    };
+
+    struct Timing
+    {
+        uint64_t ops;
+        double seconds;
+    };
+
+    // calls batch, which returns how many operations it did, until at least
+    // min_seconds have passed
+    const Timing time_batches(const double min_seconds, const std::function<uint64_t()>& batch)
+    {
+        using clock = std::chrono::steady_clock;
+
+        uint64_t ops = 0;
+        const auto start = clock::now();
+        double elapsed = 0;
+        do
+        {
+            ops += batch();
+            elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        } while (elapsed < min_seconds);
+
+        return Timing{ ops, elapsed };
+    }
+
+    // keeps the optimiser from dropping reads nobody looks at
+    volatile uint64_t sink = 0;
+
+    const std::string escape(const std::string& text)
+    {
+        std::string out;
+        for (const char c : text)
+        {
+            if (c == '"' || c == '\\')
+                out += '\\';
+            out += c;
+        }
+        return out;
+    }
+
+    void write_json(std::ostream& out, const std::vector<Result>& results, const bool quick)
+    {
+        out << "{\n";
+        out << "  \"schema\": 1,\n";
+#if defined(__VERSION__)
+        out << "  \"compiler\": \"" << escape(__VERSION__) << "\",\n";
+#endif
+        out << "  \"quick\": " << (quick ? "true" : "false") << ",\n";
+        out << "  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const auto& result = results[i];
+            out << "    { \"name\": \"" << escape(result.name) << "\""
+                << ", \"unit\": \"" << escape(result.unit) << "\""
+                << ", \"value\": " << std::setprecision(6) << result.value
+                << ", \"iterations\": " << result.iterations
+                << ", \"seconds\": " << std::setprecision(4) << result.seconds << " }"
+                << ((i + 1 < results.size()) ? ",\n" : "\n");
+        }
+        out << "  ]\n";
+        out << "}\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = false;
+    std::string out_path;
+    std::string filter;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--quick")
+        {
+            quick = true;
+        }
+        else if (arg == "--out" && i + 1 < argc)
+        {
+            out_path = argv[++i];
+        }
+        else if (arg == "--filter" && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else
+        {
+            std::cerr << "usage: gb_bench [--quick] [--out results.json] [--filter text]" << std::endl;
+            return 1;
+        }
+    }
+
+    const double min_seconds = quick ? 0.02 : 1.0;
+    std::vector<Result> results;
+
+    // rate benchmarks report ops per second divided by scale
+    const auto rate = [&](const std::string& name, const std::string& unit, const double scale, const std::function<uint64_t()>& batch)
+    {
+        if (!filter.empty() && name.find(filter) == std::string::npos)
+            return;
+
+        const auto timing = time_batches(min_seconds, batch);
+        results.push_back({ name, unit, timing.ops / timing.seconds / scale, timing.ops, timing.seconds });
+        std::cerr << std::left << std::setw(32) << name << std::fixed << std::setprecision(2)
+            << results.back().value << " " << unit << std::endl;
+    };
+
+    // latency benchmarks report microseconds per op
+    const auto latency = [&](const std::string& name, const std::function<uint64_t()>& batch)
+    {
+        if (!filter.empty() && name.find(filter) == std::string::npos)
+            return;
+
+        const auto timing = time_batches(min_seconds, batch);
+        results.push_back({ name, "us", timing.seconds * 1e6 / timing.ops, timing.ops, timing.seconds });
+        std::cerr << std::left << std::setw(32) << name << std::fixed << std::setprecision(2)
+            << results.back().value << " us" << std::endl;
+    };
+
+    // bus, WRAM is the plain array path, the PPU registers go through the
+    // I/O page handler
+    {
+        GameBoy gb(build(alu_source));
+        auto& bus = gb.bus();
+
+        rate("bus/read_fast", "Mops/s", 1e6, [&]()
+        {
+            uint64_t sum = 0;
+            for (uint16_t i = 0; i < 0x2000; ++i)
+                sum += bus.read(static_cast<uint16_t>(0xC000 + i));
+            sink = sink + sum;
+            return uint64_t(0x2000);
+        });
+
+        rate("bus/read_handler", "Mops/s", 1e6, [&]()
+        {
+            uint64_t sum = 0;
+            for (uint16_t i = 0; i < 0x2000; ++i)
+                sum += bus.read(static_cast<uint16_t>(Ppu::LCDC + (i & 0x07)));
+            sink = sink + sum;
+            return uint64_t(0x2000);
+        });
+
+        rate("bus/write_fast", "Mops/s", 1e6, [&]()
+        {
+            for (uint16_t i = 0; i < 0x2000; ++i)
+                bus.write(static_cast<uint16_t>(0xC000 + i), static_cast<uint8_t>(i));
+            sink = sink + bus.peek(0xC123);
+            return uint64_t(0x2000);
+        });
+
+        rate("bus/write_handler", "Mops/s", 1e6, [&]()
+        {
+            for (uint16_t i = 0; i < 0x2000; ++i)
+                bus.write(Ppu::SCX, static_cast<uint8_t>(i));
+            sink = sink + gb.ppu().read(Ppu::SCX);
+            return uint64_t(0x2000);
+        });
+    }
+
+    // decoder over every opcode, CB page included
+    {
+        auto memory = make_shared<MemoryMap>();
+        GBZ80 cpu(memory);
+        for (size_t op = 0; op < 256; ++op)
+            memory->write(static_cast<uint16_t>(0x100 + op), static_cast<uint8_t>(op));
+        memory->write(0, 0xCB);
+
+        rate("decode/throughput", "Mdecodes/s", 1e6, [&]()
+        {
+            uint64_t sum = 0;
+            for (size_t op = 0; op < 256; ++op)
+                sum += cpu.decode_op(0x100, static_cast<uint8_t>(op)).length;
+            for (size_t op = 0; op < 256; ++op)
+            {
+                memory->write(1, static_cast<uint8_t>(op));
+                sum += cpu.decode_op(0, 0xCB).length;
+            }
+            sink = sink + sum;
+            return uint64_t(512);
+        });
+    }
+
+    // whole ROM listings, the disassembler against a line per byte swept
+    // through DecodedOpcode::tostring()
+    {
+        const auto rom = build(bank_switch_source);
+        rate("disasm/listing", "MB/s", 1e6, [&]()
+        {
+            Disassembler disassembler(rom);
+            disassembler.run();
+            sink = sink + disassembler.text(0).size();
+            return uint64_t(rom.size());
+        });
+
+        auto memory = make_shared<MemoryMap>();
+        for (size_t addr = 0; addr < 0x8000; ++addr)
+            memory->write(static_cast<uint16_t>(addr), rom[addr]);
+        GBZ80 cpu(memory);
+        rate("disasm/tostring", "MB/s", 1e6, [&]()
+        {
+            uint64_t size = 0;
+            for (size_t pc = 0; pc < 0x8000;)
+            {
+                const auto decoded = cpu.decode_op(static_cast<uint16_t>(pc), memory->peek(static_cast<uint16_t>(pc)));
+                size += decoded.tostring().size();
+                pc += std::max<size_t>(decoded.length, 1);
+            }
+            sink = sink + size;
+            return uint64_t(0x8000);
+        });
+    }
+
+    // interpreter, instructions per second on each synthetic workload
+    const std::pair<const char*, std::vector<uint8_t>> workloads[] = {
+        { "interp/alu", build(alu_source) },
+        { "interp/branch", build(branch_source) },
+        { "interp/copy", build(copy_source) },
+        { "interp/bank_switch", build(bank_switch_source) },
+        { "interp/vram_copy", build(vram_copy_source) },
+    };
+    // one step is one instruction only without loop fusion
+    for (const auto& [name, rom] : workloads)
+    {
+        GameBoy gb(rom);
+        gb.set_fuse_loops(false);
+        rate(name, "MIPS", 1e6, [&]()
+        {
+            for (size_t i = 0; i < 100000; ++i)
+                gb.step();
+            return uint64_t(100000);
+        });
+    }
+
+    // the same on the instrumented core, the difference is the cost of the
+    // opcode counters
+    for (const auto& [name, rom] : workloads)
+    {
+        InstrumentedGameBoy gb(rom);
+        gb.set_fuse_loops(false);
+        rate(std::string(name) + "_instrumented", "MIPS", 1e6, [&]()
+        {
+            for (size_t i = 0; i < 100000; ++i)
+                gb.step();
+            return uint64_t(100000);
+        });
+    }
+
+    // whole frames run from translated blocks or one step at a time, with
+    // nothing skipped or fused either way
+    for (const auto& [name, rom] : workloads)
+    {
+        for (const bool blocks : { true, false })
+        {
+            GameBoy gb(rom);
+            gb.set_fuse_loops(false);
+            gb.set_fast_forward(false);
+            if (blocks)
+                gb.set_block_cache(make_shared<BlockCache>(rom));
+            gb.run_frame();
+
+            rate(std::string("frame/") + (name + 7) + (blocks ? "_blocks" : "_stepped"), "fps", 1, [&]()
+            {
+                gb.run_frame();
+                return uint64_t(1);
+            });
+        }
+    }
+
+    // whole frames, with and without drawing
+    for (const bool render : { true, false })
+    {
+        GameBoy gb(build(render_source));
+        gb.set_render(render);
+        for (size_t i = 0; i < 4; ++i)
+            gb.run_frame();
+
+        rate(render ? "frame/render_on" : "frame/render_off", "fps", 1, [&]()
+        {
+            gb.run_frame();
+            return uint64_t(1);
+        });
+    }
+
+    // the same drawing, shown 1 and 2 frames ahead
+    for (const size_t ahead : { size_t(1), size_t(2) })
+    {
+        GameBoy gb(build(render_source));
+        RunAhead run_ahead(gb, ahead);
+        for (size_t i = 0; i < 4; ++i)
+            run_ahead.run_frame(0);
+
+        rate(ahead == 1 ? "frame/run_ahead_1" : "frame/run_ahead_2", "fps", 1, [&]()
+        {
+            sink = run_ahead.run_frame(0)[0];
+            return uint64_t(1);
+        });
+    }
+
+    // the same drawing, pushing every frame to rewind
+    {
+        GameBoy gb(build(render_source));
+        Rewind rewind(16 << 20);
+        for (size_t i = 0; i < 4; ++i)
+            gb.run_frame();
+
+        rate("frame/render_rewind", "fps", 1, [&]()
+        {
+            gb.run_frame();
+            rewind.push(gb);
+            return uint64_t(1);
+        });
+    }
+
+    // the same drawing, recording coverage, interpreted and from blocks
+    for (const bool blocks : { false, true })
+    {
+        const auto rom = build(render_source);
+        GameBoy gb(rom);
+        if (blocks)
+            gb.set_block_cache(make_shared<BlockCache>(rom));
+        gb.set_coverage(make_shared<Coverage>(rom));
+        for (size_t i = 0; i < 4; ++i)
+            gb.run_frame();
+
+        rate(blocks ? "frame/render_coverage_blocks" : "frame/render_coverage", "fps", 1, [&]()
+        {
+            gb.run_frame();
+            return uint64_t(1);
+        });
+    }
+
+    // fuzzing the same drawing, the reset alone and 8 frames of input
+    {
+        GameBoy gb(build(render_source));
+        for (size_t i = 0; i < 4; ++i)
+            gb.run_frame();
+
+        FuzzHarness::Options options;
+        options.frames_per_input = 1;
+        options.settle_frames = 0;
+        FuzzHarness harness(gb, options);
+        const std::vector<uint8_t> input{ 0, BUTTON_A, 0, BUTTON_START, 0, BUTTON_B, 0, 0 };
+        latency("fuzz/reset", [&]()
+        {
+            sink = sink + harness.run(input.data(), 0).cycles;
+            return uint64_t(1);
+        });
+        rate("fuzz/exec_8_frames", "exec/s", 1, [&]()
+        {
+            sink = sink + harness.run(input.data(), input.size()).cycles;
+            return uint64_t(1);
+        });
+    }
+
+    // copy loops run one instruction at a time or as bulk copies
+    for (const auto& [name, source] : { std::pair{ "copy", copy_source }, std::pair{ "vram_copy", vram_copy_source } })
+    {
+        for (const bool fuse : { true, false })
+        {
+            GameBoy gb(build(source));
+            gb.set_fuse_loops(fuse);
+            rate(std::string("frame/") + name + (fuse ? "_fused" : ""), "fps", 1, [&]()
+            {
+                gb.run_frame();
+                return uint64_t(1);
+            });
+        }
+    }
+
+    // a log of input to the same drawing, replayed without drawing, and
+    // seeking to the frame before a keyframe, the furthest it replays
+    {
+        GameBoy gb(build(render_source));
+        InputLog log(60);
+        {
+            Recorder recorder(gb, log);
+            for (size_t frame = 0; frame < 240; ++frame)
+            {
+                recorder.set_buttons(static_cast<uint8_t>((frame / 5) & 0x33));
+                recorder.run_frame();
+            }
+        }
+
+        GameBoy player(build(render_source));
+        player.set_render(false);
+        Replay replay(player, log);
+        rate("replay/frames", "fps", 1, [&]()
+        {
+            if (!replay.run_frame())
+                replay.seek(0);
+            return uint64_t(1);
+        });
+        latency("replay/seek_59_frames", [&]()
+        {
+            sink = sink + replay.seek(119);
+            return uint64_t(1);
+        });
+    }
+
+    // two linked machines on the same drawing, the remote player's buttons
+    // arriving 8 frames late and never what was guessed, so every frame
+    // rolls back 8 and runs them again before its own
+    {
+        const auto rom = build(render_source);
+        LoopbackTransport link(0);
+        RollbackSession session(rom, 0, link.side(0), 9);
+        const auto remote = [](const uint64_t frame) { return static_cast<uint8_t>((frame & 1) ? BUTTON_A : BUTTON_B); };
+        while (session.frame() < 8)
+            session.advance(0);
+
+        latency("rollback/advance_8_behind", [&]()
+        {
+            link.side(1).send(InputTransport::Input{ session.frame() - 8, remote(session.frame() - 8) });
+            sink = sink + session.advance(0);
+            return uint64_t(1);
+        });
+    }
+
+    // a game waiting for VBlank, spinning through the wait or skipping it
+    for (const bool fast_forward : { true, false })
+    {
+        GameBoy gb(build(vblank_wait_source));
+        gb.set_fast_forward(fast_forward);
+        for (size_t i = 0; i < 4; ++i)
+            gb.run_frame();
+
+        rate(fast_forward ? "frame/vblank_wait_ff" : "frame/vblank_wait", "fps", 1, [&]()
+        {
+            gb.run_frame();
+            return uint64_t(1);
+        });
+    }
+
+    // snapshot and restore of a running machine
+    {
+        GameBoy gb(build(render_source));
+        for (size_t i = 0; i < 4; ++i)
+            gb.run_frame();
+
+        auto snapshot = gb.snapshot();
+        latency("snapshot/save", [&]()
+        {
+            snapshot = gb.snapshot();
+            return uint64_t(1);
+        });
+        latency("snapshot/restore", [&]()
+        {
+            gb.restore(snapshot);
+            return uint64_t(1);
+        });
+
+        // paged, with 8 pages written in between
+        auto paged = gb.paged_snapshot();
+        auto& bus = gb.bus();
+        uint8_t n = 0;
+        latency("snapshot/paged_save", [&]()
+        {
+            ++n;
+            for (uint16_t page = 0; page < 8; ++page)
+                bus.write(static_cast<uint16_t>(0xC000 + page * 0x400 + n), n);
+            paged = gb.paged_snapshot();
+            return uint64_t(1);
+        });
+        latency("snapshot/paged_restore", [&]()
+        {
+            ++n;
+            for (uint16_t page = 0; page < 8; ++page)
+                bus.write(static_cast<uint16_t>(0xC000 + page * 0x400 + n), n);
+            gb.restore(paged);
+            return uint64_t(1);
+        });
+
+        // the same as a save state, into and out of a buffer
+        std::vector<uint8_t> state(gb.saved_size());
+        latency("state/save", [&]()
+        {
+            BufferSink out(state.data(), state.size());
+            sink = sink + gb.save(out);
+            return uint64_t(1);
+        });
+        latency("state/load", [&]()
+        {
+            BufferSource in(state.data(), state.size());
+            sink = sink + gb.load(in);
+            return uint64_t(1);
+        });
+
+        // a second machine to run on from here
+        latency("clone", [&]()
+        {
+            const auto clone = gb.clone();
+            sink = sink + clone->cycles();
+            return uint64_t(1);
+        });
+
+        // the state hash, after a step, after 8 pages written, and what
+        // hashing the bus whole each time would cost
+        latency("state_hash/step", [&]()
+        {
+            gb.step();
+            sink = sink + gb.state_hash();
+            return uint64_t(1);
+        });
+        latency("state_hash/8_pages", [&]()
+        {
+            ++n;
+            for (uint16_t page = 0; page < 8; ++page)
+                bus.write(static_cast<uint16_t>(0xC000 + page * 0x400 + n), n);
+            sink = sink + gb.state_hash();
+            return uint64_t(1);
+        });
+        latency("state_hash/whole_bus", [&]()
+        {
+            sink = sink + StateHash::bytes(bus.data() + 0x8000, 0x8000, 0);
+            return uint64_t(1);
+        });
+    }
+
+    if (out_path.empty())
+    {
+        write_json(std::cout, results, quick);
+    }
+    else
+    {
+        std::ofstream out(out_path);
+        if (!out.is_open())
+        {
+            std::cerr << "can't write " << out_path << std::endl;
+            return 1;
+        }
+        write_json(out, results, quick);
+    }
+
+    return 0;
+}
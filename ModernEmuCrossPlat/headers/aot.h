@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+// Code gbrecomp compiled ahead of time from one ROM, see tools/gbrecomp.cpp.
+// A block is straight line code from a jump target up to the next jump, call
+// or return. It runs each instruction through BasicGBZ80::run_op with the
+// rest of the machine ticked in between, so it ends in exactly the state
+// stepping would, and it stops early wherever step() would have to do
+// something else: an interrupt to service, a finished frame, a bank switch
+// under it.
+template<class Machine>
+struct AotBlock
+{
+    uint16_t bank;
+    uint16_t addr;
+    // the jump, call or return it ends with
+    uint16_t last;
+    size_t (*run)(Machine& gb);
+};
+
+template<class Machine>
+struct AotProgram
+{
+    // rom_hash() of the ROM it was compiled from
+    uint64_t rom_hash = 0;
+    const AotBlock<Machine>* blocks = nullptr;
+    size_t count = 0;
+};
+
+// FNV-1a over the whole ROM
+inline const uint64_t rom_hash(const std::vector<uint8_t>& rom)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (const uint8_t byte : rom)
+    {
+        hash ^= byte;
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
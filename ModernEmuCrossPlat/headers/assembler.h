@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+
+// A small two pass SM83 assembler. Instructions are matched against the
+// generated opcode tables, so it knows exactly what the decoder knows.
+//
+// Syntax, close to RGBDS where it matters:
+//   label:  .local:          globals, and locals scoped to the last global
+//   NAME EQU expr            constants, defined before use
+//   ORG expr / BANK n        placement, bank n > 0 sits at $4000-$7FFF
+//   DB / DW / DS n[, fill]   data, DB also takes "strings"
+//   TITLE "str" / CART expr / RAMSIZE expr   header fields
+//   ; comment
+// Expressions are numbers ($ff, 0xff, %1010, 255, 'c'), symbols, @ for the
+// current address and HIGH() / LOW(), joined with + and -. Memory operands
+// can use () or [].
+//
+// The header logo and checksums are always filled in. If nothing is placed
+// at the entry point it gets NOP; JP $0150.
+struct AssembledRom
+{
+    struct Error
+    {
+        size_t line;
+        std::string message;
+    };
+
+    struct Symbol
+    {
+        std::string name;
+        uint16_t bank;
+        uint16_t addr;
+    };
+
+    inline const bool ok() const
+    {
+        return errors.empty();
+    }
+
+    std::vector<uint8_t> rom;
+    std::vector<Symbol> symbols;
+    std::vector<Error> errors;
+};
+
+const AssembledRom assemble(const std::string& source);
+
+// symbols in the RGBDS .sym format, "bank:addr name" per line
+const std::string format_symbols(const AssembledRom& assembled);
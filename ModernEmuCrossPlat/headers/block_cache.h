@@ -0,0 +1,160 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "cartridge.h"
+#include "mapped_file.h"
+#include "recompiler.h"
+
+// Blocks of ROM code decoded once, as Recompiler::decode finds them, and run
+// from their opcodes afterwards: no fetch, no dispatch on the opcode byte and
+// no interrupt check between instructions that can't need one. The runtime
+// counterpart of gbrecomp for ROMs nobody compiled.
+//
+// A cache is for one ROM. save() writes it to a file of fixed size records
+// which load() maps straight back in, shared between every process that
+// maps it, so a restarted worker runs warm without translating anything.
+// The file carries the ROM's hash and build_id(), and a file from another
+// ROM or another decoder is ignored.
+//
+// One cache serves any number of machines running the ROM, on any threads,
+// see shared(). Lookups are a single atomic load. A block is never changed
+// or freed once it's published, nor is a mapped file unmapped, until the
+// cache goes, so a reader never waits and never sees a block change under
+// it. Translating and loading take a lock, which only writers see. Code in
+// RAM is never cached, it stays with the machine running it.
+class BlockCache
+{
+public:
+    // a block as it's kept, in memory and in the file
+    struct Block
+    {
+        // bit i set if instruction i may write the MBC
+        uint64_t stores;
+        uint16_t bank;
+        uint16_t addr;
+        uint16_t last;
+        // 0 if nothing at addr can be run as a block, so it's only tried once
+        uint8_t count;
+        uint8_t reserved;
+        std::array<uint8_t, Recompiler::max_block> ops;
+
+        inline const uint32_t key() const
+        {
+            return (static_cast<uint32_t>(bank) << 16) | addr;
+        }
+    };
+
+    static constexpr uint32_t format_version = 1;
+
+    explicit BlockCache(const std::vector<uint8_t>& rom);
+
+    // the process wide cache for rom, made on first use and kept for as
+    // long as anything holds it
+    static shared_ptr<BlockCache> shared(const std::vector<uint8_t>& rom);
+
+    BlockCache(const BlockCache&) = delete;
+    BlockCache& operator=(const BlockCache&) = delete;
+
+    // what a translated block depends on besides the ROM, a hash of the
+    // format, the recompiler's decode rules, the decoder's opcode tables and
+    // the commit it was built from
+    static const uint32_t build_id();
+
+    inline const uint64_t rom_hash() const
+    {
+        return m_rom_hash;
+    }
+
+    // the block at bank:addr, nullptr if it hasn't been translated
+    inline const Block* find(const size_t bank, const uint16_t addr) const
+    {
+        const size_t idx = index(bank, addr);
+        const Block* block = idx < m_index.size() ? m_index[idx].load(std::memory_order_acquire) : nullptr;
+        return (block && block->addr == addr) ? block : nullptr;
+    }
+
+    // Decodes and keeps the block at pc, as cpu's bus has bank mapped there.
+    // Decoding is done outside the lock, and if another thread published the
+    // block in the meantime that one is returned instead.
+    template<class Cpu>
+    const Block& translate(Cpu& cpu, const MemoryMap& bus, const uint16_t bank, const uint16_t pc)
+    {
+        const auto decoded = Recompiler::decode(cpu, bus, bank, pc);
+        Block block{};
+        block.bank = bank;
+        block.addr = pc;
+        block.last = decoded.last;
+        block.count = static_cast<uint8_t>(decoded.code.size());
+        for (size_t i = 0; i < decoded.code.size(); ++i)
+        {
+            block.ops[i] = decoded.code[i].op;
+            if (decoded.code[i].may_switch_bank)
+                block.stores |= uint64_t(1) << i;
+        }
+
+        std::lock_guard<std::mutex> lock(m_write);
+        if (const Block* found = find(bank, pc))
+            return *found;
+        m_translated.push_back(block);
+        publish(m_translated.back());
+        return m_translated.back();
+    }
+
+    // Maps a file save() wrote, its blocks taking over from any cached at
+    // the same bank:addr. Returns false, keeping what's cached, if it can't
+    // be read or is for another ROM or build.
+    bool load(const std::string& path);
+
+    // Every block, mapped and translated. Written next to path and renamed
+    // over it, so nobody maps half a file.
+    bool save(const std::string& path) const;
+
+    // blocks cached, and of those the ones translated here rather than
+    // loaded
+    inline const size_t size() const
+    {
+        return m_size.load(std::memory_order_relaxed);
+    }
+
+    inline const size_t translated() const
+    {
+        std::lock_guard<std::mutex> lock(m_write);
+        return m_translated.size();
+    }
+
+private:
+    struct FileHeader
+    {
+        std::array<char, 8> magic;
+        uint32_t version;
+        uint32_t build_id;
+        uint64_t rom_hash;
+        uint64_t count;
+    };
+
+    static constexpr std::array<char, 8> file_magic = { 'G', 'B', 'B', 'L', 'O', 'C', 'K', 'S' };
+
+    inline const size_t index(const size_t bank, const uint16_t addr) const
+    {
+        return bank * Cartridge::rom_bank_size + (addr & 0x3FFF);
+    }
+
+    // makes block the one found at its bank:addr, with m_write held
+    void publish(const Block& block);
+
+    uint64_t m_rom_hash;
+    // by bank * 0x4000 + (addr & 0x3FFF), addr tells $0000 from $4000
+    std::vector<std::atomic<const Block*>> m_index;
+    std::atomic<size_t> m_size;
+
+    // everything a published block can live in, kept until the cache goes
+    mutable std::mutex m_write;
+    std::deque<Block> m_translated;
+    std::vector<std::unique_ptr<MappedFile>> m_files;
+};
+
+static_assert(sizeof(BlockCache::Block) == 16 + Recompiler::max_block, "blocks are saved as they are");
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <vector>
+
+#include "ram.h"
+
+// ROM only and MBC1 cartridges. The bus reads the two visible ROM banks
+// straight from the ROM and the current RAM bank is copied into it on a bank
+// switch, so reads from the cartridge never go through a handler, only
+// writes to the MBC do.
+class Cartridge : public BusHandler
+{
+public:
+    static constexpr size_t rom_bank_size = 0x4000;
+    static constexpr size_t ram_bank_size = 0x2000;
+
+    // header fields, see pandocs "The Cartridge Header"
+    static constexpr uint16_t entry_addr = 0x100;
+    static constexpr uint16_t logo_addr = 0x104;
+    static constexpr uint16_t title_addr = 0x134;
+    static constexpr uint16_t type_addr = 0x147;
+    static constexpr uint16_t rom_size_addr = 0x148;
+    static constexpr uint16_t ram_size_addr = 0x149;
+    static constexpr uint16_t header_checksum_addr = 0x14D;
+    static constexpr uint16_t global_checksum_addr = 0x14E;
+    static constexpr uint16_t header_end = 0x150;
+
+    static const std::array<uint8_t, 48> nintendo_logo;
+
+    // MBC registers, plus every RAM bank. The bank currently mapped is only
+    // up to date in a saved state, while running it lives on the bus.
+    struct State
+    {
+        uint8_t bank1 = 1;
+        uint8_t bank2 = 0;
+        uint8_t mode = 0;
+        bool ram_enabled = false;
+        std::vector<uint8_t> ram;
+    };
+
+    explicit Cartridge(std::vector<uint8_t> rom);
+
+    // maps the MBC, bank 0 and bank 1, and copies RAM bank 0 into the bus
+    void attach(MemoryMap& bus);
+
+    // for a copy of this cartridge on a copy of its bus, which has the
+    // banks in place already: maps the MBC there. The copy shares the ROM.
+    void reattach(MemoryMap& bus);
+
+    const uint8_t read(const uint16_t location) override;
+
+    void write(const uint16_t location, const uint8_t val) override;
+
+    // the snapshot includes the mapped RAM bank, which lives on the bus
+    const State save_state() const;
+
+    void load_state(const State& state);
+
+    // The registers and RAM as they are, for save states which keep the bus
+    // too: the mapped RAM bank is stale here, it's on the bus. Loaded in
+    // place, then map_state() maps the ROM banks it selects.
+    inline const State& state() const
+    {
+        return m_state;
+    }
+
+    inline State& state()
+    {
+        return m_state;
+    }
+
+    void map_state();
+
+    // times the RAM bank on the bus was swapped for another, the only times
+    // the RAM off the bus changes while running
+    inline const uint64_t ram_swaps() const
+    {
+        return m_ram_swaps;
+    }
+
+    // the RAM bank on the bus, its copy in state() is the stale one
+    inline const size_t mapped_ram_bank() const
+    {
+        return m_mapped_ram_bank;
+    }
+
+    inline const bool has_mbc1() const
+    {
+        return m_mbc1;
+    }
+
+    inline const size_t rom_banks() const
+    {
+        return m_rom->size() / rom_bank_size;
+    }
+
+    inline const std::vector<uint8_t>& rom() const
+    {
+        return *m_rom;
+    }
+
+    // the ROM bank visible at location, 0 outside of ROM
+    inline const size_t bank_at(const uint16_t location) const
+    {
+        if (location < 0x4000)
+            return low_bank();
+        if (location < 0x8000)
+            return high_bank();
+        return 0;
+    }
+
+    static const uint8_t header_checksum(const std::vector<uint8_t>& rom);
+
+    static const uint16_t global_checksum(const std::vector<uint8_t>& rom);
+
+    // writes the logo and both checksums, pads the rom to a whole number of
+    // banks and sets the ROM size byte to match
+    static void fix_header(std::vector<uint8_t>& rom);
+
+private:
+    const size_t low_bank() const;
+
+    const size_t high_bank() const;
+
+    const size_t ram_bank() const;
+
+    void map_banks();
+
+    // copies the ROM banks selected into the bus, unless they're there
+    void map_rom();
+
+    shared_ptr<const std::vector<uint8_t>> m_rom;
+    bool m_mbc1;
+    size_t m_ram_banks;
+
+    State m_state;
+    size_t m_mapped_ram_bank;
+    size_t m_mapped_low_bank;
+    size_t m_mapped_high_bank;
+    uint64_t m_ram_swaps;
+    MemoryMap* m_bus;
+};
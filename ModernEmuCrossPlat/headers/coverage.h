@@ -0,0 +1,136 @@
+#pragma once
+
+#include <vector>
+
+#include "cartridge.h"
+#include "profiler.h"
+
+class Disassembler;
+
+// Which ROM bytes ran, bank by bank, and which jumps, calls, returns and
+// interrupts went from where to where, with how often. For a machine to
+// keep up to date while it runs, see set_coverage().
+//
+// The machine only reports where straight line code ends: a jump, or an
+// interrupt taken, or the end of a translated block. The bytes from where
+// the code was jumped to up to there are marked then, and the edge counted,
+// so the cost is per basic block, not per instruction. A jump of 1 to 3
+// bytes forward looks like falling through and isn't an edge, and what it
+// skips counts as run. Code running outside ROM isn't marked, though jumps
+// to and from it are counted, as bank 0.
+//
+// Not thread safe, one machine at a time.
+class Coverage
+{
+public:
+    struct Edge
+    {
+        GuestAddr from;
+        GuestAddr to;
+        uint64_t count;
+    };
+
+    static constexpr uint32_t format_version = 1;
+
+    explicit Coverage(const std::vector<uint8_t>& rom);
+
+    inline const uint64_t rom_hash() const
+    {
+        return m_rom_hash;
+    }
+
+    inline const size_t banks() const
+    {
+        return m_banks;
+    }
+
+    // where the machine is now, the start of the next run of code
+    inline void start(const uint16_t pc)
+    {
+        m_run = pc;
+    }
+
+    // the CPU ran the instruction at last and is now at next
+    inline void arrive(const Cartridge& cartridge, const uint16_t last, const uint16_t next)
+    {
+        if (static_cast<uint16_t>(next - last - 1) > 2) [[unlikely]]
+            jumped(cartridge, last, next);
+    }
+
+    // an interrupt was taken from pc, before the instruction there ran
+    void interrupted(const Cartridge& cartridge, const uint16_t pc, const uint16_t vector);
+
+    // true if the ROM byte at bank:addr ran
+    inline const bool ran(const size_t bank, const uint16_t addr) const
+    {
+        const size_t offset = bank * Cartridge::rom_bank_size + (addr & 0x3FFF);
+        return bank < m_banks && ((m_bytes[offset / 64] >> (offset % 64)) & 1) != 0;
+    }
+
+    // ROM bytes that ran, in one bank or in all of them
+    const size_t bytes_run(const size_t bank) const;
+
+    const size_t bytes_run() const;
+
+    inline const size_t edge_count() const
+    {
+        return m_edge_count;
+    }
+
+    // every edge, by from then to
+    const std::vector<Edge> edges() const;
+
+    void clear();
+
+    // A header, a bit per ROM byte and 16 bytes per edge. merge() adds one
+    // to what's here, false if it's for another ROM or can't be read.
+    bool write(std::ostream& out) const;
+
+    bool merge(std::istream& in);
+
+    // The listing, a mark before each line: * ran, ! ran but the
+    // disassembler took it for data, blank didn't run. The edges out of an
+    // instruction follow it, and each bank starts with how much of it ran.
+    void write_report(std::ostream& out, const Disassembler& listing) const;
+
+private:
+    struct FileHeader
+    {
+        std::array<char, 8> magic;
+        uint32_t version;
+        uint32_t banks;
+        uint64_t rom_hash;
+        uint64_t edges;
+    };
+
+    struct Slot
+    {
+        uint64_t key;
+        uint64_t count;
+    };
+
+    static constexpr std::array<char, 8> file_magic = { 'G', 'B', 'C', 'O', 'V', 'E', 'R', 0 };
+    static constexpr uint64_t empty_key = ~uint64_t(0);
+
+    void jumped(const Cartridge& cartridge, const uint16_t last, const uint16_t next);
+
+    // marks the ROM bytes from m_run up to end
+    void mark(const Cartridge& cartridge, const uint16_t end);
+
+    void add_edge(const uint64_t key, const uint64_t count);
+
+    static inline const uint32_t location(const Cartridge& cartridge, const uint16_t pc)
+    {
+        return GuestAddr{ static_cast<uint16_t>(pc < 0x8000 ? cartridge.bank_at(pc) : 0), pc }.key();
+    }
+
+    uint64_t m_rom_hash;
+    size_t m_banks;
+    // a bit per ROM byte, by offset
+    std::vector<uint64_t> m_bytes;
+    uint16_t m_run;
+
+    // open addressing on from << 32 | to, never more than half full
+    std::vector<Slot> m_edges;
+    size_t m_edge_count;
+};
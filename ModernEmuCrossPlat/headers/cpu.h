@@ -3,6 +3,9 @@
 #include "utils.h"
 
 #include "ram.h"
+#include "registers.h"
+#include "operands.h"
+#include "opcode_stats.h"
 
 
 union Opcode
@@ -63,1076 +66,301 @@ inline const std::string op_group_to_str(const OpcodeGroup group)
     }
 }
 
-class NamedVal
-{
-public:
-    virtual const char* name() const = 0;
-};
-
-template<class _InputT>
-class NoneVal : public NamedVal
-{
-public:
-
-    NoneVal() noexcept
-    {
-    }
-
-    NoneVal<_InputT>& operator=(NoneVal<_InputT>&& other)
-    {
-        other;
-        return *this;
-    }
-
-    NoneVal(Reg<_InputT>&& other) noexcept
-    {
-        *this = &other;
-    }
-
-    const char* name() const
-    {
-        return "";
-    }
-};
-
-template<class _InputT,
-    class = typename std::enable_if<std::is_same<_InputT, uint8_t>::value || std::is_same<_InputT, uint16_t>::value>>
-class Reg : public NamedVal
+struct DecodedOpcode
 {
-public:
-
-    Reg(_InputT* reg, const char* name) noexcept
-        : m_reg(reg)
-        , m_name(name)
+    DecodedOpcode(
+        const uint16_t& location,
+        const uint8_t& op,
+        const char* name,
+        const uint8_t& length,
+        const OpcodeGroup& group,
+        const size_t& min_timing,
+        const size_t& max_timing,
+        const uint8_t& flags,
+        const Operand& op1 = NoOperand(),
+        const Operand& op2 = NoOperand())
+        : location(location)
+        , op(op)
+        , prefixed(false)
+        , name(name)
+        , length(length)
+        , group(group)
+        , min_timing(min_timing)
+        , max_timing(max_timing)
+        , flags(flags)
+        , operandOne(op1)
+        , operandTwo(op2)
     {
     }
 
-    Reg() noexcept
-        : Reg(nullptr, nullptr)
-    {
-    }
+    const std::string tostring() const;
 
-    Reg<_InputT>& operator=(Reg<_InputT>&& other)
-    {
-        if (this != &other)
-        {
-            m_reg = other.m_reg;
-            m_name = other.m_name;
-
-            other.m_reg = nullptr;
-            other.m_name = nullptr;
-        }
-        return *this;
-    }
-
-    Reg(Reg<_InputT>&& other) noexcept
-        : Reg()
+    // 0 - Z, 1 - N, 2 - H, 3 - C, true when the instruction touches the flag
+    inline const bool GetFlag(const size_t& flag) const
     {
-        *this = std::move(other);
+        return ((flags >> flag) & 1) != 0;
     }
 
-    const char* name() const
+    inline const std::string GetOprand1Name() const
     {
-        return m_name;
+        return operand_name(operandOne);
     }
 
-    const _InputT read() const
+    inline const std::string GetOprand2Name() const
     {
-        return (*m_reg);
+        return operand_name(operandTwo);
     }
 
-    const bool writable() const
-    {
-        return m_reg != nullptr;
-    }
+    uint16_t location;
+    uint8_t op;
+    bool prefixed;
+    const char* name;
+    uint8_t length;
+    OpcodeGroup group;
+    size_t min_timing;
+    size_t max_timing;
+    uint8_t flags;
+    Operand operandOne;
+    Operand operandTwo;
+};
 
-    void write(const _InputT& val)
-    {
-        (*m_reg) = val;
-    }
+struct Nop
+{
+    static constexpr uint16_t length = 1;
+    static constexpr size_t   cycles = 4;
+};
 
-private:
-    _InputT* m_reg;
-    const char* m_name;
+// everything in the CPU but the memory, for snapshots
+struct CpuState
+{
+    RegisterFile r;
+    bool ime;
+    bool ime_pending;
+    bool halted;
+    bool halt_bug;
+    bool stopped;
 };
 
-template<class _InputT,
-    class = typename std::enable_if<std::is_same<_InputT, uint8_t>::value || std::is_same<_InputT, uint16_t>::value>>
-class Immidiate : public NamedVal
+// The SM83 core. Stats is an instrumentation policy from opcode_stats.h,
+// GBZ80 is the core without any.
+template<class Stats>
+class BasicGBZ80
 {
 public:
+    using State = CpuState;
 
-    Immidiate(const _InputT& val) noexcept
-        : m_val(val)
-    {
-    }
+    BasicGBZ80(shared_ptr<MemoryMap> ram);
 
-    Immidiate() noexcept
-        : Immidiate(static_cast<_InputT>(0))
-    {
-    }
-
-    Immidiate<_InputT>& operator=(Immidiate<_InputT>&& other)
-    {
-        if (this != &other)
-        {
-            m_val = other.m_val;
-        }
-
-        return *this;
-    }
-
-    Immidiate(Immidiate<_InputT>&& other) noexcept
-        : Immidiate()
-    {
-        *this = std::move(other);
-    }
-
-    const char* name() const
-    {
-        return itoa_base<_InputT, 16ull>(m_val);
-    }
-
-    const _InputT read() const
-    {
-        return m_val;
-    }
+    DecodedOpcode decode_op(const uint16_t location, uint8_t op);
 
-    const bool writable() const
-    {
-        return false;
-    }
+    // Runs a single instruction, or services an interrupt, and returns the
+    // number of clock cycles it took.
+    size_t step();
 
-    void write(const _InputT& val)
+    // Runs the instruction at pc as op without looking at it, for code
+    // gbrecomp generated from the ROM. Interrupts, HALT and a pending EI are
+    // left to step(), so the caller makes sure there are none. Needs
+    // cpu_exec.h.
+    template<uint8_t op>
+    inline size_t run_op()
     {
+        set_pc(static_cast<uint16_t>(get_pc() + 1));
+        const size_t cycles = execute<op>();
+        if constexpr (op != 0xCB)
+            m_stats.on_op(false, op, cycles);
+        return cycles;
     }
 
-private:
-    _InputT m_val;
-};
-
-template<class _InputRef,
-    class = typename std::enable_if<(std::is_same<_InputRef, Immidiate<uint16_t>>::value || std::is_same<_InputRef, Reg<uint16_t>>::value)>>
-class Address : public NamedVal
-{
-public:
-
-    Address(const _InputRef& addressLocation, std::shared_ptr<MemoryMap> ram) noexcept
-        : m_addressLocation(addressLocation)
-        , m_ram(ram)
+    // run_op for an op only known at run time, through the executor's table
+    inline size_t run_decoded(const uint8_t op)
     {
+        set_pc(static_cast<uint16_t>(get_pc() + 1));
+        const size_t cycles = (this->*s_op_table[op])();
+        if (op != 0xCB)
+            m_stats.on_op(false, op, cycles);
+        return cycles;
     }
 
-    Address() noexcept
-        : Address(_InputRef(), nullptr)
-    {
-    }
-
-    Address<_InputRef>& operator=(Address<_InputRef>&& other)
+    inline const uint8_t get_op_at_pc()
     {
-        if (this != &other)
-        {
-            m_addressLocation = std::move(other.m_addressLocation);
-            m_ram = std::move(other.m_ram);
-        }
-
-        return *this;
+        return m_ram->read(get_pc());
     }
 
-    Address(Address<_InputRef>&& other)
-        : Address()
+    inline const uint16_t get_pc()
     {
-        *this = std::move(other);
+        return r.get(R16::PC);
     }
 
-    const char* name() const
+    inline void set_pc(const uint16_t new_pc)
     {
-        return ("(" + string(m_addressLocation.name()) + ")");
+        r.set(R16::PC, new_pc);
     }
 
-    template<typename _InputT,
-        class = typename std::enable_if<std::is_same<_InputT, uint8_t>::value>>
-        const uint8_t read() const
+    inline const RegisterFile& registers() const
     {
-        return m_ram->read(m_addressLocation.read());
+        return r;
     }
 
-    template<typename _InputT,
-        class = typename std::enable_if<std::is_same<_InputT, uint16_t>::value>>
-        const uint16_t read()
+    inline RegisterFile& registers()
     {
-        return (static_cast<uint16_t>(m_ram->read(m_addressLocation.read())) << 8)
-            | static_cast<uint16_t>(m_ram->read(m_addressLocation.read() + 1ui16));
+        return r;
     }
 
-    const bool writable() const
+    inline const bool halted() const
     {
-        return true;
+        return m_halted;
     }
 
-    template<class _InputT,
-        class = typename std::enable_if<(std::is_same<_InputT, uint8_t>::value || std::is_same<_InputT, uint16_t>::value)>>
-        void write(const _InputT& val)
+    inline const bool interrupts_enabled() const
     {
-        if (std::is_same_v<_InputT, uint8_t>)
-            m_ram->write(m_addressLocation.read(), val);
-
-        if (std::is_same_v<_InputT, uint16_t>)
-        {
-            m_ram->write(m_addressLocation.read(), static_cast<uint8_t>(val >> 8) & 0xFFui8);
-            m_ram->write(m_addressLocation.read() + 1ui16, static_cast<uint8_t>(val & 0xFFui16));
-        }
+        return m_ime;
     }
 
-private:
-    _InputRef m_addressLocation;
-    std::shared_ptr<MemoryMap> m_ram;
-};
-
-
-class DecodedOpcode
-{
-public:
-
-    DecodedOpcode(
-        const uint16_t& location,
-        const uint8_t& op,
-        const std::string& name,
-        const std::string& extras,
-        const uint8_t& length,
-        const OpcodeGroup& group,
-        const size_t& timing,
-        const uint8_t& flags,
-        const NamedVal& op1,
-        const NamedVal& op2)
-        : location(location)
-        , op(op)
-        , name(name)
-        , extras(extras)
-        , length(length)
-        , group(group)
-        , min_timing(timing)
-        , max_timing(timing)
-        , flags({ flags })
-        , operandOne(op1)
-        , operandTwo(op2)
+    // EI was just run, IME goes on after the next instruction
+    inline const bool ime_pending() const
     {
+        return m_ime_pending;
     }
 
-    DecodedOpcode(
-        const uint16_t& location,
-        const uint8_t& op,
-        const std::string& name,
-        const std::string& extras,
-        const uint8_t& length,
-        const OpcodeGroup& group,
-        const size_t& timing,
-        const uint8_t& flags,
-        const NamedVal& op1)
-        : DecodedOpcode(
-            location,
-            op,
-            name,
-            extras,
-            length,
-            group,
-            timing,
-            flags,
-            op1,
-            NoneVal<uint8_t>())
+    // the next instruction is read twice, HALT ran with IME off and an
+    // interrupt already requested
+    inline const bool halt_bug() const
     {
+        return m_halt_bug;
     }
 
-    DecodedOpcode(
-        const uint16_t& location,
-        const uint8_t& op,
-        const std::string& name,
-        const std::string& extras,
-        const uint8_t& length,
-        const OpcodeGroup& group,
-        const size_t& timing,
-        const uint8_t& flags)
-        : DecodedOpcode(
-            location,
-            op,
-            name,
-            extras,
-            length,
-            group,
-            timing,
-            flags,
-            NoneVal<uint8_t>())
+    // set by STOP and by the illegal opcodes which hang the real CPU
+    inline const bool stopped() const
     {
+        return m_stopped;
     }
 
-    inline const std::string tostring() const
+    inline const State save_state() const
     {
-        std::stringstream str_stream;
-        str_stream << uint16_helper_hex.digits[location];
-        str_stream << " -- " << uint8_helper_hex.digits[op];
-        str_stream << " - " << name << " - ";
-        str_stream << " - " << uint8_helper_hex.digits[length] << " - ";
-        str_stream << " - " << extras << " - ";
-
-        if (flags.f.Z)
-            str_stream << "Z";
-        else
-            str_stream << "-";
-
-        if (flags.f.N)
-            str_stream << "N";
-        else
-            str_stream << "-";
-
-
-        if (flags.f.H)
-            str_stream << "H";
-        else
-            str_stream << "-";
-
-        if (flags.f.C)
-            str_stream << "C";
-        else
-            str_stream << "-";
-
-        if (m_val8One)
-            str_stream << " - U8_1 - " << m_val8One->tostring();
-        if (m_val8Two)
-            str_stream << " - U8_2 - " << m_val8Two->tostring();
-        if (m_val16One)
-            str_stream << " - U16_1 - " << m_val16One->tostring();
-        if (m_val16Two)
-            str_stream << " - U16_2 - " << m_val16Two->tostring();
-        if (m_sval8One)
-            str_stream << " - S8_1 - " << m_sval8One->tostring();
-
-        str_stream << " - MIN = " << min_timing;
-        str_stream << " - MAX = " << max_timing;
-
-        return str_stream.str();
+        return State{ r, m_ime, m_ime_pending, m_halted, m_halt_bug, m_stopped };
     }
 
-    inline const bool GetFlag(const size_t& flag) const
+    inline void load_state(const State& state)
     {
-        if (flag == 0)
-            return (flags.f.Z > 0);
-        if (flag == 1)
-            return (flags.f.N > 0);
-        if (flag == 2)
-            return (flags.f.H > 0);
-        if (flag == 3)
-            return (flags.f.C > 0);
+        r = state.r;
+        m_ime = state.ime;
+        m_ime_pending = state.ime_pending;
+        m_halted = state.halted;
+        m_halt_bug = state.halt_bug;
+        m_stopped = state.stopped;
     }
 
-    inline const std::string GetOprand1Name() const
+    inline Stats& stats()
     {
-        if (m_val8One)
-            return m_val8One->tostring();
-
-        if (m_val16One)
-            return m_val16One->tostring();
-
-        if (m_sval8One)
-            return m_sval8One->tostring();
-
-        return "";
+        return m_stats;
     }
 
-    inline const std::string GetOprand2Name() const
+    inline const Stats& stats() const
     {
-        if (m_val8Two)
-            return m_val8Two->tostring();
-
-        if (m_val16Two)
-            return m_val16Two->tostring();
-
-        return "";
+        return m_stats;
     }
 
 private:
-    uint16_t location;
-    uint8_t op;
-    const std::string name;
-    const std::string extras;
-    uint8_t length;
-    OpcodeGroup group;
-    size_t min_timing;
-    size_t max_timing;
-    union F {
-        uint8_t raw;
-        struct f {
-            uint8_t Z : 1;
-            uint8_t N : 1;
-            uint8_t H : 1;
-            uint8_t C : 1;
-            uint8_t remains : 4;
-        } f;
-    } flags;
-    NamedVal operandOne;
-    NamedVal operandTwo;
-};
-/*
-struct DecodedOpcode
-{
-    DecodedOpcode(
-        const uint16_t &location,
-        const uint8_t &op,
-        const std::string &name,
-        const std::string &extras,
-        const uint8_t &length,
-        const OpcodeGroup &group,
-        const size_t &timing,
-        const uint8_t &flags) :
-        DecodedOpcode(
-            location,
-            op,
-            name,
-            extras,
-            length,
-            group,
-            timing,
-            timing,
-            flags,
-            nullptr,
-            nullptr,
-            nullptr,
-            nullptr,
-            nullptr)
-    {}
-
-    DecodedOpcode(
-        const uint16_t& location,
-        const uint8_t& op,
-        const std::string& name,
-        const std::string& extras,
-        const uint8_t& length,
-        const OpcodeGroup& group,
-        const size_t& timing,
-        const uint8_t& flags,
-        shared_ptr<IReadWrite<uint8_t>> val8One,
-        shared_ptr<IReadWrite<uint8_t>> val8Two) :
-        DecodedOpcode(
-            location,
-            op,
-            name,
-            extras,
-            length,
-            group,
-            timing,
-            timing,
-            flags,
-            val8One,
-            val8Two,
-            nullptr,
-            nullptr,
-            nullptr)
-    {}
-
-    DecodedOpcode(
-        const uint16_t& location,
-        const uint8_t& op,
-        const std::string& name,
-        const std::string& extras,
-        const uint8_t& length,
-        const OpcodeGroup& group,
-        const size_t& timing,
-        const uint8_t& flags,
-        shared_ptr<IReadWrite<uint8_t>> val8One) :
-        DecodedOpcode(
-            location,
-            op,
-            name,
-            extras,
-            length,
-            group,
-            timing,
-            timing,
-            flags,
-            val8One,
-            nullptr,
-            nullptr,
-            nullptr,
-            nullptr)
-    {}
-
-    DecodedOpcode(
-        const uint16_t& location,
-        const uint8_t& op,
-        const std::string& name,
-        const std::string& extras,
-        const uint8_t& length,
-        const OpcodeGroup& group,
-        const size_t& timing,
-        const uint8_t& flags,
-        shared_ptr<IReadWrite<int8_t>> sval8One) :
-        DecodedOpcode(
-            location,
-            op,
-            name,
-            extras,
-            length,
-            group,
-            timing,
-            timing,
-            flags,
-            nullptr,
-            nullptr,
-            nullptr,
-            nullptr,
-            sval8One)
-    {}
-
-    DecodedOpcode(
-        const uint16_t& location,
-        const uint8_t& op,
-        const std::string& name,
-        const std::string& extras,
-        const uint8_t& length,
-        const OpcodeGroup& group,
-        const size_t& timing,
-        const uint8_t& flags,
-        shared_ptr<IReadWrite<uint16_t>> val16One,
-        shared_ptr<IReadWrite<uint16_t>> val16Two) :
-        DecodedOpcode(
-            location,
-            op,
-            name,
-            extras,
-            length,
-            group,
-            timing,
-            timing,
-            flags,
-            nullptr,
-            nullptr,
-            val16One,
-            val16Two,
-            nullptr)
-    {}
+    using OpHandler = size_t(BasicGBZ80::*)();
 
-    DecodedOpcode(
-        const uint16_t& location,
-        const uint8_t& op,
-        const std::string& name,
-        const std::string& extras,
-        const uint8_t& length,
-        const OpcodeGroup& group,
-        const size_t& timing,
-        const uint8_t& flags,
-        shared_ptr<IReadWrite<uint16_t>> val16One) :
-        DecodedOpcode(
-            location,
-            op,
-            name,
-            extras,
-            length,
-            group,
-            timing,
-            timing,
-            flags,
-            nullptr,
-            nullptr,
-            val16One,
-            nullptr,
-            nullptr)
-    {}
-
-    DecodedOpcode(
-        const uint16_t& location,
-        const uint8_t& op,
-        const std::string& name,
-        const std::string& extras,
-        const uint8_t& length,
-        const OpcodeGroup& group,
-        const size_t& min_timing,
-        const size_t& max_timing,
-        const uint8_t& flags,
-        shared_ptr<IReadWrite<uint8_t>> val8One,
-        shared_ptr<IReadWrite<uint8_t>> val8Two)
-        : DecodedOpcode(
-            location,
-            op,
-            name,
-            extras,
-            length,
-            group,
-            min_timing,
-            max_timing,
-            flags,
-            val8One,
-            val8Two,
-            nullptr,
-            nullptr,
-            nullptr)
-    {}
-
-    DecodedOpcode(
-        const uint16_t& location,
-        const uint8_t& op,
-        const std::string& name,
-        const std::string& extras,
-        const uint8_t& length,
-        const OpcodeGroup& group,
-        const size_t& min_timing,
-        const size_t& max_timing,
-        const uint8_t& flags,
-        shared_ptr<IReadWrite<uint8_t>> val8One)
-        : DecodedOpcode(
-            location,
-            op,
-            name,
-            extras,
-            length,
-            group,
-            min_timing,
-            max_timing,
-            flags,
-            val8One,
-            nullptr,
-            nullptr,
-            nullptr,
-            nullptr)
-    {}
-
-    DecodedOpcode(
-        const uint16_t& location,
-        const uint8_t& op,
-        const std::string& name,
-        const std::string& extras,
-        const uint8_t& length,
-        const OpcodeGroup& group,
-        const size_t& min_timing,
-        const size_t& max_timing,
-        const uint8_t& flags,
-        shared_ptr<IReadWrite<int8_t>> sval8One)
-        : DecodedOpcode(
-            location,
-            op,
-            name,
-            extras,
-            length,
-            group,
-            min_timing,
-            max_timing,
-            flags,
-            nullptr,
-            nullptr,
-            nullptr,
-            nullptr,
-            sval8One)
-    {}
-
-    DecodedOpcode(
-        const uint16_t& location,
-        const uint8_t& op,
-        const std::string& name,
-        const std::string& extras,
-        const uint8_t& length,
-        const OpcodeGroup& group,
-        const size_t& min_timing,
-        const size_t& max_timing,
-        const uint8_t& flags,
-        shared_ptr<IReadWrite<uint16_t>> val16One,
-        shared_ptr<IReadWrite<uint16_t>> val16Two)
-        : DecodedOpcode(
-            location,
-            op,
-            name,
-            extras,
-            length,
-            group,
-            min_timing,
-            max_timing,
-            flags,
-            nullptr,
-            nullptr,
-            val16One,
-            val16Two,
-            nullptr)
-    {}
-
-    DecodedOpcode(
-        const uint16_t& location,
-        const uint8_t& op,
-        const std::string& name,
-        const std::string& extras,
-        const uint8_t& length,
-        const OpcodeGroup& group,
-        const size_t& min_timing,
-        const size_t& max_timing,
-        const uint8_t& flags,
-        shared_ptr<IReadWrite<uint16_t>> val16One)
-        : DecodedOpcode(
-            location,
-            op,
-            name,
-            extras,
-            length,
-            group,
-            min_timing,
-            max_timing,
-            flags,
-            nullptr,
-            nullptr,
-            val16One,
-            nullptr,
-            nullptr)
-    {}
-
-    DecodedOpcode(
-        const uint16_t& location,
-        const uint8_t& op,
-        const std::string& name,
-        const std::string& extras,
-        const uint8_t& length,
-        const OpcodeGroup& group,
-        const size_t& min_timing,
-        const size_t& max_timing,
-        const uint8_t& flags)
-        : DecodedOpcode(
-            location,
-            op,
-            name,
-            extras,
-            length,
-            group,
-            min_timing,
-            max_timing,
-            flags,
-            nullptr,
-            nullptr,
-            nullptr,
-            nullptr,
-            nullptr)
-    {}
-
-    DecodedOpcode(
-        const uint16_t &location,
-        const uint8_t &op,
-        const std::string &name,
-        const std::string& extras,
-        const uint8_t &length,
-        const OpcodeGroup &group,
-        const size_t &min_timing,
-        const size_t &max_timing,
-        const uint8_t &flags,
-        shared_ptr<IReadWrite<uint8_t>> val8One,
-        shared_ptr<IReadWrite<uint8_t>> val8Two,
-        shared_ptr<IReadWrite<uint16_t>> val16One,
-        shared_ptr<IReadWrite<uint16_t>> val16Two,
-        shared_ptr<IReadWrite<int8_t>> sval8One)
-        : location(location)
-        , op(op)
-        , name(name)
-        , extras(extras)
-        , length(length)
-        , group(group)
-        , min_timing(min_timing)
-        , max_timing(max_timing)
-        , flags({ flags })
-        , m_val8One(val8One)
-        , m_val8Two(val8Two)
-        , m_val16One(val16One)
-        , m_val16Two(val16Two)
-        , m_sval8One(sval8One)
-    {}
-
-    inline const std::string tostring() const
-    {
-        std::stringstream str_stream;
-        str_stream << uint16_helper_hex.digits[location];
-        str_stream << " -- " << uint8_helper_hex.digits[op];
-        str_stream << " - " << name << " - ";
-        str_stream << " - " << uint8_helper_hex.digits[length] << " - ";
-        str_stream << " - " << extras << " - ";
-
-        if (flags.f.Z)
-            str_stream << "Z";
-        else
-            str_stream << "-";
-
-        if (flags.f.N)
-            str_stream << "N";
-        else
-            str_stream << "-";
-
-
-        if (flags.f.H)
-            str_stream << "H";
-        else
-            str_stream << "-";
+    DecodedOpcode alu_op(const uint16_t location, Opcode opcode);
 
-        if (flags.f.C)
-            str_stream << "C";
-        else
-            str_stream << "-";
+    DecodedOpcode rot_op(const uint16_t location, Opcode opcode);
 
-        if (m_val8One)
-            str_stream << " - U8_1 - " << m_val8One->tostring();
-        if (m_val8Two)
-            str_stream << " - U8_2 - " << m_val8Two->tostring();
-        if (m_val16One)
-            str_stream << " - U16_1 - " << m_val16One->tostring();
-        if (m_val16Two)
-            str_stream << " - U16_2 - " << m_val16Two->tostring();
-        if (m_sval8One)
-            str_stream << " - S8_1 - " << m_sval8One->tostring();
+    DecodedOpcode perform_cb_op(const uint16_t location, uint8_t op);
 
-        str_stream << " - MIN = " << min_timing;
-        str_stream << " - MAX = " << max_timing;
+    template<size_t... ops>
+    static constexpr std::array<OpHandler, 256> make_op_table(std::index_sequence<ops...>);
 
-        return str_stream.str();
-    }
+    template<size_t... ops>
+    static constexpr std::array<OpHandler, 256> make_cb_op_table(std::index_sequence<ops...>);
 
-    inline const bool GetFlag(const size_t& flag) const
-    {
-        if (flag == 0)
-            return (flags.f.Z > 0);
-        if (flag == 1)
-            return (flags.f.N > 0);
-        if (flag == 2)
-            return (flags.f.H > 0);
-        if (flag == 3)
-            return (flags.f.C > 0);
-    }
+    template<uint8_t op>
+    size_t execute();
 
-    inline const std::string GetOprand1Name() const
-    {
-        if (m_val8One)
-            return m_val8One->tostring();
+    template<uint8_t op>
+    size_t execute_cb();
 
-        if (m_val16One)
-            return m_val16One->tostring();
+    template<uint8_t y, ReadOperand8 Src>
+    void alu(const Src& src);
 
-        if (m_sval8One)
-            return m_sval8One->tostring();
+    template<uint8_t y>
+    const uint8_t rot(uint8_t val);
 
-        return "";
-    }
+    size_t service_interrupts();
 
-    inline const std::string GetOprand2Name() const
+    inline const uint8_t fetch8()
     {
-        if (m_val8Two)
-            return m_val8Two->tostring();
-
-        if (m_val16Two)
-            return m_val16Two->tostring();
-
-        return "";
+        const uint16_t pc = r.get(R16::PC);
+        r.set(R16::PC, static_cast<uint16_t>(pc + 1));
+        return m_ram->read(pc);
     }
 
-    uint16_t location;
-    uint8_t op;
-    const std::string name;
-    const std::string extras;
-    uint8_t length;
-    OpcodeGroup group;
-    size_t min_timing;
-    size_t max_timing;
-    union F {
-        uint8_t raw;
-        struct f {
-            uint8_t Z : 1;
-            uint8_t N : 1;
-            uint8_t H : 1;
-            uint8_t C : 1;
-            uint8_t remains : 4;
-        } f;
-    } flags;
-
-    shared_ptr<IReadWrite<uint8_t>> m_val8One;
-    shared_ptr<IReadWrite<uint8_t>> m_val8Two;
-
-    shared_ptr<IReadWrite<uint16_t>> m_val16One;
-    shared_ptr<IReadWrite<uint16_t>> m_val16Two;
-
-    shared_ptr<IReadWrite<int8_t>> m_sval8One;
-};
-*/
-const std::string reg_r_names[] = { "B", "C", "D", "E", "H", "L", "A", "F" };
-
-inline const std::string get_r_name(const uint8_t idx)
-{
-    return reg_r_names[idx];
-}
-
-const std::string reg_rp_names[] = { "BC", "DE", "HL" };
-
-inline const std::string get_rp_name(const uint8_t idx)
-{
-    if (idx >= 0 && idx <= 2)
-        return reg_rp_names[idx];
-    else
-        return "SP";
-}
-
-inline const std::string get_rp2_name(const uint8_t idx)
-{
-    if (idx >= 0 && idx <= 2)
-        return reg_rp_names[idx];
-    else
-        return "AF";
-}
-
-const std::string cc_names[] = {"NZ", "Z", "NC", "C" };
-
-inline const std::string get_cc(const uint8_t idx)
-{
-    return cc_names[idx];
-}
-
-inline const std::string simple_itoa(const uint8_t idx)
-{
-    return itoa_16(idx);
-}
-
-inline const std::string itohex(const uint8_t val)
-{
-    return itoa_16(val);
-}
-
-struct Nop
-{
-    static constexpr uint16_t length = 1;
-    static constexpr size_t   cycles = 4;
-};
-
-class GBZ80
-{
-public:
-    GBZ80(shared_ptr<MemoryMap> ram);
-
-    DecodedOpcode decode_op(const uint16_t location, uint8_t op);
-
-    DecodedOpcode decode_op_latest(const uint16_t location, uint8_t op);
-
-    inline const uint8_t get_op_at_pc()
+    inline const uint16_t fetch16()
     {
-        return m_ram->read(PC);
+        const uint8_t lo = fetch8();
+        return static_cast<uint16_t>(lo | (fetch8() << 8));
     }
 
-    inline const uint16_t get_pc()
+    inline void push16(const uint16_t val)
     {
-        return PC;
+        const uint16_t sp = static_cast<uint16_t>(r.get(R16::SP) - 2);
+        r.set(R16::SP, sp);
+        m_ram->write(static_cast<uint16_t>(sp + 1), static_cast<uint8_t>(val >> 8));
+        m_ram->write(sp, static_cast<uint8_t>(val & 0xFF));
     }
 
-    inline void set_pc(const uint16_t new_pc)
+    inline const uint16_t pop16()
     {
-        PC = new_pc;
+        const uint16_t sp = r.get(R16::SP);
+        r.set(R16::SP, static_cast<uint16_t>(sp + 2));
+        return static_cast<uint16_t>(m_ram->read(sp) | (m_ram->read(static_cast<uint16_t>(sp + 1)) << 8));
     }
 
-private:
+    // r[idx] as used by the opcode tables, 6 is (HL)
+    static constexpr std::array<R8, 8> r_table = {
+        R8::B, R8::C, R8::D, R8::E, R8::H, R8::L, R8::A, R8::A };
 
-    DecodedOpcode alu_op(const uint16_t location, Opcode opcode);
-
-    DecodedOpcode rot_op(const uint16_t location, Opcode opcode);
+    // rp[idx] and rp2[idx], they only differ in the last slot
+    static constexpr std::array<R16, 4> rp_table = { R16::BC, R16::DE, R16::HL, R16::SP };
+    static constexpr std::array<R16, 4> rp2_table = { R16::BC, R16::DE, R16::HL, R16::AF };
 
-    DecodedOpcode perform_cb_op(const uint16_t location, uint8_t op);
-
-    inline shared_ptr<RegDirectOffset> get_r_and_offset(uint16_t offset, uint8_t idx)
-    {
-        if (idx <= 5)
-            return make_shared<RegDirectOffset>(offset, ref_u8[idx]);
-        else if (idx == 7)
-            return make_shared<RegDirectOffset>(offset, ref_u8[6]);
-        else
-        {
-            // TODO: Still need to figure out (HL)
-            // ERROR
-            //std::cout << "HOW DO WE HANDLE THIS!!!! - " << static_cast<int>(idx) << std::endl;
-            return make_shared<RegDirectOffset>(offset, nullptr);
-        }
-    }
-
-    inline shared_ptr<RegDirect<uint8_t>> get_r(uint8_t idx) const
+    static inline const Operand get_r(uint8_t idx)
     {
-        if (idx <= 6)
-            return ref_u8[idx];
-        //return RegDirect<uint8_t>(get_r_name(idx), &(r.u8_a[idx]));
-        else if (idx == 7)
-            return ref_u8[6];
-            //return RegDirect<uint8_t>(get_r_name(idx), &(r.u8_a[6]));
-        else
-        {
-            // TODO: Still need to figure out (HL)
-            // ERROR
-            //std::cout << "HOW DO WE HANDLE THIS!!!! - " << static_cast<int>(idx) << std::endl;
-            return nullptr;
-            //return RegDirect<uint8_t>(get_r_name(idx), nullptr);
-        }
+        if (idx == 6)
+            return RegAddress{ R16::HL, 0 };
+        return Reg8{ r_table[idx & 7] };
     }
 
-    inline shared_ptr<RegDirect<uint16_t>> get_rp(uint8_t idx) const
+    static inline const Operand get_rp(uint8_t idx)
     {
-        if (idx < 3)
-            return ref_u16[idx];
-        else
-            return ref_u16[5];
-        // something with (HL) I think?
+        return Reg16{ rp_table[idx & 3] };
     }
 
-    inline shared_ptr<RegDirect<uint16_t>> get_rp2(uint8_t idx) const
+    static inline const Operand get_rp2(uint8_t idx)
     {
-        return ref_u16[idx];
-        //return RegDirect<uint16_t>(get_rp2_name(idx), &(r.u16_a[idx]));
+        return Reg16{ rp2_table[idx & 3] };
     }
 
-    std::array<shared_ptr<RegDirect<uint16_t>>, 6> ref_u16;
-    std::array<shared_ptr<RegDirect<uint8_t>>, 8> ref_u8;
+    static const std::array<OpHandler, 256> s_op_table;
+    static const std::array<OpHandler, 256> s_cb_op_table;
 
-    union registers
-    {
-        struct u8_reg {
-            uint8_t B; // 0
-            uint8_t C; // 1
-            uint8_t D; // 2
-            uint8_t E; // 3
-            uint8_t H; // 4
-            uint8_t L; // 5
-            uint8_t A; // 6
-            union F_reg {
-                uint8_t v;
-                struct flags {
-                    uint8_t remains : 4;
-                    uint8_t C : 1;
-                    uint8_t H : 1;
-                    uint8_t N : 1;
-                    uint8_t Z : 1;
-                } flags;
-            } F; // 7
-        } u8;
-        struct {
-            uint8_t u8_a[8];
-            auto B() { return Reg(&(u8_a[0])); }
-            auto C() { return Reg(&(u8_a[1])); }
-            auto D() { return Reg(&(u8_a[2])); }
-            auto E() { return Reg(&(u8_a[3])); }
-            auto H() { return Reg(&(u8_a[4])); }
-            auto L() { return Reg(&(u8_a[5])); }
-            auto A() { return Reg(&(u8_a[6])); }
-            auto F() { return Reg(&(u8_a[7])); }
-        } ref_u8;
-        struct u16_reg {
-            uint16_t BC; // 0
-            uint16_t DE; // 1
-            uint16_t HL; // 2
-            uint16_t AF; // 3
-        } u16;
-        struct {
-            uint16_t u16_a[4];
-            auto BC() { return Reg(&(u16_a[0])); }
-            auto DE() { return Reg(&(u16_a[1])); }
-            auto HL() { return Reg(&(u16_a[2])); }
-            auto AF() { return Reg(&(u16_a[3])); }
-        } ref_u16;
-    } r;
+    RegisterFile r;
 
-    uint16_t SP;
-    uint16_t PC;
+    bool m_ime;
+    bool m_ime_pending;
+    bool m_halted;
+    bool m_halt_bug;
+    bool m_stopped;
 
     std::shared_ptr<MemoryMap> m_ram;
-};
 
+    [[no_unique_address]] Stats m_stats;
+};
 
+// both are built in cpu.cpp
+extern template class BasicGBZ80<NoStats>;
+extern template class BasicGBZ80<OpcodeStats>;
 
-// 0000 CHNZ
\ No newline at end of file
+using GBZ80 = BasicGBZ80<NoStats>;
+using InstrumentedGBZ80 = BasicGBZ80<OpcodeStats>;
@@ -0,0 +1,583 @@
+#pragma once
+
+#include "cpu.h"
+
+// The executor. Every opcode gets its own instantiation of execute<op>,
+// with the operands picked at compile time from the same x/y/z/p/q split
+// the decoder uses, so operand reads and writes inline to a register or a
+// bus access and no decoding happens at run time.
+//
+// Only cpu.cpp and the code gbrecomp generates include this, the rest of
+// the tree goes through step().
+
+namespace executor
+{
+    struct OpFields
+    {
+        uint8_t x, y, z, p, q;
+    };
+
+    constexpr OpFields fields(const uint8_t op)
+    {
+        const uint8_t y = static_cast<uint8_t>((op >> 3) & 7);
+        return { static_cast<uint8_t>(op >> 6), y, static_cast<uint8_t>(op & 7), static_cast<uint8_t>(y >> 1), static_cast<uint8_t>(y & 1) };
+    }
+
+    // r[idx] as an operand type, (HL) for 6
+    template<uint8_t idx>
+    constexpr auto r_operand()
+    {
+        if constexpr (idx == 6)
+            return RegAddress{ R16::HL, 0 };
+        else if constexpr (idx == 7)
+            return Reg8{ R8::A };
+        else
+            return Reg8{ static_cast<R8>(idx) };
+    }
+
+    // (BC), (DE), (HL+), (HL-)
+    template<uint8_t p>
+    constexpr RegAddress indirect_operand()
+    {
+        if constexpr (p == 0)
+            return { R16::BC, 0 };
+        else if constexpr (p == 1)
+            return { R16::DE, 0 };
+        else if constexpr (p == 2)
+            return { R16::HL, 1 };
+        else
+            return { R16::HL, -1 };
+    }
+
+    constexpr R16 rp(const uint8_t p)
+    {
+        return (p == 3) ? R16::SP : static_cast<R16>(p);
+    }
+
+    constexpr R16 rp2(const uint8_t p)
+    {
+        return static_cast<R16>(p);
+    }
+
+    // SP + e, as done by ADD SP, e and LD HL, SP + e
+    inline const uint16_t sp_plus(RegisterFile& r, const int8_t e)
+    {
+        const uint16_t sp = r.get(R16::SP);
+        const uint8_t ue = static_cast<uint8_t>(e);
+        r.set_flags(false, false, ((sp & 0xF) + (ue & 0xF)) > 0xF, ((sp & 0xFF) + ue) > 0xFF);
+        return static_cast<uint16_t>(sp + e);
+    }
+}
+
+template<class Stats>
+template<uint8_t y, ReadOperand8 Src>
+void BasicGBZ80<Stats>::alu(const Src& src)
+{
+    const uint8_t a = r.get(R8::A);
+    const uint8_t v = src.read(r, *m_ram);
+
+    if constexpr (y == 0 || y == 1)
+    {
+        // ADD, ADC
+        const unsigned carry = (y == 1 && r.flag(Flag::C)) ? 1 : 0;
+        const unsigned res = a + v + carry;
+        r.set(R8::A, static_cast<uint8_t>(res));
+        r.set_flags((res & 0xFF) == 0, false, ((a & 0xF) + (v & 0xF) + carry) > 0xF, res > 0xFF);
+    }
+    else if constexpr (y == 2 || y == 3 || y == 7)
+    {
+        // SUB, SBC, CP
+        const int carry = (y == 3 && r.flag(Flag::C)) ? 1 : 0;
+        const int res = a - v - carry;
+        if constexpr (y != 7)
+            r.set(R8::A, static_cast<uint8_t>(res));
+        r.set_flags((res & 0xFF) == 0, true, ((a & 0xF) - (v & 0xF) - carry) < 0, res < 0);
+    }
+    else if constexpr (y == 4)
+    {
+        // AND
+        const uint8_t res = a & v;
+        r.set(R8::A, res);
+        r.set_flags(res == 0, false, true, false);
+    }
+    else
+    {
+        // XOR, OR
+        const uint8_t res = (y == 5) ? (a ^ v) : (a | v);
+        r.set(R8::A, res);
+        r.set_flags(res == 0, false, false, false);
+    }
+}
+
+template<class Stats>
+template<uint8_t y>
+const uint8_t BasicGBZ80<Stats>::rot(uint8_t val)
+{
+    bool carry;
+    if constexpr (y == 0)
+    {
+        // RLC
+        carry = (val & 0x80) != 0;
+        val = static_cast<uint8_t>((val << 1) | (carry ? 1 : 0));
+    }
+    else if constexpr (y == 1)
+    {
+        // RRC
+        carry = (val & 1) != 0;
+        val = static_cast<uint8_t>((val >> 1) | (carry ? 0x80 : 0));
+    }
+    else if constexpr (y == 2)
+    {
+        // RL
+        carry = (val & 0x80) != 0;
+        val = static_cast<uint8_t>((val << 1) | (r.flag(Flag::C) ? 1 : 0));
+    }
+    else if constexpr (y == 3)
+    {
+        // RR
+        carry = (val & 1) != 0;
+        val = static_cast<uint8_t>((val >> 1) | (r.flag(Flag::C) ? 0x80 : 0));
+    }
+    else if constexpr (y == 4)
+    {
+        // SLA
+        carry = (val & 0x80) != 0;
+        val = static_cast<uint8_t>(val << 1);
+    }
+    else if constexpr (y == 5)
+    {
+        // SRA
+        carry = (val & 1) != 0;
+        val = static_cast<uint8_t>((val >> 1) | (val & 0x80));
+    }
+    else if constexpr (y == 6)
+    {
+        // SWAP
+        carry = false;
+        val = static_cast<uint8_t>((val << 4) | (val >> 4));
+    }
+    else
+    {
+        // SRL
+        carry = (val & 1) != 0;
+        val = static_cast<uint8_t>(val >> 1);
+    }
+
+    r.set_flags(val == 0, false, false, carry);
+    return val;
+}
+
+template<class Stats>
+template<uint8_t op>
+size_t BasicGBZ80<Stats>::execute()
+{
+    constexpr auto f = executor::fields(op);
+    MemoryMap& ram = *m_ram;
+
+    if constexpr (f.x == 0)
+    {
+        if constexpr (f.z == 0)
+        {
+            if constexpr (f.y == 0)
+            {
+                // NOP
+                return Nop::cycles;
+            }
+            else if constexpr (f.y == 1)
+            {
+                // LD (nn), SP
+                ImmAddress{ fetch16() }.write16(r, ram, r.get(R16::SP));
+                return 20;
+            }
+            else if constexpr (f.y == 2)
+            {
+                // STOP, the second byte is skipped
+                fetch8();
+                m_stopped = true;
+                return 4;
+            }
+            else
+            {
+                // JR d, JR cc[y-4], d
+                const int8_t e = static_cast<int8_t>(fetch8());
+                if constexpr (f.y > 3)
+                {
+                    if (!Condition{ static_cast<Cond>(f.y - 4) }.test(r))
+                        return 8;
+                }
+                set_pc(static_cast<uint16_t>(get_pc() + e));
+                return 12;
+            }
+        }
+        else if constexpr (f.z == 1)
+        {
+            if constexpr (f.q == 0)
+            {
+                // LD rp[p], nn
+                Reg16{ executor::rp(f.p) }.write16(r, ram, fetch16());
+                return 12;
+            }
+            else
+            {
+                // ADD HL, rp[p]
+                const uint16_t hl = r.get(R16::HL);
+                const uint16_t v = r.get(executor::rp(f.p));
+                const unsigned res = hl + v;
+                r.set(R16::HL, static_cast<uint16_t>(res));
+                r.set_flags(r.flag(Flag::Z), false, ((hl & 0xFFF) + (v & 0xFFF)) > 0xFFF, res > 0xFFFF);
+                return 8;
+            }
+        }
+        else if constexpr (f.z == 2)
+        {
+            constexpr auto mem = executor::indirect_operand<f.p>();
+            if constexpr (f.q == 0)
+                // LD (rr), A
+                mem.write(r, ram, r.get(R8::A));
+            else
+                // LD A, (rr)
+                r.set(R8::A, mem.read(r, ram));
+            return 8;
+        }
+        else if constexpr (f.z == 3)
+        {
+            // INC rp[p], DEC rp[p]
+            constexpr int delta = (f.q == 0) ? 1 : -1;
+            r.set(executor::rp(f.p), static_cast<uint16_t>(r.get(executor::rp(f.p)) + delta));
+            return 8;
+        }
+        else if constexpr (f.z == 4 || f.z == 5)
+        {
+            // INC r[y], DEC r[y]
+            constexpr auto target = executor::r_operand<f.y>();
+            const uint8_t v = target.read(r, ram);
+            if constexpr (f.z == 4)
+            {
+                const uint8_t res = static_cast<uint8_t>(v + 1);
+                target.write(r, ram, res);
+                r.set_flags(res == 0, false, (v & 0xF) == 0xF, r.flag(Flag::C));
+            }
+            else
+            {
+                const uint8_t res = static_cast<uint8_t>(v - 1);
+                target.write(r, ram, res);
+                r.set_flags(res == 0, true, (v & 0xF) == 0, r.flag(Flag::C));
+            }
+            return (f.y == 6) ? 12 : 4;
+        }
+        else if constexpr (f.z == 6)
+        {
+            // LD r[y], n
+            executor::r_operand<f.y>().write(r, ram, fetch8());
+            return (f.y == 6) ? 12 : 8;
+        }
+        else
+        {
+            const uint8_t a = r.get(R8::A);
+            if constexpr (f.y < 4)
+            {
+                // RLCA, RRCA, RLA, RRA, same as the CB versions but Z is always cleared
+                r.set(R8::A, rot<f.y>(a));
+                r.set_flag(Flag::Z, false);
+            }
+            else if constexpr (f.y == 4)
+            {
+                // DAA
+                uint8_t res = a;
+                bool carry = r.flag(Flag::C);
+                if (!r.flag(Flag::N))
+                {
+                    if (carry || res > 0x99)
+                    {
+                        res = static_cast<uint8_t>(res + 0x60);
+                        carry = true;
+                    }
+                    if (r.flag(Flag::H) || (res & 0x0F) > 0x09)
+                        res = static_cast<uint8_t>(res + 0x06);
+                }
+                else
+                {
+                    if (carry)
+                        res = static_cast<uint8_t>(res - 0x60);
+                    if (r.flag(Flag::H))
+                        res = static_cast<uint8_t>(res - 0x06);
+                }
+                r.set(R8::A, res);
+                r.set_flags(res == 0, r.flag(Flag::N), false, carry);
+            }
+            else if constexpr (f.y == 5)
+            {
+                // CPL
+                r.set(R8::A, static_cast<uint8_t>(~a));
+                r.set_flags(r.flag(Flag::Z), true, true, r.flag(Flag::C));
+            }
+            else if constexpr (f.y == 6)
+            {
+                // SCF
+                r.set_flags(r.flag(Flag::Z), false, false, true);
+            }
+            else
+            {
+                // CCF
+                r.set_flags(r.flag(Flag::Z), false, false, !r.flag(Flag::C));
+            }
+            return 4;
+        }
+    }
+    else if constexpr (f.x == 1)
+    {
+        if constexpr (f.y == 6 && f.z == 6)
+        {
+            // HALT, with IME off and an interrupt already pending the CPU
+            // does not halt and reads the next byte twice
+            const uint8_t pending = ram.read(IF_ADDR) & ram.read(IE_ADDR) & 0x1F;
+            if (!m_ime && pending != 0)
+                m_halt_bug = true;
+            else
+                m_halted = true;
+            return 4;
+        }
+        else
+        {
+            // LD r[y], r[z]
+            executor::r_operand<f.y>().write(r, ram, executor::r_operand<f.z>().read(r, ram));
+            return (f.y == 6 || f.z == 6) ? 8 : 4;
+        }
+    }
+    else if constexpr (f.x == 2)
+    {
+        // alu[y] r[z]
+        alu<f.y>(executor::r_operand<f.z>());
+        return (f.z == 6) ? 8 : 4;
+    }
+    else
+    {
+        if constexpr (f.z == 0)
+        {
+            if constexpr (f.y <= 3)
+            {
+                // RET cc[y]
+                if (!Condition{ static_cast<Cond>(f.y) }.test(r))
+                    return 8;
+                set_pc(pop16());
+                return 20;
+            }
+            else if constexpr (f.y == 4)
+            {
+                // LDH (n), A
+                HighImmAddress{ fetch8() }.write(r, ram, r.get(R8::A));
+                return 12;
+            }
+            else if constexpr (f.y == 5)
+            {
+                // ADD SP, d
+                r.set(R16::SP, executor::sp_plus(r, static_cast<int8_t>(fetch8())));
+                return 16;
+            }
+            else if constexpr (f.y == 6)
+            {
+                // LDH A, (n)
+                r.set(R8::A, HighImmAddress{ fetch8() }.read(r, ram));
+                return 12;
+            }
+            else
+            {
+                // LD HL, SP + d
+                r.set(R16::HL, executor::sp_plus(r, static_cast<int8_t>(fetch8())));
+                return 12;
+            }
+        }
+        else if constexpr (f.z == 1)
+        {
+            if constexpr (f.q == 0)
+            {
+                // POP rp2[p]
+                r.set(executor::rp2(f.p), pop16());
+                return 12;
+            }
+            else if constexpr (f.p == 0 || f.p == 1)
+            {
+                // RET, RETI
+                set_pc(pop16());
+                if constexpr (f.p == 1)
+                    m_ime = true;
+                return 16;
+            }
+            else if constexpr (f.p == 2)
+            {
+                // JP HL
+                set_pc(r.get(R16::HL));
+                return 4;
+            }
+            else
+            {
+                // LD SP, HL
+                r.set(R16::SP, r.get(R16::HL));
+                return 8;
+            }
+        }
+        else if constexpr (f.z == 2)
+        {
+            if constexpr (f.y <= 3)
+            {
+                // JP cc[y], nn
+                const uint16_t target = fetch16();
+                if (!Condition{ static_cast<Cond>(f.y) }.test(r))
+                    return 12;
+                set_pc(target);
+                return 16;
+            }
+            else if constexpr (f.y == 4)
+            {
+                // LD (C), A
+                HighCAddress{}.write(r, ram, r.get(R8::A));
+                return 8;
+            }
+            else if constexpr (f.y == 5)
+            {
+                // LD (nn), A
+                ImmAddress{ fetch16() }.write(r, ram, r.get(R8::A));
+                return 16;
+            }
+            else if constexpr (f.y == 6)
+            {
+                // LD A, (C)
+                r.set(R8::A, HighCAddress{}.read(r, ram));
+                return 8;
+            }
+            else
+            {
+                // LD A, (nn)
+                r.set(R8::A, ImmAddress{ fetch16() }.read(r, ram));
+                return 16;
+            }
+        }
+        else if constexpr (f.z == 3)
+        {
+            if constexpr (f.y == 0)
+            {
+                // JP nn
+                set_pc(fetch16());
+                return 16;
+            }
+            else if constexpr (f.y == 1)
+            {
+                // CB prefix, the table entries include the prefix cycles
+                const uint8_t cb = fetch8();
+                const size_t cycles = (this->*s_cb_op_table[cb])();
+                m_stats.on_op(true, cb, cycles);
+                return cycles;
+            }
+            else if constexpr (f.y == 6)
+            {
+                // DI
+                m_ime = false;
+                m_ime_pending = false;
+                return 4;
+            }
+            else if constexpr (f.y == 7)
+            {
+                // EI, takes effect after the next instruction
+                m_ime_pending = true;
+                return 4;
+            }
+            else
+            {
+                // illegal, hangs the CPU
+                m_stopped = true;
+                return 4;
+            }
+        }
+        else if constexpr (f.z == 4)
+        {
+            if constexpr (f.y <= 3)
+            {
+                // CALL cc[y], nn
+                const uint16_t target = fetch16();
+                if (!Condition{ static_cast<Cond>(f.y) }.test(r))
+                    return 12;
+                push16(get_pc());
+                set_pc(target);
+                return 24;
+            }
+            else
+            {
+                // illegal, hangs the CPU
+                m_stopped = true;
+                return 4;
+            }
+        }
+        else if constexpr (f.z == 5)
+        {
+            if constexpr (f.q == 0)
+            {
+                // PUSH rp2[p]
+                push16(r.get(executor::rp2(f.p)));
+                return 16;
+            }
+            else if constexpr (f.p == 0)
+            {
+                // CALL nn
+                const uint16_t target = fetch16();
+                push16(get_pc());
+                set_pc(target);
+                return 24;
+            }
+            else
+            {
+                // illegal, hangs the CPU
+                m_stopped = true;
+                return 4;
+            }
+        }
+        else if constexpr (f.z == 6)
+        {
+            // alu[y] n
+            alu<f.y>(Imm8{ fetch8() });
+            return 8;
+        }
+        else
+        {
+            // RST y*8
+            push16(get_pc());
+            set_pc(static_cast<uint16_t>(f.y * 8));
+            return 16;
+        }
+    }
+}
+
+template<class Stats>
+template<uint8_t op>
+size_t BasicGBZ80<Stats>::execute_cb()
+{
+    constexpr auto f = executor::fields(op);
+    constexpr auto target = executor::r_operand<f.z>();
+    MemoryMap& ram = *m_ram;
+
+    const uint8_t v = target.read(r, ram);
+
+    if constexpr (f.x == 0)
+    {
+        // rot[y] r[z]
+        target.write(r, ram, rot<f.y>(v));
+        return (f.z == 6) ? 16 : 8;
+    }
+    else if constexpr (f.x == 1)
+    {
+        // BIT y, r[z]
+        r.set_flags((v & (1 << f.y)) == 0, false, true, r.flag(Flag::C));
+        return (f.z == 6) ? 12 : 8;
+    }
+    else if constexpr (f.x == 2)
+    {
+        // RES y, r[z]
+        target.write(r, ram, static_cast<uint8_t>(v & ~(1 << f.y)));
+        return (f.z == 6) ? 16 : 8;
+    }
+    else
+    {
+        // SET y, r[z]
+        target.write(r, ram, static_cast<uint8_t>(v | (1 << f.y)));
+        return (f.z == 6) ? 16 : 8;
+    }
+}
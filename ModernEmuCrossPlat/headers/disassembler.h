@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+// Lists a whole ROM, bank by bank, telling code from data the way the
+// recompiler finds code: recursive descent from the entry point and the
+// interrupt vectors (see Recompiler). Bytes nothing reaches are listed as DB,
+// so jump tables, graphics and text don't come out as instructions. Past
+// bank $FF the bank is written with four digits.
+//
+//   01:4000  3E C0     LD A, $C0
+//   01:4002  E0 06     LDH ($FF06), A
+//   01:4004  18 FA     JR $4000
+//   01:4006  DB $00, $7E, $FF
+//
+// Finding the code is one pass over the ROM, it has to follow bank switches
+// from bank to bank. Listing is done a bank per thread after that, each into
+// a buffer sized up front: every opcode's line has a fixed length, so the
+// bank's size is known before a character is written.
+class Disassembler
+{
+public:
+    explicit Disassembler(std::vector<uint8_t> rom);
+
+    // Finds the code, then lists every bank on up to threads threads, 0 for
+    // one per core.
+    void run(const size_t threads = 0);
+
+    inline const size_t banks() const
+    {
+        return m_text.size();
+    }
+
+    // bank's listing, empty before run()
+    inline const std::string_view text(const size_t bank) const
+    {
+        return m_text[bank];
+    }
+
+    // true if offset in the ROM starts an instruction that was reached
+    inline const bool is_code(const size_t offset) const
+    {
+        return offset < m_code.size() && m_code[offset] != 0;
+    }
+
+    // instructions listed, and bytes listed as data
+    inline const size_t instructions() const
+    {
+        return m_instructions;
+    }
+
+    inline const size_t data_bytes() const
+    {
+        return m_data_bytes;
+    }
+
+    // every bank in order
+    void write(std::ostream& out) const;
+
+    // just marks where reached instructions start, for is_code(), run()
+    // does this first
+    void find_code();
+
+private:
+    // lists one bank into m_text[bank], returns its instruction count
+    const size_t list_bank(const size_t bank, size_t& data_bytes);
+
+    std::vector<uint8_t> m_rom;
+    // 1 for the first byte of a reached instruction, by ROM offset
+    std::vector<uint8_t> m_code;
+    std::vector<std::string> m_text;
+    size_t m_instructions;
+    size_t m_data_bytes;
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <unordered_map>
+
+#include "cpu.h"
+
+// Copy and fill loops run as one bulk copy or fill. Like IdleLoops, a loop
+// is picked up when its backward JR NZ is taken, and its decoded body is
+// matched against the idioms games use to clear memory and upload tiles:
+//
+//   ld a, [hl+] / ld [de], a / inc de / dec bc / ld a, b / or c / jr nz
+//   ld a, [hl+] / ld [de], a / inc de / dec b / jr nz
+//   ld [hl+], a / dec b / jr nz
+//
+// plus the DE to HL copies, ld [hl-], a fills and C counters. Each iteration
+// is fixed, so any number of them can be done at once and leave exactly the
+// registers, flags and memory the interpreter would.
+class FusedLoops
+{
+public:
+    enum class Kind : uint8_t
+    {
+        // BC counter, A and the flags from ld a, b / or c
+        Copy16,
+        // B or C counter, flags from dec
+        Copy8,
+        Fill8
+    };
+
+    struct Loop
+    {
+        bool fused = false;
+        Kind kind = Kind::Copy8;
+        // copies from (HL+) to (DE), or from (DE) to (HL+)
+        bool from_hl = true;
+        // fills go up with (HL+), down with (HL-)
+        int8_t direction = 1;
+        R8 counter = R8::B;
+        uint16_t head = 0;
+        uint16_t exit = 0;
+        // one iteration with the branch back taken, and the last one
+        size_t cycles = 0;
+        size_t last_cycles = 0;
+
+        // opcodes and cycles of the body, for the instrumentation policy
+        size_t op_count = 0;
+        std::array<std::pair<uint8_t, uint8_t>, 8> ops{};
+    };
+
+    // Called when the branch at branch has just been taken backwards. Returns
+    // the loop if it's one that can be fused, nullptr otherwise.
+    template<class Cpu>
+    const Loop* arrive(Cpu& cpu, MemoryMap& bus, const uint16_t bank, const uint16_t branch)
+    {
+        // they all end in JR NZ
+        if (bus.peek(branch) != 0x20)
+            return nullptr;
+
+        const uint32_t key = (static_cast<uint32_t>(bank) << 16) | branch;
+        if (!m_last || key != m_last_key)
+        {
+            auto found = m_loops.find(key);
+            if (found == m_loops.end())
+                found = m_loops.emplace(key, analyze(cpu, bus, branch)).first;
+            m_last_key = key;
+            m_last = &found->second;
+        }
+
+        if (!m_last->fused || cpu.get_pc() != m_last->head)
+            return nullptr;
+        return m_last;
+    }
+
+    // the iterations still to go, the counter at the head
+    static const size_t remaining(const Loop& loop, const RegisterFile& r);
+
+    // first address the loop writes and how many bytes, for all remaining
+    // iterations
+    static const std::pair<uint16_t, size_t> destination(const Loop& loop, const RegisterFile& r);
+
+    // Runs as many whole iterations as fit in max_cycles, straight on
+    // memory. Returns the cycles they took, 0 if none fit or the memory
+    // involved isn't plain, and the number of iterations run.
+    static const size_t run(const Loop& loop, RegisterFile& r, MemoryMap& bus, const size_t max_cycles, size_t& iterations);
+
+    inline const size_t size() const
+    {
+        return m_loops.size();
+    }
+
+    // the loop the branch at branch closes, fused false if it isn't one
+    template<class Cpu>
+    static const Loop loop_at(Cpu& cpu, MemoryMap& bus, const uint16_t branch)
+    {
+        return (bus.peek(branch) == 0x20) ? analyze(cpu, bus, branch) : Loop{};
+    }
+
+private:
+    template<class Cpu>
+    static Loop analyze(Cpu& cpu, MemoryMap& bus, const uint16_t branch)
+    {
+        const auto offset = static_cast<int8_t>(bus.peek(static_cast<uint16_t>(branch + 1)));
+        const auto head = static_cast<uint16_t>(branch + 2 + offset);
+        if (head >= branch || branch - head > 8 || branch >= 0x8000 || (head < 0x4000) != (branch < 0x4000))
+            return Loop{};
+
+        Loop loop;
+        loop.head = head;
+        loop.exit = static_cast<uint16_t>(branch + 2);
+        uint16_t pc = head;
+        while (pc <= branch)
+        {
+            const auto decoded = cpu.decode_op(pc, bus.peek(pc));
+            if (decoded.prefixed || loop.op_count == loop.ops.size())
+                return Loop{};
+            const bool last = pc == branch;
+            loop.ops[loop.op_count++] = { decoded.op, static_cast<uint8_t>(last ? decoded.max_timing : decoded.min_timing) };
+            loop.cycles += last ? decoded.max_timing : decoded.min_timing;
+            loop.last_cycles += decoded.min_timing;
+            pc = static_cast<uint16_t>(pc + decoded.length);
+        }
+
+        // the branch has to be where the decoder ends up, not mid instruction
+        if (pc != loop.exit || !match(loop))
+            return Loop{};
+        loop.fused = true;
+        return loop;
+    }
+
+    // sets kind and registers from the body's opcodes, false if it isn't one
+    static const bool match(Loop& loop);
+
+    std::unordered_map<uint32_t, Loop> m_loops;
+    uint32_t m_last_key = 0;
+    Loop* m_last = nullptr;
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+
+#include "gameboy.h"
+
+// Runs a machine on joypad input from a fuzzer, from the same state every
+// time. The state it's built with is kept as a paged snapshot, so going
+// back to it copies only the pages the last run wrote.
+//
+// Each input byte is a Button mask, held for frames_per_input frames, then
+// the buttons are let go for settle_frames more. A run ends early when the
+// machine can't go on: the CPU stopped (STOP or an illegal opcode), halted
+// with no interrupt enabled to wake it, jumped somewhere with no code, or,
+// with stall_frames set, went that many frames without writing P1 to read
+// the buttons.
+//
+// Coverage is AFL style, a byte per edge hashed into map_size counters. An
+// edge is a jump, call, return or interrupt, from the bank:address of the
+// instruction it left to the one it went to. Straight line code isn't
+// counted, nor jumps of 1 to 3 bytes forward, which look the same.
+class FuzzHarness
+{
+public:
+    static constexpr size_t map_size = 1 << 16;
+
+    enum class Outcome : uint8_t
+    {
+        Finished,
+        Stopped,
+        HaltedForever,
+        WildJump,
+        Stalled
+    };
+
+    struct Options
+    {
+        size_t frames_per_input = 4;
+        size_t settle_frames = 60;
+        size_t max_frames = 3600;
+        size_t stall_frames = 0;
+    };
+
+    struct Result
+    {
+        Outcome outcome;
+        size_t frames;
+        uint64_t cycles;
+        uint16_t bank;
+        uint16_t pc;
+    };
+
+    // the machine is run from the state it's in now
+    explicit FuzzHarness(GameBoy& gb);
+
+    FuzzHarness(GameBoy& gb, const Options& options);
+
+    // back to the base state, then the input
+    const Result run(const uint8_t* input, const size_t size);
+
+    // the machine's state now becomes the one runs start from
+    void rebase();
+
+    // hit counts by edge for the last run, wrapping like AFL's
+    inline const std::vector<uint8_t>& coverage() const
+    {
+        return m_coverage;
+    }
+
+    // edges the last run hit
+    const size_t edges() const;
+
+    inline GameBoy& machine()
+    {
+        return m_gb;
+    }
+
+    static const char* outcome_name(const Outcome outcome);
+
+private:
+    // a frame's worth of cycles, counting edges, Finished if it got through
+    const Outcome run_frame();
+
+    GameBoy& m_gb;
+    Options m_options;
+    GameBoy::PagedSnapshot m_base;
+    std::vector<uint8_t> m_coverage;
+    uint16_t m_last_pc;
+    uint64_t m_polls;
+    size_t m_quiet_frames;
+};
@@ -0,0 +1,388 @@
+#pragma once
+
+#include <vector>
+
+#include "aot.h"
+#include "block_cache.h"
+#include "cpu.h"
+#include "cartridge.h"
+#include "coverage.h"
+#include "fused_loop.h"
+#include "idle_loop.h"
+#include "joypad.h"
+#include "ppu.h"
+#include "save_state.h"
+#include "state_hash.h"
+#include "timer.h"
+
+// The whole DMG. Owns the bus and everything on it, and handles the I/O page
+// itself, routing registers to the component they belong to. Stats is the
+// CPU's instrumentation policy, see opcode_stats.h.
+template<class Stats>
+class BasicGameBoy : public BusHandler
+{
+public:
+    using Cpu = BasicGBZ80<Stats>;
+
+    static constexpr size_t clock_hz = 4194304;
+
+    // a copy of everything that changes while running, the ROM excluded
+    struct Snapshot
+    {
+        CpuState cpu;
+        std::array<uint8_t, 0x10000> memory;
+        Cartridge::State cartridge;
+        Ppu ppu;
+        Timer timer;
+        Joypad joypad;
+        uint64_t cycles;
+    };
+
+    // The pages of a PagedSnapshot, the bus from $8000 then the cartridge
+    // RAM. Those written since the snapshot before are copied, the rest are
+    // shared with it, which keeps it and the ones it shares with alive. Every
+    // max_depth snapshots all of them are copied again, so a chain of them
+    // never holds more than that many.
+    struct SnapshotPages
+    {
+        static constexpr size_t first_page = 0x80;
+        static constexpr size_t bus_pages = MemoryMap::page_count - first_page;
+        static constexpr size_t max_depth = 8;
+        // with 16 banks of RAM, the most there is
+        static constexpr size_t max_pages = bus_pages + 16 * Cartridge::ram_bank_size / MemoryMap::page_size;
+
+        // every page, in copies here or in an older snapshot's
+        std::vector<const uint8_t*> at;
+        std::vector<uint8_t> copies;
+        shared_ptr<const SnapshotPages> parent;
+        size_t depth = 0;
+    };
+
+    // A snapshot for taking often, see paged_snapshot(). The picture isn't
+    // kept, the next frame draws it again.
+    struct PagedSnapshot
+    {
+        CpuState cpu;
+        shared_ptr<const SnapshotPages> pages;
+        Ppu::State ppu;
+        Timer::State timer;
+        Joypad::State joypad;
+        save_state::CartridgeChunk cartridge;
+        uint64_t cycles;
+    };
+
+    explicit BasicGameBoy(std::vector<uint8_t> rom);
+
+    // the bus keeps a pointer to this, so it stays where it is
+    BasicGameBoy(const BasicGameBoy&) = delete;
+    BasicGameBoy& operator=(const BasicGameBoy&) = delete;
+
+    // A new machine in the same state, to run on from here separately. It
+    // shares the ROM, which the bus reads its banks from, compiled blocks
+    // and block cache with this one and copies the rest, the bus from $8000
+    // and the picture being most of it. Idle and copy loops are found again
+    // as it runs, which changes when it skips, not where to.
+    std::unique_ptr<BasicGameBoy> clone() const;
+
+    // one instruction (or interrupt dispatch) plus the time it took on the
+    // rest of the machine, returns the clock cycles. With fast forward on,
+    // a HALT or an idle loop at its fixed point also skips ahead to the next
+    // PPU or timer event, ending in the same state stepping would. Where a
+    // compiled or cached block starts, the whole block runs.
+    size_t step();
+
+    // The same, but never a block, for whoever looks at each instruction
+    // as it runs, like the profiler. Fused loops still run whole.
+    size_t step_instruction();
+
+    // runs until the PPU enters VBlank, or for a frame's worth of cycles
+    // while the LCD is off, returns the clock cycles
+    size_t run_frame();
+
+    // The same, but stopping early at the first instruction to end at or
+    // past the clock cycle stop_at. True if the frame finished, false if it
+    // stopped early and the next call carries on with it, for input made in
+    // the middle of a frame.
+    bool run_frame_until(const uint64_t stop_at);
+
+    const uint8_t read(const uint16_t location) override;
+
+    void write(const uint16_t location, const uint8_t val) override;
+
+    // buttons held, a mask of Button
+    inline void set_buttons(const uint8_t buttons)
+    {
+        m_joypad.set_buttons(*m_bus, buttons);
+    }
+
+    inline void set_render(const bool render)
+    {
+        m_ppu.set_render(render);
+    }
+
+    // on by default
+    inline void set_fast_forward(const bool fast_forward)
+    {
+        m_fast_forward = fast_forward;
+    }
+
+    inline const bool fast_forward() const
+    {
+        return m_fast_forward;
+    }
+
+    // copy and fill loops run as bulk copies and fills, on by default
+    inline void set_fuse_loops(const bool fuse_loops)
+    {
+        m_fuse_loops = fuse_loops;
+    }
+
+    inline const bool fuse_loops() const
+    {
+        return m_fuse_loops;
+    }
+
+    // Code gbrecomp compiled from this ROM, run in place of the interpreter
+    // wherever it has a block. Returns false, and runs none, if it was
+    // compiled from another ROM.
+    bool set_compiled(const AotProgram<BasicGameBoy>& program);
+
+    inline const size_t compiled_blocks() const
+    {
+        return m_compiled_count;
+    }
+
+    // Blocks translated at run time, for whatever gbrecomp didn't compile.
+    // The cache has to be for this ROM, nullptr turns it off. Off by
+    // default, since step() then runs a block at a time.
+    bool set_block_cache(shared_ptr<BlockCache> cache);
+
+    inline const shared_ptr<BlockCache>& block_cache() const
+    {
+        return m_block_cache;
+    }
+
+    // Keeps coverage up to date from here on. It has to be for this ROM,
+    // nullptr stops it. Clones start without.
+    bool set_coverage(shared_ptr<Coverage> coverage);
+
+    inline const shared_ptr<Coverage>& coverage() const
+    {
+        return m_coverage;
+    }
+
+    // For compiled blocks, after each instruction: the rest of the machine
+    // catches up, and true means the block stops here for step() to take
+    // over.
+    inline const bool compiled_step(size_t& cycles, const size_t op_cycles)
+    {
+        m_timer.tick(*m_bus, op_cycles);
+        m_ppu.tick(*m_bus, op_cycles);
+        m_cycles += op_cycles;
+        cycles += op_cycles;
+        m_block_stopped = cycles >= m_block_limit || m_ppu.frame_ready() != m_block_frame_ready
+            || (m_cpu.interrupts_enabled() && interrupt_due());
+        return m_block_stopped;
+    }
+
+    // the same, after an instruction which may have written to the MBC
+    inline const bool compiled_store(size_t& cycles, const size_t op_cycles)
+    {
+        if (m_cartridge.bank_at(m_block_addr) != m_block_bank)
+        {
+            compiled_step(cycles, op_cycles);
+            m_block_stopped = true;
+            return true;
+        }
+        return compiled_step(cycles, op_cycles);
+    }
+
+    const Snapshot snapshot() const;
+
+    void restore(const Snapshot& snapshot);
+
+    // Copies only the pages written since the last paged snapshot taken or
+    // restored, sharing the rest with it.
+    const PagedSnapshot paged_snapshot();
+
+    // Copies back only the pages which differ from the ones on the bus,
+    // those written since the last paged snapshot or not shared with it.
+    void restore(const PagedSnapshot& snapshot);
+
+    // bytes save() writes, the same for the whole run
+    const size_t saved_size() const;
+
+    // Writes a save state, see save_state.h. False if out fills up.
+    bool save(StateSink& out) const;
+
+    // Reads a state save() wrote for this ROM, false if it's for another
+    // one, newer, or cut short. Registers are set once the whole state has
+    // been read, but memory is read straight onto the bus: a state found
+    // bad after that leaves the machine half loaded, to load a good state
+    // over or throw away.
+    bool load(StateSource& in);
+
+    // A hash of the state a save state keeps but the clock and the picture,
+    // the same for the same state however it was reached: run to, restored,
+    // loaded or cloned. Costs the memory pages written since it was last
+    // asked for, see StateHash, so it can be asked for every step.
+    const uint64_t state_hash();
+
+    inline Cpu& cpu()
+    {
+        return m_cpu;
+    }
+
+    inline MemoryMap& bus()
+    {
+        return *m_bus;
+    }
+
+    inline const Ppu& ppu() const
+    {
+        return m_ppu;
+    }
+
+    inline const Cartridge& cartridge() const
+    {
+        return m_cartridge;
+    }
+
+    inline const Joypad& joypad() const
+    {
+        return m_joypad;
+    }
+
+    // clock cycles since power on
+    inline const uint64_t cycles() const
+    {
+        return m_cycles;
+    }
+
+private:
+    struct Cloning
+    {
+    };
+
+    BasicGameBoy(const BasicGameBoy& other, Cloning);
+
+    // register values the boot ROM leaves behind
+    void reset();
+
+    // rom_hash() of the cartridge, hashed the first time it's asked for
+    const uint64_t cartridge_hash() const;
+
+    // step(), skipping no further than limit cycles, and running blocks
+    // only if blocks is set
+    size_t advance(const size_t limit, const bool blocks = true);
+
+    // clock cycles until the PPU or the timer next requests an interrupt,
+    // or with ppu_changes until the PPU next changes anything at all
+    inline const size_t cycles_to_event(const bool ppu_changes) const
+    {
+        return std::min(ppu_changes ? m_ppu.cycles_to_event() : m_ppu.cycles_to_interrupt(), m_timer.cycles_to_event());
+    }
+
+    // an interrupt is requested and enabled, so HALT ends or it's serviced
+    inline const bool interrupt_due() const
+    {
+        return (m_bus->peek(IF_ADDR) & m_bus->peek(IE_ADDR) & 0x1F) != 0;
+    }
+
+    // nothing but the next instruction has to happen first, so a block can
+    // run from here
+    inline const bool block_can_run() const
+    {
+        return !m_cpu.halted() && !m_cpu.stopped() && !m_cpu.ime_pending() && !m_cpu.halt_bug()
+            && !(m_cpu.interrupts_enabled() && interrupt_due());
+    }
+
+    // the compiled block starting at pc, if there is one and it can run
+    inline const AotBlock<BasicGameBoy>* compiled_block(const uint16_t pc) const
+    {
+        if (!m_compiled || pc >= 0x8000) [[likely]]
+            return nullptr;
+        const auto& compiled = *m_compiled;
+        const size_t idx = m_cartridge.bank_at(pc) * Cartridge::rom_bank_size + (pc & 0x3FFF);
+        if (idx >= compiled.size() || !compiled[idx] || compiled[idx]->addr != pc || !block_can_run())
+            return nullptr;
+        return compiled[idx];
+    }
+
+    // coverage after a block ran, unless it stopped before its last
+    // instruction and the CPU is still inside it
+    inline void cover_block(const uint16_t addr, const uint16_t last)
+    {
+        const uint16_t next = m_cpu.get_pc();
+        if (m_coverage && !(m_block_stopped && next > addr && next <= last)) [[unlikely]]
+            m_coverage->arrive(m_cartridge, last, next);
+    }
+
+    // the cached block starting at pc, translated if it's new, if it can run
+    const BlockCache::Block* cached_block(const uint16_t pc);
+
+    // runs a compiled or cached block, as far as it goes in limit cycles
+    size_t run_compiled(const AotBlock<BasicGameBoy>& block, const size_t limit);
+
+    size_t run_cached(const BlockCache::Block& block, const size_t limit);
+
+    inline void start_block(const uint16_t bank, const uint16_t addr, const size_t limit)
+    {
+        m_block_bank = bank;
+        m_block_addr = addr;
+        m_block_limit = limit;
+        m_block_frame_ready = m_ppu.frame_ready();
+        m_block_stopped = false;
+    }
+
+    // time passes for everything but the CPU
+    void idle(const size_t cycles);
+
+    // the rest of a copy or fill loop the CPU is at the head of, up to
+    // max_cycles and the next interrupt, returns the clock cycles
+    size_t run_fused(const FusedLoops::Loop& loop, const size_t max_cycles);
+
+    shared_ptr<MemoryMap> m_bus;
+    Cpu m_cpu;
+    Cartridge m_cartridge;
+    Ppu m_ppu;
+    Timer m_timer;
+    Joypad m_joypad;
+    uint64_t m_cycles;
+    // into the frame run_frame_until() stopped in, for timing it with the
+    // LCD off
+    size_t m_frame_cycles;
+    mutable uint64_t m_rom_hash;
+
+    // the pages of the last paged snapshot, what the bus was then, and
+    // ram_swaps() at the time
+    shared_ptr<const SnapshotPages> m_pages;
+    uint64_t m_pages_ram_swaps;
+
+    StateHash m_state_hash;
+
+    IdleLoops m_idle_loops;
+    bool m_fast_forward;
+
+    FusedLoops m_fused_loops;
+    bool m_fuse_loops;
+
+    // by bank * 0x4000 + (addr & 0x3FFF), addr tells $0000 from $4000,
+    // shared with clones
+    shared_ptr<const std::vector<const AotBlock<BasicGameBoy>*>> m_compiled;
+    size_t m_compiled_count;
+    shared_ptr<BlockCache> m_block_cache;
+    shared_ptr<Coverage> m_coverage;
+    uint16_t m_block_bank;
+    uint16_t m_block_addr;
+    size_t m_block_limit;
+    bool m_block_frame_ready;
+    bool m_block_stopped;
+};
+
+// both are built in gameboy.cpp
+extern template class BasicGameBoy<NoStats>;
+extern template class BasicGameBoy<OpcodeStats>;
+
+using GameBoy = BasicGameBoy<NoStats>;
+using InstrumentedGameBoy = BasicGameBoy<OpcodeStats>;
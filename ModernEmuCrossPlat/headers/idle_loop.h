@@ -0,0 +1,146 @@
+#pragma once
+
+#include <unordered_map>
+
+#include "cpu.h"
+
+// Finds busy-wait loops the machine can skip instead of running. A candidate
+// is a short loop in ROM, found when its backward JR/JP is taken, which the
+// decoder shows only reads memory into A and tests it: polling LY or STAT,
+// or a flag in HRAM the VBlank handler sets. Nothing but A and F changes, so
+// once an iteration ends with the same registers it started with, and the
+// memory it reads is the same, every further iteration is identical until
+// the PPU or the timer changes something.
+class IdleLoops
+{
+public:
+    // longest loop body considered, in bytes
+    static constexpr size_t max_length = 16;
+    static constexpr size_t max_reads = 4;
+
+    // Called when the branch at branch has just been taken backwards. Returns
+    // the clock cycles of one iteration if the loop is at its fixed point,
+    // 0 if it isn't (yet), or isn't an idle loop.
+    template<class Cpu>
+    size_t arrive(Cpu& cpu, MemoryMap& bus, const uint16_t bank, const uint16_t branch, const uint64_t now)
+    {
+        const uint8_t op = bus.peek(branch);
+        if (!is_jump(op))
+            return 0;
+
+        const uint32_t key = (static_cast<uint32_t>(bank) << 16) | branch;
+        if (!m_last || key != m_last_key)
+        {
+            auto found = m_loops.find(key);
+            if (found == m_loops.end())
+                found = m_loops.emplace(key, analyze(cpu, bus, branch)).first;
+            m_last_key = key;
+            m_last = &found->second;
+        }
+
+        if (!m_last->idle || cpu.get_pc() != m_last->head)
+            return 0;
+        return at_head(*m_last, cpu.registers(), bus, now);
+    }
+
+    // the loop arrive() last found at its fixed point was skipped up to now
+    inline void skipped(const uint64_t now)
+    {
+        if (m_last)
+            m_last->seen_at = now;
+    }
+
+    // the loop arrive() last looked at reads PPU registers, so every mode
+    // and line change matters to it, not just interrupts
+    inline const bool watches_ppu() const
+    {
+        return m_last && m_last->watches_ppu;
+    }
+
+    inline const size_t size() const
+    {
+        return m_loops.size();
+    }
+
+    // true if the branch at branch closes a loop arrive() would skip
+    template<class Cpu>
+    static const bool is_idle_loop(Cpu& cpu, MemoryMap& bus, const uint16_t branch)
+    {
+        return is_jump(bus.peek(branch)) && analyze(cpu, bus, branch).idle;
+    }
+
+private:
+    // where a read in the loop gets its address, fixed for the whole loop
+    // since only A and F change
+    enum class Source : uint8_t
+    {
+        Absolute,
+        HighC,
+        BC,
+        DE,
+        HL
+    };
+
+    struct Read
+    {
+        Source source;
+        uint16_t addr;
+    };
+
+    struct Loop
+    {
+        bool idle = false;
+        uint16_t head = 0;
+        size_t cycles = 0;
+        size_t read_count = 0;
+        std::array<Read, max_reads> reads{};
+        bool watches_ppu = false;
+
+        // the last time the loop came round to its head
+        bool seen = false;
+        uint64_t seen_at = 0;
+        RegisterFile registers;
+        std::array<uint8_t, max_reads> values{};
+    };
+
+    // JR, JR cc, JP a16 and JP cc
+    static inline const bool is_jump(const uint8_t op)
+    {
+        return op == 0x18 || op == 0xC3 || (op & 0xE7) == 0x20 || (op & 0xE7) == 0xC2;
+    }
+
+    template<class Cpu>
+    static Loop analyze(Cpu& cpu, MemoryMap& bus, const uint16_t branch)
+    {
+        const uint16_t head = jump_target(bus, branch);
+        if (head > branch || static_cast<size_t>(branch - head) > max_length || branch >= 0x8000 || (head < 0x4000) != (branch < 0x4000))
+            return Loop{};
+
+        Loop loop;
+        loop.head = head;
+        for (uint16_t pc = head; pc != branch;)
+        {
+            const auto decoded = cpu.decode_op(pc, bus.peek(pc));
+            if (!accept(decoded, bus, loop, branch) || pc + decoded.length > branch)
+                return Loop{};
+            loop.cycles += decoded.min_timing;
+            pc = static_cast<uint16_t>(pc + decoded.length);
+        }
+
+        // the branch back is taken
+        loop.cycles += cpu.decode_op(branch, bus.peek(branch)).max_timing;
+        loop.idle = true;
+        return loop;
+    }
+
+    static const uint16_t jump_target(MemoryMap& bus, const uint16_t branch);
+
+    // true if the instruction can be in an idle loop, adding its read
+    static const bool accept(const DecodedOpcode& decoded, MemoryMap& bus, Loop& loop, const uint16_t branch);
+
+    static const size_t at_head(Loop& loop, const RegisterFile& registers, MemoryMap& bus, const uint64_t now);
+
+    std::unordered_map<uint32_t, Loop> m_loops;
+    uint32_t m_last_key = 0;
+    Loop* m_last = nullptr;
+};
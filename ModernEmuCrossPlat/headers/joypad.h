@@ -0,0 +1,81 @@
+#pragma once
+
+#include "ram.h"
+
+enum Button : uint8_t
+{
+    BUTTON_RIGHT = 0x01,
+    BUTTON_LEFT = 0x02,
+    BUTTON_UP = 0x04,
+    BUTTON_DOWN = 0x08,
+    BUTTON_A = 0x10,
+    BUTTON_B = 0x20,
+    BUTTON_SELECT = 0x40,
+    BUTTON_START = 0x80
+};
+
+// P1 at $FF00. Buttons are held as a Button mask, 1 is pressed, the register
+// itself is active low.
+class Joypad
+{
+public:
+    static constexpr uint16_t P1 = 0xFF00;
+
+    // saved as it is, fields are only ever added at the end
+    struct State
+    {
+        uint8_t select;
+        uint8_t buttons;
+    };
+
+    inline const uint8_t read() const
+    {
+        uint8_t lines = 0;
+        if (!(m_select & 0x10))
+            lines |= m_buttons & 0x0F;
+        if (!(m_select & 0x20))
+            lines |= m_buttons >> 4;
+        return static_cast<uint8_t>(0xC0 | m_select | (~lines & 0x0F));
+    }
+
+    inline void write(const uint8_t val)
+    {
+        m_select = static_cast<uint8_t>(val & 0x30);
+        ++m_polls;
+    }
+
+    // a newly pressed button requests the joypad interrupt
+    inline void set_buttons(MemoryMap& bus, const uint8_t buttons)
+    {
+        if (buttons & ~m_buttons)
+            bus.request_interrupt(Interrupt::Joypad);
+        m_buttons = buttons;
+    }
+
+    inline const uint8_t buttons() const
+    {
+        return m_buttons;
+    }
+
+    // writes to P1, which a game makes to read the buttons, not saved
+    inline const uint64_t polls() const
+    {
+        return m_polls;
+    }
+
+    inline const State save_state() const
+    {
+        return State{ m_select, m_buttons };
+    }
+
+    inline void load_state(const State& state)
+    {
+        m_select = state.select;
+        m_buttons = state.buttons;
+    }
+
+private:
+    uint8_t m_select = 0x30;
+    uint8_t m_buttons = 0;
+    uint64_t m_polls = 0;
+};
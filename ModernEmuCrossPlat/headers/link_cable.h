@@ -0,0 +1,66 @@
+#pragma once
+
+#include "gameboy.h"
+
+// Two machines joined by a link cable, run a frame at a time in step with
+// each other. The machines have no serial port of their own, SB and SC are
+// plain memory, so the cable watches SC between slices of slice_cycles: a
+// machine setting bits 7 and 0 starts a transfer on its clock, and once a
+// byte's time has passed on it the two swap SB. The one that started and
+// the other, if it set bit 7 waiting for the clock, see bit 7 clear and
+// get the serial interrupt. Transfers start and end to within a slice.
+class LinkCable
+{
+public:
+    static constexpr uint16_t SB = 0xFF01;
+    static constexpr uint16_t SC = 0xFF02;
+    // a byte at 8192 Hz, and a bit of it
+    static constexpr size_t transfer_cycles = 8 * 512;
+    static constexpr size_t slice_cycles = 512;
+    static constexpr uint8_t no_master = 0xFF;
+
+    // saved as it is, fields are only ever added at the end
+    struct State
+    {
+        // the clock cycle of the master's the transfer ends on
+        uint64_t transfer_end;
+        uint8_t master;
+    };
+
+    LinkCable(GameBoy& first, GameBoy& second);
+
+    // Runs each machine to the end of a frame, the one behind never more
+    // than a slice behind the other until it has finished.
+    void run_frame();
+
+    inline GameBoy& machine(const size_t side)
+    {
+        return *m_machines[side];
+    }
+
+    // bytes swapped, not saved
+    inline const uint64_t transfers() const
+    {
+        return m_transfers;
+    }
+
+    inline const State save_state() const
+    {
+        return State{ m_transfer_end, m_master };
+    }
+
+    inline void load_state(const State& state)
+    {
+        m_transfer_end = state.transfer_end;
+        m_master = state.master;
+    }
+
+private:
+    // starts or ends a transfer, after a slice
+    void connect();
+
+    std::array<GameBoy*, 2> m_machines;
+    uint64_t m_transfer_end;
+    uint8_t m_master;
+    uint64_t m_transfers;
+};
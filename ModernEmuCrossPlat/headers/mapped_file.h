@@ -0,0 +1,37 @@
+#pragma once
+
+// A whole file mapped read only, shared with every other process mapping
+// it. Empty if it couldn't be opened.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // unmaps whatever was mapped before, false if path can't be mapped
+    bool open(const std::string& path);
+
+    void close();
+
+    inline const uint8_t* data() const
+    {
+        return m_data;
+    }
+
+    inline const size_t size() const
+    {
+        return m_size;
+    }
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#endif
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+// Instrumentation policies for BasicGBZ80, picked at compile time. The CPU
+// calls the hooks after every instruction, interrupt dispatch and idle step.
+// NoStats has no state and empty hooks, so the plain core compiles to what
+// it was before. Both cores are built into the library, so choosing the
+// instrumented one is a runtime decision and needs no separate build.
+struct NoStats
+{
+    static constexpr bool enabled = false;
+
+    inline void on_op(const bool, const uint8_t, const size_t)
+    {
+    }
+
+    inline void on_interrupt(const size_t)
+    {
+    }
+
+    inline void on_idle(const size_t)
+    {
+    }
+};
+
+// Executions and cycles for all 512 opcodes, plus taken and untaken counts
+// for the conditional branches. A branch is taken when it ran for its
+// maximum timing in the opcode table.
+class OpcodeStats
+{
+public:
+    static constexpr bool enabled = true;
+    static constexpr size_t opcode_count = 512;
+
+    // 0x000 - 0x0FF unprefixed, 0x100 - 0x1FF CB prefixed
+    static inline const size_t index(const bool prefixed, const uint8_t op)
+    {
+        return (prefixed ? 0x100 : 0) | op;
+    }
+
+    inline void on_op(const bool prefixed, const uint8_t op, const size_t cycles)
+    {
+        const size_t idx = index(prefixed, op);
+        ++m_count[idx];
+        m_cycles[idx] += cycles;
+
+        if (!prefixed && taken_cycles[op] != 0)
+        {
+            if (cycles == taken_cycles[op])
+                ++m_taken[op];
+            else
+                ++m_untaken[op];
+        }
+    }
+
+    inline void on_interrupt(const size_t cycles)
+    {
+        ++m_interrupts;
+        m_interrupt_cycles += cycles;
+    }
+
+    inline void on_idle(const size_t cycles)
+    {
+        m_idle_cycles += cycles;
+    }
+
+    inline const uint64_t count(const size_t idx) const
+    {
+        return m_count[idx];
+    }
+
+    inline const uint64_t cycles(const size_t idx) const
+    {
+        return m_cycles[idx];
+    }
+
+    inline const uint64_t taken(const uint8_t op) const
+    {
+        return m_taken[op];
+    }
+
+    inline const uint64_t untaken(const uint8_t op) const
+    {
+        return m_untaken[op];
+    }
+
+    inline const uint64_t interrupts() const
+    {
+        return m_interrupts;
+    }
+
+    inline const uint64_t interrupt_cycles() const
+    {
+        return m_interrupt_cycles;
+    }
+
+    // HALT, STOP and the idle loops fast forward skips
+    inline const uint64_t idle_cycles() const
+    {
+        return m_idle_cycles;
+    }
+
+    const uint64_t instructions() const;
+
+    const uint64_t total_cycles() const;
+
+    void reset();
+
+    // for adding up several machines or runs
+    OpcodeStats& operator+=(const OpcodeStats& other);
+
+    // the maximum timing of each conditional branch, 0 for everything else
+    static const std::array<uint8_t, 256> taken_cycles;
+
+private:
+    std::array<uint64_t, opcode_count> m_count{};
+    std::array<uint64_t, opcode_count> m_cycles{};
+    std::array<uint64_t, 256> m_taken{};
+    std::array<uint64_t, 256> m_untaken{};
+    uint64_t m_interrupts = 0;
+    uint64_t m_interrupt_cycles = 0;
+    uint64_t m_idle_cycles = 0;
+};
+
+// A readable report, cycles by OpcodeGroup then the top opcodes by cycles,
+// top = 0 lists all the opcodes that ran.
+const std::string format_opcode_stats(const OpcodeStats& stats, const size_t top = 0);
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <variant>
+#include <concepts>
+
+#include "ram.h"
+#include "registers.h"
+
+// Operands are small value types. The executor builds them from constants
+// so reading or writing one inlines down to a register file or bus access,
+// the decoder stores them in an Operand variant and only the cold naming
+// functions at the bottom ever look at them by kind.
+//
+// The kinds follow the operand names used by data/opcodes.json.
+
+enum class Cond : uint8_t
+{
+    NZ, Z, NC, C
+};
+
+struct NoOperand
+{
+};
+
+// A, B, C, D, E, H, L
+struct Reg8
+{
+    R8 reg;
+
+    inline const uint8_t read(const RegisterFile& r, MemoryMap&) const
+    {
+        return r.get(reg);
+    }
+
+    inline void write(RegisterFile& r, MemoryMap&, const uint8_t val) const
+    {
+        r.set(reg, val);
+    }
+};
+
+// BC, DE, HL, SP, AF
+struct Reg16
+{
+    R16 reg;
+
+    inline const uint16_t read16(const RegisterFile& r, MemoryMap&) const
+    {
+        return r.get(reg);
+    }
+
+    inline void write16(RegisterFile& r, MemoryMap&, const uint16_t val) const
+    {
+        r.set(reg, val);
+    }
+};
+
+// d8
+struct Imm8
+{
+    uint8_t value;
+
+    inline const uint8_t read(const RegisterFile&, MemoryMap&) const
+    {
+        return value;
+    }
+};
+
+// d16
+struct Imm16
+{
+    uint16_t value;
+
+    inline const uint16_t read16(const RegisterFile&, MemoryMap&) const
+    {
+        return value;
+    }
+};
+
+// a16, the target of JP and CALL
+struct Target16
+{
+    uint16_t value;
+
+    inline const uint16_t read16(const RegisterFile&, MemoryMap&) const
+    {
+        return value;
+    }
+};
+
+// r8, the signed offset of JR and ADD SP
+struct Rel8
+{
+    int8_t value;
+};
+
+// SP+r8
+struct SPRel8
+{
+    int8_t value;
+};
+
+// (BC), (DE), (HL), (HL+), (HL-)
+// step is applied to the register after every access
+struct RegAddress
+{
+    R16 reg;
+    int8_t step;
+
+    inline const uint8_t read(RegisterFile& r, MemoryMap& ram) const
+    {
+        const uint16_t addr = r.get(reg);
+        if (step != 0)
+            r.set(reg, static_cast<uint16_t>(addr + step));
+        return ram.read(addr);
+    }
+
+    inline void write(RegisterFile& r, MemoryMap& ram, const uint8_t val) const
+    {
+        const uint16_t addr = r.get(reg);
+        if (step != 0)
+            r.set(reg, static_cast<uint16_t>(addr + step));
+        ram.write(addr, val);
+    }
+};
+
+// (a16)
+struct ImmAddress
+{
+    uint16_t addr;
+
+    inline const uint8_t read(const RegisterFile&, MemoryMap& ram) const
+    {
+        return ram.read(addr);
+    }
+
+    inline void write(const RegisterFile&, MemoryMap& ram, const uint8_t val) const
+    {
+        ram.write(addr, val);
+    }
+
+    inline void write16(const RegisterFile&, MemoryMap& ram, const uint16_t val) const
+    {
+        ram.write(addr, static_cast<uint8_t>(val & 0xFF));
+        ram.write(static_cast<uint16_t>(addr + 1), static_cast<uint8_t>(val >> 8));
+    }
+};
+
+// (a8), 0xFF00 + a8
+struct HighImmAddress
+{
+    uint8_t offset;
+
+    inline const uint8_t read(const RegisterFile&, MemoryMap& ram) const
+    {
+        return ram.read(static_cast<uint16_t>(0xFF00 | offset));
+    }
+
+    inline void write(const RegisterFile&, MemoryMap& ram, const uint8_t val) const
+    {
+        ram.write(static_cast<uint16_t>(0xFF00 | offset), val);
+    }
+};
+
+// (C), 0xFF00 + C
+struct HighCAddress
+{
+    inline const uint8_t read(const RegisterFile& r, MemoryMap& ram) const
+    {
+        return ram.read(static_cast<uint16_t>(0xFF00 | r.get(R8::C)));
+    }
+
+    inline void write(const RegisterFile& r, MemoryMap& ram, const uint8_t val) const
+    {
+        ram.write(static_cast<uint16_t>(0xFF00 | r.get(R8::C)), val);
+    }
+};
+
+// NZ, Z, NC, C
+struct Condition
+{
+    Cond cc;
+
+    inline const bool test(const RegisterFile& r) const
+    {
+        switch (cc)
+        {
+        case Cond::NZ:
+            return !r.flag(Flag::Z);
+        case Cond::Z:
+            return r.flag(Flag::Z);
+        case Cond::NC:
+            return !r.flag(Flag::C);
+        default:
+            return r.flag(Flag::C);
+        }
+    }
+};
+
+// 00H, 08H, ... 38H, the RST targets
+struct Vector
+{
+    uint8_t addr;
+};
+
+// the bit index of BIT/RES/SET and the 0 following STOP
+struct Constant
+{
+    uint8_t value;
+};
+
+template<class T>
+concept ReadOperand8 = requires(const T & op, RegisterFile & r, MemoryMap & ram)
+{
+    { op.read(r, ram) } -> std::convertible_to<uint8_t>;
+};
+
+template<class T>
+concept WriteOperand8 = requires(const T & op, RegisterFile & r, MemoryMap & ram, uint8_t val)
+{
+    op.write(r, ram, val);
+};
+
+template<class T>
+concept ReadOperand16 = requires(const T & op, RegisterFile & r, MemoryMap & ram)
+{
+    { op.read16(r, ram) } -> std::convertible_to<uint16_t>;
+};
+
+template<class T>
+concept WriteOperand16 = requires(const T & op, RegisterFile & r, MemoryMap & ram, uint16_t val)
+{
+    op.write16(r, ram, val);
+};
+
+static_assert(ReadOperand8<Reg8> && WriteOperand8<Reg8>);
+static_assert(ReadOperand8<RegAddress> && WriteOperand8<RegAddress>);
+static_assert(ReadOperand8<Imm8> && !WriteOperand8<Imm8>);
+static_assert(ReadOperand16<Reg16> && WriteOperand16<Reg16>);
+static_assert(WriteOperand16<ImmAddress>);
+
+using Operand = std::variant<
+    NoOperand,
+    Reg8,
+    Reg16,
+    Imm8,
+    Imm16,
+    Target16,
+    Rel8,
+    SPRel8,
+    RegAddress,
+    ImmAddress,
+    HighImmAddress,
+    HighCAddress,
+    Condition,
+    Vector,
+    Constant>;
+
+// The name of the operand as written in data/opcodes.json, placeholders
+// like d8 or a16 stand in for the values.
+const std::string operand_name(const Operand& operand);
+
+// The operand with its decoded values, used for disassembly.
+const std::string operand_to_string(const Operand& operand);
@@ -1,97 +1,88 @@
 #pragma once
 
+#include <string_view>
+
 #include "utils.h"
 
+// One entry of data/opcodes.json. The tables themselves are generated at
+// build time by tools/opcode_gen.cpp into opcode_table.h, opcodes missing
+// from the json (the illegal ones) are left with an empty mnemonic.
 class ParsedOpCode
 {
 public:
 
-    ParsedOpCode(
+    constexpr ParsedOpCode() :
+        ParsedOpCode(0, "", 0, 0, 0, "----", "", "")
+    {
+    }
+
+    constexpr ParsedOpCode(
         const std::uint8_t& addr,
-        const std::string& mnemonic,
-        const std::size_t& length) :
+        const std::string_view& mnemonic,
+        const std::size_t& length,
+        const std::size_t& max_cycles,
+        const std::size_t& min_cycles,
+        const std::string_view& flags,
+        const std::string_view& operand1,
+        const std::string_view& operand2) :
         m_addr(addr),
         m_mnemonic(mnemonic),
         m_length(length),
-        m_cycles(),
-        m_flags(),
-        m_operand1(""),
-        m_operand2("")
-    {
-    }
-
-    void SetOperand1(const std::string& operand)
-    {
-        m_operand1.assign(operand);
-    }
-
-    void SetOperand2(const std::string& operand)
+        m_cycles{ max_cycles, min_cycles },
+        m_flags{ flags[0], flags[1], flags[2], flags[3] },
+        m_operand1(operand1),
+        m_operand2(operand2)
     {
-        m_operand2.assign(operand);
     }
 
-    template<class Iter>
-    inline void SetCycles(
-        const Iter& first,
-        const Iter& last)
-    {
-        std::copy(
-            first,
-            last,
-            std::begin(m_cycles));
-
-        std::sort(
-            std::rbegin(m_cycles),
-            std::rend(m_cycles));
-    }
-    
-    template<class Iter>
-    inline void SetFlags(
-        const Iter& first,
-        const Iter& last)
+    constexpr const bool IsValid() const
     {
-        std::copy(
-            first,
-            last,
-            begin(m_flags));
+        return !m_mnemonic.empty();
     }
 
-    inline const std::uint8_t GetAddr() const
+    constexpr const std::uint8_t GetAddr() const
     {
         return m_addr;
     }
 
-    inline const std::string GetMnemonic() const
+    constexpr const std::string_view GetMnemonic() const
     {
         return m_mnemonic;
     }
 
-    inline const std::size_t GetLength() const
+    constexpr const std::size_t GetLength() const
     {
         return m_length;
     }
 
-    inline const std::string GetOperand1() const
+    constexpr const std::string_view GetOperand1() const
     {
         return m_operand1;
     }
 
-    inline const std::string GetOperand2() const
+    constexpr const std::string_view GetOperand2() const
     {
         return m_operand2;
     }
 
-    inline const bool GetFlag(const size_t& flag) const
+    // 0 - Z, 1 - N, 2 - H, 3 - C, true when the flag is touched at all
+    constexpr const bool GetFlag(const size_t& flag) const
     {
         return (m_flags[flag] != '-');
     }
 
-    inline const size_t MaxCycles() const
+    // '-', '0', '1' or the flag letter, as written in the json
+    constexpr const char GetFlagEffect(const size_t& flag) const
+    {
+        return m_flags[flag];
+    }
+
+    constexpr const size_t MaxCycles() const
     {
         return m_cycles[0];
     }
 
-    inline const size_t MinCycles() const
+    constexpr const size_t MinCycles() const
     {
         return m_cycles[1];
     }
@@ -100,11 +91,8 @@ public:
     {
         std::stringstream str_stream;
 
-        str_stream << uint8_helper_hex.digits[m_addr];
+        str_stream << std::uppercase << std::hex << std::setfill('0') << std::setw(2) << static_cast<unsigned>(m_addr) << std::dec;
         str_stream << " - " << m_mnemonic << " - ";
-        //str_stream << " - " << m_length << " - ";
-        //str_stream << m_flags[0] << m_flags[1] << m_flags[2] << m_flags[3];
-        //str_stream << " --- ";
         if (!m_operand1.empty())
             str_stream << m_operand1;
 
@@ -119,12 +107,10 @@ public:
 
 private:
     std::uint8_t m_addr;
-    std::string m_mnemonic;
+    std::string_view m_mnemonic;
     std::size_t m_length;
     std::array<size_t, 2> m_cycles;
     std::array<char, 4> m_flags;
-    std::string m_operand1;
-    std::string m_operand2;
+    std::string_view m_operand1;
+    std::string_view m_operand2;
 };
-
-std::map<uint8_t, std::shared_ptr<ParsedOpCode>> ParsedOpCodes();
\ No newline at end of file
@@ -26,8 +26,11 @@
 #include <type_traits>
 #include <iterator>
 #include <array>
-
-#include <json/json.h>
+#include <map>
+#include <variant>
+#include <iomanip>
+#include <limits>
+#include <utility>
 
 using namespace std;
 
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "ram.h"
+
+// DMG picture processor. Timing is per mode (OAM scan, transfer, HBlank,
+// VBlank) rather than per dot, a line is drawn in one go when its transfer
+// ends. Drawing can be turned off, the registers, modes and interrupts
+// still run so games behave the same, only the framebuffer goes stale.
+class Ppu
+{
+public:
+    static constexpr size_t width = 160;
+    static constexpr size_t height = 144;
+
+    static constexpr size_t line_cycles = 456;
+    static constexpr size_t lines = 154;
+    static constexpr size_t frame_cycles = line_cycles * lines;
+
+    static constexpr uint16_t LCDC = 0xFF40;
+    static constexpr uint16_t STAT = 0xFF41;
+    static constexpr uint16_t SCY = 0xFF42;
+    static constexpr uint16_t SCX = 0xFF43;
+    static constexpr uint16_t LY = 0xFF44;
+    static constexpr uint16_t LYC = 0xFF45;
+    static constexpr uint16_t DMA = 0xFF46;
+    static constexpr uint16_t BGP = 0xFF47;
+    static constexpr uint16_t OBP0 = 0xFF48;
+    static constexpr uint16_t OBP1 = 0xFF49;
+    static constexpr uint16_t WY = 0xFF4A;
+    static constexpr uint16_t WX = 0xFF4B;
+
+    enum class Mode : uint8_t
+    {
+        HBlank = 0,
+        VBlank = 1,
+        OamScan = 2,
+        Transfer = 3
+    };
+
+    // Registers and timing, saved as it is, fields are only ever added at
+    // the end. The framebuffer is kept apart, nothing reads it back.
+    struct State
+    {
+        // LCDC to WX, $FF40-$FF4B
+        std::array<uint8_t, 12> registers;
+        Mode mode;
+        uint8_t window_line;
+        bool frame_ready;
+        uint8_t reserved;
+        uint32_t dot;
+    };
+
+    void tick(MemoryMap& bus, size_t cycles);
+
+    // clock cycles to the next mode or line change, the only times anything
+    // the CPU can see changes. A frame while the LCD is off.
+    const size_t cycles_to_event() const;
+
+    // clock cycles to the next VBlank or STAT interrupt request, for anything
+    // that only wakes up on those. A frame at most.
+    const size_t cycles_to_interrupt() const;
+
+    const uint8_t read(const uint16_t location) const;
+
+    void write(MemoryMap& bus, const uint16_t location, const uint8_t val);
+
+    inline void set_render(const bool render)
+    {
+        m_render = render;
+    }
+
+    inline const bool render() const
+    {
+        return m_render;
+    }
+
+    // set when LY reaches VBlank, cleared by whoever consumes the frame
+    inline const bool frame_ready() const
+    {
+        return m_frame_ready;
+    }
+
+    inline void clear_frame_ready()
+    {
+        m_frame_ready = false;
+    }
+
+    inline const bool lcd_on() const
+    {
+        return (m_lcdc & 0x80) != 0;
+    }
+
+    inline const Mode mode() const
+    {
+        return m_mode;
+    }
+
+    // shades 0 (white) to 3 (black), palettes already applied
+    inline const std::array<uint8_t, width * height>& framebuffer() const
+    {
+        return m_framebuffer;
+    }
+
+    // to load a saved picture into
+    inline std::array<uint8_t, width * height>& framebuffer()
+    {
+        return m_framebuffer;
+    }
+
+    const State save_state() const;
+
+    void load_state(const State& state);
+
+private:
+    void set_mode(MemoryMap& bus, const Mode mode);
+
+    void set_ly(MemoryMap& bus, const uint8_t ly);
+
+    void draw_line(const MemoryMap& bus);
+
+    uint8_t m_lcdc = 0x91;
+    uint8_t m_stat = 0x85;
+    uint8_t m_scy = 0;
+    uint8_t m_scx = 0;
+    uint8_t m_ly = 0;
+    uint8_t m_lyc = 0;
+    uint8_t m_dma = 0xFF;
+    uint8_t m_bgp = 0xFC;
+    uint8_t m_obp0 = 0xFF;
+    uint8_t m_obp1 = 0xFF;
+    uint8_t m_wy = 0;
+    uint8_t m_wx = 0;
+
+    Mode m_mode = Mode::OamScan;
+    size_t m_dot = 0;
+    uint8_t m_window_line = 0;
+    bool m_frame_ready = false;
+    bool m_render = true;
+
+    std::array<uint8_t, width * height> m_framebuffer{};
+};
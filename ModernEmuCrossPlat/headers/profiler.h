@@ -0,0 +1,167 @@
+#pragma once
+
+#include <vector>
+
+#include "ppu.h"
+#include "registers.h"
+
+// bank:address, bank is the ROM bank mapped there at the time, 0 outside ROM
+struct GuestAddr
+{
+    uint16_t bank;
+    uint16_t addr;
+
+    inline const uint32_t key() const
+    {
+        return (static_cast<uint32_t>(bank) << 16) | addr;
+    }
+};
+
+// Symbols from an RGBDS .sym file, "bank:addr name" per line.
+class SymbolTable
+{
+public:
+    // returns false if the file can't be read, bad lines are skipped
+    bool load(const std::string& path);
+
+    void load(std::istream& in);
+
+    void add(const GuestAddr& location, const std::string& name);
+
+    // the symbol at location, or the closest one before it in the same bank
+    // as "name+$offset", or "bb:aaaa"
+    const std::string name_for(const GuestAddr& location) const;
+
+    // the exact symbol at location, nullptr if there's none
+    const std::string* exact(const GuestAddr& location) const;
+
+    inline const size_t size() const
+    {
+        return m_symbols.size();
+    }
+
+private:
+    std::map<uint32_t, std::string> m_symbols;
+};
+
+// Profiles the guest program. Drive the machine through step() or
+// run_frame() instead of the machine's own, which run an instruction at a
+// time whatever compiled code or block cache the machine has. Every
+// instruction's cycles go to the function on top of a shadow call stack
+// that follows CALL, RST, interrupt entry and RET/RETI by watching SP, and
+// the PC is sampled every sample_interval cycles.
+class Profiler
+{
+public:
+    struct FunctionStats
+    {
+        std::string name;
+        uint64_t calls = 0;
+        uint64_t exclusive = 0;
+        uint64_t inclusive = 0;
+    };
+
+    explicit Profiler(const size_t sample_interval = 1024);
+
+    // names are looked up the first time a function is seen, so set these
+    // before running
+    inline void set_symbols(SymbolTable symbols)
+    {
+        m_symbols = std::move(symbols);
+    }
+
+    template<class Machine>
+    size_t step(Machine& gb)
+    {
+        auto& cpu = gb.cpu();
+        auto& bus = gb.bus();
+
+        const uint16_t pc = cpu.get_pc();
+        const uint16_t sp = cpu.registers().get(R16::SP);
+        const GuestAddr location{ static_cast<uint16_t>(gb.cartridge().bank_at(pc)), pc };
+        const uint8_t op = bus.peek(pc);
+
+        // a block would hide the CALL or RST it ends in
+        const size_t cycles = gb.step_instruction();
+
+        const uint16_t new_pc = cpu.get_pc();
+        const uint16_t new_sp = cpu.registers().get(R16::SP);
+        const uint16_t pushed = static_cast<uint16_t>(bus.peek(new_sp) | (bus.peek(static_cast<uint16_t>(new_sp + 1)) << 8));
+        const GuestAddr target{ static_cast<uint16_t>(gb.cartridge().bank_at(new_pc)), new_pc };
+
+        record(location, op, sp, target, new_sp, pushed, cycles);
+        return cycles;
+    }
+
+    // a frame's worth of cycles through step(), returns the clock cycles
+    template<class Machine>
+    size_t run_frame(Machine& gb)
+    {
+        size_t total = 0;
+        while (total < Ppu::frame_cycles)
+            total += step(gb);
+        return total;
+    }
+
+    // exact cycles per function, sorted by exclusive cycles, still open
+    // calls are counted up to now
+    const std::vector<FunctionStats> functions() const;
+
+    // sampled PC locations and how often they were hit, hottest first
+    const std::vector<std::pair<GuestAddr, uint64_t>> samples() const;
+
+    // one "root;caller;callee cycles" line per call path, for flamegraph.pl
+    // and speedscope
+    void write_folded(std::ostream& out) const;
+
+    const std::string report(const size_t top = 20) const;
+
+    inline const uint64_t cycles() const
+    {
+        return m_cycles;
+    }
+
+    void reset();
+
+private:
+    struct Node
+    {
+        uint32_t function;
+        uint32_t parent;
+        uint64_t self = 0;
+        std::map<uint32_t, uint32_t> children;
+    };
+
+    struct Frame
+    {
+        uint32_t function;
+        uint32_t node;
+        uint64_t entry;
+        uint16_t return_sp;
+    };
+
+    void record(const GuestAddr& location, const uint8_t op, const uint16_t sp,
+        const GuestAddr& target, const uint16_t new_sp, const uint16_t pushed, const size_t cycles);
+
+    const uint32_t function_for(const GuestAddr& entry, const char* fallback);
+
+    void enter(const uint32_t function, const uint16_t return_sp);
+
+    void leave(const uint16_t sp);
+
+    size_t m_sample_interval;
+    uint64_t m_next_sample;
+    uint64_t m_cycles;
+
+    SymbolTable m_symbols;
+
+    std::vector<FunctionStats> m_functions;
+    std::map<uint32_t, uint32_t> m_function_ids;
+    std::vector<uint32_t> m_active;
+
+    std::vector<Node> m_nodes;
+    std::vector<Frame> m_stack;
+    uint32_t m_node;
+
+    std::map<uint32_t, uint64_t> m_samples;
+};
@@ -1,20 +1,156 @@
 #pragma once
 
+// IF and IE, the CPU services whatever is set in both
+constexpr uint16_t IF_ADDR = 0xFF0F;
+constexpr uint16_t IE_ADDR = 0xFFFF;
+
+enum class Interrupt : uint8_t
+{
+    VBlank = 0x01,
+    Stat = 0x02,
+    Timer = 0x04,
+    Serial = 0x08,
+    Joypad = 0x10
+};
+
+// Anything on the bus which isn't plain memory, I/O registers or a cartridge
+// controller. Handlers are mapped per 256 byte page, separately for reads and
+// writes, so ROM can be read straight from memory while writes to it reach
+// the MBC.
+class BusHandler
+{
+public:
+    virtual ~BusHandler() = default;
+
+    virtual const uint8_t read(const uint16_t location) = 0;
+
+    virtual void write(const uint16_t location, const uint8_t val) = 0;
+};
+
 class MemoryMap
 {
 public:
+    static constexpr size_t page_size = 0x100;
+    static constexpr size_t page_count = 0x10000 / page_size;
+
     MemoryMap();
 
+    // Copies $8000 up, the ROM pages are the cartridge's and stay shared.
+    // The handlers are copied as they are, whoever mapped them maps itself
+    // again.
+    MemoryMap(const MemoryMap& other);
+    MemoryMap& operator=(const MemoryMap&) = delete;
+
+    // pages without a handler are read and written directly
     inline const uint8_t read(const uint16_t location)
     {
-        return m_memory[location];
+        if (BusHandler* handler = m_read_handlers[location >> 8]) [[unlikely]]
+            return handler->read(location);
+        return m_pages[location >> 8][location & 0xFF];
     }
 
     inline void write(const uint16_t location, const uint8_t val)
     {
+        if (BusHandler* handler = m_write_handlers[location >> 8]) [[unlikely]]
+            return handler->write(location, val);
         m_memory[location] = val;
+        mark_dirty(location);
+    }
+
+    // raw access which never goes through a handler, for the handlers
+    // themselves, DMA and the PPU
+    inline const uint8_t peek(const uint16_t location) const
+    {
+        return m_pages[location >> 8][location & 0xFF];
+    }
+
+    inline void poke(const uint16_t location, const uint8_t val)
+    {
+        m_memory[location] = val;
+        mark_dirty(location);
+    }
+
+    // memory from $8000 up, where data() + location is the byte at location.
+    // Below that are the ROM pages, read them with peek() or page().
+    inline uint8_t* data()
+    {
+        return m_memory.data();
+    }
+
+    inline const uint8_t* data() const
+    {
+        return m_memory.data();
+    }
+
+    // where the page is read from
+    inline const uint8_t* page(const size_t page) const
+    {
+        return m_pages[page];
+    }
+
+    // Pages written since clear_dirty(), for snapshots which copy only what
+    // changed. write() and poke() mark them, whoever writes through data()
+    // marks what it wrote. IF is set without, so the I/O page is never
+    // clean as far as snapshots go.
+    inline const bool dirty(const size_t page) const
+    {
+        return (m_dirty[page >> 6] >> (page & 63)) & 1;
+    }
+
+    inline void mark_dirty(const uint16_t location)
+    {
+        const uint64_t bit = uint64_t(1) << ((location >> 8) & 63);
+        m_dirty[location >> 14] |= bit;
+        m_unhashed[location >> 14] |= bit;
     }
 
+    // first and last inclusive
+    void mark_dirty(const uint16_t first, const uint16_t last);
+
+    inline void clear_dirty()
+    {
+        m_dirty.fill(0);
+    }
+
+    // The same pages, marked dirty since clear_unhashed(), for StateHash.
+    // Kept apart so taking a snapshot doesn't clear them.
+    inline const bool unhashed(const size_t page) const
+    {
+        return (m_unhashed[page >> 6] >> (page & 63)) & 1;
+    }
+
+    inline void clear_unhashed()
+    {
+        m_unhashed.fill(0);
+    }
+
+    inline void request_interrupt(const Interrupt interrupt)
+    {
+        m_memory[IF_ADDR] |= static_cast<uint8_t>(interrupt);
+    }
+
+    // true if no handler is mapped anywhere in [first, last], so the range
+    // can be read or written straight from memory
+    const bool plain_read(const uint16_t first, const uint16_t last) const;
+
+    const bool plain_write(const uint16_t first, const uint16_t last) const;
+
+    // first and last are inclusive addresses, rounded out to whole pages,
+    // nullptr unmaps
+    void map_read(const uint16_t first, const uint16_t last, BusHandler* handler);
+
+    void map_write(const uint16_t first, const uint16_t last, BusHandler* handler);
+
+    // reads of the size bytes from first, a whole number of pages below
+    // $8000, come from rom, which outlives the map and never changes
+    void map_rom(const uint16_t first, const uint8_t* rom, const size_t size);
+
 private:
     std::array<uint8_t, size_t(0x10000)> m_memory;
-};
\ No newline at end of file
+    // m_memory's own pages, or the ROM mapped there
+    std::array<const uint8_t*, page_count> m_pages;
+    std::array<BusHandler*, page_count> m_read_handlers;
+    std::array<BusHandler*, page_count> m_write_handlers;
+    std::array<uint64_t, page_count / 64> m_dirty;
+    std::array<uint64_t, page_count / 64> m_unhashed;
+};
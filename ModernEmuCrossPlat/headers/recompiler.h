@@ -0,0 +1,135 @@
+#pragma once
+
+#include <vector>
+
+#include "cpu.h"
+
+// Finds a ROM's code by recursive descent from the entry point and the
+// interrupt vectors, following every jump, call and RST the decoder shows,
+// and writes it out as C++ for gbrecomp, one function per basic block.
+//
+// Targets in $4000-$7FFF are only followed from bank 0 when the bank is
+// known: the ROM has just the one, or the block switched to it with
+// ld a, n / ld [$2000-$3FFF], a. JP HL, returns and code in RAM aren't
+// followed at all, the interpreter runs whatever isn't found.
+class Recompiler
+{
+public:
+    // longest block, in instructions
+    static constexpr size_t max_block = 64;
+    // bumped on any change to where blocks end or what may_switch_bank()
+    // flags, so caches of the old blocks aren't loaded
+    static constexpr uint32_t decode_version = 1;
+
+    struct Instruction
+    {
+        uint16_t addr;
+        // the first byte, 0xCB for the whole CB page
+        uint8_t op;
+        uint8_t length;
+        // may write ROM, the MBC switching banks under the block
+        bool may_switch_bank;
+        std::string text;
+    };
+
+    struct Block
+    {
+        uint16_t bank;
+        uint16_t addr;
+        uint16_t last;
+        std::vector<Instruction> code;
+
+        inline const uint32_t key() const
+        {
+            return (static_cast<uint32_t>(bank) << 16) | addr;
+        }
+    };
+
+    explicit Recompiler(std::vector<uint8_t> rom);
+
+    // Straight line code from addr, as cpu's bus has it mapped, up to and
+    // including the instruction which ends the block. Stops short of an
+    // illegal opcode, and of the line between bank 0 and bank n. Text for
+    // the comments is only made with_text.
+    template<class Cpu>
+    static Block decode(Cpu& cpu, const MemoryMap& bus, const uint16_t bank, const uint16_t addr, const bool with_text = false)
+    {
+        Block block{ bank, addr, addr, {} };
+        uint16_t pc = addr;
+        while (block.code.size() < max_block && pc < 0x8000)
+        {
+            const uint8_t b = bus.peek(pc);
+            const auto decoded = cpu.decode_op(pc, b);
+            const size_t next = pc + decoded.length;
+            if (decoded.group == OpcodeGroup::UNKNOWN || (pc < 0x4000) != (next - 1 < 0x4000) || next > 0x8000)
+                break;
+
+            const auto imm16 = static_cast<uint16_t>(bus.peek(static_cast<uint16_t>(pc + 1)) | (bus.peek(static_cast<uint16_t>(pc + 2)) << 8));
+            block.code.push_back({ pc, decoded.prefixed ? uint8_t(0xCB) : b, decoded.length, may_switch_bank(decoded, imm16), with_text ? describe(decoded) : std::string() });
+            block.last = pc;
+            if (ends_block(b))
+                break;
+            pc = static_cast<uint16_t>(next);
+            if (pc == 0x4000)
+                break;
+        }
+        return block;
+    }
+
+    // jumps, calls and returns, and HALT, STOP, EI and DI, after which
+    // step() has to look at interrupts before the next instruction
+    static inline const bool ends_block(const uint8_t b)
+    {
+        return b == 0xC3 || (b & 0xE7) == 0xC2 || b == 0x18 || (b & 0xE7) == 0x20
+            || b == 0xCD || (b & 0xE7) == 0xC4 || (b & 0xC7) == 0xC7
+            || b == 0xC9 || b == 0xD9 || b == 0xE9 || (b & 0xE7) == 0xC0
+            || b == 0x76 || b == 0x10 || b == 0xFB || b == 0xF3;
+    }
+
+    // Anything written through a register could hit the MBC, as could a
+    // constant address under $8000. PUSH and CALL could too, with SP in
+    // ROM, which no game does.
+    static const bool may_switch_bank(const DecodedOpcode& decoded, const uint16_t imm16);
+
+    // finds the code, with_text keeps each instruction's text for emit()
+    void analyze(const bool with_text = true);
+
+    // by bank, then address
+    inline const std::map<uint32_t, Block>& blocks() const
+    {
+        return m_blocks;
+    }
+
+    // JP HL, or jumps into RAM or an unknown bank, left to the interpreter
+    inline const size_t unresolved() const
+    {
+        return m_unresolved;
+    }
+
+    // the C++ source, defining AotProgram<Machine> name() for GameBoy and
+    // InstrumentedGameBoy
+    void emit(std::ostream& out, const std::string& name) const;
+
+private:
+    // "LD A, $C0", for the comments
+    static const std::string describe(const DecodedOpcode& decoded);
+
+    const Block decode_block(const uint16_t bank, const uint16_t addr);
+
+    // copies bank into $4000-$7FFF for the decoder
+    void map_bank(const uint16_t bank);
+
+    // queues bank:target, from a block in from_bank which last switched to
+    // switched, 0 if it didn't
+    void follow(const uint16_t from_bank, const size_t switched, const uint16_t target);
+
+    std::vector<uint8_t> m_rom;
+    shared_ptr<MemoryMap> m_bus;
+    GBZ80 m_cpu;
+    size_t m_mapped_bank;
+
+    std::map<uint32_t, Block> m_blocks;
+    std::vector<uint32_t> m_queue;
+    size_t m_unresolved;
+    bool m_with_text;
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <bit>
+
+// 8 bit registers, in the order they pair up (B:C, D:E, H:L, A:F)
+enum class R8 : uint8_t
+{
+    B, C, D, E, H, L, A, F
+};
+
+// 16 bit registers, the first four are the pairs of R8
+enum class R16 : uint8_t
+{
+    BC, DE, HL, AF, SP, PC
+};
+
+// bit masks of the flags held in F
+enum class Flag : uint8_t
+{
+    Z = 0x80,
+    N = 0x40,
+    H = 0x20,
+    C = 0x10
+};
+
+// byte offset of an 8 bit register inside the register file words
+constexpr size_t register_slot(const R8 reg)
+{
+    constexpr bool host_little_endian = (std::endian::native == std::endian::little);
+    const auto idx = static_cast<size_t>(reg);
+    const bool high = (idx & 1) == 0;
+    return (idx & ~size_t(1)) + ((high == host_little_endian) ? 1 : 0);
+}
+
+static_assert(register_slot(R8::B) / 2 == static_cast<size_t>(R16::BC));
+static_assert(register_slot(R8::L) / 2 == static_cast<size_t>(R16::HL));
+static_assert(register_slot(R8::F) / 2 == static_cast<size_t>(R16::AF));
+
+// The register file is stored as six host order 16 bit words
+// (BC, DE, HL, AF, SP, PC). The 8 bit registers are the bytes of the
+// first four words, so which byte of a word holds the high register
+// depends on the host endianness. That is picked at compile time, so both
+// the 8 bit and the 16 bit views are a single load/store with no
+// shifting or pointer chasing, and BC always reads B:C.
+class RegisterFile
+{
+public:
+    constexpr RegisterFile() noexcept
+        : m_words{}
+    {
+    }
+
+    inline const uint8_t get(const R8 reg) const
+    {
+        return bytes()[register_slot(reg)];
+    }
+
+    inline void set(const R8 reg, const uint8_t val)
+    {
+        // the low nibble of F is hard wired to zero
+        bytes()[register_slot(reg)] = (reg == R8::F) ? static_cast<uint8_t>(val & 0xF0) : val;
+    }
+
+    inline const uint16_t get(const R16 reg) const
+    {
+        return m_words[static_cast<size_t>(reg)];
+    }
+
+    inline void set(const R16 reg, const uint16_t val)
+    {
+        m_words[static_cast<size_t>(reg)] = (reg == R16::AF) ? static_cast<uint16_t>(val & 0xFFF0) : val;
+    }
+
+    inline uint8_t* ptr(const R8 reg)
+    {
+        return bytes() + register_slot(reg);
+    }
+
+    inline uint16_t* ptr(const R16 reg)
+    {
+        return &m_words[static_cast<size_t>(reg)];
+    }
+
+    inline const bool flag(const Flag f) const
+    {
+        return (get(R8::F) & static_cast<uint8_t>(f)) != 0;
+    }
+
+    inline void set_flag(const Flag f, const bool val)
+    {
+        auto& F = bytes()[register_slot(R8::F)];
+        if (val)
+            F |= static_cast<uint8_t>(f);
+        else
+            F &= static_cast<uint8_t>(~static_cast<uint8_t>(f));
+    }
+
+    // sets all four flags at once, faster than four set_flag calls
+    inline void set_flags(const bool Z, const bool N, const bool H, const bool C)
+    {
+        bytes()[register_slot(R8::F)] = static_cast<uint8_t>(
+            (Z ? 0x80 : 0) | (N ? 0x40 : 0) | (H ? 0x20 : 0) | (C ? 0x10 : 0));
+    }
+
+    inline bool operator==(const RegisterFile& other) const
+    {
+        return m_words == other.m_words;
+    }
+
+private:
+    // uint8_t is allowed to alias any object, the other way round is not
+    inline uint8_t* bytes()
+    {
+        return reinterpret_cast<uint8_t*>(m_words.data());
+    }
+
+    inline const uint8_t* bytes() const
+    {
+        return reinterpret_cast<const uint8_t*>(m_words.data());
+    }
+
+    std::array<uint16_t, 6> m_words;
+};
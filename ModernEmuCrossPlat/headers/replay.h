@@ -0,0 +1,249 @@
+#pragma once
+
+#include <vector>
+
+#include "gameboy.h"
+
+// A run's joypad input, to play it back the same. Each change of the buttons
+// is kept with the clock cycle it was made at, and every keyframe_interval
+// frames the whole state as a save state, so a replay can start from the
+// keyframe before where it's wanted rather than from the start. Each keyframe
+// and the end keep the state hash, see BasicGameBoy::state_hash(), for a
+// replay to check it got the same.
+//
+// Frames are the ones the machine finishes, see run_frame_until(). Block
+// caches, compiled code, fast forward and fused loops make a run faster, not
+// different, so a replay needn't have the same ones as the recording.
+class InputLog
+{
+public:
+    struct Event
+    {
+        uint64_t cycle;
+        uint8_t buttons;
+    };
+
+    // where a run was at the start of a frame
+    struct Checkpoint
+    {
+        uint64_t frame;
+        uint64_t cycle;
+        // the events made before it
+        uint64_t events;
+        uint64_t state_hash;
+    };
+
+    struct Keyframe
+    {
+        Checkpoint at;
+        // a save state encoded with Rewind::encode() against nothing, and
+        // its size decoded
+        uint64_t state_size;
+        std::vector<uint8_t> state;
+    };
+
+    static constexpr uint32_t format_version = 1;
+
+    explicit InputLog(const size_t keyframe_interval = 600);
+
+    inline const size_t keyframe_interval() const
+    {
+        return m_keyframe_interval;
+    }
+
+    inline const uint64_t rom_hash() const
+    {
+        return m_rom_hash;
+    }
+
+    inline const std::vector<Event>& events() const
+    {
+        return m_events;
+    }
+
+    inline const std::vector<Keyframe>& keyframes() const
+    {
+        return m_keyframes;
+    }
+
+    // the last frame recorded
+    inline const Checkpoint& end() const
+    {
+        return m_end;
+    }
+
+    // the keyframe at or before frame, keyframes() is never empty once
+    // something has been recorded
+    const size_t keyframe_before(const uint64_t frame) const;
+
+    // Writes the machine's state as a keyframe, false if it can't be saved.
+    // The first one is for the start, and takes the ROM's hash.
+    template<class Machine>
+    bool add_keyframe(Machine& machine, const uint64_t frame)
+    {
+        m_state.assign((machine.saved_size() + 7) & ~size_t(7), 0);
+        BufferSink sink(m_state.data(), m_state.size());
+        if (!machine.save(sink))
+            return false;
+        if (m_keyframes.empty())
+            m_rom_hash = ::rom_hash(machine.cartridge().rom());
+        keep_keyframe({ frame, machine.cycles(), m_events.size(), machine.state_hash() });
+        return true;
+    }
+
+    // Loads a keyframe's state, false if it's for another ROM.
+    template<class Machine>
+    bool load_keyframe(Machine& machine, const size_t keyframe) const
+    {
+        std::vector<uint8_t> state;
+        if (!decode(keyframe, state))
+            return false;
+        BufferSource source(state.data(), state.size());
+        return machine.load(source);
+    }
+
+    // buttons changed, at cycle, which can't be before the last
+    void add_event(const uint64_t cycle, const uint8_t buttons);
+
+    inline void set_end(const Checkpoint& end)
+    {
+        m_end = end;
+    }
+
+    // A header, the events as a LEB128 count of cycles since the one
+    // before and the buttons, then the keyframes. read() replaces what's
+    // here, false if the log is cut short or isn't one.
+    bool write(std::ostream& out) const;
+
+    bool read(std::istream& in);
+
+private:
+    struct FileHeader
+    {
+        std::array<char, 8> magic;
+        uint32_t version;
+        uint32_t keyframe_interval;
+        uint64_t rom_hash;
+        Checkpoint end;
+        uint64_t event_count;
+        uint64_t keyframe_count;
+    };
+
+    struct FileKeyframe
+    {
+        Checkpoint at;
+        uint64_t state_size;
+        uint64_t encoded_size;
+    };
+
+    static constexpr std::array<char, 8> file_magic = { 'G', 'B', 'I', 'N', 'P', 'U', 'T', 0 };
+
+    // encodes m_state as a keyframe at
+    void keep_keyframe(const Checkpoint& at);
+
+    const bool decode(const size_t keyframe, std::vector<uint8_t>& out) const;
+
+    size_t m_keyframe_interval;
+    uint64_t m_rom_hash;
+    std::vector<Event> m_events;
+    std::vector<Keyframe> m_keyframes;
+    Checkpoint m_end;
+
+    // a save state on its way in
+    std::vector<uint8_t> m_state;
+};
+
+// Runs a machine and records its input into an empty log, from the state
+// it's in now, which is the first keyframe.
+class Recorder
+{
+public:
+    Recorder(GameBoy& gb, InputLog& log);
+
+    void set_buttons(const uint8_t buttons);
+
+    // a frame, then a keyframe if it's one keyframe_interval() after the last
+    void run_frame();
+
+    // one instruction, and the end of the frame if it's there
+    void step();
+
+    inline const uint64_t frame() const
+    {
+        return m_frame;
+    }
+
+    inline GameBoy& machine()
+    {
+        return m_gb;
+    }
+
+private:
+    // the log's end, and a keyframe if one's due
+    void frame_done();
+
+    GameBoy& m_gb;
+    InputLog& m_log;
+    uint64_t m_frame;
+};
+
+// Plays a log back on a machine for the same ROM, from its first keyframe or
+// any frame seek() goes to. A replay checks where it is at every keyframe and
+// the end, and stops when it isn't where the recording was: an event due in
+// the middle of an instruction, or another state hash.
+class Replay
+{
+public:
+    struct Verification
+    {
+        bool ok;
+        // the first frame found different, or the end, and how many
+        // keyframes were replayed from
+        uint64_t frame;
+        size_t checked;
+    };
+
+    // at the log's first keyframe, ok() is false if it can't be loaded
+    Replay(GameBoy& gb, const InputLog& log);
+
+    // to the start of frame, by way of the keyframe before it
+    bool seek(const uint64_t frame);
+
+    // The next frame, false at the end of the log or if the replay isn't
+    // where the recording was.
+    bool run_frame();
+
+    // the rest of the log, true if it all played back the same
+    bool run_to_end();
+
+    inline const bool ok() const
+    {
+        return m_ok;
+    }
+
+    inline const uint64_t frame() const
+    {
+        return m_frame;
+    }
+
+    inline GameBoy& machine()
+    {
+        return m_gb;
+    }
+
+    // Replays each keyframe to the next, and the last to the end, on up to
+    // threads threads, 0 for one per core, with a machine each which doesn't
+    // draw.
+    static const Verification verify(const std::vector<uint8_t>& rom, const InputLog& log, const size_t threads = 0);
+
+private:
+    // a checkpoint reached, false if the state isn't what was recorded
+    const bool check(const InputLog::Checkpoint& at);
+
+    GameBoy& m_gb;
+    const InputLog& m_log;
+    uint64_t m_frame;
+    size_t m_event;
+    size_t m_next_keyframe;
+    bool m_ok;
+};
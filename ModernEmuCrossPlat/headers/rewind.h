@@ -0,0 +1,138 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "save_state.h"
+
+// The last frames of a run, for stepping back through them. push() saves the
+// machine once a frame, as a save state XORed with the frame before and the
+// zero runs in that left out, and every keyframe_interval frames as a whole
+// state, encoded the same way against nothing.
+//
+// Frames go into one ring of budget bytes, allocated up front. When it's full
+// the oldest keyframe goes, along with the frames that need it. Going back n
+// frames from the newest undoes n deltas, and reaching any other frame
+// applies the deltas from the keyframe before it, so neither ever decodes
+// more than keyframe_interval of them.
+class Rewind
+{
+public:
+    Rewind(const size_t budget, const size_t keyframe_interval = 60);
+
+    Rewind(const Rewind&) = delete;
+    Rewind& operator=(const Rewind&) = delete;
+
+    // Keeps the machine's state as the next frame. False if it's bigger
+    // than the whole budget, and nothing is kept.
+    template<class Machine>
+    bool push(const Machine& machine)
+    {
+        // the padding stays 0, save() never reaches it
+        m_next.resize(padded(machine.saved_size()));
+        BufferSink sink(m_next.data(), m_next.size());
+        return machine.save(sink) && push_state();
+    }
+
+    // Loads the frame, which has to be between oldest() and newest(). The
+    // frames after it are kept, see rewind().
+    template<class Machine>
+    bool seek(Machine& machine, const uint64_t frame)
+    {
+        if (!decode(frame, m_seek))
+            return false;
+        BufferSource source(m_seek.data(), m_seek.size());
+        return machine.load(source);
+    }
+
+    // Loads the frame back from the newest and forgets those after it, so
+    // the next push() follows on from there.
+    template<class Machine>
+    bool rewind(Machine& machine, const uint64_t frames)
+    {
+        if (empty() || frames > newest() - oldest() || !decode(newest() - frames, m_seek))
+            return false;
+        BufferSource source(m_seek.data(), m_seek.size());
+        if (!machine.load(source))
+            return false;
+        truncate(newest() - frames);
+        return true;
+    }
+
+    inline const bool empty() const
+    {
+        return m_entries.empty();
+    }
+
+    // frames are numbered from 0 by push(), these only with !empty()
+    inline const uint64_t oldest() const
+    {
+        return m_entries.front().frame;
+    }
+
+    inline const uint64_t newest() const
+    {
+        return m_entries.back().frame;
+    }
+
+    inline const size_t frames() const
+    {
+        return m_entries.size();
+    }
+
+    // bytes of the ring holding frames
+    const size_t used() const;
+
+    inline const size_t budget() const
+    {
+        return m_ring.size();
+    }
+
+    // Encodes state XOR base in 8 byte words, as pairs of a count of zero
+    // words to skip and a count of words which follow, both LEB128, then
+    // those words. Trailing zeros aren't written. size is a multiple of 8,
+    // out holds max_encoded(size). Returns the bytes written.
+    static const size_t encode(const uint8_t* state, const uint8_t* base, const size_t size, uint8_t* out);
+
+    // XORs what encode() wrote into state, false if it runs past size
+    static const bool apply(const uint8_t* delta, const size_t delta_size, uint8_t* state, const size_t size);
+
+    static inline const size_t max_encoded(const size_t size)
+    {
+        return size + size / 4 + 20;
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t frame;
+        size_t offset;
+        size_t size;
+        bool keyframe;
+    };
+
+    static inline const size_t padded(const size_t size)
+    {
+        return (size + 7) & ~size_t(7);
+    }
+
+    // encodes m_next against the newest frame and makes it the newest
+    bool push_state();
+
+    // the state of frame into out, from the newest back or a keyframe on
+    bool decode(const uint64_t frame, std::vector<uint8_t>& out) const;
+
+    // drops the frames after frame, whose state decode() left in m_seek
+    void truncate(const uint64_t frame);
+
+    std::vector<uint8_t> m_ring;
+    size_t m_keyframe_interval;
+    std::deque<Entry> m_entries;
+    uint64_t m_next_frame;
+
+    // the newest frame's state, what the next one is encoded against
+    std::vector<uint8_t> m_newest;
+    std::vector<uint8_t> m_next;
+    std::vector<uint8_t> m_encoded;
+    std::vector<uint8_t> m_seek;
+};
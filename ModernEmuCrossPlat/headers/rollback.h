@@ -0,0 +1,178 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "link_cable.h"
+
+// Carries each player's buttons for a frame to the other player's session.
+// Inputs arrive in the order they were sent, however late.
+class InputTransport
+{
+public:
+    struct Input
+    {
+        uint64_t frame;
+        uint8_t buttons;
+    };
+
+    virtual ~InputTransport() = default;
+
+    virtual void send(const Input& input) = 0;
+
+    // the next input to have arrived, false if there isn't one yet
+    virtual bool receive(Input& input) = 0;
+};
+
+// Both ends of a connection in one process, for trying sessions out. An
+// input sent arrives delay ticks later, plus up to jitter more picked by a
+// generator seeded with seed, but never before one sent earlier.
+class LoopbackTransport
+{
+public:
+    LoopbackTransport(const size_t delay, const size_t jitter = 0, const uint32_t seed = 1);
+
+    // the ends point back here, so it stays where it is
+    LoopbackTransport(const LoopbackTransport&) = delete;
+    LoopbackTransport& operator=(const LoopbackTransport&) = delete;
+
+    // the end side, 0 or 1, sends from and receives at
+    inline InputTransport& side(const size_t side)
+    {
+        return m_ends[side];
+    }
+
+    // time passes, a frame say
+    inline void tick()
+    {
+        ++m_now;
+    }
+
+    inline void set_delay(const size_t delay)
+    {
+        m_delay = delay;
+    }
+
+private:
+    struct Message
+    {
+        uint64_t arrives;
+        InputTransport::Input input;
+    };
+
+    class End : public InputTransport
+    {
+    public:
+        End(LoopbackTransport& owner, const size_t side);
+
+        void send(const Input& input) override;
+
+        bool receive(Input& input) override;
+
+    private:
+        LoopbackTransport& m_owner;
+        size_t m_side;
+    };
+
+    uint64_t m_now;
+    size_t m_delay;
+    size_t m_jitter;
+    uint32_t m_random;
+    // on their way to each side
+    std::array<std::deque<Message>, 2> m_queues;
+    std::array<End, 2> m_ends;
+};
+
+// One player's copy of a two player session: both machines, linked, and
+// both players' buttons. The local player's are known as they're pressed,
+// the remote player's come over the transport, so until they do the
+// session guesses they're still what they were and runs on. When they turn
+// out to be something else it restores the machines to the frame guessed
+// wrong, from the paged snapshot taken at the start of each frame, and runs
+// the frames since again with what was really pressed, undrawn. The session
+// never gets more than max_rollback frames ahead of the remote player's
+// input, so that's the most it ever runs again.
+//
+// Both players' sessions run the same frames with the same buttons, so they
+// agree once the inputs are all in, frame for frame.
+class RollbackSession
+{
+public:
+    static constexpr size_t players = 2;
+
+    struct Stats
+    {
+        uint64_t rollbacks;
+        uint64_t resimulated;
+        // advance()s turned down to wait for the remote player
+        uint64_t stalls;
+        size_t longest;
+    };
+
+    // for the player local, 0 or 1, of two on the same ROM
+    RollbackSession(const std::vector<uint8_t>& rom, const size_t local, InputTransport& transport, const size_t max_rollback = 8);
+
+    // Takes in the inputs which have arrived, then runs the next frame with
+    // the local player's buttons, sending them off. False, with nothing run,
+    // if that would be max_rollback frames past the remote player's input,
+    // to try again later.
+    bool advance(const uint8_t buttons);
+
+    // takes in the inputs which have arrived, running again from the first
+    // frame they show was guessed wrong
+    void poll();
+
+    // frames run
+    inline const uint64_t frame() const
+    {
+        return m_frame;
+    }
+
+    // frames with the remote player's input in, those run or not
+    inline const uint64_t confirmed() const
+    {
+        return m_confirmed;
+    }
+
+    inline GameBoy& machine(const size_t player)
+    {
+        return *m_machines[player];
+    }
+
+    inline const Stats& stats() const
+    {
+        return m_stats;
+    }
+
+private:
+    struct Saved
+    {
+        std::array<GameBoy::PagedSnapshot, players> machines;
+        LinkCable::State cable;
+    };
+
+    // the start of frame, kept until it can't be rolled back to
+    inline Saved& saved(const uint64_t frame)
+    {
+        return m_saved[frame % m_saved.size()];
+    }
+
+    // frame m_frame, from its start
+    void run_frame();
+
+    // back to the start of frame and on to where the session was
+    void resimulate(const uint64_t from);
+
+    std::array<std::unique_ptr<GameBoy>, players> m_machines;
+    LinkCable m_cable;
+    size_t m_local;
+    InputTransport& m_transport;
+
+    // each player's buttons by frame, the remote player's from m_confirmed
+    // on guessed
+    std::array<std::vector<uint8_t>, players> m_inputs;
+    std::vector<Saved> m_saved;
+    uint64_t m_frame;
+    uint64_t m_confirmed;
+    Stats m_stats;
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <vector>
+
+#include "mapped_file.h"
+
+// What a corpus of ROMs does, for deciding which fast paths are worth
+// building and which ROMs make a representative benchmark set. Each ROM is
+// mapped and its code found without running it, by the recursive descent
+// Disassembler uses, then summarised: how often each opcode appears in the
+// code found and how often inside a loop, the cartridge type, the bank count
+// and the idioms the fast paths know.
+//
+// A loop is the code between a backward JR or JP and its target, in one
+// bank. The idioms come from the matchers the machine runs with, so an
+// idle wait here is one IdleLoops would skip and a copy one FusedLoops would
+// fuse.
+//
+// The index is a file of fixed size records, each with its opcode counts
+// sorted by opcode, and the names last. load() maps it and queries read it
+// in place.
+class RomIndex
+{
+public:
+    enum Idiom : uint16_t
+    {
+        IdleWait = 1 << 0,
+        Copy16 = 1 << 1,
+        Copy8 = 1 << 2,
+        Fill = 1 << 3,
+        HaltLoop = 1 << 4,
+        BankSwitch = 1 << 5,
+        JumpTable = 1 << 6,
+        OamDma = 1 << 7,
+    };
+
+    static constexpr size_t idiom_count = 8;
+    static constexpr uint32_t format_version = 1;
+
+    // opcodes are numbered 0-255, the CB page 256-511
+    struct OpCount
+    {
+        uint16_t op;
+        uint16_t reserved;
+        uint32_t count;
+        // of those, inside a loop
+        uint32_t hot;
+    };
+
+    struct Record
+    {
+        uint64_t rom_hash;
+        uint32_t name_offset;
+        uint32_t first_op;
+        // instructions found, and of those inside a loop
+        uint32_t instructions;
+        uint32_t hot_instructions;
+        uint16_t name_size;
+        uint16_t op_count;
+        uint16_t banks;
+        uint16_t idioms;
+        uint8_t cart_type;
+        std::array<uint8_t, 7> reserved;
+    };
+
+    // one ROM, as scan() finds it
+    struct Summary
+    {
+        std::string name;
+        Record record;
+        std::vector<OpCount> ops;
+    };
+
+    // "IdleWait", "Copy16" ... for bit i
+    static const std::string_view idiom_name(const size_t i);
+
+    // "MBC1", "MBC5" ... for the header's cartridge type byte
+    static const std::string_view mbc_name(const uint8_t cart_type);
+
+    static Summary scan(const std::string& name, const std::vector<uint8_t>& rom);
+
+    // every file under dir with a .gb or .gbc extension, on up to threads
+    // threads, 0 for one per core, sorted by name
+    static std::vector<Summary> scan_directory(const std::string& dir, const size_t threads = 0);
+
+    // written next to path and renamed over it
+    static bool save(const std::string& path, const std::vector<Summary>& summaries);
+
+    // false, keeping nothing, if path isn't a whole index
+    bool load(const std::string& path);
+
+    inline const size_t size() const
+    {
+        return m_count;
+    }
+
+    inline const Record& record(const size_t i) const
+    {
+        return m_records[i];
+    }
+
+    inline const std::string_view name(const size_t i) const
+    {
+        return std::string_view(m_names + m_records[i].name_offset, m_records[i].name_size);
+    }
+
+    // rom i's counts for op, nullptr if it never appears
+    const OpCount* find(const size_t i, const uint16_t op) const;
+
+    inline const OpCount* ops_begin(const size_t i) const
+    {
+        return m_ops + m_records[i].first_op;
+    }
+
+    inline const OpCount* ops_end(const size_t i) const
+    {
+        return ops_begin(i) + m_records[i].op_count;
+    }
+
+private:
+    struct FileHeader
+    {
+        std::array<char, 8> magic;
+        uint32_t version;
+        uint32_t count;
+        uint32_t op_total;
+        uint32_t names_size;
+    };
+
+    static constexpr std::array<char, 8> file_magic = { 'G', 'B', 'R', 'O', 'M', 'I', 'D', 'X' };
+
+    MappedFile m_file;
+    size_t m_count = 0;
+    const Record* m_records = nullptr;
+    const OpCount* m_ops = nullptr;
+    const char* m_names = nullptr;
+};
+
+static_assert(sizeof(RomIndex::Record) == 40, "records are saved as they are");
+static_assert(sizeof(RomIndex::OpCount) == 12, "op counts are saved as they are");
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "gameboy.h"
+
+// Shows each frame as it will be frames() on, so the frames a game takes to
+// react to the buttons don't show. Each frame runs the machine a frame with
+// the buttons, takes a paged snapshot, runs frames() more with the same
+// buttons, drawing only the last, and restores the snapshot. The picture
+// isn't part of a snapshot, so the last one is left to show.
+//
+// A frame costs frames() + 1 frames of emulation, only one of them drawn,
+// and a paged snapshot and restore, which copy only the pages those frames
+// wrote. The machine itself runs as it would without, frame by frame.
+class RunAhead
+{
+public:
+    using Picture = std::array<uint8_t, Ppu::width * Ppu::height>;
+
+    // drawing as the machine does now, 0 frames runs none ahead
+    RunAhead(GameBoy& gb, const size_t frames);
+
+    // a frame with the buttons held, returns the picture frames() on
+    const Picture& run_frame(const uint8_t buttons);
+
+    // a frame with the buttons as they are
+    inline const Picture& run_frame()
+    {
+        return run_frame(m_gb.joypad().buttons());
+    }
+
+    // the machine's, which the frames ahead don't add to
+    inline const uint64_t cycles() const
+    {
+        return m_gb.cycles();
+    }
+
+    inline const size_t frames() const
+    {
+        return m_frames;
+    }
+
+    inline void set_frames(const size_t frames)
+    {
+        m_frames = frames;
+    }
+
+    inline GameBoy& machine()
+    {
+        return m_gb;
+    }
+
+private:
+    GameBoy& m_gb;
+    size_t m_frames;
+    bool m_render;
+};
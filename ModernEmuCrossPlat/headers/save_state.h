@@ -0,0 +1,196 @@
+#pragma once
+
+// Save states. A fixed header, then tagged chunks, each with its own version
+// and size, the last one END:
+//
+//   CPU   registers and interrupt state
+//   MACH  clock cycles since power on
+//   TIMR  Timer::State
+//   JOYP  Joypad::State
+//   PPU   Ppu::State
+//   CART  MBC registers
+//   CRAM  every cartridge RAM bank
+//   MEM   the bus from $8000, the mapped RAM bank included
+//   LCD   the framebuffer
+//
+// A chunk only ever grows at the end. A reader takes the part it knows and
+// skips the rest, and fields missing from an older, shorter chunk keep the
+// machine's current values. Chunks a reader doesn't know are skipped.
+// format_version only changes for what can't be read that way, and a
+// reader refuses states newer than it.
+//
+// Values are in host byte order. The header records it, and a state from a
+// host of the other order is refused.
+//
+// The machine writes each chunk straight from where its state lives and
+// reads it straight back into place, there's no copy of the whole state in
+// between. A state is about 55KB, and the cartridge RAM.
+namespace save_state
+{
+    constexpr uint32_t format_version = 1;
+    constexpr uint16_t byte_order_mark = 0x0102;
+
+    struct Header
+    {
+        std::array<char, 8> magic;
+        uint32_t version;
+        uint16_t header_size;
+        uint16_t byte_order;
+        uint64_t rom_hash;
+    };
+
+    struct ChunkHeader
+    {
+        std::array<char, 4> tag;
+        uint16_t version;
+        uint16_t reserved;
+        uint32_t size;
+    };
+
+    constexpr std::array<char, 8> magic = { 'G', 'B', 'S', 'T', 'A', 'T', 'E', 0 };
+
+    using Tag = std::array<char, 4>;
+    constexpr Tag cpu_tag = { 'C', 'P', 'U', ' ' };
+    constexpr Tag machine_tag = { 'M', 'A', 'C', 'H' };
+    constexpr Tag timer_tag = { 'T', 'I', 'M', 'R' };
+    constexpr Tag joypad_tag = { 'J', 'O', 'Y', 'P' };
+    constexpr Tag ppu_tag = { 'P', 'P', 'U', ' ' };
+    constexpr Tag cartridge_tag = { 'C', 'A', 'R', 'T' };
+    constexpr Tag cartridge_ram_tag = { 'C', 'R', 'A', 'M' };
+    constexpr Tag memory_tag = { 'M', 'E', 'M', ' ' };
+    constexpr Tag lcd_tag = { 'L', 'C', 'D', ' ' };
+    constexpr Tag end_tag = { 'E', 'N', 'D', ' ' };
+
+    // the part of the bus saved, the ROM below it comes from the cartridge
+    constexpr uint16_t memory_start = 0x8000;
+    constexpr size_t memory_size = 0x10000 - memory_start;
+
+    struct CpuChunk
+    {
+        // BC, DE, HL, AF, SP, PC
+        std::array<uint16_t, 6> registers;
+        uint8_t ime;
+        uint8_t ime_pending;
+        uint8_t halted;
+        uint8_t halt_bug;
+        uint8_t stopped;
+        std::array<uint8_t, 3> reserved;
+    };
+
+    struct MachineChunk
+    {
+        uint64_t cycles;
+    };
+
+    struct CartridgeChunk
+    {
+        uint8_t bank1;
+        uint8_t bank2;
+        uint8_t mode;
+        uint8_t ram_enabled;
+    };
+}
+
+// Where a state is written. write() is called once per piece of a chunk,
+// never per byte, and false stops the save.
+class StateSink
+{
+public:
+    virtual ~StateSink() = default;
+
+    virtual bool write(const void* data, const size_t size) = 0;
+};
+
+// Where a state is read from, the reading side of StateSink.
+class StateSource
+{
+public:
+    virtual ~StateSource() = default;
+
+    virtual bool read(void* data, const size_t size) = 0;
+
+    virtual bool skip(const size_t size) = 0;
+};
+
+// A caller's buffer, or a region mapped writable. False once it's full.
+class BufferSink : public StateSink
+{
+public:
+    BufferSink(uint8_t* buffer, const size_t capacity)
+        : m_buffer(buffer)
+        , m_capacity(capacity)
+        , m_size(0)
+    {
+    }
+
+    bool write(const void* data, const size_t size) override;
+
+    // bytes written so far
+    inline const size_t size() const
+    {
+        return m_size;
+    }
+
+private:
+    uint8_t* m_buffer;
+    size_t m_capacity;
+    size_t m_size;
+};
+
+// A buffer, or a file mapped with MappedFile.
+class BufferSource : public StateSource
+{
+public:
+    BufferSource(const uint8_t* data, const size_t size)
+        : m_data(data)
+        , m_size(size)
+        , m_offset(0)
+    {
+    }
+
+    bool read(void* data, const size_t size) override;
+
+    bool skip(const size_t size) override;
+
+    inline const size_t offset() const
+    {
+        return m_offset;
+    }
+
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_offset;
+};
+
+// An open file, pipe or socket, written and read with no buffering of its
+// own. Reading from one can't be undone, see BasicGameBoy::load().
+class FdSink : public StateSink
+{
+public:
+    explicit FdSink(const int fd)
+        : m_fd(fd)
+    {
+    }
+
+    bool write(const void* data, const size_t size) override;
+
+private:
+    int m_fd;
+};
+
+class FdSource : public StateSource
+{
+public:
+    explicit FdSource(const int fd)
+        : m_fd(fd)
+    {
+    }
+
+    bool read(void* data, const size_t size) override;
+
+    bool skip(const size_t size) override;
+
+private:
+    int m_fd;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "cartridge.h"
+#include "ram.h"
+
+// A 64-bit hash of the bus from $8000 and the cartridge RAM off it, kept up
+// to date a page at a time, for BasicGameBoy::state_hash().
+//
+// Each page is hashed with where it is and the hashes added up, so a page
+// written only swaps its term of the sum. memory() hashes again the pages
+// the bus marked unhashed since it was last called, and the I/O page, which
+// changes without being marked. The RAM banks off the bus only change when
+// they're swapped, and are hashed again then. A restore which copies memory
+// without marking it calls forget().
+class StateHash
+{
+public:
+    static constexpr size_t first_page = 0x80;
+    static constexpr size_t pages = MemoryMap::page_count - first_page;
+
+    StateHash();
+
+    // the hash of memory as it is now, clears the bus's unhashed pages
+    const uint64_t memory(MemoryMap& bus, const Cartridge& cartridge);
+
+    // the next memory() hashes everything again, or only the RAM off the bus
+    inline void forget()
+    {
+        m_whole = true;
+        m_ram_stale = true;
+    }
+
+    inline void forget_ram()
+    {
+        m_ram_stale = true;
+    }
+
+    // size bytes hashed on from seed, for the registers
+    static const uint64_t bytes(const void* data, const size_t size, const uint64_t seed);
+
+private:
+    std::array<uint64_t, pages> m_pages;
+    uint64_t m_bus_sum;
+    uint64_t m_ram_sum;
+    uint64_t m_ram_swaps;
+    bool m_whole;
+    bool m_ram_stale;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "ram.h"
+
+// DIV, TIMA, TMA and TAC. DIV is the top byte of a 16 bit counter running at
+// the CPU clock, TIMA counts falling edges of the counter bit TAC selects.
+class Timer
+{
+public:
+    static constexpr uint16_t DIV = 0xFF04;
+    static constexpr uint16_t TIMA = 0xFF05;
+    static constexpr uint16_t TMA = 0xFF06;
+    static constexpr uint16_t TAC = 0xFF07;
+
+    // saved as it is, fields are only ever added at the end
+    struct State
+    {
+        uint16_t counter;
+        uint8_t tima;
+        uint8_t tma;
+        uint8_t tac;
+        bool overflow;
+    };
+
+    void tick(MemoryMap& bus, size_t cycles);
+
+    // clock cycles until TIMA overflows, the only thing that can raise an
+    // interrupt, SIZE_MAX while the timer is off
+    const size_t cycles_to_event() const;
+
+    const uint8_t read(const uint16_t location) const;
+
+    void write(const uint16_t location, const uint8_t val);
+
+    inline const State save_state() const
+    {
+        return State{ m_counter, m_tima, m_tma, m_tac, m_overflow };
+    }
+
+    inline void load_state(const State& state)
+    {
+        m_counter = state.counter;
+        m_tima = state.tima;
+        m_tma = state.tma;
+        m_tac = state.tac;
+        m_overflow = state.overflow;
+    }
+
+private:
+    // bit of the counter TIMA follows, 0 when the timer is off
+    inline const uint16_t selected_bit() const
+    {
+        static constexpr uint16_t bits[] = { 1 << 9, 1 << 3, 1 << 5, 1 << 7 };
+        return (m_tac & 0x04) ? bits[m_tac & 0x03] : 0;
+    }
+
+    uint16_t m_counter = 0xABCC;
+    uint8_t m_tima = 0;
+    uint8_t m_tma = 0;
+    uint8_t m_tac = 0xF8;
+    bool m_overflow = false;
+};
@@ -11,21 +11,22 @@ constexpr const size_t number_in_base(const size_t base)
     return num_digits(static_cast<size_t>(std::numeric_limits<_Ty>::max()), base);
 }
 
+// val in base _B, zero padded to as many digits as _Ty's largest value and
+// nul terminated, returned by value so it outlives the call
 template<
     class _Ty,
     const size_t _B,
     const size_t values = number_in_base<_Ty>(_B)>
 constexpr auto itoa_base(const _Ty val)
 {
+    static_assert(std::is_unsigned_v<_Ty>, "digits of unsigned values only");
+    static_assert(_B >= 2 && _B <= 16, "bases 2 to 16");
+
+    std::array<char, values + 1> data = {};
     _Ty valCopy(val);
-    char data[values + 1] = { '\0' };
     for (auto i = values; i > 0; --i)
     {
-        if ((val % static_cast<_Ty>(_B)) >= 0 && (val % static_cast<_Ty>(_B)) <= 9)
-            data[i] = '0' + (val % static_cast<_Ty>(_B));
-        else if ((val % static_cast<_Ty>(_B)) >= 0xA && (val % static_cast<_Ty>(_B)) <= 0xF)
-            data[i] = 'A' + ((val % static_cast<_Ty>(_B)) - 0xA);
-
+        data[i - 1] = "0123456789ABCDEF"[valCopy % static_cast<_Ty>(_B)];
         valCopy = valCopy / static_cast<_Ty>(_B);
     }
 
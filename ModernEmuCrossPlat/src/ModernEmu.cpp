@@ -1,65 +1,231 @@
 // ModernEmu.cpp : This file contains the 'main' function. Program execution begins and ends there.
 //
+// usage: ModernEmuCrossPlat <rom> [--frames N] [--opcode-stats [TOP]]
+//            [--profile [TOP]] [--sym FILE] [--folded FILE] [--sample-interval N]
+//            [--block-cache FILE] [--coverage FILE] [--run-ahead N]
+// --frames runs the machine, --opcode-stats runs it on the instrumented core
+// and prints the opcode mix, --profile runs it under the guest profiler and
+// prints the hottest functions, naming them from --sym (the ROM's .sym by
+// default) and writing folded stacks to --folded. --block-cache runs --frames
+// from translated blocks, starting from FILE if it's there and saving it
+// after. --coverage records what --frames ran into FILE, adding to what's
+// there, for gbcov to report on. --run-ahead draws each of --frames N frames
+// ahead, see run_ahead.h, to see what that costs. Listings come from gbdis,
+// decoder conformance lives in tests/.
 
 #include "pch.h"
 
-#include "parsed_op_codes.h"
-#include "cpu.h"
+#include <chrono>
+#include <vector>
 
-int main()
+#include "gameboy.h"
+#include "profiler.h"
+#include "run_ahead.h"
+
+namespace
 {
-    auto opCodes = ParsedOpCodes();
-    auto memory = make_shared<MemoryMap>();
-    GBZ80 gba_cpu(memory);
+    const std::vector<uint8_t> load_rom(const char* path)
+    {
+        std::ifstream rom(path, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(rom), std::istreambuf_iterator<char>());
+    }
+
+    template<class Machine>
+    void run(Machine& gb, const size_t frames)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < frames; ++i)
+            gb.run_frame();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << frames << " frames, " << gb.cycles() << " cycles in " << seconds << "s ("
+            << (seconds > 0 ? frames / seconds : 0) << " fps)" << std::endl;
+    }
+
+    // the .sym next to the ROM, the way RGBDS names them
+    const std::string default_sym_path(const std::string& rom_path)
+    {
+        const auto dot = rom_path.find_last_of('.');
+        const auto slash = rom_path.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            return rom_path + ".sym";
+        return rom_path.substr(0, dot) + ".sym";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: ModernEmuCrossPlat <rom> [--frames N] [--opcode-stats [TOP]]"
+            " [--profile [TOP]] [--sym FILE] [--folded FILE] [--sample-interval N] [--block-cache FILE] [--coverage FILE]"
+            " [--run-ahead N]" << std::endl;
+        return 1;
+    }
+
+    const auto rom = load_rom(argv[1]);
+    if (rom.empty())
+    {
+        std::cerr << "can't open " << argv[1] << std::endl;
+        return 1;
+    }
+
+    size_t frames = 0;
+    bool opcode_stats = false;
+    size_t top = 40;
+    bool profile = false;
+    size_t profile_top = 20;
+    std::string sym_path;
+    std::string folded_path;
+    size_t sample_interval = 1024;
+    std::string block_cache_path;
+    std::string coverage_path;
+    size_t run_ahead = 0;
+    for (int i = 2; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc)
+        {
+            frames = std::stoul(argv[++i]);
+        }
+        else if (arg == "--opcode-stats")
+        {
+            opcode_stats = true;
+            if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])))
+                top = std::stoul(argv[++i]);
+        }
+        else if (arg == "--profile")
+        {
+            profile = true;
+            if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])))
+                profile_top = std::stoul(argv[++i]);
+        }
+        else if (arg == "--sym" && i + 1 < argc)
+        {
+            sym_path = argv[++i];
+        }
+        else if (arg == "--folded" && i + 1 < argc)
+        {
+            folded_path = argv[++i];
+        }
+        else if (arg == "--sample-interval" && i + 1 < argc)
+        {
+            sample_interval = std::stoul(argv[++i]);
+        }
+        else if (arg == "--block-cache" && i + 1 < argc)
+        {
+            block_cache_path = argv[++i];
+        }
+        else if (arg == "--coverage" && i + 1 < argc)
+        {
+            coverage_path = argv[++i];
+        }
+        else if (arg == "--run-ahead" && i + 1 < argc)
+        {
+            run_ahead = std::stoul(argv[++i]);
+        }
+        else
+        {
+            std::cerr << "unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (frames == 0 && !opcode_stats && !profile)
+    {
+        std::cerr << "nothing to do, give --frames, --opcode-stats or --profile" << std::endl;
+        return 1;
+    }
 
-    //while (gba_cpu.get_pc() < 0x10000)
+    frames = std::max<size_t>(frames, 1);
+    if (profile)
     {
-        for(const auto& opKeyValue : opCodes)
+        SymbolTable symbols;
+        if (!symbols.load(sym_path.empty() ? default_sym_path(argv[1]) : sym_path) && !sym_path.empty())
+        {
+            std::cerr << "can't open " << sym_path << std::endl;
+            return 1;
+        }
+
+        Profiler profiler(sample_interval);
+        profiler.set_symbols(std::move(symbols));
+
+        GameBoy gb(rom);
+        for (size_t i = 0; i < frames; ++i)
+            profiler.run_frame(gb);
+        std::cout << profiler.report(profile_top);
+
+        if (!folded_path.empty())
+        {
+            std::ofstream folded(folded_path);
+            profiler.write_folded(folded);
+        }
+    }
+    else if (opcode_stats)
+    {
+        InstrumentedGameBoy gb(rom);
+        run(gb, frames);
+        std::cout << format_opcode_stats(gb.cpu().stats(), top);
+    }
+    else
+    {
+        GameBoy gb(rom);
+        shared_ptr<BlockCache> cache;
+        if (!block_cache_path.empty())
+        {
+            cache = make_shared<BlockCache>(rom);
+            if (cache->load(block_cache_path))
+                std::cout << cache->size() << " blocks from " << block_cache_path << std::endl;
+            gb.set_block_cache(cache);
+        }
+        shared_ptr<Coverage> coverage;
+        if (!coverage_path.empty())
         {
-            const auto opT = opKeyValue.first;
-            const auto refOpCode = opKeyValue.second;
-            if (opKeyValue.first != 0xcb)
+            coverage = make_shared<Coverage>(rom);
+            std::ifstream in(coverage_path, std::ios::binary);
+            if (in.is_open() && !coverage->merge(in))
             {
-                auto decoded_op = gba_cpu.decode_op(gba_cpu.get_pc(), opT);
-
-                //std::cout << decoded_op.tostring() << std::endl;
-                //std::cout << opCodes[opT]->tostring() << std::endl;
-                bool nameMatch = (refOpCode->GetMnemonic() == decoded_op.name);
-                bool flagMatches = true;
-                for (size_t f = 0; f < 4; ++f)
-                {
-                    flagMatches = flagMatches && (refOpCode->GetFlag(f) == decoded_op.GetFlag(f));
-                    if (!flagMatches)
-                        break;
-                }
-
-                bool lengthMatch = static_cast<uint8_t>(refOpCode->GetLength()) == decoded_op.length;
-                bool cyclesMatch = (decoded_op.min_timing == refOpCode->MinCycles()) && (decoded_op.max_timing == refOpCode->MaxCycles());
-
-                bool operand1Match = decoded_op.GetOprand1Name() == refOpCode->GetOperand1();
-                bool operand2Match = decoded_op.GetOprand2Name() == refOpCode->GetOperand2();
-
-                if (!nameMatch || !flagMatches || !lengthMatch || !cyclesMatch || !operand1Match || !operand2Match)
-                {
-                    std::cout << decoded_op.tostring() << std::endl;
-                    std::cout << refOpCode->tostring() << std::endl;
-                    std::cout << "NO MATCHED!!!" << std::endl;
-                    std::cout << "-----------------------------" << std::endl;
-                }
+                std::cerr << coverage_path << " isn't coverage of this ROM" << std::endl;
+                return 1;
             }
-            /*else
+            if (!gb.set_coverage(coverage))
             {
-                for (size_t sub_op = 0; sub_op <= 0xff; ++sub_op)
-                {
-                    memory->write(gba_cpu.get_pc() + 1, (uint8_t)sub_op);
-                    auto decoded_op = gba_cpu.decode_op(gba_cpu.get_pc(), (uint8_t)op);
-                    std::cout << "CD EXT --- " << decoded_op.tostring() << std::endl;
-                }
-            }*/
-        }
-
-        /*gba_cpu.set_pc(decoded_op.location + decoded_op.length);
-        if (decoded_op.location > gba_cpu.get_pc())
-            break;*/
+                std::cerr << "can't record coverage of a ROM that isn't whole banks" << std::endl;
+                return 1;
+            }
+        }
+
+        if (run_ahead != 0)
+        {
+            RunAhead ahead(gb, run_ahead);
+            run(ahead, frames);
+        }
+        else
+        {
+            run(gb, frames);
+        }
+
+        if (coverage)
+        {
+            std::ofstream out(coverage_path, std::ios::binary);
+            if (!coverage->write(out))
+            {
+                std::cerr << "can't write " << coverage_path << std::endl;
+                return 1;
+            }
+            std::cout << coverage->bytes_run() << " ROM bytes and " << coverage->edge_count() << " edges covered" << std::endl;
+        }
+
+        if (cache && cache->translated() != 0)
+        {
+            if (!cache->save(block_cache_path))
+            {
+                std::cerr << "can't write " << block_cache_path << std::endl;
+                return 1;
+            }
+            std::cout << cache->translated() << " blocks translated, " << cache->size() << " saved" << std::endl;
+        }
     }
-}
\ No newline at end of file
+
+    return 0;
+}
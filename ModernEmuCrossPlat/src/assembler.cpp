@@ -0,0 +1,904 @@
+#include "pch.h"
+
+#include "assembler.h"
+
+#include <cctype>
+#include <vector>
+
+#include "cartridge.h"
+#include "opcode_table.h"
+
+namespace
+{
+    constexpr uint16_t ROMX_ADDR = 0x4000;
+    constexpr uint16_t ROM_END = 0x8000;
+
+    // how an operand is written in the opcode table
+    enum class PatternKind
+    {
+        Literal,        // A, (HL+), NZ ...
+        Imm8,           // d8, r8 outside JR
+        Imm16,          // d16, a16
+        Rel8,           // r8 of JR
+        HighMem,        // (a8)
+        Mem16,          // (a16)
+        SPRel8,         // SP+r8
+        Constant        // RST vectors and bit numbers, part of the opcode
+    };
+
+    struct Pattern
+    {
+        PatternKind kind;
+        std::string_view literal;
+        int64_t value;
+    };
+
+    struct Instruction
+    {
+        bool prefixed;
+        uint8_t op;
+        size_t length;
+        std::vector<Pattern> operands;
+    };
+
+    // how an operand looks in the source
+    enum class OperandKind
+    {
+        Literal,
+        Value,
+        Memory,
+        SPRelative
+    };
+
+    struct SourceOperand
+    {
+        OperandKind kind;
+        std::string text;
+    };
+
+    const std::string upper(std::string text)
+    {
+        for (auto& c : text)
+            c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        return text;
+    }
+
+    const std::string trim(const std::string& text)
+    {
+        const auto first = text.find_first_not_of(" \t\r");
+        if (first == std::string::npos)
+            return std::string();
+        const auto last = text.find_last_not_of(" \t\r");
+        return text.substr(first, last - first + 1);
+    }
+
+    inline const bool is_ident_char(const char c)
+    {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.';
+    }
+
+    const Pattern make_pattern(const std::string_view name, const std::string_view mnemonic)
+    {
+        if (name == "d8")
+            return { PatternKind::Imm8, name, 0 };
+        if (name == "d16" || name == "a16")
+            return { PatternKind::Imm16, name, 0 };
+        if (name == "r8")
+            return { (mnemonic == "JR") ? PatternKind::Rel8 : PatternKind::Imm8, name, 0 };
+        if (name == "(a8)")
+            return { PatternKind::HighMem, name, 0 };
+        if (name == "(a16)")
+            return { PatternKind::Mem16, name, 0 };
+        if (name == "SP+r8")
+            return { PatternKind::SPRel8, name, 0 };
+        if (name.size() == 1 && name[0] >= '0' && name[0] <= '7')
+            return { PatternKind::Constant, name, name[0] - '0' };
+        if (name.size() == 3 && name[2] == 'H')
+            return { PatternKind::Constant, name, std::stoi(std::string(name.substr(0, 2)), nullptr, 16) };
+        return { PatternKind::Literal, name, 0 };
+    }
+
+    // every instruction in the tables by mnemonic
+    const std::map<std::string, std::vector<Instruction>>& instructions()
+    {
+        static const auto table = []()
+        {
+            std::map<std::string, std::vector<Instruction>> table;
+            const auto add = [&table](const ParsedOpCode& entry, const bool prefixed)
+            {
+                if (!entry.IsValid() || entry.GetMnemonic() == "PREFIX")
+                    return;
+
+                Instruction ins{ prefixed, entry.GetAddr(), entry.GetLength(), {} };
+                for (const auto name : { entry.GetOperand1(), entry.GetOperand2() })
+                {
+                    if (!name.empty())
+                        ins.operands.push_back(make_pattern(name, entry.GetMnemonic()));
+                }
+                table[std::string(entry.GetMnemonic())].push_back(ins);
+            };
+
+            for (const auto& entry : unprefixed_op_codes)
+                add(entry, false);
+            for (const auto& entry : cbprefixed_op_codes)
+                add(entry, true);
+            return table;
+        }();
+        return table;
+    }
+
+    // register, condition and fixed memory operands, with the usual aliases
+    const std::map<std::string, std::string> source_literals = {
+        { "A", "A" }, { "B", "B" }, { "C", "C" }, { "D", "D" }, { "E", "E" }, { "H", "H" }, { "L", "L" },
+        { "AF", "AF" }, { "BC", "BC" }, { "DE", "DE" }, { "HL", "HL" }, { "SP", "SP" },
+        { "NZ", "NZ" }, { "Z", "Z" }, { "NC", "NC" },
+        { "(BC)", "(BC)" }, { "(DE)", "(DE)" }, { "(HL)", "(HL)" },
+        { "(HL+)", "(HL+)" }, { "(HLI)", "(HL+)" }, { "(HL-)", "(HL-)" }, { "(HLD)", "(HL-)" },
+        { "(C)", "(C)" }, { "($FF00+C)", "(C)" }, { "(0XFF00+C)", "(C)" } };
+
+    const SourceOperand classify(const std::string& text)
+    {
+        std::string norm;
+        for (const char c : upper(text))
+        {
+            if (c == ' ' || c == '\t')
+                continue;
+            norm += (c == '[') ? '(' : (c == ']') ? ')' : c;
+        }
+
+        const auto literal = source_literals.find(norm);
+        if (literal != source_literals.end())
+            return { OperandKind::Literal, literal->second };
+
+        if (norm.size() > 3 && norm.compare(0, 2, "SP") == 0 && (norm[2] == '+' || norm[2] == '-'))
+            return { OperandKind::SPRelative, trim(text).substr(2) };
+
+        const std::string trimmed = trim(text);
+        if (trimmed.size() >= 2 && (trimmed.front() == '(' || trimmed.front() == '[') && (trimmed.back() == ')' || trimmed.back() == ']'))
+            return { OperandKind::Memory, trimmed.substr(1, trimmed.size() - 2) };
+
+        return { OperandKind::Value, trimmed };
+    }
+
+    // splits on commas outside quotes and brackets
+    const std::vector<std::string> split_operands(const std::string& text)
+    {
+        std::vector<std::string> parts;
+        std::string current;
+        int depth = 0;
+        char quote = 0;
+        for (const char c : text)
+        {
+            if (quote)
+            {
+                if (c == quote)
+                    quote = 0;
+            }
+            else if (c == '"' || c == '\'')
+            {
+                quote = c;
+            }
+            else if (c == '(' || c == '[')
+            {
+                ++depth;
+            }
+            else if (c == ')' || c == ']')
+            {
+                --depth;
+            }
+            else if (c == ',' && depth == 0)
+            {
+                parts.push_back(trim(current));
+                current.clear();
+                continue;
+            }
+            current += c;
+        }
+
+        if (!trim(current).empty() || !parts.empty())
+            parts.push_back(trim(current));
+        return parts;
+    }
+
+    class Assembler
+    {
+    public:
+        explicit Assembler(const std::string& source)
+        {
+            std::stringstream stream(source);
+            std::string line;
+            while (std::getline(stream, line))
+                m_lines.push_back(line);
+        }
+
+        const AssembledRom run()
+        {
+            for (m_pass = 1; m_pass <= 2; ++m_pass)
+            {
+                m_bank = 0;
+                m_pc = 0;
+                m_max_bank = 1;
+                m_scope.clear();
+                m_image.assign(ROM_END, 0x00);
+                m_written.assign(ROM_END, false);
+
+                for (m_line = 0; m_line < m_lines.size(); ++m_line)
+                    assemble_line(m_lines[m_line]);
+            }
+
+            finish_image();
+            return m_out;
+        }
+
+    private:
+        struct Value
+        {
+            int64_t value;
+            bool known;
+        };
+
+        struct Label
+        {
+            uint16_t bank;
+            uint16_t addr;
+        };
+
+        void error(const std::string& message)
+        {
+            // pass one would report the same things again
+            if (m_pass != 2)
+                return;
+            if (!m_out.errors.empty() && m_out.errors.back().line == m_line + 1 && m_out.errors.back().message == message)
+                return;
+            m_out.errors.push_back({ m_line + 1, message });
+        }
+
+        const std::string full_name(const std::string& name) const
+        {
+            return (!name.empty() && name[0] == '.') ? m_scope + name : name;
+        }
+
+        void assemble_line(std::string text)
+        {
+            // comments, outside of strings
+            char quote = 0;
+            for (size_t i = 0; i < text.size(); ++i)
+            {
+                if (quote)
+                {
+                    if (text[i] == quote)
+                        quote = 0;
+                }
+                else if (text[i] == '"' || text[i] == '\'')
+                {
+                    quote = text[i];
+                }
+                else if (text[i] == ';')
+                {
+                    text.resize(i);
+                    break;
+                }
+            }
+
+            text = trim(text);
+            if (text.empty())
+                return;
+            m_start = m_pc;
+
+            // label:  or  label::
+            size_t end = 0;
+            while (end < text.size() && is_ident_char(text[end]))
+                ++end;
+            if (end > 0 && end < text.size() && text[end] == ':')
+            {
+                define_label(text.substr(0, end));
+                const auto after = text.find_first_not_of(':', end);
+                text = (after == std::string::npos) ? std::string() : trim(text.substr(after));
+                if (text.empty())
+                    return;
+            }
+
+            const auto space = text.find_first_of(" \t");
+            std::string word = upper(text.substr(0, space));
+            std::string rest = (space == std::string::npos) ? std::string() : trim(text.substr(space));
+
+            // NAME EQU expr, optionally with DEF in front
+            if (word == "DEF")
+            {
+                const auto next = rest.find_first_of(" \t");
+                word = upper(rest.substr(0, next));
+                text = rest;
+                rest = (next == std::string::npos) ? std::string() : trim(rest.substr(next));
+            }
+            const auto rest_space = rest.find_first_of(" \t");
+            if (upper(rest.substr(0, rest_space)) == "EQU")
+            {
+                define_constant(text.substr(0, text.find_first_of(" \t")), (rest_space == std::string::npos) ? std::string() : rest.substr(rest_space));
+                return;
+            }
+
+            const auto operands = split_operands(rest);
+            if (word == "ORG")
+                directive_org(operands);
+            else if (word == "BANK")
+                directive_bank(operands);
+            else if (word == "DB")
+                directive_db(operands);
+            else if (word == "DW")
+                directive_dw(operands);
+            else if (word == "DS")
+                directive_ds(operands);
+            else if (word == "TITLE")
+                m_title = operands.empty() ? std::string() : string_literal(operands[0]);
+            else if (word == "CART")
+                m_cart = header_byte(operands);
+            else if (word == "RAMSIZE")
+                m_ram_size = header_byte(operands);
+            else
+                instruction(word, operands);
+        }
+
+        void define_label(const std::string& raw)
+        {
+            if (raw[0] != '.')
+                m_scope = raw;
+
+            const auto name = full_name(raw);
+            if (m_pass == 1)
+            {
+                if (m_labels.count(name) || m_constants.count(name))
+                    m_out.errors.push_back({ m_line + 1, "duplicate symbol " + name });
+                m_labels[name] = Label{ m_bank, static_cast<uint16_t>(m_pc) };
+            }
+        }
+
+        void define_constant(const std::string& name, const std::string& expr)
+        {
+            if (m_pass == 2)
+                return;
+
+            const auto value = evaluate(expr);
+            if (!value.known)
+                m_out.errors.push_back({ m_line + 1, "EQU needs a value known at this point: " + name });
+            else if (m_constants.count(name) || m_labels.count(name))
+                m_out.errors.push_back({ m_line + 1, "duplicate symbol " + name });
+            m_constants[name] = value.value;
+        }
+
+        const uint8_t header_byte(const std::vector<std::string>& operands)
+        {
+            const auto value = operands.empty() ? Value{ 0, false } : evaluate(operands[0]);
+            if (!value.known || value.value < 0 || value.value > 0xFF)
+                error("expected a byte");
+            return static_cast<uint8_t>(value.value);
+        }
+
+        void directive_org(const std::vector<std::string>& operands)
+        {
+            const auto value = operands.empty() ? Value{ 0, false } : evaluate(operands[0]);
+            if (!value.known)
+            {
+                error("ORG needs a known address");
+                return;
+            }
+            if ((m_bank == 0 && (value.value < 0 || value.value >= ROM_END)) ||
+                (m_bank != 0 && (value.value < ROMX_ADDR || value.value >= ROM_END)))
+            {
+                error("ORG outside the bank");
+                return;
+            }
+            m_pc = static_cast<uint32_t>(value.value);
+        }
+
+        void directive_bank(const std::vector<std::string>& operands)
+        {
+            const auto value = operands.empty() ? Value{ 0, false } : evaluate(operands[0]);
+            if (!value.known || value.value < 0 || value.value > 0x1FF)
+            {
+                error("BANK needs a bank number");
+                return;
+            }
+            m_bank = static_cast<uint16_t>(value.value);
+            m_pc = (m_bank == 0) ? 0 : ROMX_ADDR;
+        }
+
+        void directive_db(const std::vector<std::string>& operands)
+        {
+            for (const auto& operand : operands)
+            {
+                if (!operand.empty() && operand[0] == '"')
+                {
+                    for (const char c : string_literal(operand))
+                        emit(static_cast<uint8_t>(c));
+                }
+                else
+                {
+                    emit(byte_value(evaluate(operand)));
+                }
+            }
+        }
+
+        void directive_dw(const std::vector<std::string>& operands)
+        {
+            for (const auto& operand : operands)
+                emit16(word_value(evaluate(operand)));
+        }
+
+        void directive_ds(const std::vector<std::string>& operands)
+        {
+            const auto count = operands.empty() ? Value{ 0, false } : evaluate(operands[0]);
+            if (!count.known || count.value < 0)
+            {
+                error("DS needs a known size");
+                return;
+            }
+            const uint8_t fill = (operands.size() > 1) ? byte_value(evaluate(operands[1])) : 0;
+            for (int64_t i = 0; i < count.value; ++i)
+                emit(fill);
+        }
+
+        const bool matches(const Instruction& ins, const std::vector<SourceOperand>& operands)
+        {
+            if (ins.operands.size() != operands.size())
+                return false;
+
+            for (size_t i = 0; i < operands.size(); ++i)
+            {
+                const auto& pattern = ins.operands[i];
+                const auto& operand = operands[i];
+                switch (pattern.kind)
+                {
+                case PatternKind::Literal:
+                    if (operand.kind != OperandKind::Literal || operand.text != pattern.literal)
+                        return false;
+                    break;
+                case PatternKind::Imm8:
+                case PatternKind::Imm16:
+                case PatternKind::Rel8:
+                    if (operand.kind != OperandKind::Value)
+                        return false;
+                    break;
+                case PatternKind::HighMem:
+                case PatternKind::Mem16:
+                    if (operand.kind != OperandKind::Memory)
+                        return false;
+                    break;
+                case PatternKind::SPRel8:
+                    if (operand.kind != OperandKind::SPRelative)
+                        return false;
+                    break;
+                case PatternKind::Constant:
+                {
+                    if (operand.kind != OperandKind::Value)
+                        return false;
+                    const auto value = evaluate(operand.text);
+                    if (!value.known || value.value != pattern.value)
+                        return false;
+                    break;
+                }
+                }
+            }
+            return true;
+        }
+
+        void instruction(std::string mnemonic, const std::vector<std::string>& texts)
+        {
+            std::vector<SourceOperand> operands;
+            for (const auto& text : texts)
+                operands.push_back(classify(text));
+
+            // the common spellings which aren't in the table
+            for (auto& operand : operands)
+            {
+                if (operand.kind != OperandKind::Literal)
+                    continue;
+                if (mnemonic == "LDI" && operand.text == "(HL)")
+                    operand.text = "(HL+)";
+                else if (mnemonic == "LDD" && operand.text == "(HL)")
+                    operand.text = "(HL-)";
+                else if (mnemonic == "JP" && operand.text == "HL")
+                    operand.text = "(HL)";
+                else if (mnemonic == "LDH" && operand.text == "(C)")
+                    mnemonic = "LD";
+            }
+            if (mnemonic == "LDI" || mnemonic == "LDD")
+                mnemonic = "LD";
+
+            const auto& table = instructions();
+            const auto found = table.find(mnemonic);
+            if (found == table.end())
+            {
+                error("unknown instruction " + mnemonic);
+                return;
+            }
+
+            // STOP's second byte is usually left out
+            if (mnemonic == "STOP" && operands.empty())
+                operands.push_back({ OperandKind::Value, "0" });
+
+            const Instruction* match = nullptr;
+            for (const auto& ins : found->second)
+            {
+                if (matches(ins, operands))
+                {
+                    match = &ins;
+                    break;
+                }
+            }
+
+            if (match == nullptr)
+            {
+                error("no form of " + mnemonic + " takes these operands");
+                return;
+            }
+
+            const uint32_t start = m_pc;
+            if (match->prefixed)
+                emit(0xCB);
+            emit(match->op);
+
+            for (size_t i = 0; i < operands.size(); ++i)
+            {
+                const auto& pattern = match->operands[i];
+                switch (pattern.kind)
+                {
+                case PatternKind::Imm8:
+                {
+                    // ADD SP,r8 is signed, the others are a byte either way
+                    const auto value = evaluate(operands[i].text);
+                    if (pattern.literal == "r8" && value.known && (value.value < -128 || value.value > 127))
+                        error("offset out of range");
+                    emit(byte_value(value));
+                    break;
+                }
+                case PatternKind::Imm16:
+                case PatternKind::Mem16:
+                    emit16(word_value(evaluate(operands[i].text)));
+                    break;
+                case PatternKind::Rel8:
+                {
+                    const auto target = evaluate(operands[i].text);
+                    const int64_t offset = target.value - static_cast<int64_t>(start + match->length);
+                    if (target.known && (offset < -128 || offset > 127))
+                        error("jump target out of range");
+                    emit(static_cast<uint8_t>(offset & 0xFF));
+                    break;
+                }
+                case PatternKind::HighMem:
+                {
+                    auto value = evaluate(operands[i].text);
+                    if (value.value >= 0xFF00 && value.value <= 0xFFFF)
+                        value.value -= 0xFF00;
+                    if (value.known && (value.value < 0 || value.value > 0xFF))
+                        error("LDH address out of range");
+                    emit(static_cast<uint8_t>(value.value & 0xFF));
+                    break;
+                }
+                case PatternKind::SPRel8:
+                {
+                    const auto value = evaluate(operands[i].text);
+                    if (value.known && (value.value < -128 || value.value > 127))
+                        error("offset out of range");
+                    emit(static_cast<uint8_t>(value.value & 0xFF));
+                    break;
+                }
+                default:
+                    break;
+                }
+            }
+
+            // STOP's padding byte
+            while (m_pc < start + match->length)
+                emit(0x00);
+        }
+
+        const uint8_t byte_value(const Value& value)
+        {
+            if (value.known && (value.value < -128 || value.value > 0xFF))
+                error("value doesn't fit in a byte");
+            return static_cast<uint8_t>(value.value & 0xFF);
+        }
+
+        const uint16_t word_value(const Value& value)
+        {
+            if (value.known && (value.value < -32768 || value.value > 0xFFFF))
+                error("value doesn't fit in a word");
+            return static_cast<uint16_t>(value.value & 0xFFFF);
+        }
+
+        void emit(const uint8_t val)
+        {
+            const uint32_t pc = m_pc++;
+            if (m_pass != 2)
+                return;
+
+            if (pc >= ROM_END || (m_bank != 0 && pc < ROMX_ADDR))
+            {
+                error("code runs outside the bank");
+                return;
+            }
+            if (m_bank == 0 && pc >= Cartridge::logo_addr && pc < Cartridge::header_end)
+            {
+                error("code overlaps the cartridge header");
+                return;
+            }
+
+            const size_t offset = (m_bank == 0) ? pc : m_bank * Cartridge::rom_bank_size + (pc - ROMX_ADDR);
+            if (offset >= m_image.size())
+            {
+                m_image.resize(offset + 1, 0x00);
+                m_written.resize(offset + 1, false);
+            }
+            if (m_written[offset])
+                error("overlaps earlier code");
+
+            m_image[offset] = val;
+            m_written[offset] = true;
+            m_max_bank = std::max<size_t>(m_max_bank, offset / Cartridge::rom_bank_size);
+        }
+
+        void emit16(const uint16_t val)
+        {
+            emit(static_cast<uint8_t>(val & 0xFF));
+            emit(static_cast<uint8_t>(val >> 8));
+        }
+
+        const std::string string_literal(const std::string& text)
+        {
+            const auto trimmed = trim(text);
+            if (trimmed.size() < 2 || trimmed.front() != '"' || trimmed.back() != '"')
+            {
+                error("expected a string");
+                return std::string();
+            }
+
+            std::string out;
+            for (size_t i = 1; i + 1 < trimmed.size(); ++i)
+            {
+                if (trimmed[i] == '\\' && i + 2 < trimmed.size())
+                {
+                    const char c = trimmed[++i];
+                    out += (c == 'n') ? '\n' : (c == '0') ? '\0' : c;
+                }
+                else
+                {
+                    out += trimmed[i];
+                }
+            }
+            return out;
+        }
+
+        // expr := term (('+' | '-') term)*
+        const Value evaluate(const std::string& text)
+        {
+            size_t pos = 0;
+            auto value = parse_sum(text, pos);
+            skip_space(text, pos);
+            if (pos != text.size())
+            {
+                error("can't parse expression '" + text + "'");
+                value.known = false;
+            }
+            return value;
+        }
+
+        void skip_space(const std::string& text, size_t& pos)
+        {
+            while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t'))
+                ++pos;
+        }
+
+        const Value parse_sum(const std::string& text, size_t& pos)
+        {
+            auto value = parse_term(text, pos);
+            while (true)
+            {
+                skip_space(text, pos);
+                if (pos >= text.size() || (text[pos] != '+' && text[pos] != '-'))
+                    return value;
+
+                const char op = text[pos++];
+                const auto rhs = parse_term(text, pos);
+                value.value = (op == '+') ? value.value + rhs.value : value.value - rhs.value;
+                value.known = value.known && rhs.known;
+            }
+        }
+
+        const Value parse_term(const std::string& text, size_t& pos)
+        {
+            skip_space(text, pos);
+            if (pos >= text.size())
+            {
+                error("missing value");
+                return { 0, false };
+            }
+
+            const char c = text[pos];
+            if (c == '-' || c == '+')
+            {
+                ++pos;
+                auto value = parse_term(text, pos);
+                if (c == '-')
+                    value.value = -value.value;
+                return value;
+            }
+            if (c == '(')
+            {
+                ++pos;
+                auto value = parse_sum(text, pos);
+                skip_space(text, pos);
+                if (pos < text.size() && text[pos] == ')')
+                    ++pos;
+                else
+                    error("missing )");
+                return value;
+            }
+            if (c == '@')
+            {
+                ++pos;
+                return { m_start, true };
+            }
+            if (c == '\'' && pos + 2 < text.size() && text[pos + 2] == '\'')
+            {
+                pos += 3;
+                return { static_cast<unsigned char>(text[pos - 2]), true };
+            }
+            if (c == '$' || c == '%' || std::isdigit(static_cast<unsigned char>(c)))
+                return parse_number(text, pos);
+
+            size_t end = pos;
+            while (end < text.size() && is_ident_char(text[end]))
+                ++end;
+            if (end == pos)
+            {
+                error("unexpected '" + std::string(1, c) + "'");
+                pos = text.size();
+                return { 0, false };
+            }
+
+            const std::string name = text.substr(pos, end - pos);
+            pos = end;
+
+            const auto func = upper(name);
+            if (func == "HIGH" || func == "LOW")
+            {
+                skip_space(text, pos);
+                auto value = parse_term(text, pos);
+                value.value = (func == "HIGH") ? ((value.value >> 8) & 0xFF) : (value.value & 0xFF);
+                return value;
+            }
+
+            return symbol(name);
+        }
+
+        const Value parse_number(const std::string& text, size_t& pos)
+        {
+            int base = 10;
+            if (text[pos] == '$')
+            {
+                base = 16;
+                ++pos;
+            }
+            else if (text[pos] == '%')
+            {
+                base = 2;
+                ++pos;
+            }
+            else if (text.compare(pos, 2, "0x") == 0 || text.compare(pos, 2, "0X") == 0)
+            {
+                base = 16;
+                pos += 2;
+            }
+
+            size_t end = pos;
+            while (end < text.size() && std::isxdigit(static_cast<unsigned char>(text[end])))
+                ++end;
+
+            // 38H style hex
+            if (base == 10 && end < text.size() && (text[end] == 'H' || text[end] == 'h'))
+            {
+                base = 16;
+                const auto digits = text.substr(pos, end - pos);
+                pos = end + 1;
+                return { std::stoll(digits, nullptr, 16), true };
+            }
+
+            const auto digits = text.substr(pos, end - pos);
+            pos = end;
+            try
+            {
+                size_t used = 0;
+                const auto value = std::stoll(digits, &used, base);
+                if (used == digits.size())
+                    return { value, true };
+            }
+            catch (const std::exception&)
+            {
+            }
+
+            error("bad number '" + digits + "'");
+            return { 0, false };
+        }
+
+        const Value symbol(const std::string& raw)
+        {
+            const auto name = full_name(raw);
+            if (const auto constant = m_constants.find(name); constant != m_constants.end())
+                return { constant->second, true };
+            if (const auto label = m_labels.find(name); label != m_labels.end())
+                return { label->second.addr, true };
+
+            error("unknown symbol " + name);
+            return { 0, false };
+        }
+
+        void finish_image()
+        {
+            // whole banks, a power of two of them, like the header can say
+            size_t banks = 2;
+            while (banks < m_max_bank + 1)
+                banks *= 2;
+            m_image.resize(banks * Cartridge::rom_bank_size, 0x00);
+            m_written.resize(m_image.size(), false);
+
+            const bool has_entry = std::any_of(m_written.begin() + Cartridge::entry_addr, m_written.begin() + Cartridge::logo_addr, [](const bool w) { return w; });
+            if (!has_entry)
+            {
+                m_image[Cartridge::entry_addr] = 0x00;
+                m_image[Cartridge::entry_addr + 1] = 0xC3;
+                m_image[Cartridge::entry_addr + 2] = static_cast<uint8_t>(Cartridge::header_end & 0xFF);
+                m_image[Cartridge::entry_addr + 3] = static_cast<uint8_t>(Cartridge::header_end >> 8);
+            }
+
+            for (size_t i = 0; i < m_title.size() && i < 16; ++i)
+                m_image[Cartridge::title_addr + i] = static_cast<uint8_t>(m_title[i]);
+            m_image[Cartridge::type_addr] = m_cart;
+            m_image[Cartridge::ram_size_addr] = m_ram_size;
+            Cartridge::fix_header(m_image);
+
+            m_out.rom = m_image;
+            for (const auto& [name, label] : m_labels)
+                m_out.symbols.push_back({ name, label.bank, label.addr });
+            std::sort(m_out.symbols.begin(), m_out.symbols.end(), [](const AssembledRom::Symbol& a, const AssembledRom::Symbol& b)
+            {
+                return (a.bank != b.bank) ? a.bank < b.bank : a.addr < b.addr;
+            });
+        }
+
+        std::vector<std::string> m_lines;
+        std::map<std::string, Label> m_labels;
+        std::map<std::string, int64_t> m_constants;
+
+        int m_pass = 1;
+        size_t m_line = 0;
+        uint16_t m_bank = 0;
+        uint32_t m_pc = 0;
+        uint32_t m_start = 0;
+        size_t m_max_bank = 1;
+        std::string m_scope;
+
+        std::vector<uint8_t> m_image;
+        std::vector<bool> m_written;
+
+        std::string m_title;
+        uint8_t m_cart = 0;
+        uint8_t m_ram_size = 0;
+
+        AssembledRom m_out;
+    };
+}
+
+const AssembledRom assemble(const std::string& source)
+{
+    return Assembler(source).run();
+}
+
+const std::string format_symbols(const AssembledRom& assembled)
+{
+    std::stringstream str_stream;
+    str_stream << "; generated by gbasm\n";
+    str_stream << std::hex << std::setfill('0');
+    for (const auto& symbol : assembled.symbols)
+        str_stream << std::setw(2) << symbol.bank << ":" << std::setw(4) << symbol.addr << " " << symbol.name << "\n";
+    return str_stream.str();
+}
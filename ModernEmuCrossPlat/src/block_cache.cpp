@@ -0,0 +1,146 @@
+#include "pch.h"
+
+#include "block_cache.h"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <unordered_map>
+
+#include "aot.h"
+#include "opcode_table.h"
+
+// set by CMake to the commit configured from
+#ifndef GB_BUILD_ID
+#define GB_BUILD_ID "unknown"
+#endif
+
+BlockCache::BlockCache(const std::vector<uint8_t>& rom)
+    : m_rom_hash(::rom_hash(rom))
+    , m_index(std::max<size_t>(rom.size() / Cartridge::rom_bank_size, 2) * Cartridge::rom_bank_size)
+    , m_size(0)
+    , m_write()
+    , m_translated()
+    , m_files()
+{
+}
+
+shared_ptr<BlockCache> BlockCache::shared(const std::vector<uint8_t>& rom)
+{
+    static std::mutex mutex;
+    static std::unordered_map<uint64_t, std::weak_ptr<BlockCache>> caches;
+
+    const uint64_t hash = ::rom_hash(rom);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& weak = caches[hash];
+    auto cache = weak.lock();
+    if (!cache)
+    {
+        cache = make_shared<BlockCache>(rom);
+        weak = cache;
+    }
+    return cache;
+}
+
+const uint32_t BlockCache::build_id()
+{
+    // FNV-1a over what decides where blocks end and what they hold
+    uint32_t hash = 0x811C9DC5u;
+    const auto add = [&hash](const size_t val)
+    {
+        for (size_t i = 0; i < 4; ++i)
+        {
+            hash ^= static_cast<uint8_t>(val >> (i * 8));
+            hash *= 0x01000193u;
+        }
+    };
+    add(format_version);
+    add(Recompiler::decode_version);
+    add(Recompiler::max_block);
+    add(sizeof(Block));
+    for (const auto& op : unprefixed_op_codes)
+    {
+        add(op.IsValid());
+        add(op.GetLength());
+        add(op.MinCycles());
+        add(op.MaxCycles());
+    }
+    for (const char* c = GB_BUILD_ID; *c; ++c)
+        add(static_cast<uint8_t>(*c));
+    return hash;
+}
+
+void BlockCache::publish(const Block& block)
+{
+    const size_t idx = index(block.bank, block.addr);
+    if (idx >= m_index.size() || block.addr >= 0x8000)
+        return;
+    // release, so a reader who finds it sees all of it
+    if (!m_index[idx].exchange(&block, std::memory_order_acq_rel))
+        m_size.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool BlockCache::load(const std::string& path)
+{
+    auto file = std::make_unique<MappedFile>();
+    if (!file->open(path) || file->size() < sizeof(FileHeader))
+        return false;
+
+    FileHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (header.magic != file_magic || header.version != format_version || header.build_id != build_id() || header.rom_hash != m_rom_hash
+        || file->size() != sizeof(FileHeader) + header.count * sizeof(Block))
+        return false;
+
+    // the blocks are used where they're mapped, over whatever was there.
+    // Anyone still running an old one keeps it, nothing is unmapped.
+    std::lock_guard<std::mutex> lock(m_write);
+    const auto* blocks = reinterpret_cast<const Block*>(file->data() + sizeof(FileHeader));
+    for (size_t i = 0; i < header.count; ++i)
+    {
+        if (blocks[i].count <= Recompiler::max_block)
+            publish(blocks[i]);
+    }
+    m_files.push_back(std::move(file));
+    return true;
+}
+
+bool BlockCache::save(const std::string& path) const
+{
+    std::vector<const Block*> blocks;
+    blocks.reserve(size());
+    for (const auto& slot : m_index)
+    {
+        if (const Block* block = slot.load(std::memory_order_acquire))
+            blocks.push_back(block);
+    }
+
+    // unique per writer, workers saving at once each rename a whole file
+    const auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    const std::string temp = path + "." + std::to_string(stamp) + "." + std::to_string(reinterpret_cast<uintptr_t>(this)) + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary);
+        if (!out.is_open())
+            return false;
+
+        const FileHeader header{ file_magic, format_version, build_id(), m_rom_hash, blocks.size() };
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const Block* block : blocks)
+            out.write(reinterpret_cast<const char*>(block), sizeof(Block));
+        if (!out.good())
+        {
+            out.close();
+            std::remove(temp.c_str());
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp, path, error);
+    if (error)
+    {
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
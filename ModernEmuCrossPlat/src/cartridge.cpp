@@ -0,0 +1,217 @@
+#include "pch.h"
+
+#include "cartridge.h"
+
+#include <cstring>
+
+const std::array<uint8_t, 48> Cartridge::nintendo_logo = {
+    0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B, 0x03, 0x73, 0x00, 0x83,
+    0x00, 0x0C, 0x00, 0x0D, 0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E,
+    0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99, 0xBB, 0xBB, 0x67, 0x63,
+    0x6E, 0x0E, 0xEC, 0xCC, 0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E };
+
+namespace
+{
+    constexpr uint16_t ROM_HIGH_ADDR = 0x4000;
+    constexpr uint16_t RAM_ADDR = 0xA000;
+
+    // $0149, number of 8KB RAM banks
+    const size_t ram_banks_for(const uint8_t ram_size)
+    {
+        switch (ram_size)
+        {
+        case 0x02:
+            return 1;
+        case 0x03:
+            return 4;
+        case 0x04:
+            return 16;
+        case 0x05:
+            return 8;
+        default:
+            return 0;
+        }
+    }
+}
+
+Cartridge::Cartridge(std::vector<uint8_t> rom)
+    : m_rom()
+    , m_mbc1(false)
+    , m_ram_banks(0)
+    , m_state()
+    , m_mapped_ram_bank(0)
+    , m_mapped_low_bank(SIZE_MAX)
+    , m_mapped_high_bank(SIZE_MAX)
+    , m_ram_swaps(0)
+    , m_bus(nullptr)
+{
+    // short images are padded to two banks of 0xFF, like an unconnected bus
+    const size_t banks = std::max<size_t>(2, (rom.size() + rom_bank_size - 1) / rom_bank_size);
+    rom.resize(banks * rom_bank_size, 0xFF);
+
+    const uint8_t type = rom[type_addr];
+    m_mbc1 = (type >= 0x01 && type <= 0x03);
+    m_ram_banks = ram_banks_for(rom[ram_size_addr]);
+    m_rom = make_shared<const std::vector<uint8_t>>(std::move(rom));
+    m_state.ram.assign(std::max<size_t>(1, m_ram_banks) * ram_bank_size, 0);
+}
+
+void Cartridge::attach(MemoryMap& bus)
+{
+    m_bus = &bus;
+    m_bus->map_write(0x0000, 0x7FFF, this);
+
+    std::memcpy(m_bus->data() + RAM_ADDR, m_state.ram.data(), ram_bank_size);
+    m_bus->mark_dirty(RAM_ADDR, RAM_ADDR + ram_bank_size - 1);
+    m_mapped_ram_bank = 0;
+    map_banks();
+}
+
+void Cartridge::reattach(MemoryMap& bus)
+{
+    m_bus = &bus;
+    m_bus->map_write(0x0000, 0x7FFF, this);
+}
+
+const uint8_t Cartridge::read(const uint16_t location)
+{
+    return m_bus->peek(location);
+}
+
+void Cartridge::write(const uint16_t location, const uint8_t val)
+{
+    if (!m_mbc1)
+        return;
+
+    switch (location >> 13)
+    {
+    case 0:
+        // RAM enable is tracked but not enforced, the RAM is always mapped
+        m_state.ram_enabled = ((val & 0x0F) == 0x0A);
+        break;
+    case 1:
+        m_state.bank1 = static_cast<uint8_t>(val & 0x1F);
+        if (m_state.bank1 == 0)
+            m_state.bank1 = 1;
+        break;
+    case 2:
+        m_state.bank2 = static_cast<uint8_t>(val & 0x03);
+        break;
+    case 3:
+        m_state.mode = static_cast<uint8_t>(val & 0x01);
+        break;
+    }
+
+    map_banks();
+}
+
+const Cartridge::State Cartridge::save_state() const
+{
+    State state = m_state;
+    std::memcpy(state.ram.data() + m_mapped_ram_bank * ram_bank_size, m_bus->data() + RAM_ADDR, ram_bank_size);
+    return state;
+}
+
+void Cartridge::load_state(const State& state)
+{
+    m_state = state;
+    map_state();
+}
+
+void Cartridge::map_state()
+{
+    // the bus was restored with the snapshot's mapped bank already in place
+    m_mapped_ram_bank = ram_bank();
+    map_rom();
+}
+
+const size_t Cartridge::low_bank() const
+{
+    if (!m_mbc1 || m_state.mode == 0)
+        return 0;
+    return (static_cast<size_t>(m_state.bank2) << 5) % rom_banks();
+}
+
+const size_t Cartridge::high_bank() const
+{
+    if (!m_mbc1)
+        return 1;
+    return ((static_cast<size_t>(m_state.bank2) << 5) | m_state.bank1) % rom_banks();
+}
+
+const size_t Cartridge::ram_bank() const
+{
+    if (!m_mbc1 || m_state.mode == 0 || m_ram_banks <= 1)
+        return 0;
+    return m_state.bank2 % m_ram_banks;
+}
+
+void Cartridge::map_banks()
+{
+    map_rom();
+
+    const size_t bank = ram_bank();
+    if (bank != m_mapped_ram_bank)
+    {
+        std::memcpy(m_state.ram.data() + m_mapped_ram_bank * ram_bank_size, m_bus->data() + RAM_ADDR, ram_bank_size);
+        std::memcpy(m_bus->data() + RAM_ADDR, m_state.ram.data() + bank * ram_bank_size, ram_bank_size);
+        m_bus->mark_dirty(RAM_ADDR, RAM_ADDR + ram_bank_size - 1);
+        m_mapped_ram_bank = bank;
+        ++m_ram_swaps;
+    }
+}
+
+void Cartridge::map_rom()
+{
+    // the bus reads the banks straight from the ROM, which clones share
+    if (low_bank() != m_mapped_low_bank)
+    {
+        m_mapped_low_bank = low_bank();
+        m_bus->map_rom(0x0000, m_rom->data() + m_mapped_low_bank * rom_bank_size, rom_bank_size);
+    }
+    if (high_bank() != m_mapped_high_bank)
+    {
+        m_mapped_high_bank = high_bank();
+        m_bus->map_rom(ROM_HIGH_ADDR, m_rom->data() + m_mapped_high_bank * rom_bank_size, rom_bank_size);
+    }
+}
+
+const uint8_t Cartridge::header_checksum(const std::vector<uint8_t>& rom)
+{
+    uint8_t sum = 0;
+    for (size_t addr = title_addr; addr < header_checksum_addr; ++addr)
+        sum = static_cast<uint8_t>(sum - rom[addr] - 1);
+    return sum;
+}
+
+const uint16_t Cartridge::global_checksum(const std::vector<uint8_t>& rom)
+{
+    uint16_t sum = 0;
+    for (size_t addr = 0; addr < rom.size(); ++addr)
+    {
+        if (addr != global_checksum_addr && addr != global_checksum_addr + 1)
+            sum = static_cast<uint16_t>(sum + rom[addr]);
+    }
+    return sum;
+}
+
+void Cartridge::fix_header(std::vector<uint8_t>& rom)
+{
+    // 32KB minimum, otherwise a power of two number of banks
+    size_t banks = 2;
+    while (banks * rom_bank_size < rom.size())
+        banks *= 2;
+    rom.resize(banks * rom_bank_size, 0xFF);
+
+    std::copy(nintendo_logo.begin(), nintendo_logo.end(), rom.begin() + logo_addr);
+
+    uint8_t size_code = 0;
+    while ((size_t(2) << size_code) < banks)
+        ++size_code;
+    rom[rom_size_addr] = size_code;
+
+    rom[header_checksum_addr] = header_checksum(rom);
+    const uint16_t sum = global_checksum(rom);
+    rom[global_checksum_addr] = static_cast<uint8_t>(sum >> 8);
+    rom[global_checksum_addr + 1] = static_cast<uint8_t>(sum & 0xFF);
+}
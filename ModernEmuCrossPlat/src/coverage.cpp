@@ -0,0 +1,269 @@
+#include "pch.h"
+
+#include "coverage.h"
+
+#include <bit>
+
+#include "aot.h"
+#include "disassembler.h"
+#include "opcode_table.h"
+
+namespace
+{
+    struct FileEdge
+    {
+        uint32_t from;
+        uint32_t to;
+        uint64_t count;
+    };
+
+    static_assert(sizeof(FileEdge) == 16, "edges are saved as they are");
+
+    inline const size_t op_length(const uint8_t op)
+    {
+        return (op == 0xCB) ? 2 : std::max<size_t>(1, unprefixed_op_codes[op].GetLength());
+    }
+
+    inline const size_t slot_for(const uint64_t key, const size_t size)
+    {
+        return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & (size - 1);
+    }
+
+    // banks and bank:addr the way the disassembler writes them
+    const std::string bank_text(const size_t bank)
+    {
+        std::ostringstream text;
+        text << std::hex << std::uppercase << std::setfill('0') << std::setw(bank > 0xFF ? 4 : 2) << bank;
+        return text.str();
+    }
+
+    const std::string location_text(const GuestAddr& location)
+    {
+        std::ostringstream text;
+        text << bank_text(location.bank) << ":" << std::hex << std::uppercase << std::setfill('0') << std::setw(4) << location.addr;
+        return text.str();
+    }
+}
+
+Coverage::Coverage(const std::vector<uint8_t>& rom)
+    : m_rom_hash(::rom_hash(rom))
+    , m_banks(std::max<size_t>(2, (rom.size() + Cartridge::rom_bank_size - 1) / Cartridge::rom_bank_size))
+    , m_bytes(m_banks * Cartridge::rom_bank_size / 64, 0)
+    , m_run(Cartridge::entry_addr)
+    , m_edges(1024, Slot{ empty_key, 0 })
+    , m_edge_count(0)
+{
+}
+
+void Coverage::jumped(const Cartridge& cartridge, const uint16_t last, const uint16_t next)
+{
+    if (last < 0x8000)
+    {
+        const size_t offset = cartridge.bank_at(last) * Cartridge::rom_bank_size + (last & 0x3FFF);
+        mark(cartridge, static_cast<uint16_t>(last + op_length(cartridge.rom()[offset])));
+    }
+    add_edge((static_cast<uint64_t>(location(cartridge, last)) << 32) | location(cartridge, next), 1);
+    m_run = next;
+}
+
+void Coverage::interrupted(const Cartridge& cartridge, const uint16_t pc, const uint16_t vector)
+{
+    mark(cartridge, pc);
+    add_edge((static_cast<uint64_t>(location(cartridge, pc)) << 32) | location(cartridge, vector), 1);
+    m_run = vector;
+}
+
+void Coverage::mark(const Cartridge& cartridge, const uint16_t end)
+{
+    // a half of the ROM area at a time, they can have different banks
+    const uint16_t stop = std::min<uint16_t>(end, 0x8000);
+    for (uint16_t from = m_run; from < stop;)
+    {
+        const uint16_t to = std::min<uint16_t>(stop, (from < 0x4000) ? 0x4000 : 0x8000);
+        const size_t base = cartridge.bank_at(from) * Cartridge::rom_bank_size;
+        for (size_t offset = base + (from & 0x3FFF); offset < base + ((to - 1) & 0x3FFF) + 1; ++offset)
+            m_bytes[offset / 64] |= uint64_t(1) << (offset % 64);
+        from = to;
+    }
+}
+
+void Coverage::add_edge(const uint64_t key, const uint64_t count)
+{
+    size_t slot = slot_for(key, m_edges.size());
+    while (m_edges[slot].key != key && m_edges[slot].key != empty_key)
+        slot = (slot + 1) & (m_edges.size() - 1);
+    if (m_edges[slot].key == key)
+    {
+        m_edges[slot].count += count;
+        return;
+    }
+
+    m_edges[slot] = Slot{ key, count };
+    if (++m_edge_count * 2 > m_edges.size())
+    {
+        std::vector<Slot> old(m_edges.size() * 2, Slot{ empty_key, 0 });
+        old.swap(m_edges);
+        for (const auto& moved : old)
+        {
+            if (moved.key == empty_key)
+                continue;
+            size_t to = slot_for(moved.key, m_edges.size());
+            while (m_edges[to].key != empty_key)
+                to = (to + 1) & (m_edges.size() - 1);
+            m_edges[to] = moved;
+        }
+    }
+}
+
+const size_t Coverage::bytes_run(const size_t bank) const
+{
+    const size_t words = Cartridge::rom_bank_size / 64;
+    size_t count = 0;
+    for (size_t i = bank * words; i < (bank + 1) * words && i < m_bytes.size(); ++i)
+        count += static_cast<size_t>(std::popcount(m_bytes[i]));
+    return count;
+}
+
+const size_t Coverage::bytes_run() const
+{
+    size_t count = 0;
+    for (const uint64_t word : m_bytes)
+        count += static_cast<size_t>(std::popcount(word));
+    return count;
+}
+
+const std::vector<Coverage::Edge> Coverage::edges() const
+{
+    std::vector<Slot> slots;
+    slots.reserve(m_edge_count);
+    for (const auto& slot : m_edges)
+    {
+        if (slot.key != empty_key)
+            slots.push_back(slot);
+    }
+    std::sort(slots.begin(), slots.end(), [](const Slot& x, const Slot& y) { return x.key < y.key; });
+
+    std::vector<Edge> list;
+    list.reserve(slots.size());
+    for (const auto& slot : slots)
+    {
+        const auto from = static_cast<uint32_t>(slot.key >> 32);
+        const auto to = static_cast<uint32_t>(slot.key);
+        list.push_back(Edge{ { static_cast<uint16_t>(from >> 16), static_cast<uint16_t>(from) },
+            { static_cast<uint16_t>(to >> 16), static_cast<uint16_t>(to) }, slot.count });
+    }
+    return list;
+}
+
+void Coverage::clear()
+{
+    std::fill(m_bytes.begin(), m_bytes.end(), 0);
+    std::fill(m_edges.begin(), m_edges.end(), Slot{ empty_key, 0 });
+    m_edge_count = 0;
+}
+
+bool Coverage::write(std::ostream& out) const
+{
+    const FileHeader header{ file_magic, format_version, static_cast<uint32_t>(m_banks), m_rom_hash, m_edge_count };
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(m_bytes.data()), static_cast<std::streamsize>(m_bytes.size() * sizeof(uint64_t)));
+    for (const auto& slot : m_edges)
+    {
+        if (slot.key == empty_key)
+            continue;
+        const FileEdge edge{ static_cast<uint32_t>(slot.key >> 32), static_cast<uint32_t>(slot.key), slot.count };
+        out.write(reinterpret_cast<const char*>(&edge), sizeof(edge));
+    }
+    return out.good();
+}
+
+bool Coverage::merge(std::istream& in)
+{
+    FileHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != file_magic || header.version != format_version
+        || header.banks != m_banks || header.rom_hash != m_rom_hash)
+        return false;
+
+    // all of it read before any of it is added, the edges as they come so
+    // a bad count can't ask for more memory than the file has
+    std::vector<uint64_t> bytes(m_bytes.size());
+    if (!in.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size() * sizeof(uint64_t))))
+        return false;
+    std::vector<FileEdge> edges;
+    for (uint64_t i = 0; i < header.edges; ++i)
+    {
+        FileEdge edge;
+        if (!in.read(reinterpret_cast<char*>(&edge), sizeof(edge)))
+            return false;
+        edges.push_back(edge);
+    }
+
+    for (size_t i = 0; i < bytes.size(); ++i)
+        m_bytes[i] |= bytes[i];
+    for (const auto& edge : edges)
+        add_edge((static_cast<uint64_t>(edge.from) << 32) | edge.to, edge.count);
+    return true;
+}
+
+void Coverage::write_report(std::ostream& out, const Disassembler& listing) const
+{
+    // the edges out of each instruction, by where they're from
+    const auto all = edges();
+    std::map<uint32_t, std::vector<const Edge*>> out_of;
+    for (const auto& edge : all)
+        out_of[edge.from.key()].push_back(&edge);
+
+    for (size_t bank = 0; bank < listing.banks() && bank < m_banks; ++bank)
+    {
+        out << "; bank " << bank_text(bank) << ": "
+            << bytes_run(bank) << " of " << Cartridge::rom_bank_size << " bytes ran" << std::endl;
+
+        const std::string_view text = listing.text(bank);
+        const uint16_t bank_base = (bank == 0) ? 0x0000 : 0x4000;
+        size_t line_start = 0;
+        while (line_start < text.size())
+        {
+            const size_t line_end = std::min(text.find('\n', line_start), text.size());
+            const std::string_view line = text.substr(line_start, line_end - line_start);
+            const size_t next_start = line_end + 1;
+
+            // "bb:aaaa  ...", the bytes it covers run to the next line's address
+            const size_t colon = line.find(':');
+            if (colon == std::string_view::npos || colon + 5 > line.size())
+            {
+                out << "  " << line << std::endl;
+                line_start = next_start;
+                continue;
+            }
+            const auto addr = static_cast<uint16_t>(std::stoul(std::string(line.substr(colon + 1, 4)), nullptr, 16));
+            size_t end = bank_base + Cartridge::rom_bank_size;
+            if (next_start < text.size())
+            {
+                const size_t next_colon = text.find(':', next_start);
+                if (next_colon != std::string_view::npos && next_colon + 5 <= text.size())
+                    end = std::stoul(std::string(text.substr(next_colon + 1, 4)), nullptr, 16);
+            }
+
+            const size_t offset = bank * Cartridge::rom_bank_size + (addr & 0x3FFF);
+            char mark = ' ';
+            if (listing.is_code(offset))
+            {
+                mark = ran(bank, addr) ? '*' : ' ';
+            }
+            else
+            {
+                for (size_t at = addr; at < end && mark == ' '; ++at)
+                    mark = ran(bank, static_cast<uint16_t>(at)) ? '!' : ' ';
+            }
+            out << mark << ' ' << line << std::endl;
+
+            const auto found = out_of.find(GuestAddr{ static_cast<uint16_t>(bank), addr }.key());
+            if (found != out_of.end())
+            {
+                for (const Edge* edge : found->second)
+                    out << "          ; -> " << location_text(edge->to) << " x" << edge->count << std::endl;
+            }
+            line_start = next_start;
+        }
+    }
+}
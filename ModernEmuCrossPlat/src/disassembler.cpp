@@ -0,0 +1,316 @@
+#include "pch.h"
+
+#include "disassembler.h"
+
+#include <atomic>
+#include <cstring>
+#include <numeric>
+#include <thread>
+
+#include "cartridge.h"
+#include "opcode_table.h"
+#include "recompiler.h"
+
+namespace
+{
+    // two hex digits for every byte
+    constexpr auto hex_digits = []()
+    {
+        constexpr char digits[] = "0123456789ABCDEF";
+        std::array<std::array<char, 2>, 256> table{};
+        for (size_t i = 0; i < table.size(); ++i)
+            table[i] = { digits[i >> 4], digits[i & 0xF] };
+        return table;
+    }();
+
+    inline char* put_hex8(char* out, const uint8_t val)
+    {
+        std::memcpy(out, hex_digits[val].data(), 2);
+        return out + 2;
+    }
+
+    inline char* put_hex16(char* out, const uint16_t val)
+    {
+        return put_hex8(put_hex8(out, static_cast<uint8_t>(val >> 8)), static_cast<uint8_t>(val & 0xFF));
+    }
+
+    // what's written into an instruction's text, at patch_at
+    enum class Patch : uint8_t
+    {
+        None,
+        Imm8,       // $XX
+        Imm16,      // $XXXX
+        Rel8,       // $XXXX, the JR target
+        SignedImm8, // +$XX or -$XX
+    };
+
+    // an opcode's text with its operand left blank
+    struct Format
+    {
+        std::array<char, 24> text;
+        uint8_t size;
+        uint8_t length;
+        uint8_t patch_at;
+        Patch patch;
+    };
+
+    // after "BB:AAAA  ", the bytes column "XX XX XX  "
+    constexpr size_t bytes_column = 10;
+    constexpr size_t data_per_line = 8;
+
+    const Format make_format(const ParsedOpCode& op, const bool prefixed)
+    {
+        Format format{};
+        if (!op.IsValid())
+            return format;
+
+        std::string text(op.GetMnemonic());
+        const auto add_operand = [&](const std::string_view operand, const bool first)
+        {
+            if (operand.empty() || (op.GetMnemonic() == "STOP"))
+                return;
+            text += first ? " " : ", ";
+
+            const auto blank = [&](const Patch patch, const std::string& before, const size_t digits, const std::string& after)
+            {
+                text += before;
+                format.patch = patch;
+                format.patch_at = static_cast<uint8_t>(text.size());
+                text.append(digits, '?');
+                text += after;
+            };
+            if (operand == "d8")
+                blank(Patch::Imm8, "$", 2, "");
+            else if (operand == "d16" || operand == "a16")
+                blank(Patch::Imm16, "$", 4, "");
+            else if (operand == "(a16)")
+                blank(Patch::Imm16, "($", 4, ")");
+            else if (operand == "(a8)")
+                blank(Patch::Imm8, "($FF", 2, ")");
+            else if (operand == "r8" && op.GetMnemonic() == "JR")
+                blank(Patch::Rel8, "$", 4, "");
+            else if (operand == "r8")
+                blank(Patch::SignedImm8, "", 4, "");
+            else if (operand == "SP+r8")
+                blank(Patch::SignedImm8, "SP", 4, "");
+            else if (operand.size() == 3 && operand.back() == 'H')
+                text += "$" + std::string(operand.substr(0, 2));
+            else
+                text += operand;
+        };
+        add_operand(op.GetOperand1(), true);
+        add_operand(op.GetOperand2(), false);
+
+        std::memcpy(format.text.data(), text.data(), std::min(text.size(), format.text.size()));
+        format.size = static_cast<uint8_t>(text.size());
+        format.length = static_cast<uint8_t>(prefixed ? 2 : op.GetLength());
+        return format;
+    }
+
+    // both pages, the CB page from 256
+    const std::array<Format, 512>& formats()
+    {
+        static const auto table = []()
+        {
+            std::array<Format, 512> table{};
+            for (size_t i = 0; i < 256; ++i)
+            {
+                table[i] = make_format(unprefixed_op_codes[i], false);
+                table[256 + i] = make_format(cbprefixed_op_codes[i], true);
+            }
+            return table;
+        }();
+        return table;
+    }
+
+    // Walks bank's bytes a line at a time, handing code(offset, format) each
+    // reached instruction and data(offset, count) each run of the rest.
+    template<class Code, class Data>
+    void walk(const std::vector<uint8_t>& rom, const std::vector<uint8_t>& code_map, const size_t begin, const size_t end, Code&& code, Data&& data)
+    {
+        const auto& table = formats();
+        size_t offset = begin;
+        while (offset < end)
+        {
+            if (code_map[offset] != 0)
+            {
+                const uint8_t b = rom[offset];
+                const Format* format = (b != 0xCB) ? &table[b] : (offset + 1 < end) ? &table[256 + rom[offset + 1]] : nullptr;
+                if (format && format->length != 0 && offset + format->length <= end)
+                {
+                    code(offset, *format);
+                    offset += format->length;
+                    continue;
+                }
+            }
+
+            size_t count = 1;
+            while (count < data_per_line && offset + count < end && code_map[offset + count] == 0)
+                ++count;
+            data(offset, count);
+            offset += count;
+        }
+    }
+}
+
+Disassembler::Disassembler(std::vector<uint8_t> rom)
+    : m_rom(std::move(rom))
+    , m_instructions(0)
+    , m_data_bytes(0)
+{
+}
+
+void Disassembler::run(const size_t threads)
+{
+    find_code();
+
+    const size_t banks = (m_rom.size() + Cartridge::rom_bank_size - 1) / Cartridge::rom_bank_size;
+    m_text.assign(banks, std::string());
+    std::vector<size_t> instructions(banks);
+    std::vector<size_t> data_bytes(banks);
+
+    const size_t workers = std::max<size_t>(1, std::min<size_t>(banks, threads != 0 ? threads : std::thread::hardware_concurrency()));
+    std::atomic<size_t> next_bank(0);
+    const auto work = [&]()
+    {
+        for (size_t bank = next_bank++; bank < banks; bank = next_bank++)
+            instructions[bank] = list_bank(bank, data_bytes[bank]);
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < workers; ++i)
+        pool.emplace_back(work);
+    work();
+    for (auto& thread : pool)
+        thread.join();
+
+    m_instructions = std::accumulate(instructions.begin(), instructions.end(), size_t(0));
+    m_data_bytes = std::accumulate(data_bytes.begin(), data_bytes.end(), size_t(0));
+}
+
+void Disassembler::find_code()
+{
+    m_code.assign(m_rom.size(), 0);
+
+    Recompiler recompiler(m_rom);
+    recompiler.analyze(false);
+    for (const auto& [key, block] : recompiler.blocks())
+    {
+        for (const auto& instruction : block.code)
+        {
+            const size_t offset = (instruction.addr < 0x4000) ? instruction.addr
+                : block.bank * Cartridge::rom_bank_size + (instruction.addr & 0x3FFF);
+            if (offset < m_code.size())
+                m_code[offset] = 1;
+        }
+    }
+}
+
+const size_t Disassembler::list_bank(const size_t bank, size_t& data_bytes)
+{
+    const size_t begin = bank * Cartridge::rom_bank_size;
+    const size_t end = std::min(begin + Cartridge::rom_bank_size, m_rom.size());
+    const size_t origin = (bank == 0) ? 0 : 0x4000;
+    const auto addr_of = [&](const size_t offset)
+    {
+        return static_cast<uint16_t>(origin + offset - begin);
+    };
+
+    // past bank $FF the bank takes four digits
+    const bool wide_bank = m_text.size() > 0x100;
+    const size_t address_column = wide_bank ? 11 : 9;
+
+    // every line's length is known from its opcode, so size the bank first
+    size_t size = 0;
+    size_t instructions = 0;
+    data_bytes = 0;
+    walk(m_rom, m_code, begin, end,
+        [&](size_t, const Format& format)
+        {
+            size += address_column + bytes_column + format.size + 1;
+            ++instructions;
+        },
+        [&](size_t, const size_t count)
+        {
+            // "DB $XX" and ", $XX" for the rest
+            size += address_column + 3 + count * 5 - 1;
+            data_bytes += count;
+        });
+
+    std::string& text = m_text[bank];
+    text.resize(size);
+    char* out = text.data();
+
+    const auto put_address = [&](const size_t offset)
+    {
+        out = wide_bank ? put_hex16(out, static_cast<uint16_t>(bank)) : put_hex8(out, static_cast<uint8_t>(bank));
+        *out++ = ':';
+        out = put_hex16(out, addr_of(offset));
+        *out++ = ' ';
+        *out++ = ' ';
+    };
+
+    walk(m_rom, m_code, begin, end,
+        [&](const size_t offset, const Format& format)
+        {
+            put_address(offset);
+            char* column = out;
+            std::memset(column, ' ', bytes_column);
+            for (size_t i = 0; i < format.length; ++i)
+                put_hex8(column + i * 3, m_rom[offset + i]);
+            out += bytes_column;
+
+            char* operand = out + format.patch_at;
+            std::memcpy(out, format.text.data(), format.size);
+            const uint8_t imm8 = (format.length > 1) ? m_rom[offset + format.length - 1] : 0;
+            switch (format.patch)
+            {
+            case Patch::Imm8:
+                put_hex8(operand, imm8);
+                break;
+            case Patch::Imm16:
+                put_hex16(operand, static_cast<uint16_t>(m_rom[offset + 1] | (m_rom[offset + 2] << 8)));
+                break;
+            case Patch::Rel8:
+                put_hex16(operand, static_cast<uint16_t>(addr_of(offset) + 2 + static_cast<int8_t>(imm8)));
+                break;
+            case Patch::SignedImm8:
+            {
+                const int value = static_cast<int8_t>(imm8);
+                operand[0] = (value < 0) ? '-' : '+';
+                operand[1] = '$';
+                put_hex8(operand + 2, static_cast<uint8_t>(value < 0 ? -value : value));
+                break;
+            }
+            case Patch::None:
+                break;
+            }
+            out += format.size;
+            *out++ = '\n';
+        },
+        [&](const size_t offset, const size_t count)
+        {
+            put_address(offset);
+            std::memcpy(out, "DB ", 3);
+            out += 3;
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (i != 0)
+                {
+                    *out++ = ',';
+                    *out++ = ' ';
+                }
+                *out++ = '$';
+                out = put_hex8(out, m_rom[offset + i]);
+            }
+            *out++ = '\n';
+        });
+
+    return instructions;
+}
+
+void Disassembler::write(std::ostream& out) const
+{
+    for (const auto& text : m_text)
+        out.write(text.data(), static_cast<std::streamsize>(text.size()));
+}
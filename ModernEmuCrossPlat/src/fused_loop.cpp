@@ -0,0 +1,171 @@
+#include "pch.h"
+
+#include "fused_loop.h"
+
+#include <cstring>
+
+namespace
+{
+    // dec b or dec c, the 8 bit counters
+    inline const bool dec_counter(const uint8_t op, R8& counter)
+    {
+        if (op != 0x05 && op != 0x0D)
+            return false;
+        counter = (op == 0x05) ? R8::B : R8::C;
+        return true;
+    }
+
+    // flags dec leaves when the counter goes from val + 1 to val, C is kept
+    inline const uint8_t dec_flags(const uint8_t val, const uint8_t old_flags)
+    {
+        const bool half = ((val + 1) & 0x0F) == 0;
+        return static_cast<uint8_t>((val == 0 ? 0x80 : 0) | 0x40 | (half ? 0x20 : 0) | (old_flags & 0x10));
+    }
+}
+
+const bool FusedLoops::match(Loop& loop)
+{
+    std::array<uint8_t, 8> ops{};
+    for (size_t i = 0; i < loop.op_count; ++i)
+        ops[i] = loop.ops[i].first;
+    if (loop.op_count == 0 || ops[loop.op_count - 1] != 0x20)
+        return false;
+
+    // ld a, [hl+] / ld [de], a or ld a, [de] / ld [hl+], a, then inc de
+    const auto copy = [&ops, &loop]()
+    {
+        loop.from_hl = ops[0] == 0x2A;
+        return ((ops[0] == 0x2A && ops[1] == 0x12) || (ops[0] == 0x1A && ops[1] == 0x22)) && ops[2] == 0x13;
+    };
+
+    switch (loop.op_count)
+    {
+    case 7:
+        // dec bc / ld a, b / or c, or ld a, c / or b
+        loop.kind = Kind::Copy16;
+        return copy() && ops[3] == 0x0B && ((ops[4] == 0x78 && ops[5] == 0xB1) || (ops[4] == 0x79 && ops[5] == 0xB0));
+    case 5:
+        loop.kind = Kind::Copy8;
+        return copy() && dec_counter(ops[3], loop.counter);
+    case 3:
+        loop.kind = Kind::Fill8;
+        loop.direction = (ops[0] == 0x32) ? -1 : 1;
+        return (ops[0] == 0x22 || ops[0] == 0x32) && dec_counter(ops[1], loop.counter);
+    default:
+        return false;
+    }
+}
+
+const size_t FusedLoops::remaining(const Loop& loop, const RegisterFile& r)
+{
+    // the branch back was taken, so the counter isn't 0
+    return (loop.kind == Kind::Copy16) ? r.get(R16::BC) : r.get(loop.counter);
+}
+
+const std::pair<uint16_t, size_t> FusedLoops::destination(const Loop& loop, const RegisterFile& r)
+{
+    const size_t count = remaining(loop, r);
+    if (loop.kind == Kind::Fill8)
+    {
+        const uint16_t hl = r.get(R16::HL);
+        return { loop.direction > 0 ? hl : static_cast<uint16_t>(hl - count + 1), count };
+    }
+    return { r.get(loop.from_hl ? R16::DE : R16::HL), count };
+}
+
+const size_t FusedLoops::run(const Loop& loop, RegisterFile& r, MemoryMap& bus, const size_t max_cycles, size_t& iterations)
+{
+    iterations = 0;
+    const size_t left = remaining(loop, r);
+    if (left == 0)
+        return 0;
+
+    // all of it if the last iteration fits, else whole iterations around
+    // the branch
+    size_t count;
+    size_t cycles;
+    if ((left - 1) * loop.cycles + loop.last_cycles <= max_cycles)
+    {
+        count = left;
+        cycles = (left - 1) * loop.cycles + loop.last_cycles;
+    }
+    else
+    {
+        count = max_cycles / loop.cycles;
+        cycles = count * loop.cycles;
+    }
+    if (count == 0)
+        return 0;
+
+    uint8_t* mem = bus.data();
+    uint8_t a;
+    if (loop.kind == Kind::Fill8)
+    {
+        const uint16_t hl = r.get(R16::HL);
+        const size_t first = loop.direction > 0 ? hl : static_cast<size_t>(hl) + 1 - count;
+        if (loop.direction < 0 && count > static_cast<size_t>(hl) + 1)
+            return 0;
+        if (first + count > 0x10000 || !bus.plain_write(static_cast<uint16_t>(first), static_cast<uint16_t>(first + count - 1)))
+            return 0;
+
+        a = r.get(R8::A);
+        std::memset(mem + first, a, count);
+        bus.mark_dirty(static_cast<uint16_t>(first), static_cast<uint16_t>(first + count - 1));
+        r.set(R16::HL, static_cast<uint16_t>(loop.direction > 0 ? hl + count : hl - count));
+    }
+    else
+    {
+        const uint16_t src = r.get(loop.from_hl ? R16::HL : R16::DE);
+        const uint16_t dst = r.get(loop.from_hl ? R16::DE : R16::HL);
+        if (src + count > 0x10000 || dst + count > 0x10000)
+            return 0;
+        if (!bus.plain_read(src, static_cast<uint16_t>(src + count - 1)) || !bus.plain_write(dst, static_cast<uint16_t>(dst + count - 1)))
+            return 0;
+
+        // a byte at a time when the destination runs into the source ahead
+        // of it, the way the loop itself would smear it
+        if (dst > src && dst < src + count)
+        {
+            for (size_t i = 0; i < count; ++i)
+                mem[dst + i] = bus.peek(static_cast<uint16_t>(src + i));
+        }
+        else if (src < 0x8000)
+        {
+            // ROM a page at a time, the banks aren't in memory
+            for (size_t done = 0; done < count;)
+            {
+                const size_t at = src + done;
+                const size_t size = std::min(MemoryMap::page_size - (at & 0xFF), count - done);
+                std::memcpy(mem + dst + done, bus.page(at >> 8) + (at & 0xFF), size);
+                done += size;
+            }
+        }
+        else
+        {
+            std::memmove(mem + dst, mem + src, count);
+        }
+        bus.mark_dirty(dst, static_cast<uint16_t>(dst + count - 1));
+        a = mem[dst + count - 1];
+        r.set(R16::HL, static_cast<uint16_t>(r.get(R16::HL) + count));
+        r.set(R16::DE, static_cast<uint16_t>(r.get(R16::DE) + count));
+    }
+
+    if (loop.kind == Kind::Copy16)
+    {
+        const auto bc = static_cast<uint16_t>(r.get(R16::BC) - count);
+        r.set(R16::BC, bc);
+        r.set(R8::A, static_cast<uint8_t>((bc >> 8) | (bc & 0xFF)));
+        r.set(R8::F, bc == 0 ? 0x80 : 0x00);
+    }
+    else
+    {
+        const auto counter = static_cast<uint8_t>(r.get(loop.counter) - count);
+        r.set(loop.counter, counter);
+        r.set(R8::A, a);
+        r.set(R8::F, dec_flags(counter, r.get(R8::F)));
+    }
+
+    r.set(R16::PC, count == left ? loop.exit : loop.head);
+    iterations = count;
+    return cycles;
+}
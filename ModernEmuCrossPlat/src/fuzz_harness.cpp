@@ -0,0 +1,127 @@
+#include "pch.h"
+
+#include "fuzz_harness.h"
+
+#include <cstring>
+
+namespace
+{
+    // OAM to the end of I/O, and IE
+    inline const bool wild(const uint16_t pc)
+    {
+        return (pc >= 0xFE00 && pc < 0xFF80) || pc == 0xFFFF;
+    }
+
+    inline const uint32_t location_hash(const Cartridge& cartridge, const uint16_t pc)
+    {
+        const uint32_t location = (pc < 0x8000) ? (static_cast<uint32_t>(cartridge.bank_at(pc)) << 16) | pc : pc;
+        return (location * 0x9E3779B1u) >> 16;
+    }
+}
+
+FuzzHarness::FuzzHarness(GameBoy& gb)
+    : FuzzHarness(gb, Options())
+{
+}
+
+FuzzHarness::FuzzHarness(GameBoy& gb, const Options& options)
+    : m_gb(gb)
+    , m_options(options)
+    , m_base(gb.paged_snapshot())
+    , m_coverage(map_size, 0)
+    , m_last_pc(0)
+    , m_polls(0)
+    , m_quiet_frames(0)
+{
+}
+
+void FuzzHarness::rebase()
+{
+    m_base = m_gb.paged_snapshot();
+}
+
+const size_t FuzzHarness::edges() const
+{
+    return static_cast<size_t>(std::count_if(m_coverage.begin(), m_coverage.end(), [](const uint8_t count) { return count != 0; }));
+}
+
+const char* FuzzHarness::outcome_name(const Outcome outcome)
+{
+    switch (outcome)
+    {
+    case Outcome::Finished:
+        return "finished";
+    case Outcome::Stopped:
+        return "stopped";
+    case Outcome::HaltedForever:
+        return "halted forever";
+    case Outcome::WildJump:
+        return "wild jump";
+    case Outcome::Stalled:
+        return "stalled";
+    }
+    return "?";
+}
+
+const FuzzHarness::Result FuzzHarness::run(const uint8_t* input, const size_t size)
+{
+    m_gb.restore(m_base);
+    std::memset(m_coverage.data(), 0, m_coverage.size());
+    m_last_pc = m_gb.cpu().get_pc();
+    m_polls = m_gb.joypad().polls();
+    m_quiet_frames = 0;
+
+    const uint64_t start = m_gb.cycles();
+    const size_t frames = std::min(m_options.max_frames, size * m_options.frames_per_input + m_options.settle_frames);
+    Outcome outcome = Outcome::Finished;
+    size_t frame = 0;
+    for (; frame < frames && outcome == Outcome::Finished; ++frame)
+    {
+        const size_t i = frame / std::max<size_t>(1, m_options.frames_per_input);
+        m_gb.set_buttons(i < size ? input[i] : 0);
+        outcome = run_frame();
+    }
+
+    const uint16_t pc = m_gb.cpu().get_pc();
+    return Result{ outcome, frame, m_gb.cycles() - start, static_cast<uint16_t>(m_gb.cartridge().bank_at(pc)), pc };
+}
+
+const FuzzHarness::Outcome FuzzHarness::run_frame()
+{
+    auto& cpu = m_gb.cpu();
+    const auto& cartridge = m_gb.cartridge();
+    const auto& bus = m_gb.bus();
+
+    size_t total = 0;
+    while (total < Ppu::frame_cycles)
+    {
+        total += m_gb.step();
+
+        const uint16_t pc = cpu.get_pc();
+        if (static_cast<uint16_t>(pc - m_last_pc - 1) > 2)
+        {
+            // a bank switch is never a jump, so the bank left is still mapped
+            const uint32_t edge = location_hash(cartridge, m_last_pc) ^ (location_hash(cartridge, pc) >> 1);
+            ++m_coverage[edge & (map_size - 1)];
+
+            if (wild(pc)) [[unlikely]]
+                return Outcome::WildJump;
+        }
+        m_last_pc = pc;
+
+        if (cpu.stopped()) [[unlikely]]
+            return Outcome::Stopped;
+        if (cpu.halted() && (bus.peek(IE_ADDR) & 0x1F) == 0) [[unlikely]]
+            return Outcome::HaltedForever;
+    }
+
+    if (m_options.stall_frames != 0)
+    {
+        const uint64_t polls = m_gb.joypad().polls();
+        m_quiet_frames = (polls == m_polls) ? m_quiet_frames + 1 : 0;
+        m_polls = polls;
+        if (m_quiet_frames >= m_options.stall_frames)
+            return Outcome::Stalled;
+    }
+    return Outcome::Finished;
+}
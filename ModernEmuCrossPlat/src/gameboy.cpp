@@ -0,0 +1,726 @@
+#include "pch.h"
+
+#include "gameboy.h"
+
+#include <cstring>
+
+template<class Stats>
+BasicGameBoy<Stats>::BasicGameBoy(std::vector<uint8_t> rom)
+    : m_bus(make_shared<MemoryMap>())
+    , m_cpu(m_bus)
+    , m_cartridge(std::move(rom))
+    , m_ppu()
+    , m_timer()
+    , m_joypad()
+    , m_cycles(0)
+    , m_frame_cycles(0)
+    , m_rom_hash(0)
+    , m_pages()
+    , m_pages_ram_swaps(0)
+    , m_state_hash()
+    , m_idle_loops()
+    , m_fast_forward(true)
+    , m_fused_loops()
+    , m_fuse_loops(true)
+    , m_compiled()
+    , m_compiled_count(0)
+    , m_block_cache()
+    , m_coverage()
+    , m_block_bank(0)
+    , m_block_addr(0)
+    , m_block_limit(0)
+    , m_block_frame_ready(false)
+    , m_block_stopped(false)
+{
+    m_bus->map_read(0xFF00, 0xFFFF, this);
+    m_bus->map_write(0xFF00, 0xFFFF, this);
+    m_cartridge.attach(*m_bus);
+    reset();
+}
+
+template<class Stats>
+BasicGameBoy<Stats>::BasicGameBoy(const BasicGameBoy& other, Cloning)
+    : m_bus(make_shared<MemoryMap>(*other.m_bus))
+    , m_cpu(m_bus)
+    , m_cartridge(other.m_cartridge)
+    , m_ppu(other.m_ppu)
+    , m_timer(other.m_timer)
+    , m_joypad(other.m_joypad)
+    , m_cycles(other.m_cycles)
+    , m_frame_cycles(other.m_frame_cycles)
+    , m_rom_hash(other.m_rom_hash)
+    , m_pages(other.m_pages)
+    , m_pages_ram_swaps(other.m_pages_ram_swaps)
+    , m_state_hash(other.m_state_hash)
+    , m_idle_loops()
+    , m_fast_forward(other.m_fast_forward)
+    , m_fused_loops()
+    , m_fuse_loops(other.m_fuse_loops)
+    , m_compiled(other.m_compiled)
+    , m_compiled_count(other.m_compiled_count)
+    , m_block_cache(other.m_block_cache)
+    , m_coverage()
+    , m_block_bank(0)
+    , m_block_addr(0)
+    , m_block_limit(0)
+    , m_block_frame_ready(false)
+    , m_block_stopped(false)
+{
+    // the copied bus still hands I/O and MBC writes to the other machine
+    m_bus->map_read(0xFF00, 0xFFFF, this);
+    m_bus->map_write(0xFF00, 0xFFFF, this);
+    m_cartridge.reattach(*m_bus);
+    m_cpu.load_state(other.m_cpu.save_state());
+    m_cpu.stats() = other.m_cpu.stats();
+}
+
+template<class Stats>
+std::unique_ptr<BasicGameBoy<Stats>> BasicGameBoy<Stats>::clone() const
+{
+    return std::unique_ptr<BasicGameBoy>(new BasicGameBoy(*this, Cloning{}));
+}
+
+template<class Stats>
+void BasicGameBoy<Stats>::reset()
+{
+    auto& r = m_cpu.registers();
+    r.set(R16::AF, 0x01B0);
+    r.set(R16::BC, 0x0013);
+    r.set(R16::DE, 0x00D8);
+    r.set(R16::HL, 0x014D);
+    r.set(R16::SP, 0xFFFE);
+    r.set(R16::PC, Cartridge::entry_addr);
+
+    m_bus->poke(IF_ADDR, 0x01);
+    m_bus->poke(IE_ADDR, 0x00);
+}
+
+template<class Stats>
+size_t BasicGameBoy<Stats>::step()
+{
+    return advance(std::numeric_limits<size_t>::max());
+}
+
+template<class Stats>
+size_t BasicGameBoy<Stats>::step_instruction()
+{
+    return advance(std::numeric_limits<size_t>::max(), false);
+}
+
+template<class Stats>
+size_t BasicGameBoy<Stats>::advance(const size_t limit, const bool blocks)
+{
+    // halted until the next event at the earliest, in 4 cycle steps
+    if (m_fast_forward && m_cpu.halted() && !m_cpu.stopped() && !interrupt_due()) [[unlikely]]
+    {
+        const size_t skip = (std::min(cycles_to_event(false), limit) + 3) & ~size_t(3);
+        if (skip != 0)
+        {
+            idle(skip);
+            return skip;
+        }
+    }
+
+    // the last instruction run, a compiled block ends in its jump
+    uint16_t pc = m_cpu.get_pc();
+    const bool frame_ready = m_ppu.frame_ready();
+    size_t cycles;
+    if (const auto* block = blocks ? compiled_block(pc) : nullptr)
+    {
+        cycles = run_compiled(*block, limit);
+        cover_block(block->addr, block->last);
+        if (m_block_stopped)
+            return cycles;
+        pc = block->last;
+    }
+    else if (const auto* cached = blocks ? cached_block(pc) : nullptr)
+    {
+        cycles = run_cached(*cached, limit);
+        cover_block(cached->addr, cached->last);
+        if (m_block_stopped)
+            return cycles;
+        pc = cached->last;
+    }
+    else
+    {
+        // taking an interrupt clears IME without a DI, and a halted CPU runs
+        // nothing until it wakes
+        const bool waiting = m_coverage && (m_cpu.halted() || m_cpu.stopped());
+        const bool ime = m_coverage && m_cpu.interrupts_enabled() && (waiting || m_bus->peek(pc) != 0xF3);
+
+        cycles = m_cpu.step();
+        m_timer.tick(*m_bus, cycles);
+        m_ppu.tick(*m_bus, cycles);
+        m_cycles += cycles;
+
+        if (m_coverage) [[unlikely]]
+        {
+            if (ime && !m_cpu.interrupts_enabled())
+                m_coverage->interrupted(m_cartridge, pc, m_cpu.get_pc());
+            else if (!waiting || m_cpu.get_pc() != pc)
+                m_coverage->arrive(m_cartridge, pc, m_cpu.get_pc());
+        }
+    }
+
+    // a backward jump, maybe a copy loop or an idle loop coming round again.
+    // Not if it just finished a frame, run_frame() stops right here.
+    if ((m_fuse_loops || m_fast_forward) && m_cpu.get_pc() <= pc && frame_ready == m_ppu.frame_ready()) [[unlikely]]
+    {
+        const auto bank = static_cast<uint16_t>(m_cartridge.bank_at(pc));
+        if (m_fuse_loops)
+        {
+            if (const auto* loop = m_fused_loops.arrive(m_cpu, *m_bus, bank, pc))
+                return cycles + run_fused(*loop, limit > cycles ? limit - cycles : 0);
+        }
+        if (!m_fast_forward)
+            return cycles;
+
+        const size_t iteration = m_idle_loops.arrive(m_cpu, *m_bus, bank, pc, m_cycles);
+        if (iteration != 0 && !m_cpu.ime_pending() && !(m_cpu.interrupts_enabled() && interrupt_due()))
+        {
+            // whole iterations, the last one ending no later than the event
+            const size_t budget = std::min(cycles_to_event(m_idle_loops.watches_ppu()), limit > cycles ? limit - cycles : 0);
+            const size_t skip = (budget / iteration) * iteration;
+            if (skip != 0)
+            {
+                idle(skip);
+                m_idle_loops.skipped(m_cycles);
+                cycles += skip;
+            }
+        }
+    }
+    return cycles;
+}
+
+template<class Stats>
+size_t BasicGameBoy<Stats>::run_fused(const FusedLoops::Loop& loop, const size_t max_cycles)
+{
+    if (m_cpu.ime_pending() || (m_cpu.interrupts_enabled() && interrupt_due()))
+        return 0;
+
+    // a line drawn in the middle would see the new tiles early, so stop
+    // at every PPU change when writing to VRAM or OAM on screen
+    const auto [first, count] = FusedLoops::destination(loop, m_cpu.registers());
+    const size_t last = first + count - 1;
+    const bool on_screen = m_ppu.lcd_on() && m_ppu.render()
+        && ((first <= 0x9FFF && last >= 0x8000) || (first <= 0xFE9F && last >= 0xFE00));
+
+    size_t iterations = 0;
+    const size_t cycles = FusedLoops::run(loop, m_cpu.registers(), *m_bus, std::min(cycles_to_event(on_screen), max_cycles), iterations);
+    if (cycles == 0)
+        return 0;
+
+    if constexpr (!std::is_same_v<Stats, NoStats>)
+    {
+        // counted as if they had been run one by one
+        const bool finished = m_cpu.get_pc() == loop.exit;
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            for (size_t op = 0; op < loop.op_count; ++op)
+            {
+                const auto [code, op_cycles] = loop.ops[op];
+                const bool untaken = finished && i + 1 == iterations && op + 1 == loop.op_count;
+                m_cpu.stats().on_op(false, code, untaken ? op_cycles - (loop.cycles - loop.last_cycles) : op_cycles);
+            }
+        }
+    }
+
+    m_timer.tick(*m_bus, cycles);
+    m_ppu.tick(*m_bus, cycles);
+    m_cycles += cycles;
+    return cycles;
+}
+
+template<class Stats>
+size_t BasicGameBoy<Stats>::run_compiled(const AotBlock<BasicGameBoy>& block, const size_t limit)
+{
+    start_block(block.bank, block.addr, limit);
+    return block.run(*this);
+}
+
+template<class Stats>
+const BlockCache::Block* BasicGameBoy<Stats>::cached_block(const uint16_t pc)
+{
+    if (!m_block_cache || pc >= 0x8000 || !block_can_run()) [[likely]]
+        return nullptr;
+
+    // bank 0's slots are only for bank 0, MBC1 can map others down there
+    const auto bank = static_cast<uint16_t>(m_cartridge.bank_at(pc));
+    if (pc < 0x4000 && bank != 0)
+        return nullptr;
+    const auto* block = m_block_cache->find(bank, pc);
+    if (!block)
+        block = &m_block_cache->translate(m_cpu, *m_bus, bank, pc);
+    return block->count != 0 ? block : nullptr;
+}
+
+template<class Stats>
+size_t BasicGameBoy<Stats>::run_cached(const BlockCache::Block& block, const size_t limit)
+{
+    start_block(block.bank, block.addr, limit);
+    size_t cycles = 0;
+    for (size_t i = 0; i < block.count; ++i)
+    {
+        const size_t op_cycles = m_cpu.run_decoded(block.ops[i]);
+        if (((block.stores >> i) & 1) ? compiled_store(cycles, op_cycles) : compiled_step(cycles, op_cycles))
+            break;
+    }
+    return cycles;
+}
+
+template<class Stats>
+const uint64_t BasicGameBoy<Stats>::cartridge_hash() const
+{
+    if (m_rom_hash == 0)
+        m_rom_hash = rom_hash(m_cartridge.rom());
+    return m_rom_hash;
+}
+
+template<class Stats>
+bool BasicGameBoy<Stats>::set_block_cache(shared_ptr<BlockCache> cache)
+{
+    if (cache && cache->rom_hash() != cartridge_hash())
+    {
+        m_block_cache.reset();
+        return false;
+    }
+    m_block_cache = std::move(cache);
+    return true;
+}
+
+template<class Stats>
+bool BasicGameBoy<Stats>::set_coverage(shared_ptr<Coverage> coverage)
+{
+    if (coverage && coverage->rom_hash() != cartridge_hash())
+    {
+        m_coverage.reset();
+        return false;
+    }
+    m_coverage = std::move(coverage);
+    if (m_coverage)
+        m_coverage->start(m_cpu.get_pc());
+    return true;
+}
+
+template<class Stats>
+bool BasicGameBoy<Stats>::set_compiled(const AotProgram<BasicGameBoy>& program)
+{
+    m_compiled.reset();
+    m_compiled_count = 0;
+    if (program.rom_hash != cartridge_hash())
+        return false;
+
+    auto compiled = make_shared<std::vector<const AotBlock<BasicGameBoy>*>>(std::max<size_t>(m_cartridge.rom_banks(), 2) * Cartridge::rom_bank_size, nullptr);
+    for (size_t i = 0; i < program.count; ++i)
+    {
+        const auto& block = program.blocks[i];
+        const size_t idx = block.bank * Cartridge::rom_bank_size + (block.addr & 0x3FFF);
+        if (idx < compiled->size() && block.addr < 0x8000)
+        {
+            (*compiled)[idx] = &block;
+            ++m_compiled_count;
+        }
+    }
+    m_compiled = std::move(compiled);
+    return true;
+}
+
+template<class Stats>
+void BasicGameBoy<Stats>::idle(const size_t cycles)
+{
+    m_cpu.stats().on_idle(cycles);
+    m_timer.tick(*m_bus, cycles);
+    m_ppu.tick(*m_bus, cycles);
+    m_cycles += cycles;
+}
+
+template<class Stats>
+size_t BasicGameBoy<Stats>::run_frame()
+{
+    const uint64_t start = m_cycles;
+    run_frame_until(std::numeric_limits<uint64_t>::max());
+    return static_cast<size_t>(m_cycles - start);
+}
+
+template<class Stats>
+bool BasicGameBoy<Stats>::run_frame_until(const uint64_t stop_at)
+{
+    m_ppu.clear_frame_ready();
+    while (m_cycles < stop_at)
+    {
+        // with the LCD off the frame ends on the cycle count, so don't skip past it
+        const size_t limit = m_ppu.lcd_on() ? std::numeric_limits<size_t>::max() : Ppu::frame_cycles - std::min(m_frame_cycles, Ppu::frame_cycles);
+        m_frame_cycles += advance(static_cast<size_t>(std::min<uint64_t>(limit, stop_at - m_cycles)));
+        if (m_ppu.frame_ready() || (!m_ppu.lcd_on() && m_frame_cycles >= Ppu::frame_cycles))
+        {
+            m_ppu.clear_frame_ready();
+            m_frame_cycles = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+template<class Stats>
+const uint8_t BasicGameBoy<Stats>::read(const uint16_t location)
+{
+    if (location == Joypad::P1)
+        return m_joypad.read();
+    if (location >= Timer::DIV && location <= Timer::TAC)
+        return m_timer.read(location);
+    if (location == IF_ADDR)
+        return static_cast<uint8_t>(0xE0 | m_bus->peek(IF_ADDR));
+    if (location >= Ppu::LCDC && location <= Ppu::WX)
+        return m_ppu.read(location);
+
+    // sound, HRAM and IE are plain memory as far as we're concerned
+    return m_bus->peek(location);
+}
+
+template<class Stats>
+void BasicGameBoy<Stats>::write(const uint16_t location, const uint8_t val)
+{
+    if (location == Joypad::P1)
+        m_joypad.write(val);
+    else if (location >= Timer::DIV && location <= Timer::TAC)
+        m_timer.write(location, val);
+    else if (location == IF_ADDR)
+        m_bus->poke(IF_ADDR, static_cast<uint8_t>(val & 0x1F));
+    else if (location >= Ppu::LCDC && location <= Ppu::WX)
+        m_ppu.write(*m_bus, location, val);
+    else
+        m_bus->poke(location, val);
+}
+
+template<class Stats>
+const typename BasicGameBoy<Stats>::Snapshot BasicGameBoy<Stats>::snapshot() const
+{
+    Snapshot snapshot{ m_cpu.save_state(), {}, m_cartridge.save_state(), m_ppu, m_timer, m_joypad, m_cycles };
+    for (size_t page = 0; page < MemoryMap::page_count; ++page)
+        std::memcpy(snapshot.memory.data() + page * MemoryMap::page_size, m_bus->page(page), MemoryMap::page_size);
+    return snapshot;
+}
+
+template<class Stats>
+void BasicGameBoy<Stats>::restore(const Snapshot& snapshot)
+{
+    std::memcpy(m_bus->data(), snapshot.memory.data(), snapshot.memory.size());
+    m_cpu.load_state(snapshot.cpu);
+    m_cartridge.load_state(snapshot.cartridge);
+    m_ppu = snapshot.ppu;
+    m_timer = snapshot.timer;
+    m_joypad = snapshot.joypad;
+    m_cycles = snapshot.cycles;
+    m_pages.reset();
+    m_state_hash.forget();
+    m_frame_cycles = 0;
+    if (m_coverage)
+        m_coverage->start(m_cpu.get_pc());
+}
+
+template<class Stats>
+const typename BasicGameBoy<Stats>::PagedSnapshot BasicGameBoy<Stats>::paged_snapshot()
+{
+    constexpr size_t page_size = MemoryMap::page_size;
+    constexpr size_t bus_pages = SnapshotPages::bus_pages;
+    const auto& cartridge = m_cartridge.state();
+    const size_t total = bus_pages + cartridge.ram.size() / page_size;
+    const bool full = !m_pages || m_pages->depth + 1 >= SnapshotPages::max_depth;
+    const bool ram_swapped = m_cartridge.ram_swaps() != m_pages_ram_swaps;
+
+    // what to copy, nullptr where the page is shared
+    std::array<const uint8_t*, SnapshotPages::max_pages> from{};
+    size_t copied = 0;
+    for (size_t i = 0; i < total; ++i)
+    {
+        const uint8_t* page = (i < bus_pages) ? m_bus->data() + (SnapshotPages::first_page + i) * page_size
+            : cartridge.ram.data() + (i - bus_pages) * page_size;
+        bool changed = full;
+        if (!changed && i < bus_pages)
+            changed = m_bus->dirty(SnapshotPages::first_page + i) || i == bus_pages - 1;
+        else if (!changed)
+            changed = ram_swapped && std::memcmp(page, m_pages->at[i], page_size) != 0;
+        if (changed)
+        {
+            from[i] = page;
+            ++copied;
+        }
+    }
+
+    auto pages = make_shared<SnapshotPages>();
+    pages->at.resize(total);
+    pages->copies.resize(copied * page_size);
+    uint8_t* copy = pages->copies.data();
+    for (size_t i = 0; i < total; ++i)
+    {
+        if (from[i])
+        {
+            std::memcpy(copy, from[i], page_size);
+            pages->at[i] = copy;
+            copy += page_size;
+        }
+        else
+        {
+            pages->at[i] = m_pages->at[i];
+        }
+    }
+    if (!full)
+    {
+        pages->parent = m_pages;
+        pages->depth = m_pages->depth + 1;
+    }
+
+    m_pages = pages;
+    m_pages_ram_swaps = m_cartridge.ram_swaps();
+    m_bus->clear_dirty();
+    return PagedSnapshot{ m_cpu.save_state(), std::move(pages), m_ppu.save_state(), m_timer.save_state(), m_joypad.save_state(),
+        { cartridge.bank1, cartridge.bank2, cartridge.mode, cartridge.ram_enabled }, m_cycles };
+}
+
+template<class Stats>
+void BasicGameBoy<Stats>::restore(const PagedSnapshot& snapshot)
+{
+    constexpr size_t page_size = MemoryMap::page_size;
+    constexpr size_t bus_pages = SnapshotPages::bus_pages;
+    const auto& target = snapshot.pages->at;
+    auto& cartridge = m_cartridge.state();
+    const bool ram_swapped = !m_pages || m_cartridge.ram_swaps() != m_pages_ram_swaps;
+
+    for (size_t i = 0; i < bus_pages; ++i)
+    {
+        const size_t page = SnapshotPages::first_page + i;
+        if (!m_pages || m_pages->at[i] != target[i] || m_bus->dirty(page) || i == bus_pages - 1)
+        {
+            std::memcpy(m_bus->data() + page * page_size, target[i], page_size);
+            m_bus->mark_dirty(static_cast<uint16_t>(page * page_size));
+        }
+    }
+    for (size_t i = bus_pages; i < target.size(); ++i)
+    {
+        if (ram_swapped || m_pages->at[i] != target[i])
+        {
+            std::memcpy(cartridge.ram.data() + (i - bus_pages) * page_size, target[i], page_size);
+            m_state_hash.forget_ram();
+        }
+    }
+
+    m_cpu.load_state(snapshot.cpu);
+    m_ppu.load_state(snapshot.ppu);
+    m_timer.load_state(snapshot.timer);
+    m_joypad.load_state(snapshot.joypad);
+    m_cycles = snapshot.cycles;
+    m_frame_cycles = 0;
+    cartridge.bank1 = snapshot.cartridge.bank1;
+    cartridge.bank2 = snapshot.cartridge.bank2;
+    cartridge.mode = snapshot.cartridge.mode;
+    cartridge.ram_enabled = snapshot.cartridge.ram_enabled != 0;
+    m_cartridge.map_state();
+
+    m_pages = snapshot.pages;
+    m_pages_ram_swaps = m_cartridge.ram_swaps();
+    m_bus->clear_dirty();
+    if (m_coverage)
+        m_coverage->start(m_cpu.get_pc());
+}
+
+namespace
+{
+    using namespace save_state;
+
+    // saved as they are, so no padding to leave uninitialized
+    static_assert(sizeof(Header) == 24 && sizeof(ChunkHeader) == 12);
+    static_assert(sizeof(CpuChunk) == 20 && sizeof(MachineChunk) == 8 && sizeof(CartridgeChunk) == 4);
+    static_assert(sizeof(Timer::State) == 6 && sizeof(Joypad::State) == 2 && sizeof(Ppu::State) == 20);
+
+    // the number of chunks save() writes, END included
+    constexpr size_t chunk_count = 10;
+
+    const CpuChunk to_chunk(const CpuState& cpu)
+    {
+        CpuChunk chunk{};
+        for (size_t i = 0; i < chunk.registers.size(); ++i)
+            chunk.registers[i] = cpu.r.get(static_cast<R16>(i));
+        chunk.ime = cpu.ime;
+        chunk.ime_pending = cpu.ime_pending;
+        chunk.halted = cpu.halted;
+        chunk.halt_bug = cpu.halt_bug;
+        chunk.stopped = cpu.stopped;
+        return chunk;
+    }
+
+    const CpuState from_chunk(const CpuChunk& chunk)
+    {
+        CpuState cpu{};
+        for (size_t i = 0; i < chunk.registers.size(); ++i)
+            cpu.r.set(static_cast<R16>(i), chunk.registers[i]);
+        cpu.ime = chunk.ime != 0;
+        cpu.ime_pending = chunk.ime_pending != 0;
+        cpu.halted = chunk.halted != 0;
+        cpu.halt_bug = chunk.halt_bug != 0;
+        cpu.stopped = chunk.stopped != 0;
+        return cpu;
+    }
+
+    inline bool put(StateSink& out, const Tag& tag, const void* data, const size_t size)
+    {
+        const ChunkHeader header{ tag, 1, 0, static_cast<uint32_t>(size) };
+        return out.write(&header, sizeof(header)) && (size == 0 || out.write(data, size));
+    }
+
+    template<class T>
+    inline bool put(StateSink& out, const Tag& tag, const T& value)
+    {
+        return put(out, tag, &value, sizeof(T));
+    }
+
+    // as much of a chunk as value holds, the rest of a newer one skipped
+    template<class T>
+    inline bool get(StateSource& in, const uint32_t size, T& value)
+    {
+        const size_t known = std::min<size_t>(size, sizeof(T));
+        return in.read(&value, known) && in.skip(size - known);
+    }
+}
+
+template<class Stats>
+const size_t BasicGameBoy<Stats>::saved_size() const
+{
+    return sizeof(Header) + chunk_count * sizeof(ChunkHeader) + sizeof(CpuChunk) + sizeof(MachineChunk)
+        + sizeof(Timer::State) + sizeof(Joypad::State) + sizeof(Ppu::State) + sizeof(CartridgeChunk)
+        + m_cartridge.state().ram.size() + memory_size + Ppu::width * Ppu::height;
+}
+
+template<class Stats>
+bool BasicGameBoy<Stats>::save(StateSink& out) const
+{
+    const Header header{ magic, format_version, sizeof(Header), byte_order_mark, cartridge_hash() };
+    const auto& cartridge = m_cartridge.state();
+    const CartridgeChunk cartridge_chunk{ cartridge.bank1, cartridge.bank2, cartridge.mode, cartridge.ram_enabled };
+    const auto& framebuffer = m_ppu.framebuffer();
+    return out.write(&header, sizeof(header))
+        && put(out, cpu_tag, to_chunk(m_cpu.save_state()))
+        && put(out, machine_tag, MachineChunk{ m_cycles })
+        && put(out, timer_tag, m_timer.save_state())
+        && put(out, joypad_tag, m_joypad.save_state())
+        && put(out, ppu_tag, m_ppu.save_state())
+        && put(out, cartridge_tag, cartridge_chunk)
+        && put(out, cartridge_ram_tag, cartridge.ram.data(), cartridge.ram.size())
+        && put(out, memory_tag, m_bus->data() + memory_start, memory_size)
+        && put(out, lcd_tag, framebuffer.data(), framebuffer.size())
+        && put(out, end_tag, nullptr, 0);
+}
+
+template<class Stats>
+bool BasicGameBoy<Stats>::load(StateSource& in)
+{
+    Header header;
+    if (!in.read(&header, sizeof(header)) || header.magic != magic || header.version == 0 || header.version > format_version
+        || header.byte_order != byte_order_mark || header.header_size < sizeof(Header) || header.rom_hash != cartridge_hash()
+        || !in.skip(header.header_size - sizeof(Header)))
+        return false;
+    // the bus changes from here on, past whatever paged snapshot it was
+    m_pages.reset();
+    m_state_hash.forget();
+
+    // what an older state doesn't have stays as it is
+    auto cpu = to_chunk(m_cpu.save_state());
+    MachineChunk machine{ m_cycles };
+    auto timer = m_timer.save_state();
+    auto joypad = m_joypad.save_state();
+    auto ppu = m_ppu.save_state();
+    auto& cartridge = m_cartridge.state();
+    CartridgeChunk cartridge_chunk{ cartridge.bank1, cartridge.bank2, cartridge.mode, cartridge.ram_enabled };
+
+    // the chunks no state can do without
+    enum : uint32_t { CpuSeen = 1, MachineSeen = 2, PpuSeen = 4, CartridgeSeen = 8, RamSeen = 16, MemorySeen = 32 };
+    uint32_t seen = 0;
+    while (true)
+    {
+        ChunkHeader chunk;
+        if (!in.read(&chunk, sizeof(chunk)))
+            return false;
+        if (chunk.tag == end_tag)
+            break;
+
+        bool ok;
+        if (chunk.tag == cpu_tag)
+        {
+            ok = get(in, chunk.size, cpu);
+            seen |= CpuSeen;
+        }
+        else if (chunk.tag == machine_tag)
+        {
+            ok = get(in, chunk.size, machine);
+            seen |= MachineSeen;
+        }
+        else if (chunk.tag == timer_tag)
+            ok = get(in, chunk.size, timer);
+        else if (chunk.tag == joypad_tag)
+            ok = get(in, chunk.size, joypad);
+        else if (chunk.tag == ppu_tag)
+        {
+            ok = get(in, chunk.size, ppu);
+            seen |= PpuSeen;
+        }
+        else if (chunk.tag == cartridge_tag)
+        {
+            ok = get(in, chunk.size, cartridge_chunk);
+            seen |= CartridgeSeen;
+        }
+        else if (chunk.tag == cartridge_ram_tag)
+        {
+            ok = chunk.size == cartridge.ram.size() && in.read(cartridge.ram.data(), chunk.size);
+            seen |= RamSeen;
+        }
+        else if (chunk.tag == memory_tag)
+        {
+            ok = chunk.size == memory_size && in.read(m_bus->data() + memory_start, memory_size);
+            seen |= MemorySeen;
+        }
+        else if (chunk.tag == lcd_tag && chunk.size == m_ppu.framebuffer().size())
+            ok = in.read(m_ppu.framebuffer().data(), chunk.size);
+        else
+            ok = in.skip(chunk.size);
+        if (!ok)
+            return false;
+    }
+    if (seen != (CpuSeen | MachineSeen | PpuSeen | CartridgeSeen | RamSeen | MemorySeen))
+        return false;
+
+    m_cpu.load_state(from_chunk(cpu));
+    m_cycles = machine.cycles;
+    m_frame_cycles = 0;
+    m_timer.load_state(timer);
+    m_joypad.load_state(joypad);
+    m_ppu.load_state(ppu);
+    cartridge.bank1 = cartridge_chunk.bank1;
+    cartridge.bank2 = cartridge_chunk.bank2;
+    cartridge.mode = cartridge_chunk.mode;
+    cartridge.ram_enabled = cartridge_chunk.ram_enabled != 0;
+    m_cartridge.map_state();
+    if (m_coverage)
+        m_coverage->start(m_cpu.get_pc());
+    return true;
+}
+
+template<class Stats>
+const uint64_t BasicGameBoy<Stats>::state_hash()
+{
+    // the chunks a save state has, which leave no padding to hash
+    const auto cpu = to_chunk(m_cpu.save_state());
+    const auto ppu = m_ppu.save_state();
+    const auto timer = m_timer.save_state();
+    const auto joypad = m_joypad.save_state();
+    const auto& cartridge = m_cartridge.state();
+    const CartridgeChunk cartridge_chunk{ cartridge.bank1, cartridge.bank2, cartridge.mode, cartridge.ram_enabled };
+
+    uint64_t hash = m_state_hash.memory(*m_bus, m_cartridge);
+    hash = StateHash::bytes(&cpu, sizeof(cpu), hash);
+    hash = StateHash::bytes(&ppu, sizeof(ppu), hash);
+    hash = StateHash::bytes(&timer, sizeof(timer), hash);
+    hash = StateHash::bytes(&joypad, sizeof(joypad), hash);
+    return StateHash::bytes(&cartridge_chunk, sizeof(cartridge_chunk), hash);
+}
+
+template class BasicGameBoy<NoStats>;
+template class BasicGameBoy<OpcodeStats>;
@@ -0,0 +1,132 @@
+#include "pch.h"
+
+#include "idle_loop.h"
+
+#include <optional>
+
+#include "ppu.h"
+#include "timer.h"
+
+const uint16_t IdleLoops::jump_target(MemoryMap& bus, const uint16_t branch)
+{
+    const uint8_t op = bus.peek(branch);
+    if (op == 0x18 || (op & 0xE7) == 0x20)
+    {
+        const auto offset = static_cast<int8_t>(bus.peek(static_cast<uint16_t>(branch + 1)));
+        return static_cast<uint16_t>(branch + 2 + offset);
+    }
+    return static_cast<uint16_t>(bus.peek(static_cast<uint16_t>(branch + 1)) | (bus.peek(static_cast<uint16_t>(branch + 2)) << 8));
+}
+
+const bool IdleLoops::accept(const DecodedOpcode& decoded, MemoryMap& bus, Loop& loop, const uint16_t branch)
+{
+    const uint8_t op = decoded.op;
+
+    std::optional<Read> read;
+    if (decoded.prefixed)
+    {
+        // BIT n, r and BIT n, (HL) only touch the flags
+        if (op < 0x40 || op > 0x7F)
+            return false;
+        if ((op & 0x07) == 6)
+            read = Read{ Source::HL, 0 };
+    }
+    else if (op == 0x0A)
+    {
+        read = Read{ Source::BC, 0 };
+    }
+    else if (op == 0x1A)
+    {
+        read = Read{ Source::DE, 0 };
+    }
+    else if (op == 0xF0)
+    {
+        read = Read{ Source::Absolute, static_cast<uint16_t>(0xFF00 | bus.peek(static_cast<uint16_t>(decoded.location + 1))) };
+    }
+    else if (op == 0xF2)
+    {
+        read = Read{ Source::HighC, 0 };
+    }
+    else if (op == 0xFA)
+    {
+        read = Read{ Source::Absolute, static_cast<uint16_t>(bus.peek(static_cast<uint16_t>(decoded.location + 1)) | (bus.peek(static_cast<uint16_t>(decoded.location + 2)) << 8)) };
+    }
+    else if ((op >= 0x78 && op <= 0xBF) || (op & 0xC7) == 0xC6)
+    {
+        // LD A, r and the ALU ops, r = 6 is (HL)
+        if (op < 0xC0 && (op & 0x07) == 6)
+            read = Read{ Source::HL, 0 };
+    }
+    else if ((op & 0xE7) == 0x20 || (op & 0xE7) == 0xC2)
+    {
+        // a conditional way out, never taken while the loop spins
+        const uint16_t target = jump_target(bus, decoded.location);
+        if (target >= loop.head && target <= branch)
+            return false;
+    }
+    else
+    {
+        // NOP and the accumulator rotates, DAA, CPL, SCF, CCF
+        switch (op)
+        {
+        case 0x00: case 0x07: case 0x0F: case 0x17: case 0x1F:
+        case 0x27: case 0x2F: case 0x37: case 0x3F:
+            break;
+        default:
+            return false;
+        }
+    }
+
+    if (read)
+    {
+        if (loop.read_count == max_reads)
+            return false;
+        loop.reads[loop.read_count++] = *read;
+    }
+    return true;
+}
+
+const size_t IdleLoops::at_head(Loop& loop, const RegisterFile& registers, MemoryMap& bus, const uint64_t now)
+{
+    std::array<uint8_t, max_reads> values{};
+    bool watches_ppu = false;
+    for (size_t i = 0; i < loop.read_count; ++i)
+    {
+        const auto& read = loop.reads[i];
+        uint16_t addr = read.addr;
+        switch (read.source)
+        {
+        case Source::Absolute:
+            break;
+        case Source::HighC:
+            addr = static_cast<uint16_t>(0xFF00 | registers.get(R8::C));
+            break;
+        case Source::BC:
+            addr = registers.get(R16::BC);
+            break;
+        case Source::DE:
+            addr = registers.get(R16::DE);
+            break;
+        case Source::HL:
+            addr = registers.get(R16::HL);
+            break;
+        }
+
+        // DIV and TIMA move on their own
+        if (addr >= Timer::DIV && addr <= Timer::TAC)
+            return 0;
+        values[i] = bus.read(addr);
+        watches_ppu = watches_ppu || (addr >= Ppu::LCDC && addr <= Ppu::WX);
+    }
+
+    // one whole iteration, no interrupt in between, back where it started
+    const bool fixed = loop.seen && now - loop.seen_at == loop.cycles
+        && loop.registers == registers && loop.values == values;
+
+    loop.seen = true;
+    loop.seen_at = now;
+    loop.registers = registers;
+    loop.values = values;
+    loop.watches_ppu = watches_ppu;
+    return fixed ? loop.cycles : 0;
+}
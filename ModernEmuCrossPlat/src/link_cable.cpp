@@ -0,0 +1,67 @@
+#include "pch.h"
+
+#include "link_cable.h"
+
+LinkCable::LinkCable(GameBoy& first, GameBoy& second)
+    : m_machines{ &first, &second }
+    , m_transfer_end(0)
+    , m_master(no_master)
+    , m_transfers(0)
+{
+}
+
+void LinkCable::run_frame()
+{
+    std::array<bool, 2> done = { false, false };
+    while (!done[0] || !done[1])
+    {
+        uint64_t behind = std::numeric_limits<uint64_t>::max();
+        for (size_t side = 0; side < m_machines.size(); ++side)
+        {
+            if (!done[side])
+                behind = std::min(behind, m_machines[side]->cycles());
+        }
+        for (size_t side = 0; side < m_machines.size(); ++side)
+        {
+            if (!done[side])
+                done[side] = m_machines[side]->run_frame_until(behind + slice_cycles);
+        }
+        connect();
+    }
+}
+
+void LinkCable::connect()
+{
+    if (m_master == no_master)
+    {
+        for (size_t side = 0; side < m_machines.size(); ++side)
+        {
+            if ((m_machines[side]->bus().peek(SC) & 0x81) == 0x81)
+            {
+                m_master = static_cast<uint8_t>(side);
+                m_transfer_end = m_machines[side]->cycles() + transfer_cycles;
+                break;
+            }
+        }
+        return;
+    }
+    if (m_machines[m_master]->cycles() < m_transfer_end)
+        return;
+
+    // the other side shifts on the master's clock whether it's waiting or
+    // not, but only one waiting sees the transfer end
+    auto& master = m_machines[m_master]->bus();
+    auto& other = m_machines[m_master ^ 1]->bus();
+    const uint8_t sent = master.peek(SB);
+    master.poke(SB, other.peek(SB));
+    other.poke(SB, sent);
+    master.poke(SC, static_cast<uint8_t>(master.peek(SC) & 0x7F));
+    master.request_interrupt(Interrupt::Serial);
+    if ((other.peek(SC) & 0x81) == 0x80)
+    {
+        other.poke(SC, static_cast<uint8_t>(other.peek(SC) & 0x7F));
+        other.request_interrupt(Interrupt::Serial);
+    }
+    m_master = no_master;
+    ++m_transfers;
+}
@@ -0,0 +1,168 @@
+#include "pch.h"
+
+#include "opcode_stats.h"
+
+#include <vector>
+
+#include "cpu.h"
+#include "opcode_table.h"
+
+namespace
+{
+    constexpr std::array<uint8_t, 256> make_taken_cycles()
+    {
+        std::array<uint8_t, 256> cycles{};
+        for (size_t op = 0; op < 256; ++op)
+        {
+            const auto& entry = unprefixed_op_codes[op];
+            if (entry.IsValid() && entry.MinCycles() != entry.MaxCycles())
+                cycles[op] = static_cast<uint8_t>(entry.MaxCycles());
+        }
+        return cycles;
+    }
+
+    struct OpcodeInfo
+    {
+        std::string name;
+        OpcodeGroup group;
+    };
+
+    // name and group of all 512 opcodes, from the decoder
+    const std::array<OpcodeInfo, OpcodeStats::opcode_count>& opcode_info()
+    {
+        static const auto info = []()
+        {
+            std::array<OpcodeInfo, OpcodeStats::opcode_count> info;
+            auto memory = make_shared<MemoryMap>();
+            GBZ80 cpu(memory);
+            for (size_t idx = 0; idx < info.size(); ++idx)
+            {
+                const bool prefixed = idx >= 0x100;
+                const uint8_t op = static_cast<uint8_t>(idx & 0xFF);
+                memory->write(0, prefixed ? 0xCB : op);
+                memory->write(1, op);
+
+                const auto decoded = cpu.decode_op(0, memory->read(0));
+                std::string name = decoded.name;
+                const auto first = decoded.GetOprand1Name();
+                const auto second = decoded.GetOprand2Name();
+                if (!first.empty())
+                    name += " " + first;
+                if (!second.empty())
+                    name += "," + second;
+                info[idx] = OpcodeInfo{ name, decoded.group };
+            }
+            return info;
+        }();
+        return info;
+    }
+
+    const double percent(const uint64_t part, const uint64_t total)
+    {
+        return total ? 100.0 * static_cast<double>(part) / static_cast<double>(total) : 0.0;
+    }
+
+    constexpr std::array<uint8_t, 256> conditional_taken_cycles = make_taken_cycles();
+
+    // the conditional JR, JP, CALL and RET
+    static_assert(std::count_if(conditional_taken_cycles.begin(), conditional_taken_cycles.end(), [](const uint8_t c) { return c != 0; }) == 16);
+}
+
+const std::array<uint8_t, 256> OpcodeStats::taken_cycles = conditional_taken_cycles;
+
+const uint64_t OpcodeStats::instructions() const
+{
+    return std::accumulate(m_count.begin(), m_count.end(), uint64_t(0));
+}
+
+const uint64_t OpcodeStats::total_cycles() const
+{
+    return std::accumulate(m_cycles.begin(), m_cycles.end(), uint64_t(0)) + m_interrupt_cycles + m_idle_cycles;
+}
+
+void OpcodeStats::reset()
+{
+    *this = OpcodeStats();
+}
+
+OpcodeStats& OpcodeStats::operator+=(const OpcodeStats& other)
+{
+    for (size_t idx = 0; idx < opcode_count; ++idx)
+    {
+        m_count[idx] += other.m_count[idx];
+        m_cycles[idx] += other.m_cycles[idx];
+    }
+    for (size_t op = 0; op < 256; ++op)
+    {
+        m_taken[op] += other.m_taken[op];
+        m_untaken[op] += other.m_untaken[op];
+    }
+    m_interrupts += other.m_interrupts;
+    m_interrupt_cycles += other.m_interrupt_cycles;
+    m_idle_cycles += other.m_idle_cycles;
+    return *this;
+}
+
+const std::string format_opcode_stats(const OpcodeStats& stats, const size_t top)
+{
+    const auto& info = opcode_info();
+    const uint64_t total = stats.total_cycles();
+
+    std::stringstream out;
+    out << std::fixed << std::setprecision(1);
+    out << "instructions " << stats.instructions() << ", cycles " << total
+        << ", interrupts " << stats.interrupts() << " (" << stats.interrupt_cycles() << " cycles)"
+        << ", idle " << stats.idle_cycles() << " cycles (" << percent(stats.idle_cycles(), total) << "%)\n";
+
+    // by group
+    std::map<OpcodeGroup, std::pair<uint64_t, uint64_t>> groups;
+    for (size_t idx = 0; idx < OpcodeStats::opcode_count; ++idx)
+    {
+        auto& group = groups[info[idx].group];
+        group.first += stats.count(idx);
+        group.second += stats.cycles(idx);
+    }
+
+    out << "\ngroup        count          cycles    %cycles\n";
+    for (const auto& [group, totals] : groups)
+    {
+        if (totals.first == 0)
+            continue;
+        out << std::left << std::setw(10) << op_group_to_str(group) << std::right
+            << std::setw(8) << totals.first << std::setw(16) << totals.second
+            << std::setw(10) << percent(totals.second, total) << "\n";
+    }
+
+    // by opcode, hottest first
+    std::vector<size_t> order;
+    for (size_t idx = 0; idx < OpcodeStats::opcode_count; ++idx)
+    {
+        if (stats.count(idx) != 0)
+            order.push_back(idx);
+    }
+    std::stable_sort(order.begin(), order.end(), [&stats](const size_t a, const size_t b)
+    {
+        return stats.cycles(a) > stats.cycles(b);
+    });
+    if (top != 0 && order.size() > top)
+        order.resize(top);
+
+    out << "\nop      instruction        count          cycles    %cycles    taken  untaken\n";
+    for (const auto idx : order)
+    {
+        const bool prefixed = idx >= 0x100;
+        const uint8_t op = static_cast<uint8_t>(idx & 0xFF);
+
+        std::stringstream code;
+        code << std::uppercase << std::hex << std::setfill('0') << (prefixed ? "CB " : "") << std::setw(2) << static_cast<unsigned>(op);
+
+        out << std::left << std::setw(8) << code.str() << std::setw(16) << info[idx].name << std::right
+            << std::setw(8) << stats.count(idx) << std::setw(16) << stats.cycles(idx)
+            << std::setw(10) << percent(stats.cycles(idx), total);
+        if (!prefixed && OpcodeStats::taken_cycles[op] != 0)
+            out << std::setw(9) << stats.taken(op) << std::setw(9) << stats.untaken(op);
+        out << "\n";
+    }
+
+    return out.str();
+}
@@ -0,0 +1,83 @@
+#include "pch.h"
+
+#include "operands.h"
+
+namespace
+{
+    const char* const r8_names[] = { "B", "C", "D", "E", "H", "L", "A", "F" };
+    const char* const r16_names[] = { "BC", "DE", "HL", "AF", "SP", "PC" };
+    const char* const cc_names[] = { "NZ", "Z", "NC", "C" };
+
+    template<class... Ts>
+    struct overloaded : Ts...
+    {
+        using Ts::operator()...;
+    };
+
+    template<class... Ts>
+    overloaded(Ts...) -> overloaded<Ts...>;
+
+    const std::string hex(const unsigned val, const int width)
+    {
+        std::stringstream str_stream;
+        str_stream << "$" << std::uppercase << std::hex << std::setfill('0') << std::setw(width) << val;
+        return str_stream.str();
+    }
+
+    const std::string reg_address_name(const RegAddress& op)
+    {
+        std::string name = "(";
+        name += r16_names[static_cast<size_t>(op.reg)];
+        if (op.step > 0)
+            name += "+";
+        else if (op.step < 0)
+            name += "-";
+        name += ")";
+        return name;
+    }
+
+    const std::string vector_name(const Vector& op)
+    {
+        static const char digits[] = "0123456789ABCDEF";
+        std::string name;
+        name += digits[op.addr >> 4];
+        name += digits[op.addr & 0xF];
+        name += "H";
+        return name;
+    }
+}
+
+const std::string operand_name(const Operand& operand)
+{
+    return std::visit(overloaded{
+        [](const NoOperand&) { return std::string(); },
+        [](const Reg8& op) { return std::string(r8_names[static_cast<size_t>(op.reg)]); },
+        [](const Reg16& op) { return std::string(r16_names[static_cast<size_t>(op.reg)]); },
+        [](const Imm8&) { return std::string("d8"); },
+        [](const Imm16&) { return std::string("d16"); },
+        [](const Target16&) { return std::string("a16"); },
+        [](const Rel8&) { return std::string("r8"); },
+        [](const SPRel8&) { return std::string("SP+r8"); },
+        [](const RegAddress& op) { return reg_address_name(op); },
+        [](const ImmAddress&) { return std::string("(a16)"); },
+        [](const HighImmAddress&) { return std::string("(a8)"); },
+        [](const HighCAddress&) { return std::string("(C)"); },
+        [](const Condition& op) { return std::string(cc_names[static_cast<size_t>(op.cc)]); },
+        [](const Vector& op) { return vector_name(op); },
+        [](const Constant& op) { return std::to_string(op.value); }
+        }, operand);
+}
+
+const std::string operand_to_string(const Operand& operand)
+{
+    return std::visit(overloaded{
+        [](const Imm8& op) { return hex(op.value, 2); },
+        [](const Imm16& op) { return hex(op.value, 4); },
+        [](const Target16& op) { return hex(op.value, 4); },
+        [](const Rel8& op) { return std::to_string(op.value); },
+        [](const SPRel8& op) { return "SP" + std::string(op.value < 0 ? "" : "+") + std::to_string(op.value); },
+        [](const ImmAddress& op) { return "(" + hex(op.addr, 4) + ")"; },
+        [](const HighImmAddress& op) { return "(" + hex(0xFF00u | op.offset, 4) + ")"; },
+        [&operand](const auto&) { return operand_name(operand); }
+        }, operand);
+}
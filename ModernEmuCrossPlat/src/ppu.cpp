@@ -0,0 +1,386 @@
+#include "pch.h"
+
+#include "ppu.h"
+
+namespace
+{
+    constexpr size_t OAM_SCAN_END = 80;
+    constexpr size_t TRANSFER_END = OAM_SCAN_END + 172;
+    constexpr uint8_t VBLANK_LINE = 144;
+
+    constexpr uint16_t OAM_ADDR = 0xFE00;
+    constexpr size_t OAM_ENTRIES = 40;
+    constexpr size_t SPRITES_PER_LINE = 10;
+
+    // colour index 0-3 of one pixel of the tile at addr
+    inline const uint8_t tile_pixel(const uint8_t* mem, const uint16_t addr, const size_t row, const size_t col)
+    {
+        const uint8_t lo = mem[addr + row * 2];
+        const uint8_t hi = mem[addr + row * 2 + 1];
+        const size_t bit = 7 - col;
+        return static_cast<uint8_t>((((hi >> bit) & 1) << 1) | ((lo >> bit) & 1));
+    }
+
+    inline const uint8_t shade(const uint8_t palette, const uint8_t colour)
+    {
+        return static_cast<uint8_t>((palette >> (colour * 2)) & 0x03);
+    }
+}
+
+void Ppu::tick(MemoryMap& bus, size_t cycles)
+{
+    if (!lcd_on())
+        return;
+
+    while (cycles > 0)
+    {
+        size_t boundary = line_cycles;
+        if (m_ly < VBLANK_LINE)
+        {
+            if (m_dot < OAM_SCAN_END)
+                boundary = OAM_SCAN_END;
+            else if (m_dot < TRANSFER_END)
+                boundary = TRANSFER_END;
+        }
+
+        const size_t step = std::min(cycles, boundary - m_dot);
+        m_dot += step;
+        cycles -= step;
+
+        if (m_dot == line_cycles)
+        {
+            m_dot = 0;
+            if (m_ly + 1 == lines)
+            {
+                m_window_line = 0;
+                set_ly(bus, 0);
+                set_mode(bus, Mode::OamScan);
+            }
+            else
+            {
+                set_ly(bus, static_cast<uint8_t>(m_ly + 1));
+                if (m_ly == VBLANK_LINE)
+                {
+                    set_mode(bus, Mode::VBlank);
+                    bus.request_interrupt(Interrupt::VBlank);
+                    m_frame_ready = true;
+                }
+                else if (m_ly < VBLANK_LINE)
+                {
+                    set_mode(bus, Mode::OamScan);
+                }
+            }
+        }
+        else if (m_ly < VBLANK_LINE && m_dot == OAM_SCAN_END)
+        {
+            set_mode(bus, Mode::Transfer);
+        }
+        else if (m_ly < VBLANK_LINE && m_dot == TRANSFER_END)
+        {
+            if (m_render)
+                draw_line(bus);
+            set_mode(bus, Mode::HBlank);
+        }
+    }
+}
+
+const size_t Ppu::cycles_to_event() const
+{
+    if (!lcd_on())
+        return frame_cycles;
+
+    if (m_ly < VBLANK_LINE)
+    {
+        if (m_dot < OAM_SCAN_END)
+            return OAM_SCAN_END - m_dot;
+        if (m_dot < TRANSFER_END)
+            return TRANSFER_END - m_dot;
+    }
+    return line_cycles - m_dot;
+}
+
+const size_t Ppu::cycles_to_interrupt() const
+{
+    if (!lcd_on())
+        return frame_cycles;
+
+    // walk the mode boundaries the way tick() does, without changing anything
+    size_t ly = m_ly;
+    size_t dot = m_dot;
+    size_t elapsed = 0;
+    while (elapsed < frame_cycles)
+    {
+        size_t boundary = line_cycles;
+        if (ly < VBLANK_LINE)
+        {
+            if (dot < OAM_SCAN_END)
+                boundary = OAM_SCAN_END;
+            else if (dot < TRANSFER_END)
+                boundary = TRANSFER_END;
+        }
+        elapsed += boundary - dot;
+        dot = boundary;
+
+        if (dot == line_cycles)
+        {
+            dot = 0;
+            ly = (ly + 1 == lines) ? 0 : ly + 1;
+            if ((m_stat & 0x40) && ly == m_lyc)
+                return elapsed;
+            if (ly == VBLANK_LINE)
+                return elapsed;
+            if (ly < VBLANK_LINE && (m_stat & 0x20))
+                return elapsed;
+        }
+        else if (dot == TRANSFER_END && (m_stat & 0x08))
+        {
+            return elapsed;
+        }
+    }
+    return frame_cycles;
+}
+
+const uint8_t Ppu::read(const uint16_t location) const
+{
+    switch (location)
+    {
+    case LCDC:
+        return m_lcdc;
+    case STAT:
+        return static_cast<uint8_t>(0x80 | m_stat);
+    case SCY:
+        return m_scy;
+    case SCX:
+        return m_scx;
+    case LY:
+        return m_ly;
+    case LYC:
+        return m_lyc;
+    case DMA:
+        return m_dma;
+    case BGP:
+        return m_bgp;
+    case OBP0:
+        return m_obp0;
+    case OBP1:
+        return m_obp1;
+    case WY:
+        return m_wy;
+    case WX:
+        return m_wx;
+    default:
+        return 0xFF;
+    }
+}
+
+const Ppu::State Ppu::save_state() const
+{
+    return State{ { m_lcdc, m_stat, m_scy, m_scx, m_ly, m_lyc, m_dma, m_bgp, m_obp0, m_obp1, m_wy, m_wx },
+        m_mode, m_window_line, m_frame_ready, 0, static_cast<uint32_t>(m_dot) };
+}
+
+void Ppu::load_state(const State& state)
+{
+    const auto& r = state.registers;
+    m_lcdc = r[0];
+    m_stat = r[1];
+    m_scy = r[2];
+    m_scx = r[3];
+    m_ly = r[4];
+    m_lyc = r[5];
+    m_dma = r[6];
+    m_bgp = r[7];
+    m_obp0 = r[8];
+    m_obp1 = r[9];
+    m_wy = r[10];
+    m_wx = r[11];
+    m_mode = state.mode;
+    m_window_line = state.window_line;
+    m_frame_ready = state.frame_ready;
+    m_dot = state.dot;
+}
+
+void Ppu::write(MemoryMap& bus, const uint16_t location, const uint8_t val)
+{
+    switch (location)
+    {
+    case LCDC:
+    {
+        const bool was_on = lcd_on();
+        m_lcdc = val;
+        if (was_on && !lcd_on())
+        {
+            m_dot = 0;
+            m_window_line = 0;
+            set_ly(bus, 0);
+            set_mode(bus, Mode::HBlank);
+        }
+        else if (!was_on && lcd_on())
+        {
+            m_dot = 0;
+            set_ly(bus, 0);
+            set_mode(bus, Mode::OamScan);
+        }
+        break;
+    }
+    case STAT:
+        m_stat = static_cast<uint8_t>((m_stat & 0x07) | (val & 0x78));
+        break;
+    case SCY:
+        m_scy = val;
+        break;
+    case SCX:
+        m_scx = val;
+        break;
+    case LYC:
+        m_lyc = val;
+        set_ly(bus, m_ly);
+        break;
+    case DMA:
+    {
+        // the transfer is done at once, the CPU isn't locked out of the bus
+        m_dma = val;
+        const uint16_t source = static_cast<uint16_t>(std::min<uint8_t>(val, 0xDF) << 8);
+        for (uint16_t i = 0; i < OAM_ENTRIES * 4; ++i)
+            bus.poke(static_cast<uint16_t>(OAM_ADDR + i), bus.peek(static_cast<uint16_t>(source + i)));
+        break;
+    }
+    case BGP:
+        m_bgp = val;
+        break;
+    case OBP0:
+        m_obp0 = val;
+        break;
+    case OBP1:
+        m_obp1 = val;
+        break;
+    case WY:
+        m_wy = val;
+        break;
+    case WX:
+        m_wx = val;
+        break;
+    }
+}
+
+void Ppu::set_mode(MemoryMap& bus, const Mode mode)
+{
+    m_mode = mode;
+    m_stat = static_cast<uint8_t>((m_stat & ~0x03) | static_cast<uint8_t>(mode));
+
+    const bool stat_irq =
+        (mode == Mode::HBlank && (m_stat & 0x08)) ||
+        (mode == Mode::VBlank && (m_stat & 0x10)) ||
+        (mode == Mode::OamScan && (m_stat & 0x20));
+    if (stat_irq && lcd_on())
+        bus.request_interrupt(Interrupt::Stat);
+}
+
+void Ppu::set_ly(MemoryMap& bus, const uint8_t ly)
+{
+    m_ly = ly;
+    if (m_ly == m_lyc)
+    {
+        m_stat |= 0x04;
+        if ((m_stat & 0x40) && lcd_on())
+            bus.request_interrupt(Interrupt::Stat);
+    }
+    else
+    {
+        m_stat &= ~0x04;
+    }
+}
+
+void Ppu::draw_line(const MemoryMap& bus)
+{
+    const uint8_t* mem = bus.data();
+    uint8_t* out = m_framebuffer.data() + static_cast<size_t>(m_ly) * width;
+
+    // background colour indices, sprites behind the background need them
+    std::array<uint8_t, width> bg_colour{};
+
+    const auto tile_addr = [this](const uint8_t tile) -> uint16_t
+    {
+        if (m_lcdc & 0x10)
+            return static_cast<uint16_t>(0x8000 + tile * 16);
+        return static_cast<uint16_t>(0x9000 + static_cast<int8_t>(tile) * 16);
+    };
+
+    if (m_lcdc & 0x01)
+    {
+        const uint16_t map = (m_lcdc & 0x08) ? 0x9C00 : 0x9800;
+        const size_t y = (m_scy + m_ly) & 0xFF;
+        for (size_t x = 0; x < width; ++x)
+        {
+            const size_t px = (x + m_scx) & 0xFF;
+            const uint8_t tile = mem[map + (y / 8) * 32 + px / 8];
+            bg_colour[x] = tile_pixel(mem, tile_addr(tile), y % 8, px % 8);
+        }
+
+        const int window_x = static_cast<int>(m_wx) - 7;
+        if ((m_lcdc & 0x20) && m_wy <= m_ly && window_x < static_cast<int>(width))
+        {
+            const uint16_t window_map = (m_lcdc & 0x40) ? 0x9C00 : 0x9800;
+            const size_t wy = m_window_line;
+            for (size_t x = std::max(0, window_x); x < width; ++x)
+            {
+                const size_t wx = x - window_x;
+                const uint8_t tile = mem[window_map + (wy / 8) * 32 + wx / 8];
+                bg_colour[x] = tile_pixel(mem, tile_addr(tile), wy % 8, wx % 8);
+            }
+            ++m_window_line;
+        }
+    }
+
+    for (size_t x = 0; x < width; ++x)
+        out[x] = shade(m_bgp, bg_colour[x]);
+
+    if (!(m_lcdc & 0x02))
+        return;
+
+    // the first ten sprites on the line in OAM order, drawn so that the
+    // lowest X, then the lowest OAM index, ends up on top
+    const size_t sprite_height = (m_lcdc & 0x04) ? 16 : 8;
+    std::array<size_t, SPRITES_PER_LINE> sprites{};
+    size_t count = 0;
+    for (size_t i = 0; i < OAM_ENTRIES && count < SPRITES_PER_LINE; ++i)
+    {
+        const int top = static_cast<int>(mem[OAM_ADDR + i * 4]) - 16;
+        if (m_ly >= top && m_ly < top + static_cast<int>(sprite_height))
+            sprites[count++] = i;
+    }
+
+    std::stable_sort(sprites.begin(), sprites.begin() + count, [mem](const size_t a, const size_t b)
+    {
+        return mem[OAM_ADDR + a * 4 + 1] < mem[OAM_ADDR + b * 4 + 1];
+    });
+
+    for (size_t n = count; n-- > 0;)
+    {
+        const uint8_t* sprite = mem + OAM_ADDR + sprites[n] * 4;
+        const int left = static_cast<int>(sprite[1]) - 8;
+        const uint8_t attr = sprite[3];
+
+        size_t row = m_ly - (static_cast<int>(sprite[0]) - 16);
+        if (attr & 0x40)
+            row = sprite_height - 1 - row;
+
+        uint8_t tile = sprite[2];
+        if (sprite_height == 16)
+            tile &= 0xFE;
+
+        const uint8_t palette = (attr & 0x10) ? m_obp1 : m_obp0;
+        for (size_t col = 0; col < 8; ++col)
+        {
+            const int x = left + static_cast<int>(col);
+            if (x < 0 || x >= static_cast<int>(width))
+                continue;
+
+            const uint8_t colour = tile_pixel(mem, static_cast<uint16_t>(0x8000 + tile * 16), row, (attr & 0x20) ? 7 - col : col);
+            if (colour == 0 || ((attr & 0x80) && bg_colour[x] != 0))
+                continue;
+
+            out[x] = shade(palette, colour);
+        }
+    }
+}
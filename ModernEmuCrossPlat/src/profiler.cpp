@@ -0,0 +1,334 @@
+#include "pch.h"
+
+#include "profiler.h"
+
+#include <cctype>
+
+namespace
+{
+    // past this the stack is assumed to have been thrown away without returns
+    constexpr size_t max_depth = 1024;
+
+    bool parse_hex(const std::string& text, uint32_t& value)
+    {
+        if (text.empty() || text.size() > 8)
+            return false;
+        value = 0;
+        for (const char c : text)
+        {
+            if (!std::isxdigit(static_cast<unsigned char>(c)))
+                return false;
+            value = (value << 4) | static_cast<uint32_t>(std::isdigit(static_cast<unsigned char>(c)) ? c - '0' : (std::tolower(c) - 'a' + 10));
+        }
+        return true;
+    }
+
+    const std::string format_addr(const GuestAddr& location)
+    {
+        std::stringstream str_stream;
+        str_stream << std::hex << std::setfill('0') << std::setw(2) << location.bank << ":" << std::setw(4) << location.addr;
+        return str_stream.str();
+    }
+
+    // CALL, CALL cc and RST, with their lengths
+    const size_t call_length(const uint8_t op)
+    {
+        if (op == 0xCD || ((op & 0xE7) == 0xC4))
+            return 3;
+        if ((op & 0xC7) == 0xC7)
+            return 1;
+        return 0;
+    }
+
+    // RET, RETI and RET cc
+    const bool is_return(const uint8_t op)
+    {
+        return op == 0xC9 || op == 0xD9 || ((op & 0xE7) == 0xC0);
+    }
+
+    const char* interrupt_name(const uint16_t vector)
+    {
+        switch (vector)
+        {
+        case 0x40: return "[vblank]";
+        case 0x48: return "[stat]";
+        case 0x50: return "[timer]";
+        case 0x58: return "[serial]";
+        case 0x60: return "[joypad]";
+        default: return nullptr;
+        }
+    }
+
+    const double percent(const uint64_t part, const uint64_t total)
+    {
+        return total ? 100.0 * static_cast<double>(part) / static_cast<double>(total) : 0.0;
+    }
+}
+
+bool SymbolTable::load(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+    load(in);
+    return true;
+}
+
+void SymbolTable::load(std::istream& in)
+{
+    std::string line;
+    while (std::getline(in, line))
+    {
+        const auto comment = line.find(';');
+        if (comment != std::string::npos)
+            line.resize(comment);
+
+        std::stringstream str_stream(line);
+        std::string location;
+        std::string name;
+        if (!(str_stream >> location >> name))
+            continue;
+
+        const auto colon = location.find(':');
+        uint32_t bank = 0;
+        uint32_t addr = 0;
+        if (colon == std::string::npos || !parse_hex(location.substr(0, colon), bank) || !parse_hex(location.substr(colon + 1), addr))
+            continue;
+        if (bank > 0xFFFF || addr > 0xFFFF)
+            continue;
+
+        add(GuestAddr{ static_cast<uint16_t>(bank), static_cast<uint16_t>(addr) }, name);
+    }
+}
+
+void SymbolTable::add(const GuestAddr& location, const std::string& name)
+{
+    m_symbols.emplace(location.key(), name);
+}
+
+const std::string* SymbolTable::exact(const GuestAddr& location) const
+{
+    const auto found = m_symbols.find(location.key());
+    return found != m_symbols.end() ? &found->second : nullptr;
+}
+
+const std::string SymbolTable::name_for(const GuestAddr& location) const
+{
+    if (const auto name = exact(location))
+        return *name;
+
+    auto found = m_symbols.upper_bound(location.key());
+    if (found != m_symbols.begin())
+    {
+        --found;
+        if ((found->first >> 16) == location.bank)
+        {
+            std::stringstream str_stream;
+            str_stream << found->second << "+$" << std::hex << (location.key() - found->first);
+            return str_stream.str();
+        }
+    }
+
+    return format_addr(location);
+}
+
+Profiler::Profiler(const size_t sample_interval)
+    : m_sample_interval(std::max<size_t>(sample_interval, 1))
+{
+    reset();
+}
+
+void Profiler::reset()
+{
+    m_next_sample = m_sample_interval;
+    m_cycles = 0;
+
+    m_functions.assign(1, FunctionStats{ "[root]" });
+    m_function_ids.clear();
+    m_active.assign(1, 1);
+
+    m_nodes.assign(1, Node{ 0, 0, 0, {} });
+    m_stack.clear();
+    m_node = 0;
+
+    m_samples.clear();
+}
+
+void Profiler::record(const GuestAddr& location, const uint8_t op, const uint16_t sp,
+    const GuestAddr& target, const uint16_t new_sp, const uint16_t pushed, const size_t cycles)
+{
+    // the instruction belongs to whoever was running it, so a CALL is the
+    // caller's and a RET the callee's
+    m_cycles += cycles;
+    m_nodes[m_node].self += cycles;
+    m_functions[m_nodes[m_node].function].exclusive += cycles;
+
+    while (m_cycles >= m_next_sample)
+    {
+        ++m_samples[location.key()];
+        m_next_sample += m_sample_interval;
+    }
+
+    if (new_sp == static_cast<uint16_t>(sp - 2))
+    {
+        // interrupt dispatch pushes the PC of the instruction it preempted,
+        // CALL and RST push the one after themselves
+        const char* irq = interrupt_name(target.addr);
+        if (irq && pushed == location.addr)
+            enter(function_for(target, irq), sp);
+        else if (const size_t length = call_length(op); length != 0 && pushed == static_cast<uint16_t>(location.addr + length))
+            enter(function_for(target, nullptr), sp);
+    }
+    else if (new_sp == static_cast<uint16_t>(sp + 2) && is_return(op))
+    {
+        leave(new_sp);
+    }
+}
+
+const uint32_t Profiler::function_for(const GuestAddr& entry, const char* fallback)
+{
+    const auto found = m_function_ids.find(entry.key());
+    if (found != m_function_ids.end())
+        return found->second;
+
+    std::string name;
+    if (const auto symbol = m_symbols.exact(entry))
+        name = *symbol;
+    else if (fallback)
+        name = fallback;
+    else
+        name = m_symbols.name_for(entry);
+
+    const auto id = static_cast<uint32_t>(m_functions.size());
+    m_functions.push_back(FunctionStats{ name });
+    m_active.push_back(0);
+    m_function_ids.emplace(entry.key(), id);
+    return id;
+}
+
+void Profiler::enter(const uint32_t function, const uint16_t return_sp)
+{
+    if (m_stack.size() >= max_depth)
+        return;
+
+    uint32_t node;
+    const auto found = m_nodes[m_node].children.find(function);
+    if (found != m_nodes[m_node].children.end())
+    {
+        node = found->second;
+    }
+    else
+    {
+        node = static_cast<uint32_t>(m_nodes.size());
+        m_nodes.push_back(Node{ function, m_node, 0, {} });
+        m_nodes[m_node].children.emplace(function, node);
+    }
+
+    m_stack.push_back(Frame{ function, node, m_cycles, return_sp });
+    ++m_functions[function].calls;
+    ++m_active[function];
+    m_node = node;
+}
+
+void Profiler::leave(const uint16_t sp)
+{
+    // pops everything the RET returned past, so frames left behind by code
+    // that unwinds the stack itself go too
+    while (!m_stack.empty() && m_stack.back().return_sp <= sp)
+    {
+        const Frame frame = m_stack.back();
+        m_stack.pop_back();
+
+        // only the outermost call of a recursive function counts
+        if (--m_active[frame.function] == 0)
+            m_functions[frame.function].inclusive += m_cycles - frame.entry;
+    }
+    m_node = m_stack.empty() ? 0 : m_stack.back().node;
+}
+
+const std::vector<Profiler::FunctionStats> Profiler::functions() const
+{
+    auto functions = m_functions;
+    functions[0].inclusive = m_cycles;
+
+    std::vector<bool> open(functions.size(), false);
+    for (const auto& frame : m_stack)
+    {
+        if (open[frame.function])
+            continue;
+        open[frame.function] = true;
+        functions[frame.function].inclusive += m_cycles - frame.entry;
+    }
+
+    std::stable_sort(functions.begin(), functions.end(), [](const FunctionStats& a, const FunctionStats& b)
+    {
+        return a.exclusive > b.exclusive;
+    });
+    return functions;
+}
+
+const std::vector<std::pair<GuestAddr, uint64_t>> Profiler::samples() const
+{
+    std::vector<std::pair<GuestAddr, uint64_t>> samples;
+    for (const auto& [key, count] : m_samples)
+        samples.emplace_back(GuestAddr{ static_cast<uint16_t>(key >> 16), static_cast<uint16_t>(key & 0xFFFF) }, count);
+
+    std::stable_sort(samples.begin(), samples.end(), [](const auto& a, const auto& b)
+    {
+        return a.second > b.second;
+    });
+    return samples;
+}
+
+void Profiler::write_folded(std::ostream& out) const
+{
+    std::vector<const std::string*> path;
+    for (size_t idx = 0; idx < m_nodes.size(); ++idx)
+    {
+        if (m_nodes[idx].self == 0)
+            continue;
+
+        path.clear();
+        for (size_t node = idx; node != 0; node = m_nodes[node].parent)
+            path.push_back(&m_functions[m_nodes[node].function].name);
+        path.push_back(&m_functions[0].name);
+
+        for (auto name = path.rbegin(); name != path.rend(); ++name)
+            out << (name == path.rbegin() ? "" : ";") << **name;
+        out << " " << m_nodes[idx].self << "\n";
+    }
+}
+
+const std::string Profiler::report(const size_t top) const
+{
+    const auto functions = this->functions();
+    const auto samples = this->samples();
+    const uint64_t sample_count = std::accumulate(samples.begin(), samples.end(), uint64_t(0),
+        [](const uint64_t total, const auto& sample) { return total + sample.second; });
+
+    std::stringstream out;
+    out << std::fixed << std::setprecision(1);
+    out << "cycles " << m_cycles << ", " << sample_count << " samples every " << m_sample_interval << " cycles\n";
+
+    out << "\nfunction                          calls       exclusive    %excl       inclusive    %incl\n";
+    for (size_t idx = 0; idx < functions.size() && (top == 0 || idx < top); ++idx)
+    {
+        const auto& function = functions[idx];
+        if (function.exclusive == 0 && function.inclusive == 0)
+            break;
+        out << std::left << std::setw(30) << function.name << std::right
+            << std::setw(9) << function.calls
+            << std::setw(16) << function.exclusive << std::setw(9) << percent(function.exclusive, m_cycles)
+            << std::setw(16) << function.inclusive << std::setw(9) << percent(function.inclusive, m_cycles) << "\n";
+    }
+
+    out << "\nlocation  symbol                          samples        %\n";
+    for (size_t idx = 0; idx < samples.size() && (top == 0 || idx < top); ++idx)
+    {
+        const auto& [location, count] = samples[idx];
+        out << std::left << std::setw(10) << format_addr(location) << std::setw(30) << m_symbols.name_for(location) << std::right
+            << std::setw(9) << count << std::setw(9) << percent(count, sample_count) << "\n";
+    }
+
+    return out.str();
+}
@@ -2,9 +2,83 @@
 
 #include "ram.h"
 
+#include <cstring>
+
 MemoryMap::MemoryMap():
-    m_memory{0}
+    m_memory{0},
+    m_pages{},
+    m_read_handlers{},
+    m_write_handlers{},
+    m_dirty{},
+    m_unhashed{}
+{
+    for (size_t page = 0; page < page_count; ++page)
+        m_pages[page] = m_memory.data() + page * page_size;
+}
+
+MemoryMap::MemoryMap(const MemoryMap& other):
+    m_pages(other.m_pages),
+    m_read_handlers(other.m_read_handlers),
+    m_write_handlers(other.m_write_handlers),
+    m_dirty(other.m_dirty),
+    m_unhashed(other.m_unhashed)
+{
+    std::memcpy(m_memory.data() + 0x8000, other.m_memory.data() + 0x8000, 0x8000);
+    for (size_t page = 0; page < page_count; ++page)
+    {
+        uint8_t* own = m_memory.data() + page * page_size;
+        if (page < 0x80 && other.m_pages[page] != other.m_memory.data() + page * page_size)
+            continue;
+        // only before a cartridge maps its ROM is any of it in memory
+        if (page < 0x80)
+            std::memcpy(own, other.m_pages[page], page_size);
+        m_pages[page] = own;
+    }
+}
+
+void MemoryMap::mark_dirty(const uint16_t first, const uint16_t last)
+{
+    for (size_t page = first >> 8; page <= static_cast<size_t>(last >> 8); ++page)
+    {
+        m_dirty[page >> 6] |= uint64_t(1) << (page & 63);
+        m_unhashed[page >> 6] |= uint64_t(1) << (page & 63);
+    }
+}
+
+void MemoryMap::map_read(const uint16_t first, const uint16_t last, BusHandler* handler)
 {
+    for (size_t page = first >> 8; page <= static_cast<size_t>(last >> 8); ++page)
+        m_read_handlers[page] = handler;
 }
 
+void MemoryMap::map_write(const uint16_t first, const uint16_t last, BusHandler* handler)
+{
+    for (size_t page = first >> 8; page <= static_cast<size_t>(last >> 8); ++page)
+        m_write_handlers[page] = handler;
+}
+
+void MemoryMap::map_rom(const uint16_t first, const uint8_t* rom, const size_t size)
+{
+    for (size_t i = 0; i < size / page_size; ++i)
+        m_pages[(first >> 8) + i] = rom + i * page_size;
+}
 
+const bool MemoryMap::plain_read(const uint16_t first, const uint16_t last) const
+{
+    for (size_t page = first >> 8; page <= static_cast<size_t>(last >> 8); ++page)
+    {
+        if (m_read_handlers[page])
+            return false;
+    }
+    return true;
+}
+
+const bool MemoryMap::plain_write(const uint16_t first, const uint16_t last) const
+{
+    for (size_t page = first >> 8; page <= static_cast<size_t>(last >> 8); ++page)
+    {
+        if (m_write_handlers[page])
+            return false;
+    }
+    return true;
+}
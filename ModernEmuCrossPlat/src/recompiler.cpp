@@ -0,0 +1,246 @@
+#include "pch.h"
+
+#include "recompiler.h"
+
+#include "aot.h"
+#include "cartridge.h"
+
+namespace
+{
+    // where the interrupt vectors send the CPU, plus the entry point
+    constexpr std::array<uint16_t, 6> entry_points = { Cartridge::entry_addr, 0x40, 0x48, 0x50, 0x58, 0x60 };
+
+    inline const std::string hex(const size_t val, const int width)
+    {
+        std::stringstream str;
+        str << std::uppercase << std::hex << std::setfill('0') << std::setw(width) << val;
+        return str.str();
+    }
+
+    inline const std::string block_name(const Recompiler::Block& block)
+    {
+        return "block_" + hex(block.bank, 2) + "_" + hex(block.addr, 4);
+    }
+}
+
+Recompiler::Recompiler(std::vector<uint8_t> rom)
+    : m_rom(std::move(rom))
+    , m_bus(make_shared<MemoryMap>())
+    , m_cpu(m_bus)
+    , m_mapped_bank(0)
+    , m_unresolved(0)
+    , m_with_text(true)
+{
+    for (size_t addr = 0; addr < Cartridge::rom_bank_size && addr < m_rom.size(); ++addr)
+        m_bus->poke(static_cast<uint16_t>(addr), m_rom[addr]);
+    map_bank(1);
+}
+
+void Recompiler::analyze(const bool with_text)
+{
+    m_with_text = with_text;
+    for (const uint16_t addr : entry_points)
+        m_queue.push_back(addr);
+
+    while (!m_queue.empty())
+    {
+        const uint32_t key = m_queue.back();
+        m_queue.pop_back();
+        if (m_blocks.count(key) != 0)
+            continue;
+
+        // empty ones stay too, so they're only looked at once
+        m_blocks.emplace(key, decode_block(static_cast<uint16_t>(key >> 16), static_cast<uint16_t>(key & 0xFFFF)));
+    }
+}
+
+void Recompiler::map_bank(const uint16_t bank)
+{
+    if (bank == m_mapped_bank)
+        return;
+    m_mapped_bank = bank;
+    const size_t base = bank * Cartridge::rom_bank_size;
+    for (size_t addr = 0; addr < Cartridge::rom_bank_size; ++addr)
+        m_bus->poke(static_cast<uint16_t>(0x4000 + addr), base + addr < m_rom.size() ? m_rom[base + addr] : 0xFF);
+}
+
+void Recompiler::follow(const uint16_t from_bank, const size_t switched, const uint16_t target)
+{
+    const size_t banks = std::max<size_t>(m_rom.size() / Cartridge::rom_bank_size, 2);
+    size_t bank;
+    if (target >= 0x8000)
+        bank = banks;
+    else if (target < 0x4000)
+        bank = 0;
+    else if (switched != 0)
+        bank = switched;
+    else if (from_bank != 0)
+        bank = from_bank;
+    else
+        bank = (banks == 2) ? 1 : banks;
+
+    if (bank >= banks)
+    {
+        ++m_unresolved;
+        return;
+    }
+    m_queue.push_back((static_cast<uint32_t>(bank) << 16) | target);
+}
+
+const bool Recompiler::may_switch_bank(const DecodedOpcode& decoded, const uint16_t imm16)
+{
+    const uint8_t b = decoded.op;
+    if (decoded.prefixed)
+        return (b & 7) == 6 && (b >> 6) != 1;
+    if ((b & 0xCF) == 0x02 || (b >= 0x70 && b <= 0x77 && b != 0x76) || b == 0x34 || b == 0x35 || b == 0x36)
+        return true;
+    if (b == 0xEA || b == 0x08)
+        return imm16 < 0x8000;
+    return false;
+}
+
+const std::string Recompiler::describe(const DecodedOpcode& decoded)
+{
+    std::string text = decoded.name;
+    const auto first = operand_to_string(decoded.operandOne);
+    const auto second = operand_to_string(decoded.operandTwo);
+    if (!first.empty())
+        text += " " + first;
+    if (!second.empty())
+        text += ", " + second;
+    return text;
+}
+
+const Recompiler::Block Recompiler::decode_block(const uint16_t bank, const uint16_t addr)
+{
+    if (addr >= 0x4000)
+        map_bank(bank);
+
+    const Block block = decode(m_cpu, *m_bus, bank, addr, m_with_text);
+    if (block.code.empty())
+        return block;
+
+    const auto peek = [this](const size_t pc)
+    {
+        return m_bus->peek(static_cast<uint16_t>(pc));
+    };
+    const auto imm16 = [&peek](const uint16_t pc)
+    {
+        return static_cast<uint16_t>(peek(pc + 1) | (peek(pc + 2) << 8));
+    };
+
+    // the bank the block last wrote to the MBC with ld a, n / ld [a16], a
+    int known_a = -1;
+    size_t switched = 0;
+    for (const auto& instruction : block.code)
+    {
+        const uint8_t b = instruction.op;
+        if (b == 0xEA && known_a >= 0 && imm16(instruction.addr) >= 0x2000 && imm16(instruction.addr) < 0x4000)
+            switched = (known_a & 0x1F) == 0 ? 1 : (known_a & 0x1F);
+        known_a = (b == 0x3E) ? peek(instruction.addr + 1) : (b == 0xEA || b == 0xE0 || b == 0x00) ? known_a : -1;
+    }
+
+    const auto& end = block.code.back();
+    const uint16_t pc = end.addr;
+    const uint8_t b = end.op;
+    const auto next = static_cast<uint16_t>(pc + end.length);
+
+    // JP, JP cc
+    if (b == 0xC3 || (b & 0xE7) == 0xC2)
+    {
+        follow(bank, switched, imm16(pc));
+        if (b != 0xC3)
+            follow(bank, switched, next);
+    }
+    // JR, JR cc
+    else if (b == 0x18 || (b & 0xE7) == 0x20)
+    {
+        follow(bank, switched, static_cast<uint16_t>(next + static_cast<int8_t>(peek(pc + 1))));
+        if (b != 0x18)
+            follow(bank, switched, next);
+    }
+    // CALL, CALL cc and RST come back after themselves
+    else if (b == 0xCD || (b & 0xE7) == 0xC4 || (b & 0xC7) == 0xC7)
+    {
+        follow(bank, switched, (b & 0xC7) == 0xC7 ? static_cast<uint16_t>(b & 0x38) : imm16(pc));
+        follow(bank, switched, next);
+    }
+    // JP HL
+    else if (b == 0xE9)
+    {
+        ++m_unresolved;
+    }
+    // RET, RETI go back wherever they go, everything else carries on,
+    // unless it stopped short of an illegal opcode which hangs the CPU
+    else if (b != 0xC9 && b != 0xD9 && next < 0x8000 && m_cpu.decode_op(next, peek(next)).group != OpcodeGroup::UNKNOWN)
+    {
+        follow(bank, switched, next);
+    }
+    return block;
+}
+
+void Recompiler::emit(std::ostream& out, const std::string& name) const
+{
+    size_t count = 0;
+    for (const auto& [key, block] : m_blocks)
+        count += block.code.empty() ? 0 : 1;
+
+    const std::string hash = "0x" + hex(rom_hash(m_rom), 16) + "ull";
+    out << "// Generated by gbrecomp, don't edit. " << count << " blocks from the ROM\n"
+        << "// with hash " << hash << ", " << m_unresolved << " jumps left to the interpreter.\n\n"
+        << "#include \"pch.h\"\n\n"
+        << "#include \"aot.h\"\n"
+        << "#include \"cpu_exec.h\"\n"
+        << "#include \"gameboy.h\"\n\n"
+        << "namespace\n{\n";
+
+    for (const auto& [key, block] : m_blocks)
+    {
+        if (block.code.empty())
+            continue;
+
+        out << "    template<class Machine>\n"
+            << "    size_t " << block_name(block) << "(Machine& gb)\n"
+            << "    {\n"
+            << "        auto& cpu = gb.cpu();\n"
+            << "        size_t cycles = 0;\n";
+        for (const auto& instruction : block.code)
+        {
+            const std::string step = std::string(instruction.may_switch_bank ? "gb.compiled_store" : "gb.compiled_step")
+                + "(cycles, cpu.template run_op<0x" + hex(instruction.op, 2) + ">())";
+            out << "        // " << hex(instruction.addr, 4) << " " << instruction.text << "\n";
+            if (&instruction == &block.code.back())
+                out << "        " << step << ";\n";
+            else
+                out << "        if (" << step << ")\n            return cycles;\n";
+        }
+        out << "        return cycles;\n"
+            << "    }\n\n";
+    }
+
+    if (count != 0)
+    {
+        out << "    template<class Machine>\n"
+            << "    const AotBlock<Machine> blocks[] = {\n";
+        for (const auto& [key, block] : m_blocks)
+        {
+            if (block.code.empty())
+                continue;
+            out << "        { 0x" << hex(block.bank, 4) << ", 0x" << hex(block.addr, 4) << ", 0x" << hex(block.last, 4)
+                << ", &" << block_name(block) << "<Machine> },\n";
+        }
+        out << "    };\n";
+    }
+    out << "}\n\n";
+
+    out << "template<class Machine>\n"
+        << "const AotProgram<Machine> " << name << "()\n"
+        << "{\n";
+    if (count != 0)
+        out << "    return { " << hash << ", blocks<Machine>, std::size(blocks<Machine>) };\n";
+    else
+        out << "    return { " << hash << ", nullptr, 0 };\n";
+    out << "}\n\n"
+        << "template const AotProgram<GameBoy> " << name << "<GameBoy>();\n"
+        << "template const AotProgram<InstrumentedGameBoy> " << name << "<InstrumentedGameBoy>();\n";
+}
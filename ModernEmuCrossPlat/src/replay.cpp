@@ -0,0 +1,309 @@
+#include "pch.h"
+
+#include "replay.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "rewind.h"
+
+namespace
+{
+    // the most a save state could be, with 16 banks of cartridge RAM, so a
+    // bad size can't ask for more
+    constexpr uint64_t max_state_size = 1 << 20;
+
+    // written as they are, so no padding to leave uninitialized
+    static_assert(sizeof(InputLog::Checkpoint) == 32);
+
+    void put_count(std::string& out, uint64_t count)
+    {
+        while (count >= 0x80)
+        {
+            out.push_back(static_cast<char>(count | 0x80));
+            count >>= 7;
+        }
+        out.push_back(static_cast<char>(count));
+    }
+
+    const bool get_count(std::istream& in, uint64_t& count)
+    {
+        count = 0;
+        for (size_t shift = 0; shift < 64; shift += 7)
+        {
+            const int b = in.get();
+            if (b == std::char_traits<char>::eof())
+                return false;
+            count |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if ((b & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+}
+
+InputLog::InputLog(const size_t keyframe_interval)
+    : m_keyframe_interval(std::max<size_t>(1, keyframe_interval))
+    , m_rom_hash(0)
+    , m_events()
+    , m_keyframes()
+    , m_end{ 0, 0, 0, 0 }
+    , m_state()
+{
+}
+
+const size_t InputLog::keyframe_before(const uint64_t frame) const
+{
+    const auto after = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), frame,
+        [](const uint64_t value, const Keyframe& keyframe) { return value < keyframe.at.frame; });
+    return (after == m_keyframes.begin()) ? 0 : static_cast<size_t>(after - m_keyframes.begin() - 1);
+}
+
+void InputLog::add_event(const uint64_t cycle, const uint8_t buttons)
+{
+    // only the last change made at a cycle counts
+    if (!m_events.empty() && m_events.back().cycle == cycle)
+        m_events.back().buttons = buttons;
+    else
+        m_events.push_back(Event{ cycle, buttons });
+}
+
+void InputLog::keep_keyframe(const Checkpoint& at)
+{
+    std::vector<uint8_t> encoded(Rewind::max_encoded(m_state.size()));
+    encoded.resize(Rewind::encode(m_state.data(), nullptr, m_state.size(), encoded.data()));
+    m_keyframes.push_back(Keyframe{ at, m_state.size(), std::move(encoded) });
+}
+
+const bool InputLog::decode(const size_t keyframe, std::vector<uint8_t>& out) const
+{
+    if (keyframe >= m_keyframes.size())
+        return false;
+    const auto& found = m_keyframes[keyframe];
+    out.assign(found.state_size, 0);
+    return Rewind::apply(found.state.data(), found.state.size(), out.data(), out.size());
+}
+
+bool InputLog::write(std::ostream& out) const
+{
+    static_assert(sizeof(FileHeader) == 72 && sizeof(FileKeyframe) == 48);
+
+    std::string events;
+    uint64_t last = 0;
+    for (const auto& event : m_events)
+    {
+        put_count(events, event.cycle - last);
+        events.push_back(static_cast<char>(event.buttons));
+        last = event.cycle;
+    }
+
+    const FileHeader header{ file_magic, format_version, static_cast<uint32_t>(m_keyframe_interval), m_rom_hash, m_end,
+        m_events.size(), m_keyframes.size() };
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(events.data(), static_cast<std::streamsize>(events.size()));
+    for (const auto& keyframe : m_keyframes)
+    {
+        const FileKeyframe file_keyframe{ keyframe.at, keyframe.state_size, keyframe.state.size() };
+        out.write(reinterpret_cast<const char*>(&file_keyframe), sizeof(file_keyframe));
+        out.write(reinterpret_cast<const char*>(keyframe.state.data()), static_cast<std::streamsize>(keyframe.state.size()));
+    }
+    return out.good();
+}
+
+bool InputLog::read(std::istream& in)
+{
+    FileHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != file_magic || header.version != format_version
+        || header.keyframe_count == 0)
+        return false;
+
+    // the events and keyframes as they come, so bad counts and sizes run
+    // out of file rather than asking for memory
+    std::vector<Event> events;
+    uint64_t cycle = 0;
+    for (uint64_t i = 0; i < header.event_count; ++i)
+    {
+        uint64_t delta;
+        if (!get_count(in, delta))
+            return false;
+        const int buttons = in.get();
+        if (buttons == std::char_traits<char>::eof())
+            return false;
+        cycle += delta;
+        events.push_back(Event{ cycle, static_cast<uint8_t>(buttons) });
+    }
+
+    std::vector<Keyframe> keyframes;
+    for (uint64_t i = 0; i < header.keyframe_count; ++i)
+    {
+        FileKeyframe file_keyframe;
+        if (!in.read(reinterpret_cast<char*>(&file_keyframe), sizeof(file_keyframe)) || file_keyframe.state_size > max_state_size
+            || file_keyframe.encoded_size > Rewind::max_encoded(file_keyframe.state_size))
+            return false;
+        Keyframe keyframe{ file_keyframe.at, file_keyframe.state_size, std::vector<uint8_t>(file_keyframe.encoded_size) };
+        if (!in.read(reinterpret_cast<char*>(keyframe.state.data()), static_cast<std::streamsize>(keyframe.state.size())))
+            return false;
+        keyframes.push_back(std::move(keyframe));
+    }
+
+    m_keyframe_interval = std::max<size_t>(1, header.keyframe_interval);
+    m_rom_hash = header.rom_hash;
+    m_end = header.end;
+    m_events = std::move(events);
+    m_keyframes = std::move(keyframes);
+    return true;
+}
+
+Recorder::Recorder(GameBoy& gb, InputLog& log)
+    : m_gb(gb)
+    , m_log(log)
+    , m_frame(0)
+{
+    m_log.add_keyframe(m_gb, 0);
+    m_log.set_end({ 0, m_gb.cycles(), 0, m_gb.state_hash() });
+}
+
+void Recorder::set_buttons(const uint8_t buttons)
+{
+    if (buttons == m_gb.joypad().buttons())
+        return;
+    m_log.add_event(m_gb.cycles(), buttons);
+    m_gb.set_buttons(buttons);
+}
+
+void Recorder::run_frame()
+{
+    m_gb.run_frame();
+    frame_done();
+}
+
+void Recorder::step()
+{
+    if (m_gb.run_frame_until(m_gb.cycles() + 1))
+        frame_done();
+}
+
+void Recorder::frame_done()
+{
+    ++m_frame;
+    if (m_frame % m_log.keyframe_interval() == 0)
+        m_log.add_keyframe(m_gb, m_frame);
+    m_log.set_end({ m_frame, m_gb.cycles(), m_log.events().size(), m_gb.state_hash() });
+}
+
+Replay::Replay(GameBoy& gb, const InputLog& log)
+    : m_gb(gb)
+    , m_log(log)
+    , m_frame(0)
+    , m_event(0)
+    , m_next_keyframe(0)
+    , m_ok(false)
+{
+    seek(0);
+}
+
+bool Replay::seek(const uint64_t frame)
+{
+    if (m_log.keyframes().empty() || frame > m_log.end().frame)
+        return false;
+
+    const size_t keyframe = m_log.keyframe_before(frame);
+    const auto& at = m_log.keyframes()[keyframe].at;
+    m_frame = at.frame;
+    m_event = static_cast<size_t>(at.events);
+    m_next_keyframe = keyframe + 1;
+    m_ok = m_log.load_keyframe(m_gb, keyframe) && check(at);
+    while (m_ok && m_frame < frame)
+        run_frame();
+    return m_ok;
+}
+
+bool Replay::run_frame()
+{
+    if (!m_ok || m_frame >= m_log.end().frame)
+        return false;
+
+    // to each change of the buttons in turn, then the end of the frame
+    const auto& events = m_log.events();
+    while (true)
+    {
+        for (; m_event < events.size() && events[m_event].cycle <= m_gb.cycles(); ++m_event)
+        {
+            if (events[m_event].cycle != m_gb.cycles())
+            {
+                m_ok = false;
+                return false;
+            }
+            m_gb.set_buttons(events[m_event].buttons);
+        }
+        const uint64_t stop_at = (m_event < events.size()) ? events[m_event].cycle : std::numeric_limits<uint64_t>::max();
+        if (m_gb.run_frame_until(stop_at))
+            break;
+    }
+
+    ++m_frame;
+    const auto& keyframes = m_log.keyframes();
+    if (m_next_keyframe < keyframes.size() && keyframes[m_next_keyframe].at.frame == m_frame)
+        m_ok = check(keyframes[m_next_keyframe++].at);
+    if (m_ok && m_frame == m_log.end().frame)
+        m_ok = check(m_log.end());
+    return m_ok;
+}
+
+bool Replay::run_to_end()
+{
+    while (run_frame())
+    {
+    }
+    return m_ok && m_frame == m_log.end().frame;
+}
+
+const bool Replay::check(const InputLog::Checkpoint& at)
+{
+    return m_gb.cycles() == at.cycle && m_event == at.events && m_gb.state_hash() == at.state_hash;
+}
+
+const Replay::Verification Replay::verify(const std::vector<uint8_t>& rom, const InputLog& log, const size_t threads)
+{
+    const auto& keyframes = log.keyframes();
+    if (keyframes.empty())
+        return Verification{ false, 0, 0 };
+
+    // a keyframe to the next each, the first one found different wins
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> checked(0);
+    std::mutex failed_lock;
+    uint64_t failed = std::numeric_limits<uint64_t>::max();
+    const auto work = [&]()
+    {
+        GameBoy gb(rom);
+        gb.set_render(false);
+        Replay replay(gb, log);
+        for (size_t i = next++; i < keyframes.size(); i = next++)
+        {
+            const uint64_t to = (i + 1 < keyframes.size()) ? keyframes[i + 1].at.frame : log.end().frame;
+            bool same = replay.seek(keyframes[i].at.frame);
+            while (same && replay.frame() < to)
+                same = replay.run_frame();
+            if (same)
+            {
+                ++checked;
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(failed_lock);
+            failed = std::min(failed, replay.frame());
+        }
+    };
+
+    const size_t workers = std::max<size_t>(1, std::min<size_t>(keyframes.size(), threads != 0 ? threads : std::thread::hardware_concurrency()));
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < workers; ++i)
+        pool.emplace_back(work);
+    work();
+    for (auto& thread : pool)
+        thread.join();
+
+    const bool ok = failed == std::numeric_limits<uint64_t>::max();
+    return Verification{ ok, ok ? log.end().frame : failed, checked.load() };
+}
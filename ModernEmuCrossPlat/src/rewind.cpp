@@ -0,0 +1,204 @@
+#include "pch.h"
+
+#include "rewind.h"
+
+#include <cstring>
+
+namespace
+{
+    inline const uint64_t word_at(const uint8_t* p)
+    {
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        return word;
+    }
+
+    inline uint8_t* put_count(uint8_t* out, size_t count)
+    {
+        while (count >= 0x80)
+        {
+            *out++ = static_cast<uint8_t>(count | 0x80);
+            count >>= 7;
+        }
+        *out++ = static_cast<uint8_t>(count);
+        return out;
+    }
+
+    inline const bool get_count(const uint8_t*& in, const uint8_t* end, size_t& count)
+    {
+        count = 0;
+        for (size_t shift = 0; in < end && shift < 64; shift += 7)
+        {
+            const uint8_t b = *in++;
+            count |= static_cast<size_t>(b & 0x7F) << shift;
+            if ((b & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+}
+
+Rewind::Rewind(const size_t budget, const size_t keyframe_interval)
+    : m_ring(budget)
+    , m_keyframe_interval(std::max<size_t>(1, keyframe_interval))
+    , m_entries()
+    , m_next_frame(0)
+    , m_newest()
+    , m_next()
+    , m_encoded()
+    , m_seek()
+{
+}
+
+const size_t Rewind::used() const
+{
+    size_t size = 0;
+    for (const auto& entry : m_entries)
+        size += entry.size;
+    return size;
+}
+
+const size_t Rewind::encode(const uint8_t* state, const uint8_t* base, const size_t size, uint8_t* out)
+{
+    const size_t words = size / 8;
+    const auto changed = [&](const size_t i)
+    {
+        return word_at(state + i * 8) != (base ? word_at(base + i * 8) : 0);
+    };
+
+    uint8_t* at = out;
+    for (size_t i = 0; i < words;)
+    {
+        const size_t same_from = i;
+        while (i < words && !changed(i))
+            ++i;
+        if (i == words)
+            break;
+        const size_t changed_from = i;
+        while (i < words && changed(i))
+            ++i;
+
+        at = put_count(at, changed_from - same_from);
+        at = put_count(at, i - changed_from);
+        for (size_t j = changed_from; j < i; ++j)
+        {
+            const uint64_t delta = word_at(state + j * 8) ^ (base ? word_at(base + j * 8) : 0);
+            std::memcpy(at, &delta, sizeof(delta));
+            at += sizeof(delta);
+        }
+    }
+    return static_cast<size_t>(at - out);
+}
+
+const bool Rewind::apply(const uint8_t* delta, const size_t delta_size, uint8_t* state, const size_t size)
+{
+    const uint8_t* in = delta;
+    const uint8_t* end = delta + delta_size;
+    const size_t words = size / 8;
+    size_t i = 0;
+    while (in < end)
+    {
+        size_t same;
+        size_t changed;
+        if (!get_count(in, end, same) || !get_count(in, end, changed) || same > words - i || changed > words - i - same
+            || changed > static_cast<size_t>(end - in) / 8)
+            return false;
+        i += same;
+        for (size_t j = 0; j < changed; ++j, ++i, in += 8)
+        {
+            const uint64_t word = word_at(state + i * 8) ^ word_at(in);
+            std::memcpy(state + i * 8, &word, sizeof(word));
+        }
+    }
+    return true;
+}
+
+bool Rewind::push_state()
+{
+    // a machine of another size starts over
+    if (m_next.size() != m_newest.size())
+        m_entries.clear();
+
+    size_t since_keyframe = 0;
+    for (auto it = m_entries.rbegin(); it != m_entries.rend() && !it->keyframe; ++it)
+        ++since_keyframe;
+    bool keyframe = m_entries.empty() || since_keyframe + 1 >= m_keyframe_interval;
+
+    m_encoded.resize(max_encoded(m_next.size()));
+    while (true)
+    {
+        const size_t size = encode(m_next.data(), keyframe ? nullptr : m_newest.data(), m_next.size(), m_encoded.data());
+        if (size > m_ring.size())
+            return false;
+
+        // after the newest, or from the start if it doesn't fit before the
+        // end, pushing out the oldest frames in the way
+        size_t offset = m_entries.empty() ? 0 : m_entries.back().offset + m_entries.back().size;
+        if (offset + size > m_ring.size())
+        {
+            while (!m_entries.empty() && m_entries.front().offset >= offset)
+                m_entries.pop_front();
+            offset = 0;
+        }
+        while (!m_entries.empty() && m_entries.front().offset >= offset && m_entries.front().offset < offset + size)
+            m_entries.pop_front();
+        // and the frames which needed a keyframe that's gone
+        while (!m_entries.empty() && !m_entries.front().keyframe)
+            m_entries.pop_front();
+
+        // with nothing left to be a delta of, it's a keyframe after all
+        if (m_entries.empty() && !keyframe)
+        {
+            keyframe = true;
+            continue;
+        }
+
+        std::memcpy(m_ring.data() + offset, m_encoded.data(), size);
+        m_entries.push_back({ m_next_frame++, offset, size, keyframe });
+        m_newest.swap(m_next);
+        return true;
+    }
+}
+
+bool Rewind::decode(const uint64_t frame, std::vector<uint8_t>& out) const
+{
+    if (m_entries.empty() || frame < oldest() || frame > newest())
+        return false;
+    const size_t target = static_cast<size_t>(frame - oldest());
+
+    size_t key = target;
+    while (!m_entries[key].keyframe)
+        --key;
+
+    // back from the newest undoing deltas, unless a keyframe is in the way
+    // or it's further
+    size_t newer_key = m_entries.size() - 1;
+    while (newer_key > target && !m_entries[newer_key].keyframe)
+        --newer_key;
+    if (newer_key == target && m_entries.size() - 1 - target < target - key + 1)
+    {
+        out = m_newest;
+        for (size_t i = m_entries.size() - 1; i > target; --i)
+        {
+            if (!apply(m_ring.data() + m_entries[i].offset, m_entries[i].size, out.data(), out.size()))
+                return false;
+        }
+        return true;
+    }
+
+    out.assign(m_newest.size(), 0);
+    for (size_t i = key; i <= target; ++i)
+    {
+        if (!apply(m_ring.data() + m_entries[i].offset, m_entries[i].size, out.data(), out.size()))
+            return false;
+    }
+    return true;
+}
+
+void Rewind::truncate(const uint64_t frame)
+{
+    while (!m_entries.empty() && m_entries.back().frame > frame)
+        m_entries.pop_back();
+    m_next_frame = frame + 1;
+    m_newest.swap(m_seek);
+}
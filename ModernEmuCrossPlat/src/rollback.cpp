@@ -0,0 +1,153 @@
+#include "pch.h"
+
+#include "rollback.h"
+
+LoopbackTransport::LoopbackTransport(const size_t delay, const size_t jitter, const uint32_t seed)
+    : m_now(0)
+    , m_delay(delay)
+    , m_jitter(jitter)
+    , m_random(seed)
+    , m_queues()
+    , m_ends{ End(*this, 0), End(*this, 1) }
+{
+}
+
+LoopbackTransport::End::End(LoopbackTransport& owner, const size_t side)
+    : m_owner(owner)
+    , m_side(side)
+{
+}
+
+void LoopbackTransport::End::send(const Input& input)
+{
+    uint64_t arrives = m_owner.m_now + m_owner.m_delay;
+    if (m_owner.m_jitter != 0)
+    {
+        m_owner.m_random = m_owner.m_random * 1103515245 + 12345;
+        arrives += (m_owner.m_random >> 16) % (m_owner.m_jitter + 1);
+    }
+    auto& queue = m_owner.m_queues[m_side ^ 1];
+    if (!queue.empty())
+        arrives = std::max(arrives, queue.back().arrives);
+    queue.push_back(Message{ arrives, input });
+}
+
+bool LoopbackTransport::End::receive(Input& input)
+{
+    auto& queue = m_owner.m_queues[m_side];
+    if (queue.empty() || queue.front().arrives > m_owner.m_now)
+        return false;
+    input = queue.front().input;
+    queue.pop_front();
+    return true;
+}
+
+RollbackSession::RollbackSession(const std::vector<uint8_t>& rom, const size_t local, InputTransport& transport, const size_t max_rollback)
+    : m_machines{ std::make_unique<GameBoy>(rom), std::make_unique<GameBoy>(rom) }
+    , m_cable(*m_machines[0], *m_machines[1])
+    , m_local(local)
+    , m_transport(transport)
+    , m_inputs()
+    , m_saved(std::max<size_t>(1, max_rollback) + 1)
+    , m_frame(0)
+    , m_confirmed(0)
+    , m_stats{ 0, 0, 0, 0 }
+{
+}
+
+bool RollbackSession::advance(const uint8_t buttons)
+{
+    poll();
+    if (m_frame - m_confirmed + 1 >= m_saved.size())
+    {
+        ++m_stats.stalls;
+        return false;
+    }
+
+    m_inputs[m_local].push_back(buttons);
+    m_transport.send(InputTransport::Input{ m_frame, buttons });
+
+    // held as they were last known, if they haven't come yet
+    auto& remote = m_inputs[m_local ^ 1];
+    if (remote.size() == m_frame)
+        remote.push_back(m_confirmed != 0 ? remote[m_confirmed - 1] : 0);
+    run_frame();
+    return true;
+}
+
+void RollbackSession::poll()
+{
+    auto& remote = m_inputs[m_local ^ 1];
+    uint64_t wrong = std::numeric_limits<uint64_t>::max();
+    InputTransport::Input input;
+    while (m_transport.receive(input))
+    {
+        // one the transport repeated or lost the one before of
+        if (input.frame != m_confirmed)
+            continue;
+        if (input.frame < remote.size())
+        {
+            if (remote[input.frame] != input.buttons)
+                wrong = std::min(wrong, input.frame);
+            remote[input.frame] = input.buttons;
+        }
+        else
+        {
+            remote.push_back(input.buttons);
+        }
+        ++m_confirmed;
+    }
+
+    // the ones still guessed go on from the last one known
+    for (uint64_t frame = std::max<uint64_t>(m_confirmed, 1); frame < m_frame; ++frame)
+    {
+        if (remote[frame] != remote[frame - 1])
+        {
+            wrong = std::min(wrong, frame);
+            remote[frame] = remote[frame - 1];
+        }
+    }
+    if (wrong < m_frame)
+        resimulate(wrong);
+}
+
+void RollbackSession::run_frame()
+{
+    auto& at = saved(m_frame);
+    for (size_t player = 0; player < players; ++player)
+    {
+        at.machines[player] = m_machines[player]->paged_snapshot();
+        m_machines[player]->set_buttons(m_inputs[player][m_frame]);
+    }
+    at.cable = m_cable.save_state();
+    m_cable.run_frame();
+    ++m_frame;
+}
+
+void RollbackSession::resimulate(const uint64_t from)
+{
+    const uint64_t to = m_frame;
+    const auto& at = saved(from);
+    std::array<bool, players> render;
+    for (size_t player = 0; player < players; ++player)
+    {
+        m_machines[player]->restore(at.machines[player]);
+        render[player] = m_machines[player]->ppu().render();
+        m_machines[player]->set_render(false);
+    }
+    m_cable.load_state(at.cable);
+
+    // drawing only the last, the one showing now
+    for (m_frame = from; m_frame < to;)
+    {
+        if (m_frame + 1 == to)
+        {
+            for (size_t player = 0; player < players; ++player)
+                m_machines[player]->set_render(render[player]);
+        }
+        run_frame();
+    }
+    ++m_stats.rollbacks;
+    m_stats.resimulated += to - from;
+    m_stats.longest = std::max<size_t>(m_stats.longest, static_cast<size_t>(to - from));
+}
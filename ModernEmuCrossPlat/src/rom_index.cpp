@@ -0,0 +1,331 @@
+#include "pch.h"
+
+#include "rom_index.h"
+
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+
+#include "aot.h"
+#include "cartridge.h"
+#include "cpu.h"
+#include "disassembler.h"
+#include "fused_loop.h"
+#include "idle_loop.h"
+#include "opcode_table.h"
+
+namespace
+{
+    constexpr std::array<std::string_view, RomIndex::idiom_count> idiom_names = {
+        "IdleWait", "Copy16", "Copy8", "Fill", "HaltLoop", "BankSwitch", "JumpTable", "OamDma"
+    };
+
+    // the opcode number and length of the instruction at offset, length 0
+    // if it doesn't fit before end
+    inline const std::pair<uint16_t, size_t> op_at(const std::vector<uint8_t>& rom, const size_t offset, const size_t end)
+    {
+        const uint8_t b = rom[offset];
+        if (b == 0xCB)
+            return (offset + 1 < end) ? std::make_pair(static_cast<uint16_t>(0x100 | rom[offset + 1]), size_t(2)) : std::make_pair(uint16_t(0xCB), size_t(0));
+        const size_t length = unprefixed_op_codes[b].GetLength();
+        return { b, (offset + length <= end) ? length : 0 };
+    }
+
+    // where a JR, JP, JR cc or JP cc at offset goes, -1 for anything else
+    inline const int branch_target(const std::vector<uint8_t>& rom, const size_t offset, const uint16_t addr)
+    {
+        const uint8_t b = rom[offset];
+        if (b == 0x18 || (b & 0xE7) == 0x20)
+            return static_cast<uint16_t>(addr + 2 + static_cast<int8_t>(rom[offset + 1]));
+        if (b == 0xC3 || (b & 0xE7) == 0xC2)
+            return rom[offset + 1] | (rom[offset + 2] << 8);
+        return -1;
+    }
+}
+
+const std::string_view RomIndex::idiom_name(const size_t i)
+{
+    return i < idiom_names.size() ? idiom_names[i] : std::string_view();
+}
+
+const std::string_view RomIndex::mbc_name(const uint8_t cart_type)
+{
+    switch (cart_type)
+    {
+    case 0x00:
+    case 0x08:
+    case 0x09:
+        return "ROM";
+    case 0x01:
+    case 0x02:
+    case 0x03:
+        return "MBC1";
+    case 0x05:
+    case 0x06:
+        return "MBC2";
+    case 0x0B:
+    case 0x0C:
+    case 0x0D:
+        return "MMM01";
+    case 0x0F:
+    case 0x10:
+    case 0x11:
+    case 0x12:
+    case 0x13:
+        return "MBC3";
+    case 0x19:
+    case 0x1A:
+    case 0x1B:
+    case 0x1C:
+    case 0x1D:
+    case 0x1E:
+        return "MBC5";
+    case 0x20:
+        return "MBC6";
+    case 0x22:
+        return "MBC7";
+    case 0xFC:
+        return "CAMERA";
+    case 0xFD:
+        return "TAMA5";
+    case 0xFE:
+        return "HUC3";
+    case 0xFF:
+        return "HUC1";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+RomIndex::Summary RomIndex::scan(const std::string& name, const std::vector<uint8_t>& rom)
+{
+    Summary summary;
+    summary.name = name;
+    Record& record = summary.record;
+    record = Record{};
+    record.rom_hash = rom_hash(rom);
+    record.cart_type = (rom.size() > Cartridge::type_addr) ? rom[Cartridge::type_addr] : 0;
+    record.banks = static_cast<uint16_t>((rom.size() + Cartridge::rom_bank_size - 1) / Cartridge::rom_bank_size);
+
+    Disassembler disassembler(rom);
+    disassembler.find_code();
+
+    // the loop matchers decode from a bus, with bank 0 and the bank at hand
+    auto bus = make_shared<MemoryMap>();
+    GBZ80 cpu(bus);
+    for (size_t addr = 0; addr < Cartridge::rom_bank_size && addr < rom.size(); ++addr)
+        bus->poke(static_cast<uint16_t>(addr), rom[addr]);
+
+    std::array<OpCount, 512> counts{};
+    // +1 on a loop's first byte, -1 past its last
+    std::vector<int> loops(Cartridge::rom_bank_size + 1);
+    for (size_t bank = 0; bank < record.banks; ++bank)
+    {
+        const size_t begin = bank * Cartridge::rom_bank_size;
+        const size_t end = std::min(begin + Cartridge::rom_bank_size, rom.size());
+        const uint16_t origin = (bank == 0) ? 0 : 0x4000;
+        if (bank != 0)
+        {
+            for (size_t addr = 0; addr < Cartridge::rom_bank_size; ++addr)
+                bus->poke(static_cast<uint16_t>(0x4000 + addr), begin + addr < end ? rom[begin + addr] : 0xFF);
+        }
+
+        // the loops first, and the idioms they're in
+        std::fill(loops.begin(), loops.end(), 0);
+        for (size_t offset = begin; offset < end; ++offset)
+        {
+            if (!disassembler.is_code(offset))
+                continue;
+            const auto [op, length] = op_at(rom, offset, end);
+            if (length == 0)
+                continue;
+            const auto addr = static_cast<uint16_t>(origin + offset - begin);
+
+            if (op == 0xE9)
+                record.idioms |= JumpTable;
+            else if (op == 0xEA && rom[offset + 2] >= 0x20 && rom[offset + 2] < 0x40)
+                record.idioms |= BankSwitch;
+            else if (op == 0xE0 && rom[offset + 1] == 0x46)
+                record.idioms |= OamDma;
+
+            const int target = branch_target(rom, offset, addr);
+            if (target < origin || target > addr || !disassembler.is_code(begin + target - origin))
+                continue;
+            ++loops[target - origin];
+            --loops[offset - begin + length];
+
+            if (IdleLoops::is_idle_loop(cpu, *bus, addr))
+                record.idioms |= IdleWait;
+            const auto fused = FusedLoops::loop_at(cpu, *bus, addr);
+            if (fused.fused)
+                record.idioms |= (fused.kind == FusedLoops::Kind::Copy16) ? Copy16 : (fused.kind == FusedLoops::Kind::Copy8) ? Copy8 : Fill;
+        }
+
+        // then every instruction, counted as hot inside any of them
+        int depth = 0;
+        for (size_t offset = begin; offset < end; ++offset)
+        {
+            depth += loops[offset - begin];
+            if (!disassembler.is_code(offset))
+                continue;
+            const auto [op, length] = op_at(rom, offset, end);
+            if (length == 0)
+                continue;
+
+            ++counts[op].count;
+            ++record.instructions;
+            if (depth > 0)
+            {
+                ++counts[op].hot;
+                ++record.hot_instructions;
+                if (op == 0x76)
+                    record.idioms |= HaltLoop;
+            }
+        }
+    }
+
+    for (size_t op = 0; op < counts.size(); ++op)
+    {
+        if (counts[op].count == 0)
+            continue;
+        counts[op].op = static_cast<uint16_t>(op);
+        summary.ops.push_back(counts[op]);
+    }
+    record.op_count = static_cast<uint16_t>(summary.ops.size());
+    return summary;
+}
+
+std::vector<RomIndex::Summary> RomIndex::scan_directory(const std::string& dir, const size_t threads)
+{
+    std::vector<std::filesystem::path> paths;
+    std::error_code error;
+    for (std::filesystem::recursive_directory_iterator it(dir, error), end; !error && it != end; it.increment(error))
+    {
+        if (!it->is_regular_file(error))
+            continue;
+        std::string extension = it->path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](const char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+        if (extension == ".gb" || extension == ".gbc")
+            paths.push_back(it->path());
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<Summary> summaries(paths.size());
+    std::atomic<size_t> next(0);
+    const auto work = [&]()
+    {
+        for (size_t i = next++; i < paths.size(); i = next++)
+        {
+            MappedFile file;
+            if (!file.open(paths[i].string()) || file.size() == 0)
+                continue;
+            const std::vector<uint8_t> rom(file.data(), file.data() + file.size());
+            summaries[i] = scan(std::filesystem::relative(paths[i], dir).generic_string(), rom);
+        }
+    };
+
+    const size_t workers = std::max<size_t>(1, std::min<size_t>(paths.size(), threads != 0 ? threads : std::thread::hardware_concurrency()));
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < workers; ++i)
+        pool.emplace_back(work);
+    work();
+    for (auto& thread : pool)
+        thread.join();
+
+    // the ones that couldn't be mapped
+    summaries.erase(std::remove_if(summaries.begin(), summaries.end(), [](const Summary& summary) { return summary.name.empty(); }), summaries.end());
+    return summaries;
+}
+
+bool RomIndex::save(const std::string& path, const std::vector<Summary>& summaries)
+{
+    std::vector<Record> records;
+    std::vector<OpCount> ops;
+    std::string names;
+    for (const auto& summary : summaries)
+    {
+        Record record = summary.record;
+        record.name_offset = static_cast<uint32_t>(names.size());
+        record.name_size = static_cast<uint16_t>(std::min<size_t>(summary.name.size(), 0xFFFF));
+        record.first_op = static_cast<uint32_t>(ops.size());
+        record.op_count = static_cast<uint16_t>(summary.ops.size());
+        names.append(summary.name, 0, record.name_size);
+        ops.insert(ops.end(), summary.ops.begin(), summary.ops.end());
+        records.push_back(record);
+    }
+
+    const auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    const std::string temp = path + "." + std::to_string(stamp) + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary);
+        if (!out.is_open())
+            return false;
+
+        const FileHeader header{ file_magic, format_version, static_cast<uint32_t>(records.size()), static_cast<uint32_t>(ops.size()), static_cast<uint32_t>(names.size()) };
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(Record)));
+        out.write(reinterpret_cast<const char*>(ops.data()), static_cast<std::streamsize>(ops.size() * sizeof(OpCount)));
+        out.write(names.data(), static_cast<std::streamsize>(names.size()));
+        if (!out.good())
+        {
+            out.close();
+            std::remove(temp.c_str());
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp, path, error);
+    if (error)
+    {
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool RomIndex::load(const std::string& path)
+{
+    m_count = 0;
+    m_records = nullptr;
+    m_ops = nullptr;
+    m_names = nullptr;
+    if (!m_file.open(path) || m_file.size() < sizeof(FileHeader))
+    {
+        m_file.close();
+        return false;
+    }
+
+    FileHeader header;
+    std::memcpy(&header, m_file.data(), sizeof(header));
+    const size_t ops_at = sizeof(FileHeader) + size_t(header.count) * sizeof(Record);
+    const size_t names_at = ops_at + size_t(header.op_total) * sizeof(OpCount);
+    bool whole = header.magic == file_magic && header.version == format_version && m_file.size() == names_at + header.names_size;
+
+    const auto* records = reinterpret_cast<const Record*>(m_file.data() + sizeof(FileHeader));
+    for (size_t i = 0; whole && i < header.count; ++i)
+    {
+        whole = size_t(records[i].first_op) + records[i].op_count <= header.op_total
+            && size_t(records[i].name_offset) + records[i].name_size <= header.names_size;
+    }
+    if (!whole)
+    {
+        m_file.close();
+        return false;
+    }
+
+    m_count = header.count;
+    m_records = records;
+    m_ops = reinterpret_cast<const OpCount*>(m_file.data() + ops_at);
+    m_names = reinterpret_cast<const char*>(m_file.data() + names_at);
+    return true;
+}
+
+const RomIndex::OpCount* RomIndex::find(const size_t i, const uint16_t op) const
+{
+    const auto* found = std::lower_bound(ops_begin(i), ops_end(i), op, [](const OpCount& count, const uint16_t op) { return count.op < op; });
+    return (found != ops_end(i) && found->op == op) ? found : nullptr;
+}
@@ -0,0 +1,33 @@
+#include "pch.h"
+
+#include "run_ahead.h"
+
+RunAhead::RunAhead(GameBoy& gb, const size_t frames)
+    : m_gb(gb)
+    , m_frames(frames)
+    , m_render(gb.ppu().render())
+{
+}
+
+const RunAhead::Picture& RunAhead::run_frame(const uint8_t buttons)
+{
+    m_gb.set_buttons(buttons);
+    if (m_frames == 0)
+    {
+        m_gb.run_frame();
+        return m_gb.ppu().framebuffer();
+    }
+
+    // the frame that counts, not drawn, then the ones ahead of it
+    m_gb.set_render(false);
+    m_gb.run_frame();
+    const auto snapshot = m_gb.paged_snapshot();
+    for (size_t frame = 1; frame <= m_frames; ++frame)
+    {
+        m_gb.set_render(m_render && frame == m_frames);
+        m_gb.run_frame();
+    }
+    m_gb.restore(snapshot);
+    m_gb.set_render(m_render);
+    return m_gb.ppu().framebuffer();
+}
@@ -0,0 +1,114 @@
+#include "pch.h"
+
+#include "save_state.h"
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+bool BufferSink::write(const void* data, const size_t size)
+{
+    if (size > m_capacity - m_size)
+        return false;
+    std::memcpy(m_buffer + m_size, data, size);
+    m_size += size;
+    return true;
+}
+
+bool BufferSource::read(void* data, const size_t size)
+{
+    if (size > m_size - m_offset)
+        return false;
+    std::memcpy(data, m_data + m_offset, size);
+    m_offset += size;
+    return true;
+}
+
+bool BufferSource::skip(const size_t size)
+{
+    if (size > m_size - m_offset)
+        return false;
+    m_offset += size;
+    return true;
+}
+
+#ifdef _WIN32
+
+bool FdSink::write(const void* data, const size_t size)
+{
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t done = 0; done < size;)
+    {
+        const int written = ::_write(m_fd, bytes + done, static_cast<unsigned>(std::min<size_t>(size - done, 1 << 30)));
+        if (written <= 0)
+            return false;
+        done += written;
+    }
+    return true;
+}
+
+bool FdSource::read(void* data, const size_t size)
+{
+    auto* bytes = static_cast<uint8_t*>(data);
+    for (size_t done = 0; done < size;)
+    {
+        const int got = ::_read(m_fd, bytes + done, static_cast<unsigned>(std::min<size_t>(size - done, 1 << 30)));
+        if (got <= 0)
+            return false;
+        done += got;
+    }
+    return true;
+}
+
+#else
+
+bool FdSink::write(const void* data, const size_t size)
+{
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t done = 0; done < size;)
+    {
+        const ssize_t written = ::write(m_fd, bytes + done, size - done);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        done += static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool FdSource::read(void* data, const size_t size)
+{
+    auto* bytes = static_cast<uint8_t*>(data);
+    for (size_t done = 0; done < size;)
+    {
+        const ssize_t got = ::read(m_fd, bytes + done, size - done);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+        done += static_cast<size_t>(got);
+    }
+    return true;
+}
+
+#endif
+
+bool FdSource::skip(const size_t size)
+{
+    // pipes can't seek, so read it away
+    std::array<uint8_t, 256> scratch;
+    for (size_t done = 0; done < size;)
+    {
+        const size_t piece = std::min(size - done, scratch.size());
+        if (!read(scratch.data(), piece))
+            return false;
+        done += piece;
+    }
+    return true;
+}
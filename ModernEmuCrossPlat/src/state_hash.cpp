@@ -0,0 +1,100 @@
+#include "pch.h"
+
+#include "state_hash.h"
+
+#include <bit>
+#include <cstring>
+
+namespace
+{
+    constexpr uint64_t golden = 0x9E3779B97F4A7C15ull;
+
+    // splitmix64's finish, every bit in reaches every bit out
+    inline const uint64_t finish(uint64_t h)
+    {
+        h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+        h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+        return h ^ (h >> 31);
+    }
+
+    inline const uint64_t word_at(const uint8_t* data)
+    {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        return word;
+    }
+
+    inline const uint64_t mix(const uint64_t h, const uint64_t word)
+    {
+        const uint64_t m = (h ^ word) * golden;
+        return m ^ (m >> 32);
+    }
+
+    // a page's term of the sum, its hash mixed with which page it is
+    inline const uint64_t page_term(const uint8_t* page, const size_t index)
+    {
+        return finish(StateHash::bytes(page, MemoryMap::page_size, index * golden));
+    }
+}
+
+StateHash::StateHash()
+    : m_pages{}
+    , m_bus_sum(0)
+    , m_ram_sum(0)
+    , m_ram_swaps(0)
+    , m_whole(true)
+    , m_ram_stale(true)
+{
+}
+
+const uint64_t StateHash::bytes(const void* data, const size_t size, const uint64_t seed)
+{
+    // four lanes, so the multiplies overlap
+    const auto* at = static_cast<const uint8_t*>(data);
+    std::array<uint64_t, 4> lanes = { seed, seed + golden, seed + 2 * golden, seed + 3 * golden };
+    size_t offset = 0;
+    for (; offset + 32 <= size; offset += 32)
+    {
+        for (size_t lane = 0; lane < lanes.size(); ++lane)
+            lanes[lane] = mix(lanes[lane], word_at(at + offset + lane * 8));
+    }
+    for (; offset + 8 <= size; offset += 8)
+        lanes[0] = mix(lanes[0], word_at(at + offset));
+    if (offset < size)
+    {
+        uint64_t tail = 0;
+        std::memcpy(&tail, at + offset, size - offset);
+        lanes[0] = mix(lanes[0], tail);
+    }
+    return finish(lanes[0] ^ std::rotl(lanes[1], 16) ^ std::rotl(lanes[2], 32) ^ std::rotl(lanes[3], 48) ^ size);
+}
+
+const uint64_t StateHash::memory(MemoryMap& bus, const Cartridge& cartridge)
+{
+    for (size_t i = 0; i < pages; ++i)
+    {
+        const size_t page = first_page + i;
+        if (!m_whole && !bus.unhashed(page) && page != MemoryMap::page_count - 1)
+            continue;
+        const uint64_t term = page_term(bus.data() + page * MemoryMap::page_size, page);
+        m_bus_sum += term - m_pages[i];
+        m_pages[i] = term;
+    }
+    bus.clear_unhashed();
+    m_whole = false;
+
+    // every bank but the one on the bus, whose copy here is stale
+    if (m_ram_stale || cartridge.ram_swaps() != m_ram_swaps)
+    {
+        const auto& ram = cartridge.state().ram;
+        m_ram_sum = 0;
+        for (size_t bank = 0; bank * Cartridge::ram_bank_size < ram.size(); ++bank)
+        {
+            if (bank != cartridge.mapped_ram_bank())
+                m_ram_sum += finish(bytes(ram.data() + bank * Cartridge::ram_bank_size, Cartridge::ram_bank_size, ~bank * golden));
+        }
+        m_ram_swaps = cartridge.ram_swaps();
+        m_ram_stale = false;
+    }
+    return m_bus_sum + std::rotl(m_ram_sum, 32);
+}
@@ -0,0 +1,98 @@
+#include "pch.h"
+
+#include "timer.h"
+
+void Timer::tick(MemoryMap& bus, size_t cycles)
+{
+    const uint16_t bit = selected_bit();
+
+    // a long stretch without an overflow, from skipped idle time, in one go
+    if (!m_overflow && cycles > 4)
+    {
+        const uint32_t end = m_counter + static_cast<uint32_t>(cycles & ~size_t(3));
+        const uint32_t edges = bit ? (end / (bit * 2u)) - (m_counter / (bit * 2u)) : 0;
+        if (m_tima + edges <= 0xFF)
+        {
+            m_tima = static_cast<uint8_t>(m_tima + edges);
+            m_counter = static_cast<uint16_t>(end);
+            return;
+        }
+    }
+
+    // one machine cycle at a time, TIMA can see several edges per instruction
+    for (; cycles >= 4; cycles -= 4)
+    {
+        // TIMA reads as 0 for a cycle after it overflows, then gets TMA
+        if (m_overflow)
+        {
+            m_overflow = false;
+            m_tima = m_tma;
+            bus.request_interrupt(Interrupt::Timer);
+        }
+
+        const uint16_t before = m_counter;
+        m_counter = static_cast<uint16_t>(m_counter + 4);
+        if ((before & bit) && !(m_counter & bit))
+        {
+            if (++m_tima == 0)
+                m_overflow = true;
+        }
+    }
+}
+
+const size_t Timer::cycles_to_event() const
+{
+    if (m_overflow)
+        return 4;
+
+    const uint16_t bit = selected_bit();
+    if (bit == 0)
+        return std::numeric_limits<size_t>::max();
+
+    // TIMA counts falling edges, which come every 2 * bit cycles
+    const size_t period = bit * 2u;
+    const size_t first = period - (m_counter % period);
+    return first + (0xFFu - m_tima) * period;
+}
+
+const uint8_t Timer::read(const uint16_t location) const
+{
+    switch (location)
+    {
+    case DIV:
+        return static_cast<uint8_t>(m_counter >> 8);
+    case TIMA:
+        return m_tima;
+    case TMA:
+        return m_tma;
+    case TAC:
+        return static_cast<uint8_t>(0xF8 | m_tac);
+    default:
+        return 0xFF;
+    }
+}
+
+void Timer::write(const uint16_t location, const uint8_t val)
+{
+    const uint16_t bit = selected_bit();
+
+    switch (location)
+    {
+    case DIV:
+        // resetting the counter is a falling edge if the selected bit was set
+        if ((m_counter & bit) && ++m_tima == 0)
+            m_overflow = true;
+        m_counter = 0;
+        break;
+    case TIMA:
+        m_tima = val;
+        m_overflow = false;
+        break;
+    case TMA:
+        m_tma = val;
+        break;
+    case TAC:
+        m_tac = static_cast<uint8_t>(val & 0x07);
+        break;
+    }
+}
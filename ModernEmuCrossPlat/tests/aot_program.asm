@@ -0,0 +1,155 @@
+; aot_program.asm : ROM for the aot_recompiled test, built with gbasm and
+; compiled with gbrecomp. Bank switching, a jump table, code in WRAM, an
+; idle loop, interrupts and HALT, all in one frame.
+
+TMA     EQU $FF06
+TAC     EQU $FF07
+LY      EQU $FF44
+COUNT   EQU $C100
+RAMFN   EQU $C200
+
+        CART 1
+        TITLE "AOT"
+
+        ORG $40
+vblank: push af
+        ld a, [COUNT]
+        inc a
+        ld [COUNT], a
+        pop af
+        reti
+
+        ORG $50
+timer:  push hl
+        ld hl, COUNT + 1
+        inc [hl]
+        pop hl
+        reti
+
+        ORG $150
+main:   ld a, $C0
+        ldh [TMA], a
+        ld a, $05
+        ldh [TAC], a
+        ld a, $05
+        ld [$FFFF], a
+
+        ; a routine the CPU runs from WRAM, which stays interpreted
+        ld hl, ramfn
+        ld de, RAMFN
+        ld b, ramfn_end - ramfn
+.copy:  ld a, [hl+]
+        ld [de], a
+        inc de
+        dec b
+        jr nz, .copy
+        ei
+
+frame:  ; the same address in two banks
+        ld a, 2
+        ld [$2000], a
+        call $4000
+        ld a, 3
+        ld [$2000], a
+        call $4000
+
+        ; through a jump table
+        ld a, [COUNT + 2]
+        inc a
+        and 3
+        ld [COUNT + 2], a
+        add a, a
+        ld e, a
+        ld d, 0
+        ld hl, table
+        add hl, de
+        ld a, [hl+]
+        ld h, [hl]
+        ld l, a
+        call jump
+
+        call RAMFN
+
+        ; bank 1 switches itself out from under the code it's running
+        ld a, 1
+        ld [$2000], a
+        call $4000
+
+        ; bit twiddling and BCD
+        ld a, [COUNT + 3]
+        add a, $19
+        daa
+        ld [COUNT + 3], a
+        ld hl, COUNT + 4
+        rlc [hl]
+        set 0, [hl]
+        swap a
+        bit 3, a
+        jr z, .skip
+        res 0, [hl]
+.skip:  halt
+        nop
+
+        ; wait for VBlank on LY
+.wait:  ldh a, [LY]
+        cp 144
+        jr nz, .wait
+        jp frame
+
+jump:   jp hl
+
+table:  DW case0, case1, case2, case3
+case0:  ld hl, COUNT + 8
+        inc [hl]
+        ret
+case1:  ld hl, COUNT + 9
+        inc [hl]
+        ret
+case2:  ld hl, COUNT + 10
+        inc [hl]
+        ret
+case3:  ld b, 40
+        ld hl, $C300
+        ld a, [COUNT]
+.fill:  ld [hl+], a
+        dec b
+        jr nz, .fill
+        ret
+
+ramfn:  ld hl, COUNT + 5
+        inc [hl]
+        ret
+ramfn_end:
+
+        BANK 1
+        ORG $4000
+        ld hl, COUNT + 6
+        inc [hl]
+        ld a, 2
+        ld [$2000], a
+        ; carries on in bank 2
+        inc [hl]
+        ret
+
+        BANK 2
+        ORG $4000
+        ld hl, COUNT + 7
+        inc [hl]
+        dec [hl]
+        dec [hl]
+        ret
+        nop
+        nop
+        ; where bank 1 switched to this one
+        inc [hl]
+        inc [hl]
+        inc [hl]
+        ret
+
+        BANK 3
+        ORG $4000
+        ld hl, COUNT + 7
+        ld a, [hl]
+        add a, 7
+        ld [hl], a
+        ret
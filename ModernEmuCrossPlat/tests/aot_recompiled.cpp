@@ -0,0 +1,97 @@
+// aot_recompiled.cpp : Runs aot_program.asm, recompiled by gbrecomp at build
+// time, with its compiled blocks and on the interpreter, and checks both
+// machines and their opcode counts agree after every frame.
+//
+// usage: aot_recompiled <aot_program.gb>
+
+#include "pch.h"
+
+#include <cstdlib>
+#include <iterator>
+#include <vector>
+
+#include "gameboy.h"
+#include "test_support.h"
+
+// generated by gbrecomp into aot_program.cpp
+template<class Machine>
+const AotProgram<Machine> aot_program();
+
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        std::cerr << "usage: aot_recompiled <aot_program.gb>" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::ifstream in(argv[1], std::ios::binary);
+    const std::vector<uint8_t> rom((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (rom.empty())
+    {
+        fail(std::string("can't read ") + argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    // both with and without the other fast paths in the way
+    for (const bool fast : { false, true })
+    {
+        InstrumentedGameBoy plain(rom);
+        InstrumentedGameBoy compiled(rom);
+        for (auto* gb : { &plain, &compiled })
+        {
+            gb->set_fast_forward(fast);
+            gb->set_fuse_loops(fast);
+        }
+        if (!compiled.set_compiled(aot_program<InstrumentedGameBoy>()))
+            fail("compiled from another ROM");
+        if (compiled.compiled_blocks() < 20)
+            fail("only " + std::to_string(compiled.compiled_blocks()) + " blocks");
+
+        for (size_t frame = 0; frame < 12 && failures == 0; ++frame)
+        {
+            const size_t plain_cycles = plain.run_frame();
+            const size_t compiled_cycles = compiled.run_frame();
+            if (plain_cycles != compiled_cycles || plain.cycles() != compiled.cycles())
+                fail("frame " + std::to_string(frame) + " took " + std::to_string(compiled_cycles) + " cycles, not " + std::to_string(plain_cycles));
+            compare_machines(plain, compiled, frame);
+        }
+    }
+
+    // the code in WRAM and the switch under bank 1 ran, on both
+    {
+        GameBoy gb(rom);
+        gb.set_compiled(aot_program<GameBoy>());
+        for (size_t frame = 0; frame < 4; ++frame)
+            gb.run_frame();
+        if (gb.bus().peek(0xC105) == 0 || gb.bus().peek(0xC106) == 0)
+            fail("WRAM routine or bank 1 never ran");
+    }
+
+    // a block runs as one step, as far as it goes
+    GameBoy a(rom);
+    GameBoy b(rom);
+    b.set_compiled(aot_program<GameBoy>());
+    size_t plain_steps = 0;
+    size_t compiled_steps = 0;
+    while (a.cycles() < 4 * Ppu::frame_cycles)
+    {
+        a.step();
+        ++plain_steps;
+    }
+    while (b.cycles() < 4 * Ppu::frame_cycles)
+    {
+        b.step();
+        ++compiled_steps;
+    }
+    if (compiled_steps * 2 > plain_steps)
+        fail(std::to_string(compiled_steps) + " steps compiled, " + std::to_string(plain_steps) + " interpreted");
+
+    // and none of it is for any other ROM
+    auto other = rom;
+    other[0x200] ^= 0xFF;
+    GameBoy c(other);
+    if (c.set_compiled(aot_program<GameBoy>()) || c.compiled_blocks() != 0)
+        fail("took blocks compiled from another ROM");
+
+    return finish("aot recompiled: ");
+}
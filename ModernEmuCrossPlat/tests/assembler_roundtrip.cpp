@@ -0,0 +1,222 @@
+// assembler_roundtrip.cpp : Assembles every opcode in the generated tables,
+// checks the bytes and that the decoder reads back the same instruction, then
+// runs a small banked program and checks the cartridge header.
+
+#include "pch.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include "opcode_table.h"
+#include "assembler.h"
+#include "gameboy.h"
+#include "test_support.h"
+
+namespace
+{
+    // source text for a table operand, and the bytes it should produce
+    const std::string operand_source(const std::string_view name, std::vector<uint8_t>& bytes)
+    {
+        if (name == "d8")
+        {
+            bytes.push_back(0x12);
+            return "$12";
+        }
+        if (name == "d16" || name == "a16")
+        {
+            bytes.insert(bytes.end(), { 0x34, 0x12 });
+            return "$1234";
+        }
+        if (name == "r8")
+        {
+            // JR lands 5 bytes past its end, ADD SP adds 5
+            bytes.push_back(0x05);
+            return "5";
+        }
+        if (name == "(a8)")
+        {
+            bytes.push_back(0x12);
+            return "[$FF12]";
+        }
+        if (name == "(a16)")
+        {
+            bytes.insert(bytes.end(), { 0x34, 0x12 });
+            return "[$1234]";
+        }
+        if (name == "SP+r8")
+        {
+            bytes.push_back(0x05);
+            return "SP+5";
+        }
+        if (name.size() == 3 && name[2] == 'H')
+            return "$" + std::string(name.substr(0, 2));
+        return std::string(name);
+    }
+
+    void check_opcode(const ParsedOpCode& entry, const bool prefixed)
+    {
+        std::vector<uint8_t> expected;
+        if (prefixed)
+            expected.push_back(0xCB);
+        expected.push_back(entry.GetAddr());
+
+        std::vector<std::string> operands;
+        for (const auto name : { entry.GetOperand1(), entry.GetOperand2() })
+        {
+            if (!name.empty())
+                operands.push_back(operand_source(name, expected));
+        }
+        while (expected.size() < entry.GetLength())
+            expected.push_back(0x00);
+
+        // JR's operand is a target, not an offset
+        if (entry.GetMnemonic() == "JR")
+            operands.back() = "@ + 7";
+
+        std::string line = std::string(entry.GetMnemonic());
+        for (size_t i = 0; i < operands.size(); ++i)
+            line += (i == 0 ? " " : ", ") + operands[i];
+
+        const auto assembled = assemble("ORG $150\n" + line + "\n");
+        if (!assembled.ok())
+        {
+            fail(line + ": " + assembled.errors[0].message);
+            return;
+        }
+
+        if (!std::equal(expected.begin(), expected.end(), assembled.rom.begin() + 0x150))
+        {
+            fail(line + ": wrong bytes");
+            return;
+        }
+
+        auto memory = make_shared<MemoryMap>();
+        for (size_t i = 0; i < expected.size(); ++i)
+            memory->write(static_cast<uint16_t>(0x150 + i), assembled.rom[0x150 + i]);
+        GBZ80 cpu(memory);
+        const auto decoded = cpu.decode_op(0x150, assembled.rom[0x150]);
+        if (decoded.prefixed != prefixed || decoded.op != entry.GetAddr() || decoded.length != entry.GetLength() ||
+            entry.GetMnemonic() != decoded.name)
+        {
+            fail(line + ": decodes as " + decoded.tostring());
+        }
+    }
+
+    void check_header(const std::vector<uint8_t>& rom)
+    {
+        if (!std::equal(Cartridge::nintendo_logo.begin(), Cartridge::nintendo_logo.end(), rom.begin() + Cartridge::logo_addr))
+            fail("logo");
+        if (rom[Cartridge::header_checksum_addr] != Cartridge::header_checksum(rom))
+            fail("header checksum");
+        const uint16_t global = static_cast<uint16_t>((rom[Cartridge::global_checksum_addr] << 8) | rom[Cartridge::global_checksum_addr + 1]);
+        if (global != Cartridge::global_checksum(rom))
+            fail("global checksum");
+        if ((size_t(0x8000) << rom[Cartridge::rom_size_addr]) != rom.size())
+            fail("rom size byte");
+    }
+
+    const char* const banked_program = R"(
+        TITLE "ROUNDTRIP"
+        CART $01                ; MBC1
+COUNT   EQU 10
+RESULT  EQU $C000
+
+        ORG $150
+main:
+        xor a
+        ld b, COUNT
+.loop:  add a, 3
+        dec b
+        jr nz, .loop
+        ld [RESULT], a
+        ld a, BANK_NUMBER
+        ld [$2000], a
+        ld a, [far_data]
+        ld [RESULT + 1], a
+        ld hl, message
+        ld a, [hl+]
+        ld [RESULT + 2], a
+        call far_code
+.done:  jr .done
+
+message:
+        db "OK", 0
+
+BANK_NUMBER EQU 3
+        BANK 3
+far_data:
+        db $5A
+far_code:
+        ld a, HIGH(far_code)
+        ld [RESULT + 3], a
+        ret
+)";
+
+    void check_program()
+    {
+        const auto assembled = assemble_checked(banked_program);
+        if (!assembled.ok())
+            return;
+
+        check_header(assembled.rom);
+        if (assembled.rom.size() != 4 * Cartridge::rom_bank_size)
+            fail("banked rom size");
+
+        GameBoy gb(assembled.rom);
+        for (size_t i = 0; i < 1000; ++i)
+            gb.step();
+
+        auto& bus = gb.bus();
+        if (bus.read(0xC000) != 30)
+            fail("loop result");
+        if (bus.read(0xC001) != 0x5A)
+            fail("banked read");
+        if (bus.read(0xC002) != 'O')
+            fail("string data");
+        if (bus.read(0xC003) != 0x40)
+            fail("banked call");
+
+        const auto symbols = format_symbols(assembled);
+        if (symbols.find("03:4000 far_data") == std::string::npos || symbols.find("00:0153 main.loop") == std::string::npos)
+            fail("symbols:\n" + symbols);
+    }
+
+    void check_errors()
+    {
+        const auto assembled = assemble("ORG $150\nnop\nfrob a\nld a, missing\njr far\nds 200\nfar: nop\n");
+        const std::vector<size_t> lines = { 3, 4, 5 };
+        if (assembled.errors.size() != lines.size())
+        {
+            fail("expected " + std::to_string(lines.size()) + " errors, got " + std::to_string(assembled.errors.size()));
+            return;
+        }
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            if (assembled.errors[i].line != lines[i])
+                fail("error on line " + std::to_string(assembled.errors[i].line) + ": " + assembled.errors[i].message);
+        }
+    }
+}
+
+int main()
+{
+    size_t checked = 0;
+    for (const auto& entry : unprefixed_op_codes)
+    {
+        if (entry.IsValid() && entry.GetMnemonic() != "PREFIX")
+        {
+            check_opcode(entry, false);
+            ++checked;
+        }
+    }
+    for (const auto& entry : cbprefixed_op_codes)
+    {
+        check_opcode(entry, true);
+        ++checked;
+    }
+
+    check_program();
+    check_errors();
+
+    return finish("assembled " + std::to_string(checked) + " opcodes, ");
+}
@@ -0,0 +1,192 @@
+// block_cache.cpp : Runs a banked program from translated blocks and on the
+// interpreter and checks both agree after every frame, then saves the cache,
+// maps it back in and checks nothing is translated again. Last, machines on
+// several threads share one cache and each still ends where the interpreter
+// does.
+
+#include "pch.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+#include "gameboy.h"
+#include "test_support.h"
+
+namespace
+{
+    const char* const program = R"(
+TMA     EQU $FF06
+TAC     EQU $FF07
+LY      EQU $FF44
+        CART 1
+        ORG $50
+timer:  push hl
+        ld hl, $C100
+        inc [hl]
+        pop hl
+        reti
+
+        ORG $150
+main:   ld a, $C0
+        ldh [TMA], a
+        ld a, $05
+        ldh [TAC], a
+        ld a, $04
+        ld [$FFFF], a
+        ei
+
+frame:  ld a, 2
+        ld [$2000], a
+        call $4000
+        ; switches to bank 2 under itself
+        ld a, 1
+        ld [$2000], a
+        call $4000
+
+        ld hl, $C200
+        ld b, 64
+        ld a, [$C100]
+.fill:  ld [hl+], a
+        rlca
+        dec b
+        jr nz, .fill
+
+.wait:  ldh a, [LY]
+        cp 144
+        jr nz, .wait
+        jp frame
+
+        BANK 1
+        ORG $4000
+        ld hl, $C101
+        inc [hl]
+        ld a, 2
+        ld [$2000], a
+        inc [hl]
+        ret
+
+        BANK 2
+        ORG $4000
+        ld hl, $C102
+        inc [hl]
+        ret
+        nop
+        nop
+        inc [hl]
+        inc [hl]
+        inc [hl]
+        ret
+
+        BANK 3
+        ORG $4000
+        ret
+)";
+
+    // runs frames with and without cache, returns the cycles
+    uint64_t run(const std::vector<uint8_t>& rom, shared_ptr<BlockCache> cache, const size_t frames)
+    {
+        InstrumentedGameBoy plain(rom);
+        InstrumentedGameBoy cached(rom);
+        for (auto* gb : { &plain, &cached })
+        {
+            gb->set_fast_forward(false);
+            gb->set_fuse_loops(false);
+        }
+        if (!cached.set_block_cache(cache))
+            fail("cache refused");
+
+        for (size_t frame = 0; frame < frames && failures == 0; ++frame)
+        {
+            const size_t plain_cycles = plain.run_frame();
+            const size_t cached_cycles = cached.run_frame();
+            if (plain_cycles != cached_cycles || plain.cycles() != cached.cycles())
+                fail("frame " + std::to_string(frame) + " took " + std::to_string(cached_cycles) + " cycles, not " + std::to_string(plain_cycles));
+            compare_machines(plain, cached, frame);
+        }
+        return cached.cycles();
+    }
+}
+
+int main()
+{
+    const auto assembled = assemble_checked(program);
+    if (!assembled.ok())
+        return EXIT_FAILURE;
+    const auto& rom = assembled.rom;
+
+    auto cache = make_shared<BlockCache>(rom);
+    run(rom, cache, 8);
+    if (cache->size() < 10 || cache->translated() != cache->size())
+        fail(std::to_string(cache->size()) + " blocks, " + std::to_string(cache->translated()) + " translated");
+
+    const auto path = (std::filesystem::temp_directory_path() / "block_cache_test.blocks").string();
+    if (!cache->save(path))
+        fail("can't save " + path);
+
+    // warm from the file, with nothing left to translate
+    auto warm = make_shared<BlockCache>(rom);
+    if (!warm->load(path))
+        fail("can't load " + path);
+    if (warm->size() != cache->size())
+        fail(std::to_string(warm->size()) + " blocks loaded, " + std::to_string(cache->size()) + " saved");
+    run(rom, warm, 8);
+    if (warm->translated() != 0)
+        fail(std::to_string(warm->translated()) + " blocks translated after loading");
+
+    // not for another ROM, nor a cut short file
+    auto other_rom = rom;
+    other_rom[0x200] ^= 0xFF;
+    BlockCache other(other_rom);
+    if (other.load(path))
+        fail("loaded a cache for another ROM");
+    {
+        std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+        BlockCache cut(rom);
+        if (cut.load(path))
+            fail("loaded a cut short cache");
+    }
+    GameBoy gb(other_rom);
+    if (gb.set_block_cache(cache))
+        fail("took a cache for another ROM");
+    std::filesystem::remove(path);
+
+    // one cache for the whole process, translated into from every thread
+    const auto shared = BlockCache::shared(rom);
+    if (BlockCache::shared(rom) != shared || BlockCache::shared(other_rom) == shared)
+        fail("not one shared cache per ROM");
+
+    GameBoy reference(rom);
+    for (size_t frame = 0; frame < 8; ++frame)
+        reference.run_frame();
+    const auto expected = reference.snapshot();
+
+    constexpr size_t thread_count = 4;
+    std::vector<GameBoy::Snapshot> results(thread_count);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+        threads.emplace_back([&rom, &results, i]()
+        {
+            GameBoy gb(rom);
+            gb.set_block_cache(BlockCache::shared(rom));
+            for (size_t frame = 0; frame < 8; ++frame)
+                gb.run_frame();
+            results[i] = gb.snapshot();
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+        if (!(results[i].cpu.r == expected.cpu.r) || results[i].memory != expected.memory || results[i].cycles != expected.cycles)
+            fail("thread " + std::to_string(i) + " ended somewhere else");
+    }
+    // a block two threads translated at once is kept once
+    if (shared->translated() != shared->size() || shared->size() == 0)
+        fail(std::to_string(shared->translated()) + " blocks translated for " + std::to_string(shared->size()) + " shared");
+
+    return finish("block cache: ");
+}
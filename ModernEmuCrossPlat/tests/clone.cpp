@@ -0,0 +1,160 @@
+// clone.cpp : Clones a banked program with RAM as it renders, and checks a
+// clone runs on to the same state as the machine it came from, pressing
+// buttons on one leaves the other alone, and the ROM and block cache are
+// shared rather than copied. Then the same for an instrumented machine,
+// whose clone keeps the counts so far.
+
+#include "pch.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include "gameboy.h"
+#include "test_support.h"
+
+namespace
+{
+    // counts frames on VBlank, into the RAM bank and ROM bank the count
+    // picks, and keeps the buttons held at $C001
+    const char* const source = R"(
+        CART 3
+        RAMSIZE 3
+P1      EQU $FF00
+        ORG $150
+main:   ld a, $0A
+        ld [$0000], a
+        ld a, 1
+        ld [$6000], a
+        ld a, $01
+        ld [$FFFF], a
+        ei
+.loop:  halt
+        ld a, [$C000]
+        and 1
+        inc a
+        ld [$2000], a
+        call $4000
+        jr .loop
+
+vblank: ld hl, $C000
+        inc [hl]
+        ld a, [hl]
+        and 3
+        ld [$4000], a
+        ld a, [hl]
+        ld [$A000], a
+        ld a, $10
+        ldh [P1], a
+        ldh a, [P1]
+        ld [$C001], a
+        ld hl, $9800
+        inc [hl]
+        reti
+
+        BANK 1
+        ORG $4000
+        ld hl, $C002
+        inc [hl]
+        ret
+
+        BANK 2
+        ORG $4000
+        ld hl, $C003
+        inc [hl]
+        ret
+)";
+
+    template<class Machine>
+    void run(Machine& gb, const size_t frames)
+    {
+        for (size_t frame = 0; frame < frames; ++frame)
+            gb.run_frame();
+    }
+
+    template<class Machine>
+    const bool same(Machine& a, Machine& b)
+    {
+        const auto x = a.snapshot();
+        const auto y = b.snapshot();
+        return x.cpu.r == y.cpu.r && x.cpu.ime == y.cpu.ime && x.cpu.halted == y.cpu.halted && x.memory == y.memory
+            && x.cartridge.ram == y.cartridge.ram && x.cartridge.bank1 == y.cartridge.bank1 && x.cartridge.bank2 == y.cartridge.bank2
+            && x.cycles == y.cycles && a.ppu().framebuffer() == b.ppu().framebuffer();
+    }
+}
+
+int main()
+{
+    const auto assembled = assemble_with_vectors(source);
+    if (!assembled.ok())
+        return EXIT_FAILURE;
+
+    GameBoy gb(assembled.rom);
+    GameBoy reference(assembled.rom);
+    gb.set_render(true);
+    reference.set_render(true);
+    // step() runs a block at a time with a cache, so both have one
+    gb.set_block_cache(make_shared<BlockCache>(assembled.rom));
+    reference.set_block_cache(make_shared<BlockCache>(assembled.rom));
+    run(gb, 10);
+    run(reference, 10);
+
+    // cloned mid frame, both run on the same as a machine never cloned
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        gb.step();
+        reference.step();
+    }
+    const auto clone = gb.clone();
+    if (!same(*clone, gb))
+        fail("the clone isn't the machine it came from");
+    if (&clone->cartridge().rom() != &gb.cartridge().rom() || clone->block_cache() != gb.block_cache())
+        fail("the clone copied the ROM or block cache");
+
+    run(*clone, 10);
+    if (!same(gb, reference))
+        fail("running the clone ran the machine it came from");
+    run(gb, 10);
+    run(reference, 10);
+    if (!same(*clone, reference) || !same(gb, reference))
+        fail("the clone and the machine it came from didn't run on the same");
+    const auto ran = clone->snapshot();
+    if (ran.memory[0xC000] < 20 || ran.memory[0xC002] == 0 || ran.memory[0xC003] == 0 || ran.cartridge.ram[3 * 0x2000] == 0)
+        fail("the program didn't run");
+
+    // buttons held on a clone of a clone aren't on either before it
+    const auto pressed = clone->clone();
+    pressed->set_buttons(BUTTON_A | BUTTON_START);
+    run(*pressed, 3);
+    run(*clone, 3);
+    run(gb, 3);
+    if (pressed->snapshot().memory[0xC001] == gb.snapshot().memory[0xC001])
+        fail("buttons on the clone weren't read");
+    if (!same(*clone, gb))
+        fail("buttons on a clone reached the machine it came from");
+
+    // a clone outliving the machine it came from
+    {
+        auto first = std::make_unique<GameBoy>(assembled.rom);
+        run(*first, 5);
+        const auto second = first->clone();
+        first.reset();
+        run(*second, 5);
+        if (second->snapshot().memory[0xC000] != 10)
+            fail("a clone stopped when the machine it came from went");
+    }
+
+    // instrumented, the clone counts on from where it was
+    {
+        InstrumentedGameBoy counted(assembled.rom);
+        run(counted, 5);
+        const auto other = counted.clone();
+        if (other->cpu().stats().instructions() != counted.cpu().stats().instructions())
+            fail("the clone's counts aren't the machine's");
+        run(counted, 5);
+        run(*other, 5);
+        if (!same(counted, *other) || other->cpu().stats().instructions() != counted.cpu().stats().instructions())
+            fail("the instrumented clone didn't run on the same");
+    }
+
+    return finish("clone: ");
+}
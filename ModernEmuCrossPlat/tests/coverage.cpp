@@ -0,0 +1,246 @@
+// coverage.cpp : Runs a banked program with a VBlank handler, a branch
+// never taken, a bank never called and code only JP HL reaches, and checks
+// the bytes and edges that ran are the ones recorded, the same from the
+// interpreter and from translated blocks. Then round trips the binary form,
+// checks a restore doesn't mark what ran in between, and looks for the marks
+// and edges in the report.
+
+#include "pch.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include "assembler.h"
+#include "disassembler.h"
+#include "gameboy.h"
+#include "test_support.h"
+
+namespace
+{
+    const char* const source = R"(
+        CART 1
+        ORG $150
+main:   ld a, $01
+        ld [$FFFF], a
+        ei
+wait:   halt
+        ld a, [$C000]
+        cp $FF
+        jr z, never
+        ld a, 2
+        ld [$2000], a
+        call $4000
+        ld hl, hidden
+        jp hl
+back:   jr wait
+
+never:  ld a, 1
+        ld [$C001], a
+        jr never
+
+vblank: push af
+        ld a, [$C000]
+        inc a
+        ld [$C000], a
+        pop af
+        reti
+
+hidden: ld a, 7
+        ld [$C002], a
+        jp back
+
+        BANK 2
+        ORG $4000
+        ld hl, $C003
+        inc [hl]
+        ret
+
+        BANK 3
+        ORG $4000
+        ld hl, $C004
+        inc [hl]
+        ret
+)";
+
+    constexpr size_t frames = 30;
+
+    const uint16_t symbol(const AssembledRom& assembled, const std::string& name)
+    {
+        for (const auto& entry : assembled.symbols)
+        {
+            if (entry.name == name)
+                return entry.addr;
+        }
+        fail("no symbol " + name);
+        return 0;
+    }
+
+    const uint64_t edge_count(const Coverage& coverage, const GuestAddr& from, const GuestAddr& to)
+    {
+        for (const auto& edge : coverage.edges())
+        {
+            if (edge.from.key() == from.key() && edge.to.key() == to.key())
+                return edge.count;
+        }
+        return 0;
+    }
+
+    const shared_ptr<Coverage> run(const std::vector<uint8_t>& rom, const bool blocks)
+    {
+        GameBoy gb(rom);
+        if (blocks)
+            gb.set_block_cache(make_shared<BlockCache>(rom));
+        auto coverage = make_shared<Coverage>(rom);
+        if (!gb.set_coverage(coverage))
+            fail("coverage refused");
+        for (size_t frame = 0; frame < frames; ++frame)
+            gb.run_frame();
+        if (gb.snapshot().memory[0xC003] < frames - 1)
+            fail("the program didn't run");
+        return coverage;
+    }
+}
+
+int main()
+{
+    const auto assembled = assemble_with_vectors(source);
+    if (!assembled.ok())
+        return EXIT_FAILURE;
+
+    const auto coverage = run(assembled.rom, false);
+    const uint16_t main = symbol(assembled, "main");
+    const uint16_t never = symbol(assembled, "never");
+    const uint16_t vblank = symbol(assembled, "vblank");
+    const uint16_t hidden = symbol(assembled, "hidden");
+    const uint16_t back = symbol(assembled, "back");
+
+    // every byte from main to never ran, never didn't, the handler and the
+    // hidden code did
+    for (uint16_t addr = main; addr < never; ++addr)
+    {
+        if (!coverage->ran(0, addr))
+            fail("byte " + std::to_string(addr) + " didn't run");
+    }
+    for (uint16_t addr = never; addr < vblank; ++addr)
+    {
+        if (coverage->ran(0, addr))
+            fail("byte " + std::to_string(addr) + " of never ran");
+    }
+    for (uint16_t addr = vblank; addr < hidden + 8; ++addr)
+    {
+        if (!coverage->ran(0, addr))
+            fail("byte " + std::to_string(addr) + " of the handler or hidden didn't run");
+    }
+    if (!coverage->ran(0, 0x0040) || coverage->ran(0, 0x0043) || coverage->ran(0, 0x0048))
+        fail("the vectors are wrong");
+    if (coverage->bytes_run(2) != 5 || coverage->bytes_run(3) != 0 || coverage->ran(3, 0x4000))
+        fail("bank 2 ran " + std::to_string(coverage->bytes_run(2)) + " bytes, bank 3 " + std::to_string(coverage->bytes_run(3)));
+
+    // the call, its return, the interrupts and the jumps, once a frame
+    const uint64_t calls = edge_count(*coverage, { 0, static_cast<uint16_t>(back - 7) }, { 2, 0x4000 });
+    const uint64_t returns = edge_count(*coverage, { 2, 0x4004 }, { 0, static_cast<uint16_t>(back - 4) });
+    const uint64_t to_hidden = edge_count(*coverage, { 0, static_cast<uint16_t>(back - 1) }, { 0, hidden });
+    const uint64_t from_hidden = edge_count(*coverage, { 0, static_cast<uint16_t>(hidden + 5) }, { 0, back });
+    const uint64_t to_handler = edge_count(*coverage, { 0, 0x0040 }, { 0, vblank });
+    if (calls < frames - 1 || calls != returns || calls != to_hidden || calls != from_hidden)
+        fail("the call went " + std::to_string(calls) + " times, the return " + std::to_string(returns) + ", JP HL " + std::to_string(to_hidden)
+            + ", back " + std::to_string(from_hidden));
+    if (to_handler < frames - 1 || to_handler > frames + 1)
+        fail("the handler ran " + std::to_string(to_handler) + " times");
+    uint64_t interrupts = 0;
+    for (const auto& edge : coverage->edges())
+    {
+        if (edge.to.addr == 0x0040)
+            interrupts += edge.count;
+        if (edge.to.addr == never || edge.from.bank == 3)
+            fail("an edge into never or bank 3");
+    }
+    if (interrupts != to_handler)
+        fail(std::to_string(interrupts) + " interrupts, " + std::to_string(to_handler) + " into the handler");
+
+    // translated blocks record the same
+    const auto from_blocks = run(assembled.rom, true);
+    for (size_t bank = 0; bank < coverage->banks(); ++bank)
+    {
+        if (from_blocks->bytes_run(bank) != coverage->bytes_run(bank))
+            fail("blocks ran " + std::to_string(from_blocks->bytes_run(bank)) + " bytes of bank " + std::to_string(bank));
+    }
+    const auto edges = coverage->edges();
+    const auto block_edges = from_blocks->edges();
+    if (edges.size() != block_edges.size())
+        fail(std::to_string(block_edges.size()) + " edges from blocks, " + std::to_string(edges.size()) + " interpreted");
+    for (size_t i = 0; i < std::min(edges.size(), block_edges.size()); ++i)
+    {
+        if (edges[i].from.key() != block_edges[i].from.key() || edges[i].to.key() != block_edges[i].to.key())
+            fail("blocks took other edges");
+    }
+
+    // saved and merged, twice over, counts add up and marks don't change
+    std::stringstream saved;
+    if (!coverage->write(saved))
+        fail("can't write coverage");
+    const std::string bytes = saved.str();
+    if (bytes.size() != 32 + coverage->banks() * Cartridge::rom_bank_size / 8 + 16 * coverage->edge_count())
+        fail(std::to_string(bytes.size()) + " bytes written");
+    Coverage merged(assembled.rom);
+    for (size_t i = 0; i < 2; ++i)
+    {
+        std::istringstream in(bytes);
+        if (!merged.merge(in))
+            fail("can't merge coverage");
+    }
+    if (merged.bytes_run() != coverage->bytes_run() || merged.edge_count() != coverage->edge_count()
+        || edge_count(merged, { 0, 0x0040 }, { 0, vblank }) != 2 * to_handler)
+        fail("merged coverage differs");
+    std::istringstream short_in(bytes.substr(0, bytes.size() - 1));
+    auto other_rom = assembled.rom;
+    other_rom[0x4000 * 3] ^= 1;
+    Coverage other(other_rom);
+    std::istringstream other_in(bytes);
+    if (merged.merge(short_in) || other.merge(other_in))
+        fail("merged a cut short file or one for another ROM");
+    if (merged.edge_count() != coverage->edge_count() || other.bytes_run() != 0)
+        fail("a refused merge changed coverage");
+
+    // a restore starts over from where it lands, rather than marking
+    // everything from where the code was before up to the next jump, here
+    // the VBlank interrupt taken first
+    {
+        GameBoy gb(assembled.rom);
+        gb.run_frame();
+        const auto start = gb.snapshot();
+        gb.cpu().set_pc(hidden);
+        auto far = gb.snapshot();
+        far.cpu.halted = false;
+        gb.restore(start);
+
+        auto restored = make_shared<Coverage>(assembled.rom);
+        gb.set_coverage(restored);
+        gb.restore(far);
+        for (size_t i = 0; i < 20; ++i)
+            gb.step();
+        if (!restored->ran(0, hidden) || restored->ran(0, never))
+            fail("a restore marked what was between");
+    }
+
+    // the report marks what ran, what ran as data and the edges
+    Disassembler listing(assembled.rom);
+    listing.run(1);
+    std::ostringstream report;
+    coverage->write_report(report, listing);
+    const std::string text = report.str();
+    const auto hex = [](const uint16_t addr)
+    {
+        std::ostringstream out;
+        out << std::hex << std::uppercase << std::setfill('0') << std::setw(4) << addr;
+        return out.str();
+    };
+    for (const std::string& expected : std::vector<std::string>{ "; bank 02: 5 of 16384 bytes ran", "* 02:4000", "  03:4000", "* 00:" + hex(main),
+        "  00:" + hex(never), "! 00:" + hex(hidden), "; -> 00:" + hex(vblank) + " x" + std::to_string(to_handler) })
+    {
+        if (text.find(expected) == std::string::npos)
+            fail("no \"" + expected + "\" in the report");
+    }
+
+    return finish("coverage: " + std::to_string(coverage->bytes_run()) + " bytes, " + std::to_string(coverage->edge_count()) + " edges, ");
+}
@@ -0,0 +1,260 @@
+// decoder_conformance.cpp : Checks GBZ80::decode_op against the tables
+// generated from data/opcodes.json for all 512 opcodes and measures the
+// decode throughput. Fails if any opcode disagrees with the table or if a
+// decode allocates.
+//
+// usage: decoder_conformance [seconds of throughput measurement, default 0.5]
+
+#include "pch.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "opcode_table.h"
+#include "cpu.h"
+
+// Every allocation in the process goes through here, decode calls are
+// bracketed with count_allocations so only those get counted, each thread
+// its own.
+namespace
+{
+    thread_local bool count_allocations = false;
+    thread_local size_t decode_allocations = 0;
+}
+
+void* operator new(std::size_t size)
+{
+    if (count_allocations)
+        ++decode_allocations;
+
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+namespace
+{
+    struct Decoder
+    {
+        Decoder()
+            : memory(make_shared<MemoryMap>())
+            , cpu(memory)
+        {
+        }
+
+        // the CB page is decoded through its prefix, which is at location 0
+        DecodedOpcode decode(const bool prefixed, const uint8_t op)
+        {
+            if (prefixed)
+            {
+                memory->write(0, 0xCB);
+                memory->write(1, op);
+                return cpu.decode_op(0, 0xCB);
+            }
+            memory->write(0, op);
+            return cpu.decode_op(0, op);
+        }
+
+        shared_ptr<MemoryMap> memory;
+        GBZ80 cpu;
+    };
+
+    // returns an empty string when the decode matches the table entry
+    const std::string compare(const DecodedOpcode& decoded, const ParsedOpCode& ref, const bool prefixed)
+    {
+        std::string errors;
+
+        if (!ref.IsValid())
+        {
+            // illegal opcode, the decoder has to say so
+            if (decoded.group != OpcodeGroup::UNKNOWN)
+                errors += " decoded an illegal opcode;";
+            return errors;
+        }
+
+        if (ref.GetMnemonic() != decoded.name)
+            errors += " mnemonic;";
+        if (decoded.prefixed != prefixed)
+            errors += " prefix;";
+        if (ref.GetOperand1() != decoded.GetOprand1Name())
+            errors += " operand1;";
+        if (ref.GetOperand2() != decoded.GetOprand2Name())
+            errors += " operand2;";
+        if (ref.GetLength() != decoded.length)
+            errors += " length;";
+        if (ref.MinCycles() != decoded.min_timing)
+            errors += " min cycles;";
+        if (ref.MaxCycles() != decoded.max_timing)
+            errors += " max cycles;";
+        for (size_t f = 0; f < 4; ++f)
+        {
+            if (ref.GetFlag(f) != decoded.GetFlag(f))
+            {
+                errors += " flags;";
+                break;
+            }
+        }
+
+        return errors;
+    }
+
+    // all 512 opcodes as (prefixed, op), the CB prefix itself is checked on
+    // its own since decoding it yields the prefixed instruction
+    struct OpcodeId
+    {
+        bool prefixed;
+        uint8_t op;
+    };
+
+    const std::vector<OpcodeId> all_opcodes()
+    {
+        std::vector<OpcodeId> ops;
+        for (size_t op = 0; op < 256; ++op)
+        {
+            if (op != 0xCB)
+                ops.push_back({ false, static_cast<uint8_t>(op) });
+        }
+        for (size_t op = 0; op < 256; ++op)
+            ops.push_back({ true, static_cast<uint8_t>(op) });
+        return ops;
+    }
+
+    size_t thread_count()
+    {
+        return std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    size_t check_conformance(const std::vector<OpcodeId>& ops)
+    {
+        std::atomic<size_t> failures{ 0 };
+        std::atomic<size_t> checked{ 0 };
+        std::mutex out_lock;
+        std::vector<std::thread> workers;
+
+        const size_t threads = thread_count();
+        for (size_t t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]()
+            {
+                Decoder decoder;
+                for (size_t i = t; i < ops.size(); i += threads)
+                {
+                    const auto& id = ops[i];
+                    const auto& ref = id.prefixed ? cbprefixed_op_codes[id.op] : unprefixed_op_codes[id.op];
+
+                    const size_t before = decode_allocations;
+                    count_allocations = true;
+                    const auto decoded = decoder.decode(id.prefixed, id.op);
+                    count_allocations = false;
+
+                    auto errors = compare(decoded, ref, id.prefixed);
+                    if (decode_allocations != before)
+                        errors += " allocated;";
+
+                    ++checked;
+                    if (!errors.empty())
+                    {
+                        ++failures;
+                        std::lock_guard<std::mutex> lock(out_lock);
+                        std::cout << decoded.tostring() << std::endl;
+                        std::cout << ref.tostring() << std::endl;
+                        std::cout << "NO MATCH:" << errors << std::endl;
+                        std::cout << "-----------------------------" << std::endl;
+                    }
+                }
+            });
+        }
+
+        for (auto& worker : workers)
+            worker.join();
+
+        // 0xCB itself, the table has it as a one byte prefix
+        Decoder decoder;
+        const auto decoded = decoder.decode(false, 0xCB);
+        if (unprefixed_op_codes[0xCB].GetMnemonic() != "PREFIX" || !decoded.prefixed)
+        {
+            ++failures;
+            std::cout << "NO MATCH: CB prefix" << std::endl;
+        }
+
+        std::cout << "checked " << checked + 1 << " opcodes, " << failures << " mismatches" << std::endl;
+        return failures;
+    }
+
+    void measure_throughput(const std::vector<OpcodeId>& ops, const double seconds)
+    {
+        std::atomic<uint64_t> decodes{ 0 };
+        std::vector<std::thread> workers;
+
+        const auto start = std::chrono::steady_clock::now();
+        const auto deadline = start + std::chrono::duration<double>(seconds);
+
+        const size_t threads = thread_count();
+        for (size_t t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&]()
+            {
+                Decoder decoder;
+                // the immediates don't change the decode path, only the opcode
+                for (size_t op = 0; op < 256; ++op)
+                    decoder.memory->write(static_cast<uint16_t>(0x100 + op), static_cast<uint8_t>(op));
+
+                uint64_t local = 0;
+                size_t length_sum = 0;
+                while (std::chrono::steady_clock::now() < deadline)
+                {
+                    for (const auto& id : ops)
+                    {
+                        const auto decoded = id.prefixed
+                            ? decoder.decode(true, id.op)
+                            : decoder.cpu.decode_op(0x100, id.op);
+                        length_sum += decoded.length;
+                    }
+                    local += ops.size();
+                }
+                // a volatile store the lengths have to reach, so the
+                // decodes aren't thrown away
+                volatile size_t sink = length_sum;
+                (void)sink;
+                decodes += local;
+            });
+        }
+
+        for (auto& worker : workers)
+            worker.join();
+
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::fixed << std::setprecision(1)
+            << "throughput: " << (decodes / elapsed) / 1e6 << " M decodes/s on "
+            << threads << " threads ("
+            << (decodes / elapsed) / 1e6 / threads << " M decodes/s per thread)" << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const double seconds = (argc > 1) ? std::atof(argv[1]) : 0.5;
+
+    const auto ops = all_opcodes();
+    const size_t failures = check_conformance(ops);
+
+    if (seconds > 0)
+        measure_throughput(ops, seconds);
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
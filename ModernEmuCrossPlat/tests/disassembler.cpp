@@ -0,0 +1,186 @@
+// disassembler.cpp : Lists every opcode and checks the assembler turns the
+// text back into the same bytes, then lists a banked program with a jump
+// table and a message in it and checks code and data come out apart, the
+// same on one thread as on several.
+
+#include "pch.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include "opcode_table.h"
+#include "assembler.h"
+#include "cartridge.h"
+#include "disassembler.h"
+#include "utils.h"
+#include "test_support.h"
+
+namespace
+{
+    static_assert(std::string_view(itoa_16<uint16_t>(0x1F0A).data()) == "1F0A");
+    static_assert(std::string_view(itoa_10<uint8_t>(7).data()) == "007");
+
+    const char* const program = R"(
+        CART 1
+        ORG $150
+main:   ld a, 1
+        ld [$2000], a
+        call $4000
+        ld a, [$C000]
+        and 3
+        add a, a
+        ld e, a
+        ld d, 0
+        ld hl, table
+        add hl, de
+        ld a, [hl+]
+        ld h, [hl]
+        ld l, a
+jump:   jp hl
+table:  dw one, two, one, two
+message:
+        db "HELLO", 0
+one:    jr main
+two:    jp main
+
+        BANK 1
+        ORG $4000
+        ld hl, $C000
+        inc [hl]
+        ret
+        db $DE, $AD
+)";
+
+    // the line listing offset, without its address and bytes
+    const std::string listed(const Disassembler& disassembler, const size_t offset)
+    {
+        const size_t bank = offset / Cartridge::rom_bank_size;
+        const auto text = disassembler.text(bank);
+        const uint16_t addr = static_cast<uint16_t>((bank == 0 ? 0 : 0x4000) + offset % Cartridge::rom_bank_size);
+        char prefix[16];
+        std::snprintf(prefix, sizeof(prefix), "%02X:%04X  ", static_cast<unsigned>(bank), addr);
+        const auto at = text.find(prefix);
+        if (at == std::string_view::npos || (at != 0 && text[at - 1] != '\n'))
+            return std::string();
+        const auto end = text.find('\n', at);
+        return std::string(text.substr(at + 9, end - at - 9));
+    }
+
+    // every opcode at $150, reached from the entry point, listed and
+    // assembled again
+    void check_opcodes(const std::vector<uint8_t>& blank)
+    {
+        for (size_t page = 0; page < 2; ++page)
+        {
+            for (size_t op = 0; op < 256; ++op)
+            {
+                const auto& entry = (page == 0) ? unprefixed_op_codes[op] : cbprefixed_op_codes[op];
+                if (!entry.IsValid() || (page == 0 && op == 0xCB))
+                    continue;
+
+                auto rom = blank;
+                std::vector<uint8_t> bytes = { static_cast<uint8_t>(op) };
+                if (page == 1)
+                    bytes.insert(bytes.begin(), 0xCB);
+                // negative, to see signed operands and JR backwards
+                while (bytes.size() < entry.GetLength())
+                    bytes.push_back(bytes.size() == 1 ? 0xFD : 0x12);
+                if (op == 0x10 && page == 0)
+                    bytes[1] = 0x00;
+                std::copy(bytes.begin(), bytes.end(), rom.begin() + 0x150);
+
+                Disassembler disassembler(rom);
+                disassembler.run(1);
+                const std::string line = listed(disassembler, 0x150);
+                char first[4];
+                std::snprintf(first, sizeof(first), "%02X ", bytes[0]);
+                if (line.size() < 10 || line.compare(0, 3, first) != 0)
+                {
+                    fail("opcode " + std::to_string(op) + " page " + std::to_string(page) + " listed as \"" + line + "\"");
+                    continue;
+                }
+
+                const auto assembled = assemble("ORG $150\n" + line.substr(10) + "\n");
+                if (!assembled.ok())
+                    fail(line + ": " + assembled.errors[0].message);
+                else if (!std::equal(bytes.begin(), bytes.end(), assembled.rom.begin() + 0x150))
+                    fail(line + ": assembles to other bytes");
+            }
+        }
+    }
+}
+
+int main()
+{
+    const auto blank = assemble("ORG $150\n");
+    const auto assembled = assemble_checked(program);
+    if (!assembled.ok() || !blank.ok())
+        return EXIT_FAILURE;
+
+    check_opcodes(blank.rom);
+
+    const auto& rom = assembled.rom;
+    const auto symbol = [&](const std::string& name)
+    {
+        for (const auto& sym : assembled.symbols)
+        {
+            if (sym.name == name)
+                return static_cast<size_t>(sym.addr);
+        }
+        fail("no symbol " + name);
+        return size_t(0);
+    };
+
+    Disassembler disassembler(rom);
+    disassembler.run(4);
+    if (disassembler.banks() != rom.size() / Cartridge::rom_bank_size)
+        fail(std::to_string(disassembler.banks()) + " banks listed");
+
+    const std::pair<size_t, std::string> expected[] = {
+        { 0x100, "00        NOP" },
+        { 0x150, "3E 01     LD A, $01" },
+        { 0x152, "EA 00 20  LD ($2000), A" },
+        { 0x155, "CD 00 40  CALL $4000" },
+        { symbol("table"), "DB $" },
+        { symbol("message"), "DB $48, $45, $4C, $4C, $4F, $00" },
+        { symbol("jump"), "E9        JP (HL)" },
+        { symbol("two"), "DB $C3, $50, $01" },
+        { 0x4000, "21 00 C0  LD HL, $C000" },
+        { 0x4004, "C9        RET" },
+        { 0x4005, "DB $DE, $AD" },
+    };
+    for (const auto& [offset, text] : expected)
+    {
+        const std::string line = listed(disassembler, offset);
+        if (line.compare(0, text.size(), text) != 0)
+            fail("listed \"" + line + "\" at " + std::to_string(offset) + ", not \"" + text + "\"");
+    }
+
+    // JP HL isn't followed, so one and two are left as data
+    if (disassembler.is_code(symbol("table")) || disassembler.is_code(symbol("one")) || !disassembler.is_code(0x4003))
+        fail("code and data mixed up");
+
+    size_t listed_bytes = 0;
+    for (size_t bank = 0; bank < disassembler.banks(); ++bank)
+    {
+        const auto text = disassembler.text(bank);
+        if (text.empty() || text.back() != '\n')
+            fail("bank " + std::to_string(bank) + " doesn't end a line");
+        listed_bytes += text.size();
+    }
+
+    // one thread lists the same
+    Disassembler serial(rom);
+    serial.run(1);
+    std::stringstream a;
+    std::stringstream b;
+    disassembler.write(a);
+    serial.write(b);
+    if (a.str() != b.str() || a.str().size() != listed_bytes)
+        fail("listing depends on the threads");
+    if (serial.instructions() != disassembler.instructions() || serial.data_bytes() != disassembler.data_bytes()
+        || disassembler.data_bytes() >= rom.size() || disassembler.instructions() < 20)
+        fail(std::to_string(disassembler.instructions()) + " instructions, " + std::to_string(disassembler.data_bytes()) + " data bytes");
+
+    return finish("disassembler: ");
+}
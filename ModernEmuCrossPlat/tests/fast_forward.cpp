@@ -0,0 +1,183 @@
+// fast_forward.cpp : Runs programs that wait on LY, STAT, a VBlank flag in
+// HRAM and HALT with fast forward on and off, and checks both end every frame
+// in the same state while the fast one runs far fewer instructions.
+
+#include "pch.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include "assembler.h"
+#include "gameboy.h"
+#include "test_support.h"
+
+namespace
+{
+    // waits for VBlank polling LY, then for it to end
+    const char* const ly_source = R"(
+LY      EQU $FF44
+        ORG $150
+main:
+.wait:  ldh a, [LY]
+        cp 144
+        jr nz, .wait
+        ld hl, $C000
+        inc [hl]
+.vbl:   ldh a, [LY]
+        cp 144
+        jr z, .vbl
+        jr main
+)";
+
+    // waits for HBlank on STAT, with a STAT interrupt on LYC
+    const char* const stat_source = R"(
+STAT    EQU $FF41
+LYC     EQU $FF45
+        ORG $48
+stat:   push hl
+        ld hl, $C001
+        inc [hl]
+        pop hl
+        reti
+
+        ORG $150
+main:   ld a, $40
+        ldh [STAT], a
+        ld a, 77
+        ldh [LYC], a
+        ld a, $02
+        ld [$FFFF], a
+        ei
+.wait:  ldh a, [STAT]
+        and 3
+        jr nz, .wait
+        ld hl, $C000
+        inc [hl]
+.busy:  ldh a, [STAT]
+        and 3
+        jr z, .busy
+        jr .wait
+)";
+
+    // the main loop spins on a flag the VBlank handler sets
+    const char* const flag_source = R"(
+FLAG    EQU $FF80
+        ORG $40
+vblank: push af
+        ld a, 1
+        ldh [FLAG], a
+        pop af
+        reti
+
+        ORG $150
+main:   ld a, $01
+        ld [$FFFF], a
+        ei
+.loop:  xor a
+        ldh [FLAG], a
+.wait:  ldh a, [FLAG]
+        and a
+        jp z, .wait
+        ld hl, $C000
+        inc [hl]
+        jr .loop
+)";
+
+    // HALT woken by the timer and VBlank
+    const char* const halt_source = R"(
+TMA     EQU $FF06
+TAC     EQU $FF07
+        ORG $40
+vblank: reti
+        ORG $50
+timer:  push hl
+        ld hl, $C001
+        inc [hl]
+        pop hl
+        reti
+
+        ORG $150
+main:   ld a, $80
+        ldh [TMA], a
+        ld a, $05
+        ldh [TAC], a
+        ld a, $05
+        ld [$FFFF], a
+        ei
+.loop:  halt
+        ld hl, $C000
+        inc [hl]
+        jr .loop
+)";
+
+    // LCD off, so frames end on the cycle count, with the CPU halted for good
+    const char* const lcd_off_source = R"(
+        ORG $150
+main:   xor a
+        ldh [$FF40], a
+        ld [$FFFF], a
+        halt
+        nop
+        jr main
+)";
+
+    void check(const char* name, const char* source, const uint64_t fewer)
+    {
+        const auto assembled = assemble(source);
+        for (const auto& error : assembled.errors)
+            fail(std::string(name) + " line " + std::to_string(error.line) + ": " + error.message);
+        if (!assembled.ok())
+            return;
+
+        InstrumentedGameBoy plain(assembled.rom);
+        InstrumentedGameBoy fast(assembled.rom);
+        plain.set_fast_forward(false);
+
+        for (size_t frame = 0; frame < 10; ++frame)
+        {
+            const size_t plain_cycles = plain.run_frame();
+            const size_t fast_cycles = fast.run_frame();
+            if (plain_cycles != fast_cycles || plain.cycles() != fast.cycles())
+            {
+                fail(std::string(name) + ": frame " + std::to_string(frame) + " took " + std::to_string(fast_cycles) + " cycles, not " + std::to_string(plain_cycles));
+                return;
+            }
+
+            const auto a = plain.snapshot();
+            const auto b = fast.snapshot();
+            if (!(a.cpu.r == b.cpu.r) || a.cpu.ime != b.cpu.ime || a.cpu.halted != b.cpu.halted)
+                fail(std::string(name) + ": cpu differs after frame " + std::to_string(frame));
+            if (a.memory != b.memory)
+                fail(std::string(name) + ": memory differs after frame " + std::to_string(frame));
+            for (const uint16_t reg : { Timer::DIV, Timer::TIMA, Ppu::STAT, Ppu::LY })
+            {
+                if (plain.bus().read(reg) != fast.bus().read(reg))
+                    fail(std::string(name) + ": register " + std::to_string(reg) + " differs after frame " + std::to_string(frame));
+            }
+        }
+
+        if (plain.cpu().stats().total_cycles() != fast.cpu().stats().total_cycles())
+            fail(std::string(name) + ": stats cycles differ");
+
+        // at least this many times fewer instructions, HALT doesn't count as
+        // any so there's nothing to check there
+        if (fewer == 0)
+            return;
+        const uint64_t plain_ops = plain.cpu().stats().instructions();
+        const uint64_t fast_ops = fast.cpu().stats().instructions();
+        if (fast_ops * fewer >= plain_ops)
+            fail(std::string(name) + ": " + std::to_string(fast_ops) + " instructions with fast forward, " + std::to_string(plain_ops) + " without");
+    }
+}
+
+int main()
+{
+    // STAT changes three times a line, there's little to skip between
+    check("ly", ly_source, 3);
+    check("stat", stat_source, 1);
+    check("flag", flag_source, 10);
+    check("halt", halt_source, 0);
+    check("lcd_off", lcd_off_source, 0);
+
+    return finish("fast forward: ");
+}
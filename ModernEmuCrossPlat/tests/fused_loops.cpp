@@ -0,0 +1,141 @@
+// fused_loops.cpp : Runs copy and fill loops with loop fusion on and off, with
+// the LCD drawing and a timer interrupt landing in the middle of them, and
+// checks both machines and their opcode counts agree after every frame.
+
+#include "pch.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include "gameboy.h"
+#include "test_support.h"
+
+namespace
+{
+    const char* const program = R"(
+TMA     EQU $FF06
+TAC     EQU $FF07
+        ORG $50
+timer:  push af
+        push hl
+        ld hl, $C100
+        inc [hl]
+        pop hl
+        pop af
+        reti
+
+        ORG $150
+main:   ld a, $C0
+        ldh [TMA], a
+        ld a, $05
+        ldh [TAC], a
+        ld a, $04
+        ld [$FFFF], a
+        ei
+        ld e, 0
+
+frame:  ; tiles from ROM to VRAM, BC counter
+        ld hl, $0000
+        ld de, $8000
+        ld bc, $1800
+.tiles: ld a, [hl+]
+        ld [de], a
+        inc de
+        dec bc
+        ld a, b
+        or c
+        jr nz, .tiles
+
+        ; fill up, then down, with a value that changes every frame
+        ld a, [$C800]
+        inc a
+        ld [$C800], a
+        ld hl, $C000
+        ld b, 0
+.up:    ld [hl+], a
+        dec b
+        jr nz, .up
+        cpl
+        ld hl, $C3FF
+        ld c, 200
+.down:  ld [hl-], a
+        dec c
+        jr nz, .down
+
+        ; DE to HL, C counter, ld a, c / or b
+        ld de, $C000
+        ld hl, $C400
+        ld bc, $0300
+.back:  ld a, [de]
+        ld [hl+], a
+        inc de
+        dec bc
+        ld a, c
+        or b
+        jr nz, .back
+
+        ; overlapping, the first byte gets smeared forward
+        ld hl, $C0F0
+        ld de, $C0F1
+        ld b, 100
+.smear: ld a, [hl+]
+        ld [de], a
+        inc de
+        dec b
+        jr nz, .smear
+
+        ; into the cartridge's registers, which has to stay on the slow path
+        ld hl, $0000
+        ld de, $2000
+        ld c, 4
+.mbc:   ld a, [hl+]
+        ld [de], a
+        inc de
+        dec c
+        jr nz, .mbc
+
+        jp frame
+)";
+}
+
+int main()
+{
+    const auto assembled = assemble_checked(program);
+    if (!assembled.ok())
+        return EXIT_FAILURE;
+
+    InstrumentedGameBoy plain(assembled.rom);
+    InstrumentedGameBoy fused(assembled.rom);
+    plain.set_fuse_loops(false);
+
+    for (size_t frame = 0; frame < 8 && failures == 0; ++frame)
+    {
+        const size_t plain_cycles = plain.run_frame();
+        const size_t fused_cycles = fused.run_frame();
+        if (plain_cycles != fused_cycles || plain.cycles() != fused.cycles())
+            fail("frame " + std::to_string(frame) + " took " + std::to_string(fused_cycles) + " cycles, not " + std::to_string(plain_cycles));
+        compare_machines(plain, fused, frame);
+    }
+
+    // the same time in fewer steps, the VRAM copy still stops at every PPU
+    // mode change
+    GameBoy a(assembled.rom);
+    GameBoy b(assembled.rom);
+    a.set_fuse_loops(false);
+    size_t plain_steps = 0;
+    size_t fused_steps = 0;
+    while (a.cycles() < 4 * Ppu::frame_cycles)
+    {
+        a.step();
+        ++plain_steps;
+    }
+    while (b.cycles() < 4 * Ppu::frame_cycles)
+    {
+        b.step();
+        ++fused_steps;
+    }
+    if (fused_steps * 2 > plain_steps)
+        fail(std::to_string(fused_steps) + " steps fused, " + std::to_string(plain_steps) + " without");
+
+    return finish("fused loops: ");
+}
@@ -0,0 +1,151 @@
+// fuzz_harness.cpp : Runs a program which reads the joypad every frame and
+// hangs a different way for each of a few buttons, and checks every button
+// gets the outcome it should, each run starts from the same state whatever
+// the one before did, and coverage follows the paths taken. Then tries
+// every single byte input and checks each outcome turns up.
+
+#include "pch.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include "fuzz_harness.h"
+#include "test_support.h"
+
+namespace
+{
+    // Start halts with nothing enabled, Select stops, A and B together jump
+    // into OAM, Down spins without reading the buttons again, and A alone
+    // counts at $C000
+    const char* const source = R"(
+P1      EQU $FF00
+        ORG $150
+main:   ld a, $01
+        ld [$FFFF], a
+        ei
+.loop:  halt
+        ld a, $10
+        ldh [P1], a
+        ldh a, [P1]
+        cpl
+        and $0F
+        ld b, a
+        ld a, $20
+        ldh [P1], a
+        ldh a, [P1]
+        cpl
+        and $0F
+        ld c, a
+        bit 3, b
+        jr nz, dead
+        bit 2, b
+        jr nz, stops
+        ld a, b
+        and 3
+        cp 3
+        jr z, wild
+        bit 3, c
+        jr nz, spin
+        bit 0, b
+        jr z, .loop
+        ld hl, $C000
+        inc [hl]
+        jr .loop
+
+dead:   di
+        xor a
+        ld [$FFFF], a
+        halt
+        nop
+wild:   jp $FE00
+stops:  stop
+spin:   jr spin
+
+vblank: reti
+)";
+
+    const FuzzHarness::Result run(FuzzHarness& harness, const std::vector<uint8_t>& input)
+    {
+        return harness.run(input.data(), input.size());
+    }
+
+    void expect(const std::string& what, const FuzzHarness::Result& result, const FuzzHarness::Outcome outcome)
+    {
+        if (result.outcome != outcome)
+            fail(what + ": " + FuzzHarness::outcome_name(result.outcome) + ", not " + FuzzHarness::outcome_name(outcome));
+    }
+}
+
+int main()
+{
+    const auto assembled = assemble_with_vectors(source);
+    if (!assembled.ok())
+        return EXIT_FAILURE;
+
+    GameBoy gb(assembled.rom);
+    for (size_t frame = 0; frame < 3; ++frame)
+        gb.run_frame();
+    const auto base = gb.snapshot();
+
+    FuzzHarness::Options options;
+    options.frames_per_input = 2;
+    options.settle_frames = 20;
+    options.stall_frames = 10;
+    FuzzHarness harness(gb, options);
+
+    // nothing pressed runs to the end, the settle frames after no input
+    const auto idle = run(harness, {});
+    expect("no input", idle, FuzzHarness::Outcome::Finished);
+    if (idle.frames != options.settle_frames)
+        fail("no input ran " + std::to_string(idle.frames) + " frames");
+    const auto idle_coverage = harness.coverage();
+    const size_t idle_edges = harness.edges();
+
+    expect("start", run(harness, { 0, BUTTON_START }), FuzzHarness::Outcome::HaltedForever);
+    expect("select", run(harness, { BUTTON_SELECT }), FuzzHarness::Outcome::Stopped);
+    const auto wild = run(harness, { 0, 0, BUTTON_A | BUTTON_B });
+    expect("a and b", wild, FuzzHarness::Outcome::WildJump);
+    if (wild.pc != 0xFE00)
+        fail("the wild jump stopped at " + std::to_string(wild.pc));
+    const auto stall = run(harness, { BUTTON_DOWN });
+    expect("down", stall, FuzzHarness::Outcome::Stalled);
+    if (stall.frames < options.stall_frames || stall.frames > options.stall_frames + 2)
+        fail("stalled after " + std::to_string(stall.frames) + " frames");
+
+    // A takes a path nothing pressed doesn't, and counts once a frame
+    const auto counted = run(harness, { BUTTON_A, BUTTON_A, BUTTON_A });
+    expect("a", counted, FuzzHarness::Outcome::Finished);
+    if (harness.edges() <= idle_edges)
+        fail("pressing A hit " + std::to_string(harness.edges()) + " edges, nothing pressed " + std::to_string(idle_edges));
+    if (gb.snapshot().memory[0xC000] != 6)
+        fail("A counted " + std::to_string(gb.snapshot().memory[0xC000]) + " times");
+
+    // after all that, the same run comes out the same
+    const auto again = run(harness, {});
+    if (again.cycles != idle.cycles || again.pc != idle.pc || harness.coverage() != idle_coverage)
+        fail("no input again didn't run the same");
+    gb.restore(base);
+    run(harness, { BUTTON_A });
+    if (gb.snapshot().memory[0xC000] != 2)
+        fail("a run didn't start from the base state");
+
+    // without stall_frames spinning runs to the end
+    {
+        GameBoy other(assembled.rom);
+        other.run_frame();
+        FuzzHarness patient(other);
+        expect("down, not watching for stalls", run(patient, { BUTTON_DOWN }), FuzzHarness::Outcome::Finished);
+    }
+
+    // every one byte input, each outcome found
+    std::vector<size_t> found(5, 0);
+    for (size_t buttons = 0; buttons < 0x100; ++buttons)
+        ++found[static_cast<size_t>(run(harness, { static_cast<uint8_t>(buttons) }).outcome)];
+    for (size_t outcome = 0; outcome < found.size(); ++outcome)
+    {
+        if (found[outcome] == 0)
+            fail(std::string("no input ") + FuzzHarness::outcome_name(static_cast<FuzzHarness::Outcome>(outcome)));
+    }
+
+    return finish("fuzz harness: ");
+}
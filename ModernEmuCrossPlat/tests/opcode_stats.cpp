@@ -0,0 +1,178 @@
+// opcode_stats.cpp : Steps a short program through each conditional JR, JP,
+// CALL and RET both ways on the instrumented core, and checks the counts,
+// cycles and branches taken and not are exactly the ones worked out by hand.
+// Then that HALT counts as idle, and the skipped part of an idle loop does
+// too.
+
+#include "pch.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include "gameboy.h"
+#include "test_support.h"
+
+namespace
+{
+    // B counts down through JR NZ, then with Z set each of JP, CALL and RET
+    // goes one way on NZ and the other on Z, and it halts with nothing to
+    // wake it
+    const char* const source = R"(
+        ORG $150
+main:   di
+        ld b, 3
+.loop:  dec b
+        jr nz, .loop
+        xor a
+        swap a
+        jp nz, main
+        jp z, .next
+        nop
+.next:  call z, sub
+        call nz, sub
+        jr done
+sub:    ret nz
+        ret z
+done:   halt
+        jr done
+)";
+
+    // polls LY until VBlank, which fast forward skips to
+    const char* const idle_source = R"(
+LY      EQU $FF44
+        ORG $150
+main:   di
+.wait:  ldh a, [LY]
+        cp 144
+        jr nz, .wait
+done:   jr done
+)";
+
+    struct Expected
+    {
+        bool prefixed;
+        uint8_t op;
+        uint64_t count;
+        uint64_t cycles;
+        uint64_t taken;
+        uint64_t untaken;
+    };
+
+    const Expected expected[] = {
+        { false, 0xF3, 1, 4, 0, 0 },  // di
+        { false, 0x06, 1, 8, 0, 0 },  // ld b, n
+        { false, 0x05, 3, 12, 0, 0 }, // dec b
+        { false, 0x20, 3, 32, 2, 1 }, // jr nz
+        { false, 0xAF, 1, 4, 0, 0 },  // xor a
+        { true, 0x37, 1, 8, 0, 0 },   // swap a
+        { false, 0xC2, 1, 12, 0, 1 }, // jp nz
+        { false, 0xCA, 1, 16, 1, 0 }, // jp z
+        { false, 0xCC, 1, 24, 1, 0 }, // call z
+        { false, 0xC0, 1, 8, 0, 1 },  // ret nz
+        { false, 0xC8, 1, 20, 1, 0 }, // ret z
+        { false, 0xC4, 1, 12, 0, 1 }, // call nz
+        { false, 0x18, 1, 12, 0, 0 }, // jr
+    };
+
+    const uint16_t symbol(const AssembledRom& assembled, const std::string& name)
+    {
+        for (const auto& entry : assembled.symbols)
+        {
+            if (entry.name == name)
+                return entry.addr;
+        }
+        fail("no symbol " + name);
+        return 0;
+    }
+
+    // steps until pc is at addr, giving up after limit instructions
+    void step_to(InstrumentedGameBoy& gb, const uint16_t addr, const size_t limit = 1000)
+    {
+        for (size_t i = 0; i < limit && gb.cpu().get_pc() != addr; ++i)
+            gb.step_instruction();
+        if (gb.cpu().get_pc() != addr)
+            fail("never got to " + std::to_string(addr));
+    }
+
+    void check_counts()
+    {
+        const auto assembled = assemble_checked(source);
+        if (!assembled.ok())
+            return;
+
+        InstrumentedGameBoy gb(assembled.rom);
+        gb.set_fast_forward(false);
+        gb.set_fuse_loops(false);
+        step_to(gb, symbol(assembled, "main"));
+        gb.cpu().stats().reset();
+        step_to(gb, symbol(assembled, "done"));
+
+        const auto& stats = gb.cpu().stats();
+        uint64_t instructions = 0;
+        uint64_t cycles = 0;
+        std::vector<bool> listed(OpcodeStats::opcode_count);
+        for (const auto& op : expected)
+        {
+            const size_t idx = OpcodeStats::index(op.prefixed, op.op);
+            const std::string name = "opcode " + std::to_string(idx);
+            listed[idx] = true;
+            instructions += op.count;
+            cycles += op.cycles;
+            if (stats.count(idx) != op.count)
+                fail(name + " ran " + std::to_string(stats.count(idx)) + " times, not " + std::to_string(op.count));
+            if (stats.cycles(idx) != op.cycles)
+                fail(name + " took " + std::to_string(stats.cycles(idx)) + " cycles, not " + std::to_string(op.cycles));
+            if (!op.prefixed && (stats.taken(op.op) != op.taken || stats.untaken(op.op) != op.untaken))
+                fail(name + " taken " + std::to_string(stats.taken(op.op)) + " and untaken " + std::to_string(stats.untaken(op.op)));
+        }
+        for (size_t idx = 0; idx < OpcodeStats::opcode_count; ++idx)
+        {
+            if (!listed[idx] && (stats.count(idx) != 0 || stats.cycles(idx) != 0))
+                fail("opcode " + std::to_string(idx) + " counted but never ran");
+        }
+        if (stats.instructions() != instructions || stats.total_cycles() != cycles)
+            fail("totals " + std::to_string(stats.instructions()) + " and " + std::to_string(stats.total_cycles()));
+        if (stats.interrupts() != 0 || stats.idle_cycles() != 0)
+            fail("interrupts or idle before the halt");
+
+        // added up twice, everything doubles
+        OpcodeStats sum;
+        sum += stats;
+        sum += stats;
+        if (sum.instructions() != 2 * instructions || sum.taken(0x20) != 4 || sum.untaken(0xC4) != 2)
+            fail("adding up");
+
+        // the halt runs once, then each step is idle
+        constexpr size_t idle_steps = 10;
+        for (size_t i = 0; i < 1 + idle_steps; ++i)
+            gb.step_instruction();
+        if (stats.count(0x76) != 1 || stats.idle_cycles() != 4 * idle_steps)
+            fail("halt ran " + std::to_string(stats.count(0x76)) + " times, idle " + std::to_string(stats.idle_cycles()) + " cycles");
+        if (stats.total_cycles() != cycles + 4 + 4 * idle_steps)
+            fail("idle cycles left out of the total");
+    }
+
+    // fast forward skips the polling, and the cycles it skips are idle ones,
+    // so the total is still the machine's
+    void check_idle_skip()
+    {
+        const auto assembled = assemble_checked(idle_source);
+        if (!assembled.ok())
+            return;
+
+        InstrumentedGameBoy gb(assembled.rom);
+        gb.run_frame();
+        const auto& stats = gb.cpu().stats();
+        if (stats.idle_cycles() == 0)
+            fail("no idle cycles from the skipped loop");
+        if (stats.total_cycles() != gb.cycles())
+            fail("total " + std::to_string(stats.total_cycles()) + " vs machine " + std::to_string(gb.cycles()));
+    }
+}
+
+int main()
+{
+    check_counts();
+    check_idle_skip();
+    return finish("opcode_stats: ");
+}
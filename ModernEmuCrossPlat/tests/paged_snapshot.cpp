@@ -0,0 +1,142 @@
+// paged_snapshot.cpp : Takes a paged snapshot every few frames of a program
+// which copies with a fused loop, switches RAM banks and writes all over
+// memory, and checks each one shares what wasn't written with the one
+// before, restores to the same state a full snapshot does, in any order,
+// and runs on from there the same.
+
+#include "pch.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include "gameboy.h"
+#include "test_support.h"
+
+namespace
+{
+    // each VBlank copies $40 bytes of code across two WRAM pages picked by
+    // the frame count, the second only written fused, bumps a byte in VRAM,
+    // OAM and HRAM, and writes the count into the RAM bank it picks
+    const char* const source = R"(
+        CART 3
+        RAMSIZE 3
+        ORG $150
+main:   ld a, $0A
+        ld [$0000], a
+        ld a, 1
+        ld [$6000], a
+        ld a, $01
+        ld [$FFFF], a
+        ei
+.loop:  halt
+        jr .loop
+
+vblank: ld hl, $C000
+        inc [hl]
+        ld a, [hl]
+        and 3
+        ld [$4000], a
+        ld a, [hl]
+        ld [$A010], a
+        and $0F
+        or $C0
+        ld d, a
+        ld e, $E0
+        ld hl, main
+        ld bc, $0040
+.copy:  ld a, [hl+]
+        ld [de], a
+        inc de
+        dec bc
+        ld a, b
+        or c
+        jr nz, .copy
+        ld hl, $9900
+        inc [hl]
+        ld hl, $FE10
+        inc [hl]
+        ld hl, $FF90
+        inc [hl]
+        reti
+)";
+
+    // the state a snapshot has to bring back
+    void compare(const std::string& what, const GameBoy::Snapshot& x, const GameBoy::Snapshot& y)
+    {
+        if (!(x.cpu.r == y.cpu.r) || x.cpu.ime != y.cpu.ime || x.cpu.halted != y.cpu.halted)
+            fail(what + ": cpu differs");
+        if (x.memory != y.memory)
+            fail(what + ": memory differs");
+        if (x.cartridge.ram != y.cartridge.ram || x.cartridge.bank2 != y.cartridge.bank2 || x.cartridge.mode != y.cartridge.mode)
+            fail(what + ": cartridge differs");
+        if (x.cycles != y.cycles)
+            fail(what + ": " + std::to_string(y.cycles) + " cycles, not " + std::to_string(x.cycles));
+    }
+}
+
+int main()
+{
+    const auto assembled = assemble_with_vectors(source);
+    if (!assembled.ok())
+        return EXIT_FAILURE;
+
+    GameBoy gb(assembled.rom);
+    std::vector<GameBoy::PagedSnapshot> paged;
+    std::vector<GameBoy::Snapshot> full;
+    for (size_t i = 0; i < 20; ++i)
+    {
+        for (size_t frame = 0; frame < 3; ++frame)
+            gb.run_frame();
+        paged.push_back(gb.paged_snapshot());
+        full.push_back(gb.snapshot());
+    }
+    if (gb.cartridge().ram_swaps() == 0 || full.back().memory[0xC000] < 50)
+        fail("the program didn't run");
+
+    // the first copies everything, the rest a few pages each, and every
+    // max_depth-th all of them again
+    const size_t total = paged[0].pages->at.size();
+    for (size_t i = 0; i < paged.size(); ++i)
+    {
+        const auto& pages = *paged[i].pages;
+        const size_t copied = pages.copies.size() / MemoryMap::page_size;
+        const bool first = (i % GameBoy::SnapshotPages::max_depth) == 0;
+        if (pages.depth != i % GameBoy::SnapshotPages::max_depth || (pages.parent == nullptr) != first)
+            fail("snapshot " + std::to_string(i) + " at depth " + std::to_string(pages.depth));
+        if (first ? copied != total : copied > 48)
+            fail("snapshot " + std::to_string(i) + " copied " + std::to_string(copied) + " of " + std::to_string(total) + " pages");
+        if (!first && pages.at[0] != paged[i - 1].pages->at[0])
+            fail("snapshot " + std::to_string(i) + " doesn't share VRAM's first page");
+    }
+
+    // back and forth, each restore copying only what differs
+    for (const size_t i : { 5, 19, 0, 8, 7, 9, 9, 15, 1 })
+    {
+        gb.restore(paged[i]);
+        compare("restored " + std::to_string(i), full[i], gb.snapshot());
+    }
+
+    // and on from there, the same as from a full snapshot
+    GameBoy reference(assembled.rom);
+    for (const size_t i : { 3, 12 })
+    {
+        gb.restore(paged[i]);
+        reference.restore(full[i]);
+        for (size_t frame = 0; frame < 5; ++frame)
+        {
+            gb.run_frame();
+            reference.run_frame();
+        }
+        compare("run on from " + std::to_string(i), reference.snapshot(), gb.snapshot());
+        if (gb.ppu().framebuffer() != reference.ppu().framebuffer())
+            fail("run on from " + std::to_string(i) + ": picture differs");
+    }
+
+    // a snapshot taken after a restore shares with the one restored
+    gb.restore(paged[4]);
+    const auto after = gb.paged_snapshot();
+    if (after.pages->parent != paged[4].pages || after.pages->copies.size() != MemoryMap::page_size)
+        fail("a snapshot straight after a restore copied " + std::to_string(after.pages->copies.size()) + " bytes");
+
+    return finish("paged snapshot: ");
+}
@@ -0,0 +1,145 @@
+// profiler_attribution.cpp : Runs a small program with nested calls and a
+// VBlank handler under the profiler, and checks that cycles add up across the
+// call tree, symbols resolve and the folded stacks come out right, the same
+// with a block cache set, which the profiler runs without.
+
+#include "pch.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include "assembler.h"
+#include "gameboy.h"
+#include "profiler.h"
+#include "test_support.h"
+
+namespace
+{
+    const char* const program = R"(
+        ORG $40
+vblank:
+        push af
+        pop af
+        reti
+
+        ORG $150
+main:
+        ld a, 1
+        ld [$FFFF], a
+        ei
+.loop:  call outer
+        jr .loop
+
+outer:
+        call inner
+        call inner
+        ret
+
+inner:
+        ld b, 20
+.spin:  dec b
+        jr nz, .spin
+        ret
+)";
+
+    const Profiler::FunctionStats* find(const std::vector<Profiler::FunctionStats>& functions, const std::string& name)
+    {
+        const auto found = std::find_if(functions.begin(), functions.end(), [&name](const auto& f) { return f.name == name; });
+        return found != functions.end() ? &*found : nullptr;
+    }
+
+    void check_symbols()
+    {
+        SymbolTable symbols;
+        std::stringstream sym("; comment\n00:0150 Main\n00:0160 Main.loop\n01:4000 Far\nnot a symbol\n");
+        symbols.load(sym);
+
+        if (symbols.size() != 3)
+            fail("symbol count " + std::to_string(symbols.size()));
+        if (symbols.name_for(GuestAddr{ 0, 0x0150 }) != "Main")
+            fail("exact symbol");
+        if (symbols.name_for(GuestAddr{ 0, 0x0168 }) != "Main.loop+$8")
+            fail("offset from symbol, got " + symbols.name_for(GuestAddr{ 0, 0x0168 }));
+        if (symbols.name_for(GuestAddr{ 2, 0x4001 }) != "02:4001")
+            fail("other bank, got " + symbols.name_for(GuestAddr{ 2, 0x4001 }));
+    }
+
+    // the folded stacks, the same whether there's a block cache or not
+    const std::string check_profile(const bool cached)
+    {
+        const std::string with = cached ? " with a block cache" : "";
+        const auto assembled = assemble_checked(program);
+        if (!assembled.ok())
+            return "";
+
+        SymbolTable symbols;
+        std::stringstream sym(format_symbols(assembled));
+        symbols.load(sym);
+
+        constexpr size_t interval = 64;
+        Profiler profiler(interval);
+        profiler.set_symbols(std::move(symbols));
+
+        GameBoy gb(assembled.rom);
+        if (cached)
+            gb.set_block_cache(make_shared<BlockCache>(assembled.rom));
+        for (size_t frame = 0; frame < 3; ++frame)
+            profiler.run_frame(gb);
+
+        if (profiler.cycles() != gb.cycles())
+            fail("profiler cycles " + std::to_string(profiler.cycles()) + " vs machine " + std::to_string(gb.cycles()) + with);
+
+        const auto functions = profiler.functions();
+        const auto root = find(functions, "[root]");
+        const auto outer = find(functions, "outer");
+        const auto inner = find(functions, "inner");
+        const auto vblank = find(functions, "vblank");
+        if (!root || !outer || !inner || !vblank)
+        {
+            fail("missing functions" + with);
+            return "";
+        }
+
+        uint64_t exclusive = 0;
+        for (const auto& function : functions)
+            exclusive += function.exclusive;
+        if (exclusive != profiler.cycles() || root->inclusive != profiler.cycles())
+            fail("exclusive cycles don't add up to the total" + with);
+
+        if (inner->calls < 2 * outer->calls - 1 || inner->calls > 2 * outer->calls)
+            fail("inner called " + std::to_string(inner->calls) + " times for " + std::to_string(outer->calls) + " outer" + with);
+        if (vblank->calls == 0 || vblank->calls > 4)
+            fail("vblank called " + std::to_string(vblank->calls) + " times" + with);
+        if (inner->inclusive < inner->exclusive || outer->inclusive < outer->exclusive + inner->exclusive)
+            fail("inclusive cycles below exclusive" + with);
+
+        std::stringstream folded;
+        profiler.write_folded(folded);
+        const auto text = folded.str();
+        if (text.find("[root];outer;inner ") == std::string::npos || text.find(";vblank ") == std::string::npos)
+            fail("folded stacks" + with + ":\n" + text);
+
+        uint64_t samples = 0;
+        for (const auto& [location, count] : profiler.samples())
+            samples += count;
+        if (samples != profiler.cycles() / interval)
+            fail("sample count " + std::to_string(samples) + with);
+
+        if (cached && gb.block_cache()->translated() != 0)
+            fail("the profiler ran cached blocks");
+
+        const auto hottest = profiler.samples().front().first;
+        if (hottest.addr < 0x150)
+            fail("hottest sample outside the program" + with);
+        return text;
+    }
+}
+
+int main()
+{
+    check_symbols();
+    if (check_profile(true) != check_profile(false))
+        fail("a block cache changed the profile");
+
+    return finish("profiler: ");
+}
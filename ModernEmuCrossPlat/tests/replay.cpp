@@ -0,0 +1,172 @@
+// replay.cpp : Records input to a program which reads the buttons all the
+// time and adds them up, changing them between frames and in the middle of
+// them, and checks a replay, from the start or seeking to a frame, gets the
+// state hash the recording had at every frame, with other settings than the
+// recording and after a round trip through the file. Then verifies it in
+// parallel, and that a log with an event changed is caught.
+
+#include "pch.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include "replay.h"
+#include "test_support.h"
+
+namespace
+{
+    // adds up both halves of the buttons, read over and over, and halts
+    // until the next VBlank while the sum is odd
+    const char* const source = R"(
+        CART 1
+        ORG $150
+main:   ld a, $01
+        ld [$FFFF], a
+        ei
+loop:   ld a, $10
+        ld [$FF00], a
+        ld a, [$FF00]
+        cpl
+        and $0F
+        ld hl, $C000
+        add a, [hl]
+        ld [hl+], a
+        ld a, $20
+        ld [$FF00], a
+        ld a, [$FF00]
+        cpl
+        and $0F
+        add a, [hl]
+        ld [hl], a
+        ld a, [$C000]
+        and 1
+        jr z, loop
+        halt
+        jr loop
+
+vblank: push af
+        ld a, [$C002]
+        inc a
+        ld [$C002], a
+        pop af
+        reti
+)";
+
+    constexpr size_t frames = 240;
+    constexpr size_t keyframe_interval = 50;
+}
+
+int main()
+{
+    const auto assembled = assemble_with_vectors(source);
+    if (!assembled.ok())
+        return EXIT_FAILURE;
+    const auto& rom = assembled.rom;
+
+    // the hash at the start of each frame, as recorded
+    GameBoy gb(rom);
+    gb.run_frame();
+    InputLog log(keyframe_interval);
+    Recorder recorder(gb, log);
+    std::vector<uint64_t> hashes{ gb.state_hash() };
+    uint32_t random = 12345;
+    while (recorder.frame() < frames)
+    {
+        random = random * 1103515245 + 12345;
+        const auto buttons = static_cast<uint8_t>(random >> 16);
+        if (random & 0x80000000)
+        {
+            // in the middle of the frame, a few instructions in
+            const uint64_t frame = recorder.frame();
+            for (size_t i = 0; i < ((random >> 8) & 0xFF) && recorder.frame() == frame; ++i)
+                recorder.step();
+            recorder.set_buttons(buttons);
+            while (recorder.frame() == frame)
+                recorder.step();
+        }
+        else
+        {
+            recorder.set_buttons(buttons);
+            recorder.run_frame();
+        }
+        hashes.push_back(gb.state_hash());
+    }
+    if (log.events().size() < frames / 2 || log.keyframes().size() != frames / keyframe_interval + 1 || log.end().frame != frames)
+        fail(std::to_string(log.events().size()) + " events, " + std::to_string(log.keyframes().size()) + " keyframes");
+    if (gb.snapshot().memory[0xC002] < frames)
+        fail("the program didn't run");
+
+    // through the file and back
+    std::stringstream file;
+    if (!log.write(file))
+        fail("can't write the log");
+    const std::string bytes = file.str();
+    InputLog read_back;
+    std::istringstream in(bytes);
+    if (!read_back.read(in) || read_back.events().size() != log.events().size() || read_back.keyframes().size() != log.keyframes().size()
+        || read_back.keyframe_interval() != keyframe_interval || read_back.end().state_hash != log.end().state_hash)
+        fail("the log read back differs");
+    InputLog cut_short;
+    std::istringstream short_in(bytes.substr(0, bytes.size() - 1));
+    if (cut_short.read(short_in))
+        fail("read a log cut short");
+
+    // played back from the start on translated blocks, every frame the same
+    {
+        GameBoy other(rom);
+        other.set_block_cache(make_shared<BlockCache>(rom));
+        Replay replay(other, read_back);
+        if (!replay.ok())
+            fail("can't start the replay");
+        for (size_t frame = 1; frame <= frames; ++frame)
+        {
+            if (!replay.run_frame() || other.state_hash() != hashes[frame])
+            {
+                fail("the replay went off at frame " + std::to_string(frame));
+                break;
+            }
+        }
+        if (replay.run_frame() || !replay.ok() || replay.frame() != frames)
+            fail("the replay went past the end");
+    }
+
+    // seeking, forwards and back, without fast forward
+    {
+        GameBoy other(rom);
+        other.set_fast_forward(false);
+        Replay replay(other, read_back);
+        for (const uint64_t frame : { uint64_t(237), uint64_t(12), uint64_t(150), uint64_t(149), uint64_t(0), uint64_t(frames) })
+        {
+            if (!replay.seek(frame) || replay.frame() != frame || other.state_hash() != hashes[frame])
+                fail("seeking to frame " + std::to_string(frame) + " went wrong");
+        }
+        if (replay.seek(frames + 1))
+            fail("sought past the end");
+        if (!replay.seek(3) || !replay.run_to_end())
+            fail("didn't run to the end");
+    }
+
+    // in parallel, a keyframe to the next each
+    const auto verified = Replay::verify(rom, read_back, 3);
+    if (!verified.ok || verified.frame != frames || verified.checked != read_back.keyframes().size())
+        fail("verifying found frame " + std::to_string(verified.frame) + " different, " + std::to_string(verified.checked) + " checked");
+
+    // the first event's buttons changed, after the 72 byte header and its
+    // LEB128 cycle count
+    {
+        std::string bad = bytes;
+        size_t at = 72;
+        while (static_cast<uint8_t>(bad[at]) & 0x80)
+            ++at;
+        bad[at + 1] = static_cast<char>(bad[at + 1] ^ 0x01);
+        InputLog changed;
+        std::istringstream bad_in(bad);
+        if (!changed.read(bad_in))
+            fail("can't read the changed log");
+        const auto caught = Replay::verify(rom, changed, 2);
+        if (caught.ok || caught.frame > keyframe_interval)
+            fail("a changed event was caught at frame " + std::to_string(caught.frame));
+    }
+
+    return finish("replay: " + std::to_string(log.events().size()) + " events, " + std::to_string(bytes.size()) + " bytes, ");
+}
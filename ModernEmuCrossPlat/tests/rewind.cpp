@@ -0,0 +1,183 @@
+// rewind.cpp : Pushes every frame of a program which changes a little
+// memory each frame and redraws, and checks any frame held comes back the
+// same as it was saved, the budget is kept to by dropping whole keyframes,
+// and rewinding then running on numbers the frames from there. Also round
+// trips the delta encoding on its edge cases.
+
+#include "pch.h"
+
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "gameboy.h"
+#include "rewind.h"
+#include "test_support.h"
+
+namespace
+{
+    // a frame counter, a scrolling background and a byte of cartridge RAM
+    const char* const source = R"(
+        CART 3
+        RAMSIZE 2
+        ORG $150
+main:   ld a, $0A
+        ld [$0000], a
+        ld a, $01
+        ld [$FFFF], a
+        ei
+.loop:  halt
+        jr .loop
+
+vblank: ld hl, $C000
+        inc [hl]
+        ld a, [hl]
+        ld [$A000], a
+        ldh [$FF43], a
+        ld l, a
+        ld h, $98
+        inc [hl]
+        reti
+)";
+
+    const std::vector<uint8_t> save(const GameBoy& gb)
+    {
+        std::vector<uint8_t> state(gb.saved_size());
+        BufferSink sink(state.data(), state.size());
+        gb.save(sink);
+        return state;
+    }
+
+    void check_encoding()
+    {
+        std::mt19937 random(7);
+        for (const size_t size : { size_t(0), size_t(8), size_t(64), size_t(4096) })
+        {
+            std::vector<uint8_t> base(size);
+            for (auto& b : base)
+                b = static_cast<uint8_t>(random());
+
+            // nothing changed, everything changed, every other word and a
+            // long run past the one byte counts
+            for (size_t pattern = 0; pattern < 4; ++pattern)
+            {
+                auto state = base;
+                for (size_t i = 0; i < size; ++i)
+                {
+                    const bool change = pattern == 1 || (pattern == 2 && (i / 8) % 2 == 0) || (pattern == 3 && i >= 8 && i < 8 + 200 * 8);
+                    if (change)
+                        state[i] = static_cast<uint8_t>(~state[i]);
+                }
+
+                std::vector<uint8_t> encoded(Rewind::max_encoded(size));
+                const size_t encoded_size = Rewind::encode(state.data(), base.data(), size, encoded.data());
+                auto decoded = base;
+                if (!Rewind::apply(encoded.data(), encoded_size, decoded.data(), size) || decoded != state)
+                    fail("pattern " + std::to_string(pattern) + " over " + std::to_string(size) + " bytes doesn't round trip");
+                if (pattern == 0 && encoded_size != 0)
+                    fail("no change encoded in " + std::to_string(encoded_size) + " bytes");
+
+                // and against nothing, the way keyframes are
+                std::vector<uint8_t> whole(size);
+                const size_t whole_size = Rewind::encode(state.data(), nullptr, size, encoded.data());
+                if (!Rewind::apply(encoded.data(), whole_size, whole.data(), size) || whole != state)
+                    fail("pattern " + std::to_string(pattern) + " doesn't round trip as a keyframe");
+            }
+        }
+
+        // a delta running past the state is refused
+        std::vector<uint8_t> state(16, 0xAA);
+        std::vector<uint8_t> encoded(Rewind::max_encoded(16));
+        const size_t encoded_size = Rewind::encode(state.data(), nullptr, 16, encoded.data());
+        if (Rewind::apply(encoded.data(), encoded_size, state.data(), 8) || Rewind::apply(encoded.data(), encoded_size - 1, state.data(), 16))
+            fail("applied a delta past the state");
+    }
+}
+
+int main()
+{
+    check_encoding();
+
+    const auto assembled = assemble_with_vectors(source);
+    if (!assembled.ok())
+        return EXIT_FAILURE;
+
+    // room for all of it
+    {
+        GameBoy gb(assembled.rom);
+        Rewind rewind(16 << 20, 20);
+        std::vector<std::vector<uint8_t>> states;
+        for (size_t frame = 0; frame < 150; ++frame)
+        {
+            gb.run_frame();
+            if (!rewind.push(gb))
+                fail("can't push frame " + std::to_string(frame));
+            states.push_back(save(gb));
+        }
+        if (rewind.frames() != 150 || rewind.oldest() != 0 || rewind.newest() != 149)
+            fail("holding " + std::to_string(rewind.frames()) + " frames");
+        // deltas are mostly the picture, keyframes mostly zeros
+        if (rewind.used() > 150 * 8000)
+            fail(std::to_string(rewind.used()) + " bytes for 150 frames");
+
+        GameBoy seeker(assembled.rom);
+        for (const uint64_t frame : { 149, 0, 75, 148, 20, 19, 21, 139, 140, 141, 100 })
+        {
+            if (!rewind.seek(seeker, frame) || save(seeker) != states[frame])
+                fail("frame " + std::to_string(frame) + " didn't come back");
+        }
+        if (rewind.seek(seeker, 150))
+            fail("sought a frame not pushed yet");
+
+        // back 30 and on again, the frames after are replaced
+        if (!rewind.rewind(gb, 30) || save(gb) != states[119] || rewind.newest() != 119)
+            fail("rewind by 30 didn't land on frame 119");
+        gb.set_buttons(0);
+        for (size_t frame = 0; frame < 10; ++frame)
+        {
+            gb.run_frame();
+            rewind.push(gb);
+        }
+        if (rewind.newest() != 129 || save(gb) != states[129])
+            fail("running on after the rewind didn't get back to frame 129");
+        if (!rewind.seek(seeker, 125) || save(seeker) != states[125])
+            fail("frame 125 didn't come back after the rewind");
+        if (!rewind.rewind(gb, 129) || save(gb) != states[0] || rewind.rewind(gb, 1))
+            fail("rewind all the way didn't stop at frame 0");
+    }
+
+    // room for a few keyframes, the oldest dropped with their deltas
+    {
+        GameBoy gb(assembled.rom);
+        Rewind rewind(5000, 10);
+        std::vector<std::vector<uint8_t>> states;
+        for (size_t frame = 0; frame < 200; ++frame)
+        {
+            gb.run_frame();
+            rewind.push(gb);
+            states.push_back(save(gb));
+            if (rewind.used() > rewind.budget())
+                fail("over budget at frame " + std::to_string(frame));
+        }
+        if (rewind.newest() != 199 || rewind.oldest() == 0 || rewind.oldest() % 10 != 0)
+            fail("holding " + std::to_string(rewind.oldest()) + " to " + std::to_string(rewind.newest()));
+        GameBoy seeker(assembled.rom);
+        for (uint64_t frame = rewind.oldest(); frame <= rewind.newest(); frame += 7)
+        {
+            if (!rewind.seek(seeker, frame) || save(seeker) != states[frame])
+                fail("frame " + std::to_string(frame) + " didn't come back from a full ring");
+        }
+        if (rewind.seek(seeker, rewind.oldest() - 1))
+            fail("sought a dropped frame");
+    }
+
+    // too small for even one frame
+    {
+        GameBoy gb(assembled.rom);
+        Rewind rewind(64);
+        if (rewind.push(gb) || !rewind.empty())
+            fail("pushed a frame bigger than the budget");
+    }
+
+    return finish("rewind: ");
+}
@@ -0,0 +1,223 @@
+// rollback.cpp : Runs two machines linked by cable on a program which adds
+// up the buttons and sends the sum across, late in the frame, while START
+// is held, and checks both players' rollback sessions, over a loopback with
+// delay and jitter, agree with a run that knew every input in time, frame
+// by frame once the inputs are in. A delay longer than the rollback window
+// has to stall rather than roll back further, and buttons that never change
+// never roll back at all.
+
+#include "pch.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include "rollback.h"
+#include "test_support.h"
+
+namespace
+{
+    // $C000 the buttons added up, $C001 the bytes received added up and
+    // $C002 how many. With START held the sum is sent from line 140, so the
+    // byte is still on its way at the end of the frame, otherwise each
+    // VBlank waits for the other side to send
+    const char* const source = R"(
+        CART 1
+        ORG $150
+main:   ld a, 140
+        ld [$FF45], a
+        ld a, $40
+        ld [$FF41], a
+        ld a, $0B
+        ld [$FFFF], a
+        ei
+wait:   halt
+        jr wait
+
+vblank: push af
+        push bc
+        ld a, $10
+        ld [$FF00], a
+        ld a, [$FF00]
+        cpl
+        and $0F
+        ld b, a
+        ld a, $20
+        ld [$FF00], a
+        ld a, [$FF00]
+        cpl
+        and $0F
+        swap a
+        or b
+        ld [$C003], a
+        ld b, a
+        ld a, [$C000]
+        add a, b
+        ld [$C000], a
+        bit 7, b
+        jr nz, done
+        ld a, [$FF02]
+        bit 7, a
+        jr nz, done
+        ld a, [$C000]
+        ld [$FF01], a
+        ld a, $80
+        ld [$FF02], a
+done:   pop bc
+        pop af
+        reti
+
+stat:   push af
+        ld a, [$C003]
+        bit 7, a
+        jr z, quiet
+        ld a, [$C000]
+        ld [$FF01], a
+        ld a, $81
+        ld [$FF02], a
+quiet:  pop af
+        reti
+
+serial: push af
+        push bc
+        ld a, [$FF01]
+        ld b, a
+        ld a, [$C001]
+        add a, b
+        ld [$C001], a
+        ld a, [$C002]
+        inc a
+        ld [$C002], a
+        pop bc
+        pop af
+        reti
+)";
+
+    constexpr size_t frames = 300;
+
+    const uint64_t pair_hash(GameBoy& first, GameBoy& second)
+    {
+        return first.state_hash() * 0x9E3779B97F4A7C15ull + second.state_hash();
+    }
+
+    // each player's buttons, changing now and then
+    const std::array<std::vector<uint8_t>, 2> make_inputs(const bool change)
+    {
+        std::array<std::vector<uint8_t>, 2> inputs;
+        uint32_t random = 12345;
+        for (auto& player : inputs)
+        {
+            uint8_t buttons = 0;
+            for (size_t frame = 0; frame < frames; ++frame)
+            {
+                random = random * 1103515245 + 12345;
+                if (change && ((random >> 28) & 3) == 0)
+                    buttons = static_cast<uint8_t>(random >> 16);
+                player.push_back(buttons);
+            }
+        }
+        return inputs;
+    }
+
+    // the hash at the start of each frame, with every input known in time
+    const std::vector<uint64_t> reference(const std::vector<uint8_t>& rom, const std::array<std::vector<uint8_t>, 2>& inputs,
+        uint64_t& transfers)
+    {
+        GameBoy first(rom);
+        GameBoy second(rom);
+        LinkCable cable(first, second);
+        std::vector<uint64_t> hashes{ pair_hash(first, second) };
+        for (size_t frame = 0; frame < frames; ++frame)
+        {
+            first.set_buttons(inputs[0][frame]);
+            second.set_buttons(inputs[1][frame]);
+            cable.run_frame();
+            hashes.push_back(pair_hash(first, second));
+        }
+        transfers = cable.transfers();
+        return hashes;
+    }
+
+    // both players' sessions to the end, checked wherever they have the
+    // inputs in
+    const std::array<RollbackSession::Stats, 2> play(const std::string& name, const std::vector<uint8_t>& rom,
+        const std::array<std::vector<uint8_t>, 2>& inputs, const std::vector<uint64_t>& hashes, LoopbackTransport& link)
+    {
+        RollbackSession first(rom, 0, link.side(0));
+        RollbackSession second(rom, 1, link.side(1));
+        std::array<RollbackSession*, 2> sessions = { &first, &second };
+        bool went_off = false;
+        for (size_t tick = 0; tick < frames * 20; ++tick)
+        {
+            bool finished = true;
+            for (size_t player = 0; player < sessions.size(); ++player)
+            {
+                auto& session = *sessions[player];
+                if (session.frame() < frames)
+                    session.advance(inputs[player][session.frame()]);
+                else
+                    session.poll();
+                if (!went_off && session.confirmed() >= session.frame()
+                    && pair_hash(session.machine(0), session.machine(1)) != hashes[session.frame()])
+                {
+                    fail(name + ", player " + std::to_string(player) + " went off by frame " + std::to_string(session.frame()));
+                    went_off = true;
+                }
+                finished = finished && session.frame() == frames && session.confirmed() == frames;
+            }
+            if (finished)
+                return { first.stats(), second.stats() };
+            link.tick();
+        }
+        fail(name + " didn't finish");
+        return { first.stats(), second.stats() };
+    }
+}
+
+int main()
+{
+    const auto assembled = assemble_with_vectors(source, { "vblank", "stat", "serial" });
+    if (!assembled.ok())
+        return EXIT_FAILURE;
+    const auto& rom = assembled.rom;
+
+    const auto inputs = make_inputs(true);
+    uint64_t transfers = 0;
+    const auto hashes = reference(rom, inputs, transfers);
+    if (transfers < 10)
+        fail("only " + std::to_string(transfers) + " bytes went over the cable");
+
+    // inside the window, guessing wrong now and then
+    {
+        LoopbackTransport link(3, 2, 7);
+        for (const auto& stats : play("3 frames late", rom, inputs, hashes, link))
+        {
+            if (stats.rollbacks == 0 || stats.longest > 8)
+                fail("3 frames late, " + std::to_string(stats.rollbacks) + " rollbacks, " + std::to_string(stats.longest) + " frames the longest");
+        }
+    }
+
+    // later than the window, which stalls
+    {
+        LoopbackTransport link(12);
+        for (const auto& stats : play("12 frames late", rom, inputs, hashes, link))
+        {
+            if (stats.stalls == 0 || stats.longest > 8)
+                fail("12 frames late, " + std::to_string(stats.stalls) + " stalls, " + std::to_string(stats.longest) + " frames the longest");
+        }
+    }
+
+    // nothing pressed, nothing to guess wrong
+    {
+        const auto idle = make_inputs(false);
+        uint64_t idle_transfers = 0;
+        const auto idle_hashes = reference(rom, idle, idle_transfers);
+        LoopbackTransport link(3);
+        for (const auto& stats : play("nothing pressed", rom, idle, idle_hashes, link))
+        {
+            if (stats.rollbacks != 0)
+                fail("nothing pressed, " + std::to_string(stats.rollbacks) + " rollbacks");
+        }
+    }
+
+    return finish("rollback: " + std::to_string(transfers) + " bytes sent, ");
+}
@@ -0,0 +1,167 @@
+// rom_index.cpp : Indexes a directory of assembled ROMs, one with DAA in a
+// loop, one with DAA outside of any and a copy in bank 1, and checks the
+// counts, the idioms and the cartridge type come back from the file the
+// same as they were scanned, and the same on one thread as on several.
+
+#include "pch.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#include "rom_index.h"
+#include "test_support.h"
+
+namespace
+{
+    // DAA in a BCD counter loop, waiting on LY, and a HALT loop, after
+    // vectors which all return
+    const char* const daa_loop = R"(
+LY      EQU $FF44
+        ORG $150
+main:   xor a
+.count: add a, 1
+        daa
+        ld [$C000], a
+        jr nz, .count
+.wait:  ldh a, [LY]
+        cp 144
+        jr nz, .wait
+.halt:  halt
+        jr .halt
+)";
+
+    // DAA once, then a copy in bank 1 and a jump table
+    const char* const banked_copy = R"(
+        CART 1
+        ORG $150
+main:   ld a, $19
+        daa
+        ld a, 1
+        ld [$2000], a
+        call $4000
+        ld hl, table
+        jp hl
+table:  dw main
+
+        BANK 1
+        ORG $4000
+        ld hl, $0000
+        ld de, $C000
+        ld bc, $0100
+.copy:  ld a, [hl+]
+        ld [de], a
+        inc de
+        dec bc
+        ld a, b
+        or c
+        jr nz, .copy
+        ret
+
+        BANK 3
+        ORG $4000
+        db 0
+)";
+
+    const std::vector<uint8_t> build(const std::string& source)
+    {
+        return assemble_checked(source).rom;
+    }
+
+    void write(const std::filesystem::path& path, const std::vector<uint8_t>& data)
+    {
+        std::ofstream out(path, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    }
+
+    const uint32_t uses(const RomIndex& index, const size_t i, const uint16_t op, const bool hot)
+    {
+        const auto* count = index.find(i, op);
+        return count ? (hot ? count->hot : count->count) : 0;
+    }
+}
+
+int main()
+{
+    const auto dir = std::filesystem::temp_directory_path() / "rom_index_test";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "more");
+    write(dir / "daa_loop.gb", build(interrupt_vectors({}) + daa_loop));
+    write(dir / "more" / "banked_copy.GBC", build(banked_copy));
+    write(dir / "notes.txt", { 'h', 'i' });
+    if (failures != 0)
+        return EXIT_FAILURE;
+
+    const auto summaries = RomIndex::scan_directory(dir.string(), 4);
+    const auto serial = RomIndex::scan_directory(dir.string(), 1);
+    if (summaries.size() != 2 || serial.size() != 2)
+    {
+        fail(std::to_string(summaries.size()) + " ROMs scanned");
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < summaries.size(); ++i)
+    {
+        if (summaries[i].name != serial[i].name || summaries[i].ops.size() != serial[i].ops.size()
+            || std::memcmp(&summaries[i].record, &serial[i].record, sizeof(RomIndex::Record)) != 0)
+            fail(summaries[i].name + " scanned differently on one thread");
+    }
+
+    const auto path = (dir / "corpus.index").string();
+    if (!RomIndex::save(path, summaries))
+        fail("can't save " + path);
+    RomIndex index;
+    if (!index.load(path) || index.size() != 2)
+    {
+        fail("can't load " + path);
+        return EXIT_FAILURE;
+    }
+
+    // sorted by path
+    if (index.name(0) != "daa_loop.gb" || index.name(1) != "more/banked_copy.GBC")
+        fail("named " + std::string(index.name(0)) + " and " + std::string(index.name(1)));
+
+    const auto& loop = index.record(0);
+    if (RomIndex::mbc_name(loop.cart_type) != "ROM" || loop.banks != 2)
+        fail("daa_loop is " + std::string(RomIndex::mbc_name(loop.cart_type)) + " with " + std::to_string(loop.banks) + " banks");
+    if (uses(index, 0, 0x27, false) != 1 || uses(index, 0, 0x27, true) != 1)
+        fail("DAA in daa_loop's loop not found");
+    if (loop.idioms != (RomIndex::IdleWait | RomIndex::HaltLoop))
+        fail("daa_loop idioms " + std::to_string(loop.idioms));
+    if (uses(index, 0, 0xF0, true) != 1 || loop.hot_instructions != 9 || loop.instructions != 17)
+        fail("daa_loop has " + std::to_string(loop.hot_instructions) + " of " + std::to_string(loop.instructions) + " instructions hot");
+
+    const auto& banked = index.record(1);
+    if (RomIndex::mbc_name(banked.cart_type) != "MBC1" || banked.banks != 4)
+        fail("banked_copy is " + std::string(RomIndex::mbc_name(banked.cart_type)) + " with " + std::to_string(banked.banks) + " banks");
+    if (uses(index, 1, 0x27, false) != 1 || uses(index, 1, 0x27, true) != 0)
+        fail("banked_copy's DAA counted in a loop");
+    if (banked.idioms != (RomIndex::Copy16 | RomIndex::BankSwitch | RomIndex::JumpTable))
+        fail("banked_copy idioms " + std::to_string(banked.idioms));
+    // the copy is in bank 1, found through the bank switch
+    if (uses(index, 1, 0x2A, true) != 1 || uses(index, 1, 0x76, false) != 0 || index.find(1, 0x176) != nullptr)
+        fail("banked_copy's copy loop not counted");
+
+    // opcodes sorted, and every one counted in the summary
+    for (size_t i = 0; i < index.size(); ++i)
+    {
+        uint64_t total = 0;
+        for (auto* count = index.ops_begin(i); count != index.ops_end(i); ++count)
+        {
+            total += count->count;
+            if (count != index.ops_begin(i) && count[-1].op >= count->op)
+                fail("opcodes out of order");
+        }
+        if (total != index.record(i).instructions)
+            fail(std::string(index.name(i)) + " counts " + std::to_string(total) + " instructions");
+    }
+
+    // cut short, it's not an index
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+    RomIndex cut;
+    if (cut.load(path) || cut.size() != 0)
+        fail("loaded a cut short index");
+    std::filesystem::remove_all(dir);
+
+    return finish("rom index: ");
+}
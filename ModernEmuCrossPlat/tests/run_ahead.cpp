@@ -0,0 +1,101 @@
+// run_ahead.cpp : Runs a program which shades the screen by the A and B
+// buttons read two VBlanks before, and checks that run-ahead of N frames
+// shows the buttons from N frames later than a plain run does, all of them
+// the ones just pressed from 2 frames on. The machine itself has to end up
+// where a plain run with the same buttons does, frame by frame.
+
+#include "pch.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "run_ahead.h"
+#include "test_support.h"
+
+namespace
+{
+    // each VBlank reads A and B into $C000, moves the last ones to $C001
+    // and those into BGP, whose low two bits shade the blank background
+    const char* const source = R"(
+        CART 1
+        ORG $150
+main:   ld a, $01
+        ld [$FFFF], a
+        ei
+wait:   halt
+        jr wait
+
+vblank: push af
+        push bc
+        ld a, $10
+        ld [$FF00], a
+        ld a, [$FF00]
+        cpl
+        and $03
+        ld b, a
+        ld a, [$C001]
+        ld [$FF47], a
+        ld a, [$C000]
+        ld [$C001], a
+        ld a, b
+        ld [$C000], a
+        pop bc
+        pop af
+        reti
+)";
+
+    constexpr size_t frames = 60;
+    constexpr size_t lag = 2;
+}
+
+int main()
+{
+    const auto assembled = assemble_with_vectors(source);
+    if (!assembled.ok())
+        return EXIT_FAILURE;
+    const auto& rom = assembled.rom;
+
+    std::vector<uint8_t> buttons;
+    uint32_t random = 12345;
+    for (size_t frame = 0; frame < frames; ++frame)
+    {
+        random = random * 1103515245 + 12345;
+        buttons.push_back(static_cast<uint8_t>(random >> 16));
+    }
+
+    for (const size_t ahead : { size_t(0), size_t(1), size_t(2), size_t(3) })
+    {
+        GameBoy plain(rom);
+        GameBoy gb(rom);
+        RunAhead run_ahead(gb, ahead);
+        for (size_t frame = 0; frame < frames; ++frame)
+        {
+            plain.set_buttons(buttons[frame]);
+            plain.run_frame();
+            const auto& picture = run_ahead.run_frame(buttons[frame]);
+            if (gb.state_hash() != plain.state_hash() || gb.cycles() != plain.cycles())
+            {
+                fail(std::to_string(ahead) + " ahead, the machine went off at frame " + std::to_string(frame));
+                break;
+            }
+
+            // A is shade 1 and B shade 2, from the buttons lag frames back,
+            // and no later than now, as the frames ahead hold them
+            if (frame + ahead < lag + 1)
+                continue;
+            const size_t shown = std::min(frame, frame + ahead - lag);
+            const uint8_t expected = ((buttons[shown] & BUTTON_A) ? 1 : 0) | ((buttons[shown] & BUTTON_B) ? 2 : 0);
+            if (std::any_of(picture.begin(), picture.end(), [&](const uint8_t pixel) { return pixel != expected; }))
+            {
+                fail(std::to_string(ahead) + " ahead, frame " + std::to_string(frame) + " shows " + std::to_string(picture[0])
+                    + " not " + std::to_string(expected));
+                break;
+            }
+        }
+        if (run_ahead.frames() != ahead || gb.ppu().render() != true)
+            fail(std::to_string(ahead) + " ahead, the settings changed");
+    }
+
+    return finish("run_ahead: ");
+}
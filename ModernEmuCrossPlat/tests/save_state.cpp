@@ -0,0 +1,270 @@
+// save_state.cpp : Saves a banked MBC1 program with RAM while it renders,
+// runs on, loads the state back through a buffer, a file descriptor and a
+// mapped file, and checks it goes on to the same state each time. Then
+// checks states with an unknown chunk or a longer chunk still load, and cut
+// short, newer or other ROM ones don't.
+
+#include "pch.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#include "gameboy.h"
+#include "mapped_file.h"
+#include "test_support.h"
+
+namespace
+{
+    // counts frames on VBlank, into a RAM bank picked by the count, and calls
+    // into a ROM bank picked by it too, with the timer running
+    const char* const source = R"(
+        CART 3
+        RAMSIZE 3
+TAC     EQU $FF07
+        ORG $150
+main:   ld a, $0A
+        ld [$0000], a
+        ld a, 1
+        ld [$6000], a
+        ld a, $05
+        ldh [TAC], a
+        ld a, $05
+        ld [$FFFF], a
+        ei
+.loop:  halt
+        ld a, [$C000]
+        and 3
+        or 1
+        ld [$2000], a
+        call $4000
+        jr .loop
+
+vblank: push af
+        push hl
+        ld hl, $C000
+        inc [hl]
+        ld a, [hl]
+        and 3
+        ld [$4000], a
+        ld a, [hl]
+        ld [$A000], a
+        ld hl, $9800
+        inc [hl]
+        pop hl
+        pop af
+        reti
+
+        BANK 1
+        ORG $4000
+        ld hl, $C001
+        inc [hl]
+        ret
+
+        BANK 2
+        ORG $4000
+        ld hl, $C002
+        inc [hl]
+        ret
+
+        BANK 3
+        ORG $4000
+        ld hl, $C003
+        inc [hl]
+        ret
+)";
+
+    constexpr size_t frames = 12;
+
+    const std::vector<uint8_t> save(const GameBoy& gb)
+    {
+        std::vector<uint8_t> state(gb.saved_size());
+        BufferSink sink(state.data(), state.size());
+        if (!gb.save(sink) || sink.size() != state.size())
+            fail("saved " + std::to_string(sink.size()) + " of " + std::to_string(state.size()) + " bytes");
+        return state;
+    }
+
+    bool load(GameBoy& gb, const std::vector<uint8_t>& state)
+    {
+        BufferSource source(state.data(), state.size());
+        return gb.load(source) && source.offset() == state.size();
+    }
+
+    // the same everywhere a state reaches
+    void compare(const std::string& what, GameBoy& a, GameBoy& b)
+    {
+        const auto x = a.snapshot();
+        const auto y = b.snapshot();
+        if (!(x.cpu.r == y.cpu.r) || x.cpu.ime != y.cpu.ime || x.cpu.halted != y.cpu.halted)
+            fail(what + ": cpu differs");
+        if (x.memory != y.memory)
+            fail(what + ": memory differs");
+        if (x.cartridge.ram != y.cartridge.ram || x.cartridge.bank1 != y.cartridge.bank1 || x.cartridge.bank2 != y.cartridge.bank2)
+            fail(what + ": cartridge differs");
+        if (x.cycles != y.cycles)
+            fail(what + ": " + std::to_string(y.cycles) + " cycles, not " + std::to_string(x.cycles));
+        if (a.ppu().framebuffer() != b.ppu().framebuffer())
+            fail(what + ": picture differs");
+        for (const uint16_t reg : { Timer::DIV, Timer::TIMA, Ppu::STAT, Ppu::LY })
+        {
+            if (a.bus().read(reg) != b.bus().read(reg))
+                fail(what + ": register " + std::to_string(reg) + " differs");
+        }
+    }
+
+    void run(GameBoy& gb, const size_t count)
+    {
+        for (size_t frame = 0; frame < count; ++frame)
+            gb.run_frame();
+    }
+
+    // the chunks of a state, as tag and payload
+    const std::vector<std::pair<save_state::ChunkHeader, std::vector<uint8_t>>> chunks(const std::vector<uint8_t>& state)
+    {
+        std::vector<std::pair<save_state::ChunkHeader, std::vector<uint8_t>>> list;
+        for (size_t at = sizeof(save_state::Header); at + sizeof(save_state::ChunkHeader) <= state.size();)
+        {
+            save_state::ChunkHeader header;
+            std::memcpy(&header, state.data() + at, sizeof(header));
+            at += sizeof(header);
+            list.emplace_back(header, std::vector<uint8_t>(state.begin() + at, state.begin() + at + header.size));
+            at += header.size;
+        }
+        return list;
+    }
+
+    // a state put back together from the header and chunks
+    const std::vector<uint8_t> join(const std::vector<uint8_t>& state, const std::vector<std::pair<save_state::ChunkHeader, std::vector<uint8_t>>>& list)
+    {
+        std::vector<uint8_t> joined(state.begin(), state.begin() + sizeof(save_state::Header));
+        for (auto [header, payload] : list)
+        {
+            header.size = static_cast<uint32_t>(payload.size());
+            const auto* bytes = reinterpret_cast<const uint8_t*>(&header);
+            joined.insert(joined.end(), bytes, bytes + sizeof(header));
+            joined.insert(joined.end(), payload.begin(), payload.end());
+        }
+        return joined;
+    }
+}
+
+int main()
+{
+    const auto assembled = assemble_with_vectors(source);
+    if (!assembled.ok())
+        return EXIT_FAILURE;
+
+    GameBoy gb(assembled.rom);
+    gb.set_render(true);
+    run(gb, frames);
+    const auto state = save(gb);
+    const auto picture = gb.ppu().framebuffer();
+
+    // on from the save, then back and on again
+    run(gb, frames);
+    GameBoy later(assembled.rom);
+    if (!load(later, save(gb)))
+        fail("can't load a state into a new machine");
+    compare("loaded later", gb, later);
+
+    if (!load(gb, state))
+        fail("can't load the state back");
+    if (gb.ppu().framebuffer() != picture)
+        fail("picture not loaded");
+    run(gb, frames);
+    compare("run again", later, gb);
+
+    // a new machine, loaded from a buffer
+    GameBoy fresh(assembled.rom);
+    fresh.set_render(true);
+    if (!load(fresh, state))
+        fail("can't load into a new machine");
+    run(fresh, frames);
+    compare("new machine", later, fresh);
+    const auto ran = later.snapshot();
+    if (ran.memory[0xC000] < frames || ran.memory[0xC003] == 0 || ran.cartridge.ram[3 * 0x2000] == 0)
+        fail("the program didn't run");
+
+    // through a file descriptor
+    {
+        GameBoy from_fd(assembled.rom);
+        from_fd.set_render(true);
+        if (!load(from_fd, state))
+            fail("can't load to save");
+        std::FILE* file = std::tmpfile();
+        FdSink sink(fileno(file));
+        if (!from_fd.save(sink))
+            fail("can't save to a file");
+        GameBoy other(assembled.rom);
+        std::fseek(file, 0, SEEK_SET);
+        FdSource source(fileno(file));
+        if (!other.load(source))
+            fail("can't load from a file");
+        std::fclose(file);
+        run(other, frames);
+        compare("file descriptor", later, other);
+    }
+
+    // from a mapped file
+    {
+        const auto path = (std::filesystem::temp_directory_path() / "save_state_test.state").string();
+        {
+            std::ofstream out(path, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(state.data()), static_cast<std::streamsize>(state.size()));
+        }
+        MappedFile file;
+        GameBoy mapped(assembled.rom);
+        mapped.set_render(true);
+        if (!file.open(path))
+            fail("can't map " + path);
+        BufferSource source(file.data(), file.size());
+        if (!mapped.load(source))
+            fail("can't load from a mapped file");
+        file.close();
+        std::filesystem::remove(path);
+        run(mapped, frames);
+        compare("mapped file", later, mapped);
+    }
+
+    // no room
+    std::vector<uint8_t> small(state.size() - 1);
+    BufferSink sink(small.data(), small.size());
+    if (gb.save(sink))
+        fail("saved into too small a buffer");
+
+    // a chunk from the future, and a CPU chunk which grew, still load
+    auto list = chunks(state);
+    if (list.size() != 10 || list.back().first.tag != save_state::end_tag)
+        fail(std::to_string(list.size()) + " chunks");
+    list.insert(list.end() - 1, { save_state::ChunkHeader{ { 'N', 'E', 'W', ' ' }, 1, 0, 0 }, std::vector<uint8_t>(37, 0xEE) });
+    list[0].second.resize(list[0].second.size() + 6, 0xEE);
+    GameBoy newer(assembled.rom);
+    newer.set_render(true);
+    if (!load(newer, join(state, list)))
+        fail("can't load a state with new chunks");
+    run(newer, frames);
+    compare("new chunks", later, newer);
+
+    // cut short, from a newer format, missing memory, or for another ROM
+    GameBoy refused(assembled.rom);
+    if (load(refused, std::vector<uint8_t>(state.begin(), state.end() - 1)))
+        fail("loaded a cut short state");
+    auto version = state;
+    version[8] = save_state::format_version + 1;
+    if (load(refused, version))
+        fail("loaded a newer format");
+    auto missing = chunks(state);
+    missing.erase(std::remove_if(missing.begin(), missing.end(), [](const auto& chunk) { return chunk.first.tag == save_state::memory_tag; }), missing.end());
+    if (load(refused, join(state, missing)))
+        fail("loaded a state without memory");
+    auto other_rom = assembled.rom;
+    other_rom[0x4001] ^= 1;
+    GameBoy other(other_rom);
+    if (load(other, state))
+        fail("loaded a state for another ROM");
+
+    return finish("save state: " + std::to_string(state.size()) + " bytes, ");
+}
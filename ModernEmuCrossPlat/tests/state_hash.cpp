@@ -0,0 +1,190 @@
+// state_hash.cpp : Steps a program which switches RAM banks, copies with a
+// fused loop and writes all over memory, and checks the hash kept up to date
+// as it goes is the one hashed from scratch, on a machine restored to the
+// same state, at every step. Then that a byte or a register changed changes
+// it, and restores, loads and clones bring back the same hash.
+
+#include "pch.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include "gameboy.h"
+#include "test_support.h"
+
+namespace
+{
+    // each VBlank bumps a counter, picks a RAM bank with it and writes it
+    // there, copies $40 bytes of code into a WRAM page it picks too, and
+    // bumps a byte in VRAM, OAM and HRAM
+    const char* const source = R"(
+        CART 3
+        RAMSIZE 3
+        ORG $150
+main:   ld a, $0A
+        ld [$0000], a
+        ld a, 1
+        ld [$6000], a
+        ld a, $01
+        ld [$FFFF], a
+        ei
+.loop:  halt
+        jr .loop
+
+vblank: ld hl, $C000
+        inc [hl]
+        ld a, [hl]
+        and 3
+        ld [$4000], a
+        ld a, [hl]
+        ld [$A010], a
+        and $0F
+        or $C0
+        ld d, a
+        ld e, $E0
+        ld hl, main
+        ld bc, $0040
+.copy:  ld a, [hl+]
+        ld [de], a
+        inc de
+        dec bc
+        ld a, b
+        or c
+        jr nz, .copy
+        ld hl, $9900
+        inc [hl]
+        ld hl, $FE10
+        inc [hl]
+        ld hl, $FF90
+        inc [hl]
+        reti
+)";
+
+    // hashed from nothing, on a machine which has never hashed before
+    const uint64_t fresh_hash(const std::vector<uint8_t>& rom, const GameBoy::Snapshot& snapshot)
+    {
+        GameBoy gb(rom);
+        gb.restore(snapshot);
+        return gb.state_hash();
+    }
+}
+
+int main()
+{
+    const auto assembled = assemble_with_vectors(source);
+    if (!assembled.ok())
+        return EXIT_FAILURE;
+    const auto& rom = assembled.rom;
+
+    // kept up to date, against from scratch, every step for a few frames
+    // and then every frame, with paged snapshots taken in between clearing
+    // the pages they track
+    GameBoy gb(rom);
+    std::vector<uint64_t> hashes;
+    for (size_t frame = 0; frame < 24; ++frame)
+    {
+        if (frame < 4)
+        {
+            const uint64_t start = gb.cycles();
+            while (gb.cycles() - start < 70224)
+            {
+                gb.step();
+                if (gb.state_hash() != fresh_hash(rom, gb.snapshot()))
+                {
+                    fail("the hash went wrong at " + std::to_string(gb.cycles()) + " cycles");
+                    break;
+                }
+            }
+        }
+        else
+        {
+            gb.run_frame();
+            if (frame % 3 == 0)
+                gb.paged_snapshot();
+            if (gb.state_hash() != fresh_hash(rom, gb.snapshot()))
+                fail("the hash went wrong after frame " + std::to_string(frame));
+        }
+        hashes.push_back(gb.state_hash());
+    }
+    if (gb.cartridge().ram_swaps() < 4 || gb.snapshot().memory[0xC000] < 20)
+        fail("the program didn't run");
+
+    // asking again without running costs nothing and changes nothing, and
+    // each frame hashed differently
+    if (gb.state_hash() != hashes.back())
+        fail("asking twice gave two hashes");
+    std::sort(hashes.begin(), hashes.end());
+    if (std::adjacent_find(hashes.begin(), hashes.end()) != hashes.end())
+        fail("two frames hashed the same");
+
+    // a byte written, in WRAM or a RAM bank off the bus, or a register
+    // changed changes it, and changed back brings it back
+    const uint64_t before = gb.state_hash();
+    const uint8_t wram = gb.bus().peek(0xD123);
+    gb.bus().write(0xD123, static_cast<uint8_t>(wram ^ 0x40));
+    if (gb.state_hash() == before)
+        fail("a WRAM write didn't change the hash");
+    gb.bus().write(0xD123, wram);
+    if (gb.state_hash() != before)
+        fail("writing WRAM back didn't bring the hash back");
+    gb.cpu().set_pc(static_cast<uint16_t>(gb.cpu().get_pc() + 1));
+    if (gb.state_hash() == before)
+        fail("changing PC didn't change the hash");
+    gb.cpu().set_pc(static_cast<uint16_t>(gb.cpu().get_pc() - 1));
+    if (gb.state_hash() != before)
+        fail("setting PC back didn't bring the hash back");
+    {
+        auto snapshot = gb.snapshot();
+        const size_t other_bank = (gb.cartridge().mapped_ram_bank() + 1) % 4;
+        snapshot.cartridge.ram[other_bank * Cartridge::ram_bank_size + 0x10] ^= 0x80;
+        GameBoy other(rom);
+        other.restore(snapshot);
+        if (other.state_hash() == before)
+            fail("a byte of a RAM bank off the bus didn't change the hash");
+    }
+
+    // back to an earlier state, by a paged snapshot, a full one or a save
+    // state, and cloned, the hash is the one it had there
+    const auto paged = gb.paged_snapshot();
+    const auto full = gb.snapshot();
+    std::vector<uint8_t> saved(gb.saved_size());
+    BufferSink sink(saved.data(), saved.size());
+    if (!gb.save(sink))
+        fail("can't save");
+    const auto clone = gb.clone();
+    for (size_t frame = 0; frame < 5; ++frame)
+        gb.run_frame();
+    if (clone->state_hash() != before)
+        fail("a clone hashed differently");
+    if (gb.state_hash() == before)
+        fail("5 frames on hashed the same");
+    gb.restore(paged);
+    if (gb.state_hash() != before)
+        fail("a paged snapshot restored hashed differently");
+    for (size_t frame = 0; frame < 5; ++frame)
+        gb.run_frame();
+    gb.restore(full);
+    if (gb.state_hash() != before)
+        fail("a snapshot restored hashed differently");
+    for (size_t frame = 0; frame < 5; ++frame)
+        gb.run_frame();
+    BufferSource source_in(saved.data(), saved.size());
+    if (!gb.load(source_in) || gb.state_hash() != before)
+        fail("a save state loaded hashed differently");
+
+    // the same input gives the same hashes, other input other ones
+    for (size_t frame = 0; frame < 5; ++frame)
+    {
+        gb.set_buttons(BUTTON_A);
+        clone->set_buttons(BUTTON_A);
+        gb.run_frame();
+        clone->run_frame();
+        if (gb.state_hash() != clone->state_hash())
+            fail("the same input hashed differently in frame " + std::to_string(frame));
+    }
+    clone->set_buttons(BUTTON_B);
+    if (gb.state_hash() == clone->state_hash())
+        fail("other buttons hashed the same");
+
+    return finish("state_hash: ");
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <initializer_list>
+
+#include "assembler.h"
+#include "gameboy.h"
+
+// What the tests share. Each one counts what went wrong with fail() and
+// returns finish(), and most run programs built by assemble_with_vectors().
+// Those running a program two ways, to check a faster way runs it the same,
+// compare the machines with compare_machines().
+
+inline size_t failures = 0;
+
+inline void fail(const std::string& what)
+{
+    ++failures;
+    std::cout << "FAIL: " << what << std::endl;
+}
+
+// prints summary and the failures, "name: ..., N failures", and returns the
+// exit code
+inline int finish(const std::string& summary)
+{
+    std::cout << summary << failures << " failures" << std::endl;
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// $40 to $60, VBlank, STAT, timer, serial and joypad. The ones named in
+// handled jump to the label of that name, the rest return.
+inline const std::string interrupt_vectors(const std::initializer_list<const char*> handled)
+{
+    static constexpr const char* names[] = { "vblank", "stat", "timer", "serial", "joypad" };
+    static constexpr const char* addrs[] = { "$40", "$48", "$50", "$58", "$60" };
+    std::string vectors;
+    for (size_t i = 0; i < std::size(names); ++i)
+    {
+        const bool jumps = std::any_of(handled.begin(), handled.end(), [&](const char* name) { return std::string(name) == names[i]; });
+        vectors += std::string("        ORG ") + addrs[i] + "\n        " + (jumps ? std::string("jp ") + names[i] : "reti") + "\n";
+    }
+    return vectors;
+}
+
+// assembles source, failing with each error
+inline const AssembledRom assemble_checked(const std::string& source, const size_t first_line = 1)
+{
+    auto assembled = assemble(source);
+    for (const auto& error : assembled.errors)
+        fail("line " + std::to_string(error.line + 1 - first_line) + ": " + error.message);
+    return assembled;
+}
+
+// the same after interrupt_vectors(handled), program's lines counted from
+// its own first, which goes on from $150 with main
+inline const AssembledRom assemble_with_vectors(const std::string& program, const std::initializer_list<const char*> handled = { "vblank" })
+{
+    const auto vectors = interrupt_vectors(handled);
+    return assemble_checked(vectors + program, static_cast<size_t>(std::count(vectors.begin(), vectors.end(), '\n')) + 1);
+}
+
+// Fails where other isn't where plain is after frame: the CPU, memory, ROM
+// bank, picture, the timer and PPU registers read through the bus, and the
+// opcode counts, cycles and branches taken and not.
+template<class Machine>
+void compare_machines(Machine& plain, Machine& other, const size_t frame)
+{
+    const auto a = plain.snapshot();
+    const auto b = other.snapshot();
+    const std::string when = " after frame " + std::to_string(frame);
+    if (!(a.cpu.r == b.cpu.r) || a.cpu.ime != b.cpu.ime || a.cpu.halted != b.cpu.halted)
+        fail("cpu differs" + when);
+    if (a.memory != b.memory)
+        fail("memory differs" + when);
+    if (a.cartridge.bank1 != b.cartridge.bank1)
+        fail("bank differs" + when);
+    if (plain.ppu().framebuffer() != other.ppu().framebuffer())
+        fail("framebuffer differs" + when);
+    for (const uint16_t reg : { Timer::DIV, Timer::TIMA, Ppu::STAT, Ppu::LY })
+    {
+        if (plain.bus().read(reg) != other.bus().read(reg))
+            fail("register " + std::to_string(reg) + " differs" + when);
+    }
+
+    const auto& x = plain.cpu().stats();
+    const auto& y = other.cpu().stats();
+    for (size_t idx = 0; idx < OpcodeStats::opcode_count; ++idx)
+    {
+        if (x.count(idx) != y.count(idx) || x.cycles(idx) != y.cycles(idx))
+            fail("opcode " + std::to_string(idx) + " counted differently" + when);
+    }
+    for (size_t op = 0; op < 256; ++op)
+    {
+        if (x.taken(op) != y.taken(op) || x.untaken(op) != y.untaken(op))
+            fail("branch " + std::to_string(op) + " counted differently" + when);
+    }
+}
@@ -0,0 +1,55 @@
+// gbasm.cpp : Command line front end for the assembler in src/assembler.cpp,
+// writes a cartridge image with a valid header and optionally a .sym file.
+//
+// usage: gbasm <source.asm> <out.gb> [--sym out.sym]
+
+#include "pch.h"
+
+#include <cstdlib>
+
+#include "assembler.h"
+
+int main(int argc, char** argv)
+{
+    if (argc != 3 && !(argc == 5 && std::string(argv[3]) == "--sym"))
+    {
+        std::cerr << "usage: gbasm <source.asm> <out.gb> [--sym out.sym]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream in(argv[1]);
+    if (!in.is_open())
+    {
+        std::cerr << "gbasm: can't open " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::stringstream source;
+    source << in.rdbuf();
+
+    const auto assembled = assemble(source.str());
+    for (const auto& error : assembled.errors)
+        std::cerr << argv[1] << ":" << error.line << ": " << error.message << std::endl;
+    if (!assembled.ok())
+        return EXIT_FAILURE;
+
+    std::ofstream out(argv[2], std::ios::binary);
+    if (!out.is_open())
+    {
+        std::cerr << "gbasm: can't write " << argv[2] << std::endl;
+        return EXIT_FAILURE;
+    }
+    out.write(reinterpret_cast<const char*>(assembled.rom.data()), static_cast<std::streamsize>(assembled.rom.size()));
+
+    if (argc == 5)
+    {
+        std::ofstream sym(argv[4]);
+        if (!sym.is_open())
+        {
+            std::cerr << "gbasm: can't write " << argv[4] << std::endl;
+            return EXIT_FAILURE;
+        }
+        sym << format_symbols(assembled);
+    }
+
+    return out.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,90 @@
+// gbcov.cpp : Reports on coverage recorded with --coverage, see coverage.h.
+// Adds up any number of files for one ROM, writes the listing with what ran
+// marked, and optionally the sum as one file.
+//
+// usage: gbcov <rom.gb> <coverage>... [--out report.txt] [--merged FILE]
+//
+// The report goes to --out, or stdout, and a summary to stderr.
+
+#include "pch.h"
+
+#include <cstdlib>
+#include <iterator>
+
+#include "coverage.h"
+#include "disassembler.h"
+
+int main(int argc, char** argv)
+{
+    std::string rom_path;
+    std::vector<std::string> inputs;
+    std::string out_path;
+    std::string merged_path;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc)
+            out_path = argv[++i];
+        else if (arg == "--merged" && i + 1 < argc)
+            merged_path = argv[++i];
+        else if (rom_path.empty())
+            rom_path = arg;
+        else
+            inputs.push_back(arg);
+    }
+    if (rom_path.empty() || inputs.empty())
+    {
+        std::cerr << "usage: gbcov <rom.gb> <coverage>... [--out report.txt] [--merged FILE]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream in(rom_path, std::ios::binary);
+    if (!in.is_open())
+    {
+        std::cerr << "gbcov: can't open " << rom_path << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    Coverage coverage(rom);
+    for (const auto& path : inputs)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!coverage.merge(file))
+        {
+            std::cerr << "gbcov: " << path << " isn't coverage of " << rom_path << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!merged_path.empty())
+    {
+        std::ofstream merged(merged_path, std::ios::binary);
+        if (!coverage.write(merged))
+        {
+            std::cerr << "gbcov: can't write " << merged_path << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    Disassembler listing(std::move(rom));
+    listing.run();
+    if (out_path.empty())
+    {
+        coverage.write_report(std::cout, listing);
+    }
+    else
+    {
+        std::ofstream out(out_path);
+        if (!out.is_open())
+        {
+            std::cerr << "gbcov: can't write " << out_path << std::endl;
+            return EXIT_FAILURE;
+        }
+        coverage.write_report(out, listing);
+    }
+
+    std::cerr << "gbcov: " << coverage.bytes_run() << " of " << coverage.banks() * Cartridge::rom_bank_size << " ROM bytes ran, "
+        << coverage.edge_count() << " edges, from " << inputs.size() << " files" << std::endl;
+    return std::cout.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,72 @@
+// gbdis.cpp : Lists a whole ROM, code found by following control flow from
+// the entry point and the interrupt vectors, everything else as DB. See
+// disassembler.h for the format.
+//
+// usage: gbdis <rom.gb> [out.asm] [--threads N]
+//
+// The listing goes to out.asm, or stdout, and a summary to stderr.
+
+#include "pch.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iterator>
+
+#include "disassembler.h"
+
+int main(int argc, char** argv)
+{
+    std::string rom_path;
+    std::string out_path;
+    size_t threads = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc)
+            threads = std::stoul(argv[++i]);
+        else if (rom_path.empty())
+            rom_path = arg;
+        else if (out_path.empty())
+            out_path = arg;
+        else
+            rom_path.clear(), i = argc;
+    }
+    if (rom_path.empty())
+    {
+        std::cerr << "usage: gbdis <rom.gb> [out.asm] [--threads N]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream in(rom_path, std::ios::binary);
+    if (!in.is_open())
+    {
+        std::cerr << "gbdis: can't open " << rom_path << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const size_t rom_size = rom.size();
+
+    const auto start = std::chrono::steady_clock::now();
+    Disassembler disassembler(std::move(rom));
+    disassembler.run(threads);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (out_path.empty())
+    {
+        disassembler.write(std::cout);
+    }
+    else
+    {
+        std::ofstream out(out_path, std::ios::binary);
+        if (!out.is_open())
+        {
+            std::cerr << "gbdis: can't write " << out_path << std::endl;
+            return EXIT_FAILURE;
+        }
+        disassembler.write(out);
+    }
+
+    std::cerr << "gbdis: " << disassembler.banks() << " banks, " << disassembler.instructions() << " instructions, "
+        << disassembler.data_bytes() << " of " << rom_size << " bytes data, in " << seconds * 1000 << "ms" << std::endl;
+    return std::cout.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
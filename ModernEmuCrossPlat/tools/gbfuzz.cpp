@@ -0,0 +1,218 @@
+// gbfuzz.cpp : Fuzzes a ROM's joypad input, see fuzz_harness.h. Anything
+// but a finished run is a crash, reported with where the CPU was.
+//
+// With -DGBFUZZ_LIBFUZZER=ON it's a libFuzzer target, coverage going to
+// libFuzzer as extra counters:
+//
+//     GBFUZZ_ROM=game.gb gbfuzz corpus/
+//
+// Otherwise it has a driver of its own, which replays the inputs given, or
+// with none mutates the ones which found new edges for --runs runs, writing
+// crashing inputs to crash-N.bin:
+//
+// usage: gbfuzz [input...] [--runs N] [--seed N]
+//
+// Both read the rest from the environment: GBFUZZ_ROM, GBFUZZ_STATE for a
+// save state to start from, else GBFUZZ_BOOT_FRAMES to run from power on
+// first, and GBFUZZ_FRAMES_PER_INPUT, GBFUZZ_SETTLE_FRAMES,
+// GBFUZZ_MAX_FRAMES and GBFUZZ_STALL_FRAMES for the options.
+
+#include "pch.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <random>
+
+#include "fuzz_harness.h"
+
+namespace
+{
+    std::unique_ptr<GameBoy> machine;
+    std::unique_ptr<FuzzHarness> harness;
+
+    const size_t env_size(const char* name, const size_t fallback)
+    {
+        const char* value = std::getenv(name);
+        return (value && *value) ? std::stoul(value) : fallback;
+    }
+
+    const std::vector<uint8_t> read_file(const std::string& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    bool set_up()
+    {
+        const char* rom_path = std::getenv("GBFUZZ_ROM");
+        if (!rom_path)
+        {
+            std::cerr << "gbfuzz: set GBFUZZ_ROM to the ROM to fuzz" << std::endl;
+            return false;
+        }
+        auto rom = read_file(rom_path);
+        if (rom.empty())
+        {
+            std::cerr << "gbfuzz: can't read " << rom_path << std::endl;
+            return false;
+        }
+        machine = std::make_unique<GameBoy>(std::move(rom));
+
+        if (const char* state_path = std::getenv("GBFUZZ_STATE"))
+        {
+            const auto state = read_file(state_path);
+            BufferSource source(state.data(), state.size());
+            if (!machine->load(source))
+            {
+                std::cerr << "gbfuzz: can't load " << state_path << std::endl;
+                return false;
+            }
+        }
+        else
+        {
+            for (size_t frame = env_size("GBFUZZ_BOOT_FRAMES", 0); frame != 0; --frame)
+                machine->run_frame();
+        }
+
+        FuzzHarness::Options options;
+        options.frames_per_input = env_size("GBFUZZ_FRAMES_PER_INPUT", options.frames_per_input);
+        options.settle_frames = env_size("GBFUZZ_SETTLE_FRAMES", options.settle_frames);
+        options.max_frames = env_size("GBFUZZ_MAX_FRAMES", options.max_frames);
+        options.stall_frames = env_size("GBFUZZ_STALL_FRAMES", options.stall_frames);
+        harness = std::make_unique<FuzzHarness>(*machine, options);
+        return true;
+    }
+
+    void report(const FuzzHarness::Result& result)
+    {
+        std::cerr << "gbfuzz: " << FuzzHarness::outcome_name(result.outcome) << " after " << result.frames << " frames at "
+            << std::hex << std::setfill('0') << std::setw(2) << result.bank << ":" << std::setw(4) << result.pc
+            << std::dec << std::setfill(' ') << std::endl;
+    }
+}
+
+#ifdef GBFUZZ_LIBFUZZER
+
+extern "C" __attribute__((used, section("__libfuzzer_extra_counters"))) uint8_t gbfuzz_counters[FuzzHarness::map_size];
+
+extern "C" int LLVMFuzzerInitialize(int*, char***)
+{
+    if (!set_up())
+        std::exit(EXIT_FAILURE);
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    const auto result = harness->run(data, size);
+    std::memcpy(gbfuzz_counters, harness->coverage().data(), FuzzHarness::map_size);
+    if (result.outcome != FuzzHarness::Outcome::Finished)
+    {
+        report(result);
+        std::abort();
+    }
+    return 0;
+}
+
+#else
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> inputs;
+    size_t runs = 10000;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--runs" && i + 1 < argc)
+            runs = std::stoul(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else
+            inputs.push_back(arg);
+    }
+    if (!set_up())
+        return EXIT_FAILURE;
+
+    if (!inputs.empty())
+    {
+        bool crashed = false;
+        for (const auto& path : inputs)
+        {
+            const auto input = read_file(path);
+            const auto result = harness->run(input.data(), input.size());
+            std::cerr << path << ": " << harness->edges() << " edges" << std::endl;
+            if (result.outcome != FuzzHarness::Outcome::Finished)
+            {
+                report(result);
+                crashed = true;
+            }
+        }
+        return crashed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    // keeps the inputs which hit an edge nothing before did
+    std::mt19937 random(seed);
+    std::vector<std::vector<uint8_t>> corpus{ std::vector<uint8_t>(8, 0) };
+    std::vector<uint8_t> seen(FuzzHarness::map_size, 0);
+    size_t covered = 0;
+    size_t crashes = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t run = 0; run < runs; ++run)
+    {
+        auto input = corpus[random() % corpus.size()];
+        for (size_t changes = 1 + random() % 4; changes != 0; --changes)
+        {
+            const uint8_t buttons = static_cast<uint8_t>(1 << (random() % 8));
+            switch (random() % 3)
+            {
+            case 0:
+                if (!input.empty())
+                {
+                    input[random() % input.size()] ^= buttons;
+                    break;
+                }
+                [[fallthrough]];
+            case 1:
+                input.insert(input.begin() + random() % (input.size() + 1), buttons);
+                break;
+            default:
+                if (!input.empty())
+                    input.erase(input.begin() + random() % input.size());
+                break;
+            }
+        }
+
+        const auto result = harness->run(input.data(), input.size());
+        bool found = false;
+        const auto& coverage = harness->coverage();
+        for (size_t i = 0; i < FuzzHarness::map_size; ++i)
+        {
+            if (coverage[i] != 0 && seen[i] == 0)
+            {
+                seen[i] = 1;
+                ++covered;
+                found = true;
+            }
+        }
+        if (result.outcome != FuzzHarness::Outcome::Finished)
+        {
+            report(result);
+            const std::string path = "crash-" + std::to_string(crashes++) + ".bin";
+            std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(input.data()), static_cast<std::streamsize>(input.size()));
+        }
+        else if (found)
+        {
+            corpus.push_back(std::move(input));
+        }
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "gbfuzz: " << runs << " runs in " << seconds << "s (" << static_cast<size_t>(runs / std::max(seconds, 1e-9)) << "/s), "
+        << covered << " edges, " << corpus.size() << " inputs kept, " << crashes << " crashes" << std::endl;
+    return (crashes == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif
@@ -0,0 +1,226 @@
+// gbindex.cpp : Builds and queries an index of what a corpus of ROMs does,
+// see rom_index.h.
+//
+// usage: gbindex build <rom dir> <index> [--threads N]
+//        gbindex query <index> [--op OP] [--hot] [--idiom NAME] [--mbc NAME] [--limit N]
+//        gbindex ops <index> [--hot] [--limit N]
+//
+// query lists the ROMs which use OP (a mnemonic like DAA, or a number,
+// 0x100 and up for the CB page), inside a loop with --hot, and have every
+// idiom and cartridge type asked for, most uses first. ops ranks the opcodes
+// over the whole corpus.
+
+#include "pch.h"
+
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+
+#include "opcode_table.h"
+#include "rom_index.h"
+
+namespace
+{
+    const std::string upper(std::string text)
+    {
+        std::transform(text.begin(), text.end(), text.begin(), [](const char c) { return static_cast<char>(std::toupper(static_cast<unsigned char>(c))); });
+        return text;
+    }
+
+    const ParsedOpCode& entry(const uint16_t op)
+    {
+        return (op < 0x100) ? unprefixed_op_codes[op] : cbprefixed_op_codes[op & 0xFF];
+    }
+
+    // "LD A, (HL+)", "CB BIT 7, H"
+    const std::string op_text(const uint16_t op)
+    {
+        const auto& parsed = entry(op);
+        std::string text = (op < 0x100) ? "" : "CB ";
+        text += parsed.GetMnemonic();
+        if (!parsed.GetOperand1().empty())
+            text += " " + std::string(parsed.GetOperand1());
+        if (!parsed.GetOperand2().empty())
+            text += ", " + std::string(parsed.GetOperand2());
+        return text;
+    }
+
+    // every opcode spec names, empty if none
+    const std::vector<uint16_t> parse_ops(const std::string& spec)
+    {
+        std::vector<uint16_t> ops;
+        if (!spec.empty() && std::isdigit(static_cast<unsigned char>(spec[0])))
+        {
+            const unsigned long op = std::stoul(spec, nullptr, 0);
+            if (op < 0x200)
+                ops.push_back(static_cast<uint16_t>(op));
+            return ops;
+        }
+        const std::string mnemonic = upper(spec);
+        for (uint16_t op = 0; op < 0x200; ++op)
+        {
+            if (entry(op).IsValid() && entry(op).GetMnemonic() == mnemonic && op != 0xCB)
+                ops.push_back(op);
+        }
+        return ops;
+    }
+
+    const std::string idioms_text(const uint16_t idioms)
+    {
+        std::string text;
+        for (size_t i = 0; i < RomIndex::idiom_count; ++i)
+        {
+            if (idioms & (1 << i))
+                text += (text.empty() ? "" : ",") + std::string(RomIndex::idiom_name(i));
+        }
+        return text.empty() ? "-" : text;
+    }
+
+    int usage()
+    {
+        std::cerr << "usage: gbindex build <rom dir> <index> [--threads N]\n"
+            "       gbindex query <index> [--op OP] [--hot] [--idiom NAME] [--mbc NAME] [--limit N]\n"
+            "       gbindex ops <index> [--hot] [--limit N]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int build(const std::string& dir, const std::string& path, const size_t threads)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const auto summaries = RomIndex::scan_directory(dir, threads);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!RomIndex::save(path, summaries))
+        {
+            std::cerr << "gbindex: can't write " << path << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cerr << "gbindex: " << summaries.size() << " ROMs in " << seconds << "s" << std::endl;
+        return EXIT_SUCCESS;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+        return usage();
+    const std::string command = argv[1];
+
+    std::vector<std::string> args(argv + 2, argv + argc);
+    size_t threads = 0;
+    size_t limit = 0;
+    bool hot = false;
+    std::string op_spec;
+    std::string mbc;
+    uint16_t idioms = 0;
+    std::vector<std::string> positional;
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        const bool has_value = i + 1 < args.size();
+        if (args[i] == "--threads" && has_value)
+            threads = std::stoul(args[++i]);
+        else if (args[i] == "--limit" && has_value)
+            limit = std::stoul(args[++i]);
+        else if (args[i] == "--op" && has_value)
+            op_spec = args[++i];
+        else if (args[i] == "--mbc" && has_value)
+            mbc = upper(args[++i]);
+        else if (args[i] == "--hot")
+            hot = true;
+        else if (args[i] == "--idiom" && has_value)
+        {
+            const std::string name = upper(args[++i]);
+            size_t bit = 0;
+            while (bit < RomIndex::idiom_count && upper(std::string(RomIndex::idiom_name(bit))) != name)
+                ++bit;
+            if (bit == RomIndex::idiom_count)
+            {
+                std::cerr << "gbindex: no idiom " << name << std::endl;
+                return EXIT_FAILURE;
+            }
+            idioms |= static_cast<uint16_t>(1 << bit);
+        }
+        else
+            positional.push_back(args[i]);
+    }
+
+    if (command == "build")
+        return (positional.size() == 2) ? build(positional[0], positional[1], threads) : usage();
+    if ((command != "query" && command != "ops") || positional.size() != 1)
+        return usage();
+
+    RomIndex index;
+    if (!index.load(positional[0]))
+    {
+        std::cerr << "gbindex: " << positional[0] << " isn't an index" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (command == "ops")
+    {
+        // uses over the corpus and how many ROMs have it
+        std::vector<std::pair<uint64_t, size_t>> totals(0x200);
+        for (size_t i = 0; i < index.size(); ++i)
+        {
+            for (auto* count = index.ops_begin(i); count != index.ops_end(i); ++count)
+            {
+                const uint32_t uses = hot ? count->hot : count->count;
+                totals[count->op].first += uses;
+                totals[count->op].second += (uses != 0) ? 1 : 0;
+            }
+        }
+        std::vector<uint16_t> order;
+        for (uint16_t op = 0; op < totals.size(); ++op)
+        {
+            if (totals[op].first != 0)
+                order.push_back(op);
+        }
+        std::stable_sort(order.begin(), order.end(), [&](const uint16_t a, const uint16_t b) { return totals[a].first > totals[b].first; });
+        if (limit != 0 && order.size() > limit)
+            order.resize(limit);
+        for (const uint16_t op : order)
+        {
+            std::cout << std::left << std::setw(20) << op_text(op) << std::right << std::setw(12) << totals[op].first
+                << std::setw(8) << totals[op].second << " ROMs" << std::endl;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    const auto ops = parse_ops(op_spec);
+    if (!op_spec.empty() && ops.empty())
+    {
+        std::cerr << "gbindex: no opcode " << op_spec << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::pair<uint64_t, size_t>> matches;
+    for (size_t i = 0; i < index.size(); ++i)
+    {
+        const auto& record = index.record(i);
+        if ((record.idioms & idioms) != idioms || (!mbc.empty() && RomIndex::mbc_name(record.cart_type) != mbc))
+            continue;
+
+        uint64_t uses = 0;
+        for (const uint16_t op : ops)
+        {
+            if (const auto* count = index.find(i, op))
+                uses += hot ? count->hot : count->count;
+        }
+        if (ops.empty())
+            uses = hot ? record.hot_instructions : record.instructions;
+        if (uses != 0 || (ops.empty() && !hot))
+            matches.emplace_back(uses, i);
+    }
+    std::stable_sort(matches.begin(), matches.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+    const size_t matched = matches.size();
+    if (limit != 0 && matches.size() > limit)
+        matches.resize(limit);
+
+    for (const auto& [uses, i] : matches)
+    {
+        const auto& record = index.record(i);
+        std::cout << index.name(i) << "  " << RomIndex::mbc_name(record.cart_type) << "  " << record.banks << " banks  "
+            << uses << (hot ? " hot" : "") << " uses  " << idioms_text(record.idioms) << std::endl;
+    }
+    std::cerr << "gbindex: " << matched << " of " << index.size() << " ROMs" << std::endl;
+    return EXIT_SUCCESS;
+}
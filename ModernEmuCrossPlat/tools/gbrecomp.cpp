@@ -0,0 +1,60 @@
+// gbrecomp.cpp : Static recompiler, writes a ROM's reachable code out as C++
+// to be built into the emulator with the host compiler. The generated file
+// defines
+//
+//   template<class Machine> const AotProgram<Machine> NAME();
+//
+// for GameBoy and InstrumentedGameBoy, which is handed to set_compiled().
+// Declare it where it's used, see aot.h.
+//
+// usage: gbrecomp <rom.gb> <out.cpp> [--name NAME]
+
+#include "pch.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <iterator>
+
+#include "recompiler.h"
+
+int main(int argc, char** argv)
+{
+    if (argc != 3 && !(argc == 5 && std::string(argv[3]) == "--name"))
+    {
+        std::cerr << "usage: gbrecomp <rom.gb> <out.cpp> [--name NAME]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::string name = (argc == 5) ? argv[4] : "recompiled_rom";
+    if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0]))
+        || !std::all_of(name.begin(), name.end(), [](const char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; }))
+    {
+        std::cerr << "gbrecomp: " << name << " isn't a C++ name" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in.is_open())
+    {
+        std::cerr << "gbrecomp: can't open " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    Recompiler recompiler(std::move(rom));
+    recompiler.analyze();
+
+    std::ofstream out(argv[2]);
+    if (!out.is_open())
+    {
+        std::cerr << "gbrecomp: can't write " << argv[2] << std::endl;
+        return EXIT_FAILURE;
+    }
+    recompiler.emit(out, name);
+
+    size_t count = 0;
+    for (const auto& [key, block] : recompiler.blocks())
+        count += block.code.empty() ? 0 : 1;
+    std::cout << "gbrecomp: " << count << " blocks, " << recompiler.unresolved() << " jumps left to the interpreter" << std::endl;
+    return out.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
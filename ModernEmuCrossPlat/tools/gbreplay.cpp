@@ -0,0 +1,121 @@
+// gbreplay.cpp : Plays back an input log, see replay.h, as fast as it goes.
+// Plain, it replays the whole log and says whether it came out the same.
+// --verify replays it a keyframe to the next on each of THREADS threads, one
+// per core by default. --seek goes to the start of FRAME from the keyframe
+// before it and writes a save state there to --state, for a debugger to
+// start from.
+//
+// usage: gbreplay <rom.gb> <log> [--verify [THREADS]] [--seek FRAME --state FILE]
+
+#include "pch.h"
+
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <iterator>
+
+#include "replay.h"
+
+namespace
+{
+    const std::vector<uint8_t> read_file(const std::string& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    const double seconds_since(const std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string rom_path;
+    std::string log_path;
+    std::string state_path;
+    bool verify = false;
+    size_t threads = 0;
+    bool seek = false;
+    uint64_t seek_frame = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--verify")
+        {
+            verify = true;
+            if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])))
+                threads = std::stoul(argv[++i]);
+        }
+        else if (arg == "--seek" && i + 1 < argc)
+        {
+            seek = true;
+            seek_frame = std::stoull(argv[++i]);
+        }
+        else if (arg == "--state" && i + 1 < argc)
+            state_path = argv[++i];
+        else if (rom_path.empty())
+            rom_path = arg;
+        else
+            log_path = arg;
+    }
+    if (rom_path.empty() || log_path.empty() || seek != !state_path.empty())
+    {
+        std::cerr << "usage: gbreplay <rom.gb> <log> [--verify [THREADS]] [--seek FRAME --state FILE]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    auto rom = read_file(rom_path);
+    InputLog log;
+    std::ifstream in(log_path, std::ios::binary);
+    if (rom.empty() || !log.read(in))
+    {
+        std::cerr << "gbreplay: can't read " << (rom.empty() ? rom_path : log_path) << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (log.rom_hash() != rom_hash(Cartridge(rom).rom()))
+    {
+        std::cerr << "gbreplay: " << log_path << " was recorded on another ROM" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    if (verify)
+    {
+        const auto verified = Replay::verify(rom, log, threads);
+        std::cout << log.end().frame << " frames, " << verified.checked << " of " << log.keyframes().size() << " keyframes replayed in "
+            << seconds_since(start) << "s, " << (verified.ok ? "the same" : "different from frame " + std::to_string(verified.frame)) << std::endl;
+        return verified.ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    GameBoy gb(std::move(rom));
+    Replay replay(gb, log);
+    if (seek)
+    {
+        gb.set_render(false);
+        if (!replay.seek(seek_frame))
+        {
+            std::cerr << "gbreplay: couldn't get to frame " << seek_frame << ", stopped at " << replay.frame() << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::vector<uint8_t> state(gb.saved_size());
+        BufferSink sink(state.data(), state.size());
+        std::ofstream out(state_path, std::ios::binary);
+        if (!gb.save(sink) || !out.write(reinterpret_cast<const char*>(state.data()), static_cast<std::streamsize>(state.size())))
+        {
+            std::cerr << "gbreplay: can't write " << state_path << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "frame " << seek_frame << " in " << seconds_since(start) << "s, from the keyframe at "
+            << log.keyframes()[log.keyframe_before(seek_frame)].at.frame << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    gb.set_render(false);
+    const bool same = replay.run_to_end();
+    const double seconds = seconds_since(start);
+    std::cout << replay.frame() << " of " << log.end().frame << " frames in " << seconds << "s ("
+        << (seconds > 0 ? replay.frame() / seconds : 0) << " fps), " << (same ? "the same" : "different") << std::endl;
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,186 @@
+// opcode_gen.cpp : Build time generator, turns data/opcodes.json into a
+// header of constexpr ParsedOpCode tables so the emulator itself never
+// parses json.
+//
+// usage: opcode_gen <opcodes.json> <opcode_table.h>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+namespace
+{
+    struct Entry
+    {
+        bool valid = false;
+        std::string mnemonic;
+        size_t length = 0;
+        size_t max_cycles = 0;
+        size_t min_cycles = 0;
+        std::string flags = "----";
+        std::string operand1;
+        std::string operand2;
+    };
+
+    const uint8_t ParseAddr(const std::string& addrStr)
+    {
+        uint8_t rVal = 0;
+        bool skip = true;
+        for (const auto& val : addrStr)
+        {
+            if (skip && (val == 'x' || val == 'X'))
+            {
+                skip = false;
+            }
+            else if (!skip)
+            {
+                rVal = static_cast<uint8_t>(rVal << 4);
+                if (val <= '9' && val >= '0')
+                {
+                    rVal += static_cast<uint8_t>(val - '0');
+                }
+                else if (val <= 'F' && val >= 'A')
+                {
+                    rVal += static_cast<uint8_t>(val - 'A' + 0xA);
+                }
+                else if (val <= 'f' && val >= 'a')
+                {
+                    rVal += static_cast<uint8_t>(val - 'a' + 0xA);
+                }
+            }
+        }
+
+        return rVal;
+    }
+
+    bool ParseSection(const Json::Value& section, std::array<Entry, 256>& entries)
+    {
+        for (const auto& key : section.getMemberNames())
+        {
+            const auto& content = section[key];
+
+            const auto& addrJson = content["addr"];
+            const auto& mnemonicJson = content["mnemonic"];
+            const auto& lengthJson = content["length"];
+            const auto& cycleArray = content["cycles"];
+            const auto& jsonFlags = content["flags"];
+            const auto& operandOne = content["operand1"];
+            const auto& operandTwo = content["operand2"];
+
+            if (!addrJson.isString() || !mnemonicJson.isString() || !lengthJson.isNumeric())
+            {
+                std::cerr << "opcode_gen: malformed entry " << key << std::endl;
+                return false;
+            }
+
+            auto& entry = entries[ParseAddr(addrJson.asString())];
+            entry.valid = true;
+            entry.mnemonic = mnemonicJson.asString();
+            entry.length = lengthJson.as<std::size_t>();
+
+            std::vector<size_t> cycleData;
+            if (cycleArray.isArray())
+            {
+                for (const auto& val : cycleArray)
+                    cycleData.push_back(val.as<std::size_t>());
+            }
+
+            if (cycleData.empty())
+            {
+                std::cerr << "opcode_gen: no cycles for " << key << std::endl;
+                return false;
+            }
+
+            entry.max_cycles = *std::max_element(cycleData.begin(), cycleData.end());
+            entry.min_cycles = *std::min_element(cycleData.begin(), cycleData.end());
+
+            if (jsonFlags.isArray() && jsonFlags.size() == 4)
+            {
+                entry.flags.clear();
+                for (const auto& flag : jsonFlags)
+                    entry.flags.push_back(flag.asCString()[0]);
+            }
+
+            if (operandOne.isString())
+                entry.operand1 = operandOne.asString();
+
+            if (operandTwo.isString())
+                entry.operand2 = operandTwo.asString();
+        }
+
+        return true;
+    }
+
+    void WriteTable(std::ostream& out, const char* name, const std::array<Entry, 256>& entries)
+    {
+        out << "constexpr std::array<ParsedOpCode, 256> " << name << " = {\n";
+        for (size_t op = 0; op < entries.size(); ++op)
+        {
+            const auto& entry = entries[op];
+            out << "    ParsedOpCode(0x" << std::hex << op << std::dec << ", ";
+            if (entry.valid)
+            {
+                out << "\"" << entry.mnemonic << "\", "
+                    << entry.length << ", "
+                    << entry.max_cycles << ", "
+                    << entry.min_cycles << ", "
+                    << "\"" << entry.flags << "\", "
+                    << "\"" << entry.operand1 << "\", "
+                    << "\"" << entry.operand2 << "\")";
+            }
+            else
+            {
+                out << "\"\", 0, 0, 0, \"----\", \"\", \"\")";
+            }
+            out << ((op + 1 < entries.size()) ? ",\n" : "\n");
+        }
+        out << "};\n\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "usage: opcode_gen <opcodes.json> <opcode_table.h>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream jsonFile(argv[1]);
+    if (!jsonFile.is_open())
+    {
+        std::cerr << "opcode_gen: can't open " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Json::Value root;
+    jsonFile >> root;
+
+    std::array<Entry, 256> unprefixed;
+    std::array<Entry, 256> cbprefixed;
+    if (!ParseSection(root["unprefixed"], unprefixed) || !ParseSection(root["cbprefixed"], cbprefixed))
+        return EXIT_FAILURE;
+
+    std::ofstream out(argv[2]);
+    if (!out.is_open())
+    {
+        std::cerr << "opcode_gen: can't write " << argv[2] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    out << "// Generated by tools/opcode_gen.cpp from data/opcodes.json, do not edit.\n";
+    out << "#pragma once\n\n";
+    out << "#include \"parsed_op_codes.h\"\n\n";
+    WriteTable(out, "unprefixed_op_codes", unprefixed);
+    WriteTable(out, "cbprefixed_op_codes", cbprefixed);
+
+    return out.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+}